@@ -45,6 +45,7 @@
 #include <map>
 #include <memory>
 #include <condition_variable>
+#include <deque>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -64,12 +65,22 @@
 #define MONERO_DEFAULT_LOG_CATEGORY "net"
 
 #define ABSTRACT_SERVER_SEND_QUE_MAX_COUNT 1000
+#define ABSTRACT_SERVER_GATHER_MAX_COUNT 64
+#define ABSTRACT_SERVER_GATHER_MAX_BYTES (64 * 1024)
 
 namespace epee
 {
 namespace net_utils
 {
 
+  /*! Picks the oldest messages of a write queue (newest at the front) for one
+      gathered write: at most ABSTRACT_SERVER_GATHER_MAX_COUNT of them, and no
+      more than ABSTRACT_SERVER_GATHER_MAX_BYTES unless the first is larger.
+      Once written, `buffers.size()` messages are popped from the back.
+
+      \return Number of bytes gathered into `buffers`. */
+  std::size_t gather_write_buffers(const std::deque<byte_slice>& queue, std::vector<boost::asio::const_buffer>& buffers);
+
   struct i_connection_filter
   {
     virtual bool is_remote_host_allowed(const epee::net_utils::network_address &address, time_t *t = NULL)=0;
@@ -309,6 +320,7 @@ namespace net_utils
     virtual boost::asio::io_service& get_io_service();
     virtual bool add_ref();
     virtual bool release();
+    virtual bool wait_send_queue(std::size_t max_bytes, std::chrono::milliseconds timeout);
     //------------------------------------------------------
 	public:
 			void setRpcStation();
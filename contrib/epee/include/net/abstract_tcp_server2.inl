@@ -73,6 +73,21 @@ namespace net_utils
     return *ptr;
   }
 
+  inline std::size_t gather_write_buffers(const std::deque<byte_slice>& queue, std::vector<boost::asio::const_buffer>& buffers)
+  {
+    buffers.clear();
+    std::size_t bytes = 0;
+    for (auto message = queue.rbegin(); message != queue.rend(); ++message) {
+      if (buffers.size() == ABSTRACT_SERVER_GATHER_MAX_COUNT ||
+        (!buffers.empty() && bytes + message->size() > ABSTRACT_SERVER_GATHER_MAX_BYTES)
+      )
+        break;
+      buffers.emplace_back(message->data(), message->size());
+      bytes += message->size();
+    }
+    return bytes;
+  }
+
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -454,8 +469,14 @@ namespace net_utils
       return;
     }
     auto self = connection<T>::shared_from_this();
+
+    // queued messages are written together, oldest first, so a burst of
+    // small notifications does not cost a write each
+    std::vector<boost::asio::const_buffer> buffers;
+    const std::size_t bytes = gather_write_buffers(m_state.data.write.queue, buffers);
+
     if (m_connection_type != e_connection_type_RPC) {
-      auto calc_duration = [this]{
+      auto calc_duration = [this, bytes]{
         CRITICAL_REGION_LOCAL(
           network_throttle_manager_t::m_lock_get_global_throttle_out
         );
@@ -463,9 +484,7 @@ namespace net_utils
             std::chrono::duration<double, std::chrono::seconds::period>(
               std::min(
                 network_throttle_manager_t::get_global_throttle_out(
-                ).get_sleep_time_after_tick(
-                  m_state.data.write.queue.back().size()
-                ),
+                ).get_sleep_time_after_tick(bytes),
                 1.0
               )
             )
@@ -492,7 +511,8 @@ namespace net_utils
     }
 
     m_state.socket.wait_write = true;
-    auto on_write = [this, self](const ec_t &ec, size_t bytes_transferred){
+    const std::size_t count = buffers.size();
+    auto on_write = [this, self, count, bytes](const ec_t &ec, size_t bytes_transferred){
       std::lock_guard<std::mutex> guard(m_state.lock);
       m_state.socket.wait_write = false;
       if (m_state.socket.cancel_write) {
@@ -526,8 +546,9 @@ namespace net_utils
 
           start_timer(get_default_timeout(), true);
         }
-        assert(bytes_transferred == m_state.data.write.queue.back().size());
-        m_state.data.write.queue.pop_back();
+        assert(bytes_transferred == bytes);
+        for (std::size_t i = 0; i < count; ++i)
+          m_state.data.write.queue.pop_back();
         m_state.condition.notify_all();
         start_write();
       }
@@ -535,21 +556,15 @@ namespace net_utils
     if (!m_state.ssl.enabled)
       boost::asio::async_write(
         connection_basic::socket_.next_layer(),
-        boost::asio::buffer(
-          m_state.data.write.queue.back().data(),
-          m_state.data.write.queue.back().size()
-        ),
+        buffers,
         m_strand.wrap(on_write)
       );
     else
       m_strand.post(
-        [this, self, on_write]{
+        [this, self, on_write, buffers]{
           boost::asio::async_write(
             connection_basic::socket_,
-            boost::asio::buffer(
-              m_state.data.write.queue.back().data(),
-              m_state.data.write.queue.back().size()
-            ),
+            buffers,
             m_strand.wrap(on_write)
           );
         }
@@ -1037,6 +1052,36 @@ namespace net_utils
     return send(std::move(message));
   }
 
+  template<typename T>
+  bool connection<T>::wait_send_queue(std::size_t max_bytes, std::chrono::milliseconds timeout)
+  {
+    std::lock_guard<std::mutex> guard(m_state.lock);
+    auto queued = [this]{
+      std::size_t bytes = 0;
+      for (const auto &message: m_state.data.write.queue)
+        bytes += message.size();
+      return bytes;
+    };
+    // Writes completing (or the connection going away) wake us up, and a
+    // peer that stops reading altogether is dropped, as in send(), as is
+    // one that does not read fast enough for the caller
+    const bool success = m_state.condition.wait_for(
+      m_state.lock,
+      std::min<duration_t>(timeout, get_default_timeout()),
+      [this, max_bytes, &queued]{
+        return (
+          m_state.status != status_t::RUNNING ||
+          queued() <= max_bytes
+        );
+      }
+    );
+    if (!success) {
+      terminate();
+      return false;
+    }
+    return m_state.status == status_t::RUNNING;
+  }
+
   template<typename T>
   bool connection<T>::send_done()
   {
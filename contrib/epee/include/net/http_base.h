@@ -27,9 +27,11 @@
 
 
 #pragma once
+#include "byte_slice.h"
 #include "memwipe.h"
 
 #include <boost/utility/string_ref.hpp>
+#include <functional>
 
 #include <string>
 #include <utility>
@@ -148,6 +150,14 @@ namespace net_utils
 		};
 
 
+		//! Sink handed to a response's body writer, see http_response_info::m_body_writer
+		struct i_http_body_writer
+		{
+			virtual ~i_http_body_writer() {}
+			//! Sends `data` as part of the body, blocking while the connection's send queue is full. False if the connection went away.
+			virtual bool write(byte_slice data) = 0;
+		};
+
 		struct http_response_info 
 		{
 			int					m_response_code;
@@ -155,6 +165,7 @@ namespace net_utils
 			fields_list	        m_additional_fields;
 			std::string			m_body;
 			std::string			m_mime_tipe;
+			std::function<bool(i_http_body_writer&)> m_body_writer; // server only: if set, produces the body (chunked) instead of m_body
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
 			int                 m_http_ver_lo;// OUT paramter only
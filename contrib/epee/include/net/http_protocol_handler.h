@@ -31,14 +31,22 @@
 #define _HTTP_SERVER_H_
 
 #include <boost/optional/optional.hpp>
+#include <chrono>
 #include <string>
 #include "net_utils_base.h"
+#include "syncobj.h"
 #include "http_auth.h"
 #include "http_base.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
 
+#define HTTP_STREAM_CHUNK_SIZE        (64 * 1024)
+#define HTTP_STREAM_MAX_QUEUED_BYTES  (1024 * 1024)
+// A streamed response gets this long, plus the time to send its body at the minimum rate
+#define HTTP_STREAM_GRACE_PERIOD_MS   (30 * 1000)
+#define HTTP_STREAM_MIN_BYTES_PER_SECOND (16 * 1024)
+
 namespace epee
 {
 namespace net_utils
@@ -59,6 +67,48 @@ namespace net_utils
 			critical_section m_lock;
 		};
 
+		/************************************************************************/
+		/*                                                                      */
+		/************************************************************************/
+		//! Sends each write as HTTP chunks, waiting for the socket to drain before queueing more.
+		//! A peer reading slower than HTTP_STREAM_MIN_BYTES_PER_SECOND is dropped.
+		class http_chunked_writer final : public i_http_body_writer
+		{
+		public:
+			explicit http_chunked_writer(i_service_endpoint& endpoint)
+				: m_endpoint(endpoint), m_started(false), m_start(std::chrono::steady_clock::now()), m_queued(0)
+			{}
+			virtual bool write(byte_slice data) override;
+			//! Sends the terminating empty chunk
+			bool finish();
+
+		private:
+			//! how long the peer has left to read all but the last HTTP_STREAM_MAX_QUEUED_BYTES queued
+			std::chrono::milliseconds get_wait_timeout() const;
+
+			i_service_endpoint& m_endpoint;
+			bool m_started;
+			const std::chrono::steady_clock::time_point m_start;
+			std::size_t m_queued;
+		};
+
+		//! Collects the body for clients which cannot take a chunked one
+		class http_buffer_writer final : public i_http_body_writer
+		{
+		public:
+			explicit http_buffer_writer(std::string& body)
+				: m_body(body)
+			{}
+			virtual bool write(byte_slice data) override
+			{
+				m_body.append(reinterpret_cast<const char*>(data.data()), data.size());
+				return true;
+			}
+
+		private:
+			std::string& m_body;
+		};
+
 		/************************************************************************/
 		/*                                                                      */
 		/************************************************************************/
@@ -195,6 +195,40 @@ namespace net_utils
 
 
 
+		//--------------------------------------------------------------------------------------------
+		inline std::chrono::milliseconds http_chunked_writer::get_wait_timeout() const
+		{
+			const std::size_t must_have_sent = m_queued > HTTP_STREAM_MAX_QUEUED_BYTES ? m_queued - HTTP_STREAM_MAX_QUEUED_BYTES : 0;
+			const std::chrono::milliseconds allowed{HTTP_STREAM_GRACE_PERIOD_MS + must_have_sent * 1000 / HTTP_STREAM_MIN_BYTES_PER_SECOND};
+			const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start);
+			return elapsed < allowed ? allowed - elapsed : std::chrono::milliseconds{0};
+		}
+		//--------------------------------------------------------------------------------------------
+		inline bool http_chunked_writer::write(byte_slice data)
+		{
+			while (!data.empty())
+			{
+				if (!m_endpoint.wait_send_queue(HTTP_STREAM_MAX_QUEUED_BYTES, get_wait_timeout()))
+					return false;
+				byte_slice chunk = data.take_slice(HTTP_STREAM_CHUNK_SIZE);
+				// the previous chunk's trailing CRLF goes out with this chunk's size line
+				char head[32];
+				const int len = snprintf(head, sizeof(head), "%s%zx\r\n", m_started ? "\r\n" : "", chunk.size());
+				m_started = true;
+				m_queued += len + chunk.size();
+				if (!m_endpoint.do_send(byte_slice{std::string(head, len)}))
+					return false;
+				if (!m_endpoint.do_send(std::move(chunk)))
+					return false;
+			}
+			return true;
+		}
+		//--------------------------------------------------------------------------------------------
+		inline bool http_chunked_writer::finish()
+		{
+			std::string tail = m_started ? "\r\n0\r\n\r\n" : "0\r\n\r\n";
+			return m_endpoint.do_send(byte_slice{std::move(tail)});
+		}
 		//--------------------------------------------------------------------------------------------
 		template<class t_connection_context>
 		simple_http_connection_handler<t_connection_context>::simple_http_connection_handler(i_service_endpoint* psnd_hndlr, config_type& config, t_connection_context& conn_context):
@@ -370,7 +404,7 @@ namespace net_utils
 		boost::smatch result;	
 		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
 		{
-			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi))
+			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_lo))
 			{
 				m_state = http_state_error;
 				MERROR("Failed to analyze method");
@@ -598,11 +632,34 @@ namespace net_utils
 			response.m_response_comment = "OK";
 		}
 
+		const bool chunked_ok = query_info.m_http_ver_hi > 1 || (query_info.m_http_ver_hi == 1 && query_info.m_http_ver_lo >= 1);
+		if (response.m_body_writer && (!chunked_ok || query_info.m_http_method == http::http_method_head))
+		{
+			// HTTP/1.0 has no chunked encoding, and HEAD needs the full length
+			http_buffer_writer writer{response.m_body};
+			res = response.m_body_writer(writer) && res;
+			response.m_body_writer = nullptr;
+		}
+
 		std::string response_data = get_response_header(response);
 		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
 
 		LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
 
+		if (response.m_body_writer)
+		{
+			// the status line is out once the body starts, so a failing writer
+			// can only be reported by dropping the connection before the last chunk
+			http_chunked_writer writer{*m_psnd_hndlr};
+			if (!m_psnd_hndlr->do_send(byte_slice{std::move(response_data)}) || !response.m_body_writer(writer) || !writer.finish())
+			{
+				MWARNING("Failed to stream response body for " << query_info.m_URI);
+				return false;
+			}
+			m_psnd_hndlr->send_done();
+			return res;
+		}
+
 		if ((response.m_body.size() && (query_info.m_http_method != http::http_method_head)) || (query_info.m_http_method == http::http_method_options))
 			response_data += response.m_body;
 
@@ -646,9 +703,11 @@ namespace net_utils
 	{
 		std::string buf = "HTTP/1.1 ";
 		buf += boost::lexical_cast<std::string>(response.m_response_code) + " " + response.m_response_comment + "\r\n" +
-			"Server: Epee-based\r\n"
-			"Content-Length: ";
-		buf += boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
+			"Server: Epee-based\r\n";
+		if (response.m_body_writer)
+			buf += "Transfer-Encoding: chunked\r\n";
+		else
+			buf += "Content-Length: " + boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
 
 		if(!response.m_mime_tipe.empty())
 		{
@@ -26,6 +26,9 @@
 
 
 #pragma once 
+#include <memory>
+
+#include "byte_stream.h"
 #include "http_base.h"
 #include "jsonrpc_structs.h"
 #include "storages/portable_storage.h"
@@ -34,6 +37,26 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
 
+namespace epee
+{
+  namespace json_rpc
+  {
+    // same output as store_t_to_json on a response whose result serializes to result
+    inline void store_raw_result_to_json(raw_response &resp, const std::string &result, std::string &json)
+    {
+      epee::serialization::store_t_to_json(resp, json);
+      // result sorts after id and jsonrpc, so it is the last member
+      const size_t end = json.rfind('}');
+      json.resize(end == std::string::npos ? 0 : end);
+      while (!json.empty() && (json.back() == '\r' || json.back() == '\n'))
+        json.pop_back();
+      json += ",\r\n  \"result\": ";
+      json += result;
+      json += "\r\n}";
+    }
+  }
+}
+
 
 #define CHAIN_HTTP_TO_MAP2(context_type) bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, \
               epee::net_utils::http::http_response_info& response, \
@@ -63,7 +86,14 @@
   bool handled = false; \
   if(false) return true; //just a stub to have "else if"
 
-#define MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, cond) \
+// hands the finished body to the server to send as chunks, without copying it into m_body
+#define HTTP_STREAM_BODY(response_info, slice) \
+  do { \
+    auto body_slice = std::make_shared<epee::byte_slice>(slice); \
+    response_info.m_body_writer = [body_slice](epee::net_utils::http::i_http_body_writer& writer) { return writer.write(std::move(*body_slice)); }; \
+  } while (0)
+
+#define MAP_URI_AUTO_JON2_IMPL(s_pattern, callback_f, command_type, cond, stream) \
     else if((query_info.m_URI == s_pattern) && (cond)) \
     { \
       handled = true; \
@@ -90,16 +120,22 @@
         return true; \
       } \
       uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-      epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), response_info.m_body); \
+      std::string body; \
+      epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), body); \
+      if (stream) HTTP_STREAM_BODY(response_info, epee::byte_slice{std::move(body)}); \
+      else response_info.m_body = std::move(body); \
       uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
       response_info.m_mime_tipe = "application/json"; \
       response_info.m_header_info.m_content_type = " application/json"; \
       MDEBUG( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
     }
 
+#define MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, cond) MAP_URI_AUTO_JON2_IMPL(s_pattern, callback_f, command_type, cond, false)
 #define MAP_URI_AUTO_JON2(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, true)
+// for large responses: the body is sent chunked, with backpressure from the connection
+#define MAP_URI_AUTO_JON2_CHUNKED(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IMPL(s_pattern, callback_f, command_type, true, true)
 
-#define MAP_URI_AUTO_BIN2(s_pattern, callback_f, command_type) \
+#define MAP_URI_AUTO_BIN2_IMPL(s_pattern, callback_f, command_type, stream) \
     else if(query_info.m_URI == s_pattern) \
     { \
       handled = true; \
@@ -129,12 +165,50 @@
       epee::byte_slice buffer; \
       epee::serialization::store_t_to_binary(static_cast<command_type::response&>(resp), buffer, 64 * 1024); \
       uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
-      response_info.m_body.assign(reinterpret_cast<const char*>(buffer.data()), buffer.size()); \
+      if (stream) HTTP_STREAM_BODY(response_info, std::move(buffer)); \
+      else response_info.m_body.assign(reinterpret_cast<const char*>(buffer.data()), buffer.size()); \
       response_info.m_mime_tipe = " application/octet-stream"; \
       response_info.m_header_info.m_content_type = " application/octet-stream"; \
       MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
     }
 
+#define MAP_URI_AUTO_BIN2(s_pattern, callback_f, command_type) MAP_URI_AUTO_BIN2_IMPL(s_pattern, callback_f, command_type, false)
+#define MAP_URI_AUTO_BIN2_CHUNKED(s_pattern, callback_f, command_type) MAP_URI_AUTO_BIN2_IMPL(s_pattern, callback_f, command_type, true)
+
+// for handlers which write the binary response themselves: callback_f(request, byte_stream&, context)
+#define MAP_URI_AUTO_BIN2_STREAM(s_pattern, callback_f, command_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      uint64_t ticks = epee::misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), epee::strspan<uint8_t>(query_info.m_body)); \
+      if (!parse_res) \
+      { \
+         MERROR("Failed to parse bin body data, body size=" << query_info.m_body.size()); \
+         response_info.m_response_code = 400; \
+         response_info.m_response_comment = "Bad request"; \
+         return true; \
+      } \
+      uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
+      MINFO(m_conn_context << "calling " << s_pattern); \
+      epee::byte_stream buffer; \
+      bool res = false; \
+      try { res = callback_f(static_cast<command_type::request&>(req), buffer, &m_conn_context); } \
+      catch (const std::exception &e) { MERROR(m_conn_context << "Failed to " << #callback_f << "()"); } \
+      if (!res) \
+      { \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+      HTTP_STREAM_BODY(response_info, (epee::byte_slice{std::move(buffer), false})); \
+      response_info.m_mime_tipe = " application/octet-stream"; \
+      response_info.m_header_info.m_content_type = " application/octet-stream"; \
+      MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms"); \
+    }
+
 #define END_URI_MAP2() return handled;}
 
 
@@ -219,6 +293,43 @@
 
 #define MAP_JON_RPC_WE(method_name, callback_f, command_type) MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, true)
 
+// for handlers which may serialize the result themselves (eg, from a cache):
+// callback_f(request, response, raw_result, error, context), a non empty raw_result
+// is sent as is instead of response, and must be serialized at indent 1
+#define MAP_JON_RPC_WE_RAW_IF(method_name, callback_f, command_type, cond) \
+    else if((callback_name == method_name) && (cond)) \
+{ \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+  fail_resp.jsonrpc = "2.0"; \
+  fail_resp.id = req.id; \
+  MINFO(m_conn_context << "Calling RPC method " << method_name); \
+  std::string raw_result; \
+  bool res = false; \
+  try { res = callback_f(req.params, resp.result, raw_result, fail_resp.error, &m_conn_context); } \
+  catch (const std::exception &e) { MERROR(m_conn_context << "Failed to " << #callback_f << "(): " << e.what()); } \
+  if (!res) \
+  { \
+    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    return true; \
+  } \
+  if (raw_result.empty()) \
+  { \
+    FINALIZE_OBJECTS_TO_JSON(method_name) \
+    return true; \
+  } \
+  epee::json_rpc::raw_response raw_resp; \
+  raw_resp.jsonrpc = "2.0"; \
+  raw_resp.id = req.id; \
+  epee::json_rpc::store_raw_result_to_json(raw_resp, raw_result, response_info.m_body); \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "ms (raw)"); \
+  return true;\
+}
+
+#define MAP_JON_RPC_WE_RAW(method_name, callback_f, command_type) MAP_JON_RPC_WE_RAW_IF(method_name, callback_f, command_type, true)
+
 #define MAP_JON_RPC(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
@@ -103,7 +103,23 @@ namespace epee
       END_KV_SERIALIZE_MAP()
     };
 
+    // envelope for a result serialized separately, see store_raw_result_to_json
+    template<>
+    struct response<dummy_result, dummy_error>
+    {
+      std::string jsonrpc;
+      epee::serialization::storage_entry id;
+
+      response(): id{} {}
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(jsonrpc)
+        KV_SERIALIZE(id)
+      END_KV_SERIALIZE_MAP()
+    };
+
     typedef response<dummy_result, error> error_response;
+    typedef response<dummy_result, dummy_error> raw_response;
   }
 }
 
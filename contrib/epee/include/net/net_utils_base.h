@@ -32,6 +32,7 @@
 #include <boost/uuid/uuid.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/address_v6.hpp>
+#include <chrono>
 #include <typeinfo>
 #include <type_traits>
 #include "byte_slice.h"
@@ -447,6 +448,9 @@ namespace net_utils
     //protect from deletion connection object(with protocol instance) during external call "invoke"
     virtual bool add_ref()=0;
     virtual bool release()=0;
+    //! Blocks until at most `max_bytes` are waiting to be written; false if the connection went away meanwhile,
+    //! or was dropped because that took longer than `timeout`.
+    virtual bool wait_send_queue(std::size_t max_bytes, std::chrono::milliseconds timeout) { return true; }
   protected:
     virtual ~i_service_endpoint() noexcept(false) {}
 	};
@@ -86,7 +86,8 @@ namespace epee
 
       //-------------------------------------------------------------------------------
       bool		store_to_binary(byte_slice& target, std::size_t initial_buffer_size = 8192);
-      bool		store_to_binary(byte_stream& ss);
+      //! `extra_root_entries` is the number of entries the caller appends to the root section itself
+      bool		store_to_binary(byte_stream& ss, std::size_t extra_root_entries = 0);
       bool		load_from_binary(const epee::span<const uint8_t> target, const limits_t *limits = nullptr);
       bool		load_from_binary(const std::string& target, const limits_t *limits = nullptr)
       {
@@ -31,6 +31,7 @@
 #include "misc_language.h"
 #include "portable_storage_base.h"
 #include "portable_storage_bin_utils.h"
+#include "span.h"
 #include "misc_log_ex.h"
 
 namespace epee
@@ -79,6 +80,34 @@ namespace epee
       return true;
     }
 
+    template<class t_stream>
+    bool put_string(t_stream& strm, const epee::span<const std::uint8_t> v)
+    {
+      pack_varint(strm, v.size());
+      if(v.size())
+        strm.write((const char*)v.data(), v.size());
+      return true;
+    }
+
+    // helpers for writing entries directly, without building a section first
+    template<class t_stream>
+    void pack_entry_name(t_stream& strm, const std::string& name)
+    {
+      CHECK_AND_ASSERT_THROW_MES(name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << name.size() << ", val: " << name);
+      CHECK_AND_ASSERT_THROW_MES(!name.empty(), "storage_entry_name is empty");
+      uint8_t len = static_cast<uint8_t>(name.size());
+      strm.write((const char*)&len, sizeof(len));
+      strm.write(name.data(), size_t(len));
+    }
+
+    template<class t_stream>
+    void pack_array_header(t_stream& strm, uint8_t contained_type, size_t count)
+    {
+      uint8_t type = contained_type|SERIALIZE_FLAG_ARRAY;
+      strm.write((const char*)&type, 1);
+      pack_varint(strm, count);
+    }
+
     template<class t_stream>
     struct array_entry_store_visitor: public boost::static_visitor<bool>
     {
@@ -199,20 +228,21 @@ namespace epee
     }
 
     template<class t_stream>
-    bool pack_entry_to_buff(t_stream& strm, const section& sec)
+    bool pack_section_entries(t_stream& strm, const section& sec, size_t extra_entries)
     {
       typedef std::map<std::string, storage_entry>::value_type section_pair;
-      pack_varint(strm, sec.m_entries.size());
+      pack_varint(strm, sec.m_entries.size() + extra_entries);
       for(const section_pair& se: sec.m_entries)
       {
-        CHECK_AND_ASSERT_THROW_MES(se.first.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << se.first.size() << ", val: " << se.first);
-        CHECK_AND_ASSERT_THROW_MES(!se.first.empty(), "storage_entry_name is empty");
-        uint8_t len = static_cast<uint8_t>(se.first.size());
-        strm.write((const char*)&len, sizeof(len));
-        strm.write(se.first.data(), size_t(len));
+        pack_entry_name(strm, se.first);
         pack_entry_to_buff(strm, se.second);
       }
       return true;
     }
+    template<class t_stream>
+    bool pack_entry_to_buff(t_stream& strm, const section& sec)
+    {
+      return pack_section_entries(strm, sec, 0);
+    }
   }
 }
@@ -54,7 +54,7 @@ namespace serialization
     CATCH_ENTRY("portable_storage::store_to_binary", false);
   }
 
-  bool portable_storage::store_to_binary(byte_stream& ss)
+  bool portable_storage::store_to_binary(byte_stream& ss, const std::size_t extra_root_entries)
   {
     TRY_ENTRY();
     storage_block_header sbh{};
@@ -62,7 +62,7 @@ namespace serialization
     sbh.m_signature_b = SWAP32LE(PORTABLE_STORAGE_SIGNATUREB);
     sbh.m_ver = PORTABLE_STORAGE_FORMAT_VER;
     ss.write(epee::as_byte_span(sbh));
-    pack_entry_to_buff(ss, m_root);
+    pack_section_entries(ss, m_root, extra_root_entries);
     return true;
     CATCH_ENTRY("portable_storage::store_to_binary", false);
   }
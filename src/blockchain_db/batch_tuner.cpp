@@ -0,0 +1,129 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+
+#include "misc_log_ex.h"
+#include "batch_tuner.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "perf.db"
+
+// weight of a new sample in the moving averages
+static constexpr const double EMA_ALPHA = 0.25;
+
+static double ema(double avg, double sample, bool first)
+{
+  return first ? sample : avg + EMA_ALPHA * (sample - avg);
+}
+
+namespace cryptonote
+{
+
+batch_tuner::batch_tuner(uint64_t min_blocks, uint64_t max_blocks):
+  m_min_blocks(std::max<uint64_t>(min_blocks, 1)),
+  m_max_blocks(std::max(max_blocks, std::max<uint64_t>(min_blocks, 1))),
+  m_batches(0),
+  m_since_change(0),
+  m_write_time(0.0),
+  m_commit_time(0.0),
+  m_amplification(0.0),
+  m_last_amplification(0.0),
+  m_suggested_blocks(m_min_blocks)
+{
+}
+
+void batch_tuner::on_batch(uint64_t num_blocks, uint64_t bytes, uint64_t growth, uint64_t write_time, uint64_t commit_time)
+{
+  if (num_blocks == 0 || bytes == 0)
+    return;
+
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  const bool first = m_batches == 0;
+  m_last_amplification = growth / (double)bytes;
+  m_amplification = ema(m_amplification, m_last_amplification, first);
+  m_write_time = ema(m_write_time, write_time, first);
+  m_commit_time = ema(m_commit_time, commit_time, first);
+  ++m_batches;
+  ++m_since_change;
+
+  MDEBUG("batch of " << num_blocks << " blocks, " << bytes << " bytes: grew " << growth << " bytes, write " << write_time
+      << " us, commit " << commit_time << " us; averages: amplification " << m_amplification << ", write "
+      << (uint64_t)m_write_time << " us, commit " << (uint64_t)m_commit_time << " us");
+
+  if (m_batches < MIN_SAMPLES || m_since_change < SETTLE_BATCHES)
+    return;
+
+  // only batches about as big as suggested tell how that size does
+  if (num_blocks * 2 < m_suggested_blocks)
+    return;
+
+  const double total_time = m_write_time + m_commit_time;
+  uint64_t suggested = m_suggested_blocks;
+  if (total_time > MAX_BATCH_TIME)
+    suggested = std::max(m_min_blocks, suggested * 2 / 3);
+  else if (total_time > 0.0 && m_commit_time / total_time > MAX_COMMIT_SHARE && total_time * 3 / 2 <= MAX_BATCH_TIME)
+    suggested = std::min(m_max_blocks, suggested + (suggested + 1) / 2);
+  if (suggested != m_suggested_blocks)
+  {
+    MINFO("batch size " << m_suggested_blocks << " -> " << suggested << " blocks (write " << (uint64_t)m_write_time
+        << " us, commit " << (uint64_t)m_commit_time << " us)");
+    m_suggested_blocks = suggested;
+    m_since_change = 0;
+  }
+}
+
+uint64_t batch_tuner::estimate_growth(uint64_t bytes) const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  if (m_batches < MIN_SAMPLES)
+    return 0;
+  // pages freed by earlier batches get reused, which makes some batches look
+  // cheap, so never go below the last measurement or a plain copy
+  const double amplification = std::max(1.0, std::max(m_amplification, m_last_amplification));
+  return bytes * amplification * GROWTH_SAFETY_FACTOR;
+}
+
+uint64_t batch_tuner::get_suggested_blocks() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  return m_batches < MIN_SAMPLES ? 0 : m_suggested_blocks;
+}
+
+void batch_tuner::get_stats(db_batch_stats &stats) const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  stats.batches = m_batches;
+  stats.write_time = m_write_time;
+  stats.commit_time = m_commit_time;
+  stats.write_amplification = m_amplification;
+  stats.suggested_batch_blocks = m_batches < MIN_SAMPLES ? 0 : m_suggested_blocks;
+}
+
+}
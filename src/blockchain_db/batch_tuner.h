@@ -0,0 +1,131 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <boost/thread/mutex.hpp>
+
+namespace cryptonote
+{
+
+/**
+ * @brief what the database measured over recent batches, and what it made of it
+ */
+struct db_batch_stats
+{
+  uint64_t batches;               //!< number of batches measured
+  uint64_t write_time;            //!< moving average time writing a batch, commit excluded, in microseconds
+  uint64_t commit_time;           //!< moving average time committing a batch, in microseconds
+  double write_amplification;     //!< moving average database growth per byte of block data
+  uint64_t suggested_batch_blocks; //!< number of blocks per batch to aim for, 0 if no opinion
+  uint64_t map_size;              //!< current size of the memory map
+  uint64_t map_used;              //!< part of the memory map in use
+  uint64_t resizes;               //!< number of times the map was grown
+};
+
+/**
+ * @brief sizes database batches and map growth from measured batch commits
+ *
+ * Each committed batch reports how many blocks it held, how many bytes of
+ * block data, how much the database grew, how long the writes took and
+ * how long the commit took. From moving averages of those:
+ *
+ * - the growth of a future batch is predicted from the measured write
+ *   amplification, so the map can be grown ahead of need, by more than
+ *   one batch at a time;
+ * - the suggested number of blocks per batch grows when commits take a
+ *   large share of the batch time (so the fixed cost of a commit is spread
+ *   over more blocks), and shrinks when batches run for so long that other
+ *   writers would wait on them.
+ *
+ * All calls are thread safe.
+ */
+class batch_tuner
+{
+public:
+  batch_tuner(uint64_t min_blocks, uint64_t max_blocks);
+
+  /**
+   * @brief records a committed batch
+   *
+   * @param num_blocks the number of blocks in the batch
+   * @param bytes the size of the block data in the batch
+   * @param growth how much the used part of the database grew
+   * @param write_time time spent writing, in microseconds
+   * @param commit_time time spent committing, in microseconds
+   */
+  void on_batch(uint64_t num_blocks, uint64_t bytes, uint64_t growth, uint64_t write_time, uint64_t commit_time);
+
+  /**
+   * @brief predicts how much the database will grow for a batch
+   *
+   * @param bytes the size of the block data in the batch
+   *
+   * @return the predicted growth, with a safety margin, or 0 if too few
+   *         batches were measured to tell
+   */
+  uint64_t estimate_growth(uint64_t bytes) const;
+
+  /**
+   * @brief gets the number of blocks per batch to aim for
+   *
+   * @return the number of blocks, or 0 if too few batches were measured
+   */
+  uint64_t get_suggested_blocks() const;
+
+  /**
+   * @brief fills in the measured part of the stats
+   */
+  void get_stats(db_batch_stats &stats) const;
+
+  //! batches needed before the tuner has an opinion
+  static constexpr const uint64_t MIN_SAMPLES = 4;
+  //! batches between two changes to the suggested size
+  static constexpr const uint64_t SETTLE_BATCHES = 4;
+  //! grow the batch size when commits take more than this share of the time
+  static constexpr const double MAX_COMMIT_SHARE = 0.3;
+  //! shrink the batch size when a batch takes longer than this, in microseconds
+  static constexpr const uint64_t MAX_BATCH_TIME = 10000000;
+  //! margin over the predicted growth of a batch
+  static constexpr const double GROWTH_SAFETY_FACTOR = 2.0;
+
+private:
+  mutable boost::mutex m_mutex;
+  const uint64_t m_min_blocks;
+  const uint64_t m_max_blocks;
+  uint64_t m_batches;
+  uint64_t m_since_change;
+  double m_write_time;
+  double m_commit_time;
+  double m_amplification;
+  double m_last_amplification;
+  uint64_t m_suggested_blocks;
+};
+
+}
@@ -370,6 +370,15 @@ block BlockchainDB::get_block(const crypto::hash& h) const
   return b;
 }
 
+std::vector<uint64_t> BlockchainDB::get_rct_output_distribution(uint64_t start_height, size_t count) const
+{
+  std::vector<uint64_t> heights;
+  heights.reserve(count);
+  for (uint64_t h = start_height; h < start_height + count; ++h)
+    heights.push_back(h);
+  return get_block_cumulative_rct_outputs(heights);
+}
+
 bool BlockchainDB::get_tx(const crypto::hash& h, cryptonote::transaction &tx) const
 {
   blobdata bd;
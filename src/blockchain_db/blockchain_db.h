@@ -34,6 +34,7 @@
 #include <exception>
 #include <boost/program_options.hpp>
 #include "common/command_line.h"
+#include "blockchain_db/batch_tuner.h"
 #include "crypto/hash.h"
 #include "cryptonote_basic/blobdatatype.h"
 #include "cryptonote_basic/cryptonote_basic.h"
@@ -139,6 +140,26 @@ struct tx_data_t
 };
 #pragma pack(pop)
 
+/**
+ * @brief a block's blob and its transactions' blobs, pointing into the database
+ *
+ * The spans are only valid until the read transaction they were fetched in
+ * ends, so the caller must hold one (see db_rtxn_guard).
+ */
+struct block_blob_refs_t
+{
+  struct tx_refs
+  {
+    crypto::hash hash;
+    epee::span<const uint8_t> pruned;   //!< the pruned part of the tx blob
+    epee::span<const uint8_t> prunable; //!< the rest of the blob, empty if pruned data was requested
+  };
+
+  epee::span<const uint8_t> block;
+  crypto::hash miner_tx_hash;
+  std::vector<tx_refs> txs;
+};
+
 struct alt_block_data_t
 {
   uint64_t height;
@@ -942,6 +963,24 @@ public:
    */
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const = 0;
 
+  /**
+   * @brief fetch the cumulative number of rct outputs for a range of blocks
+   *
+   * The subclass should return, for each of the count blocks starting at
+   * start_height, the number of rct outputs in the blockchain up to that
+   * block (inclusive). Subclasses which keep this distribution indexed by
+   * height should override this; the default implementation calls
+   * get_block_cumulative_rct_outputs.
+   *
+   * If any of the blocks do not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param start_height the height of the first block in the range
+   * @param count the number of blocks requested
+   *
+   * @return the cumulative number of rct outputs at each height in the range
+   */
+  virtual std::vector<uint64_t> get_rct_output_distribution(uint64_t start_height, size_t count) const;
+
   /**
    * @brief fetch the top block's timestamp
    *
@@ -1307,6 +1346,26 @@ public:
    */
   virtual bool get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const = 0;
 
+  /**
+   * @brief fetches a variable number of blocks and transactions without copying their blobs
+   *
+   * Same as above, but the blobs point into the database, and are valid only
+   * as long as the caller's read transaction.
+   *
+   * @param start_height the height of the first block
+   * @param min_block_count the minimum number of blocks to return, if they exist
+   * @param max_block_count the maximum number of blocks to return
+   * @param max_tx_count the maximum number of txes to return
+   * @param max_size the maximum size of block/transaction data to return (will be exceeded by one blocks's worth at most, if min_count is met)
+   * @param blocks the returned block/transaction data
+   * @param pruned whether to return full or pruned tx data
+   * @param skip_coinbase whether to return or skip coinbase transactions (they're in blocks regardless)
+   * @param get_miner_tx_hash whether to calculate and return the miner (coinbase) tx hash
+   *
+   * @return true iff the blocks and transactions were found
+   */
+  virtual bool get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<block_blob_refs_t>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const = 0;
+
   /**
    * @brief fetches the prunable transaction blob with the given hash
    *
@@ -1464,9 +1523,15 @@ public:
    * get_output_data(const uint64_t& amount, const uint64_t& index)
    * but for a list of outputs rather than just one.
    *
+   * Offsets may come in any order, and may repeat: they are looked up once
+   * each, in database order, and the outputs are returned in the order of
+   * offsets. With allow_partial, the outputs up to the first missing one
+   * are returned.
+   *
    * @param amounts an output amount, or as many as offsets
    * @param offsets a list of amount-specific output indices
    * @param outputs return-by-reference a list of outputs' metadata
+   * @param allow_partial whether to return partial results rather than throw if an output is missing
    */
   virtual void get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false) const = 0;
   
@@ -1502,6 +1567,17 @@ public:
    */
   virtual bool has_key_image(const crypto::key_image& img) const = 0;
 
+  /**
+   * @brief check if key images are stored as spent
+   *
+   * This function is a mirror of has_key_image(const crypto::key_image&),
+   * but for a list of key images rather than just one.
+   *
+   * @param imgs the key images to check for
+   * @param spent return-by-reference whether each key image is present
+   */
+  virtual void has_key_images(const epee::span<const crypto::key_image> &imgs, std::vector<bool> &spent) const = 0;
+
   /**
    * @brief add a txpool transaction
    *
@@ -1824,6 +1900,13 @@ public:
    */
   virtual uint64_t get_database_size() const = 0;
 
+  /**
+   * @brief get what the database measured about its recent batches
+   *
+   * @return the stats, all zero if the database does not measure them
+   */
+  virtual db_batch_stats get_batch_stats() const { return db_batch_stats(); }
+
   // TODO: this should perhaps be (or call) a series of functions which
   // progressively update through version updates
   /**
@@ -0,0 +1,152 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include <utility>
+#include <boost/thread/locks.hpp>
+
+#include "int-util.h"
+#include "key_image_filter.h"
+
+// about 1% false positives at capacity
+static constexpr const uint64_t BITS_PER_KEY_IMAGE = 10;
+static constexpr const unsigned int NUM_HASHES = 7;
+static constexpr const uint64_t MIN_CAPACITY = 65536;
+
+static inline uint64_t mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+namespace cryptonote
+{
+
+key_image_filter::key_image_filter():
+  m_nbits(0),
+  m_capacity(0),
+  m_inserted(0),
+  m_salt{0, 0}
+{
+}
+
+void key_image_filter::reset(uint64_t expected)
+{
+  boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+  // leave room for the chain to grow before a rebuild is needed
+  m_capacity = expected + expected / 2 + MIN_CAPACITY;
+  const uint64_t nwords = (m_capacity * BITS_PER_KEY_IMAGE + 63) / 64;
+  m_bits.reset(new std::atomic<uint64_t>[nwords]);
+  for (uint64_t i = 0; i < nwords; ++i)
+    m_bits[i].store(0, std::memory_order_relaxed);
+  m_nbits = nwords * 64;
+  m_inserted = 0;
+  // key images are chosen by whoever makes a tx, so keep the bit positions unpredictable
+  m_salt[0] = crypto::rand<uint64_t>();
+  m_salt[1] = crypto::rand<uint64_t>();
+}
+
+void key_image_filter::clear()
+{
+  boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+  m_bits.reset();
+  m_nbits = 0;
+  m_capacity = 0;
+  m_inserted = 0;
+}
+
+void key_image_filter::get_hashes(const crypto::key_image &ki, uint64_t &h1, uint64_t &h2) const
+{
+  uint64_t w[4];
+  static_assert(sizeof(w) == sizeof(ki), "Unexpected key image size");
+  memcpy(w, &ki, sizeof(w));
+  h1 = mix(w[0] ^ m_salt[0] ^ mix(w[2]));
+  h2 = mix(w[1] ^ m_salt[1] ^ mix(w[3])) | 1;
+}
+
+uint64_t key_image_filter::bit(uint64_t h1, uint64_t h2, unsigned int i) const
+{
+  // maps the hash onto [0, m_nbits) without a division
+  uint64_t hi;
+  mul128(h1 + i * h2, m_nbits, &hi);
+  return hi;
+}
+
+void key_image_filter::insert(const crypto::key_image &ki)
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  if (!enabled())
+    return;
+  uint64_t h1, h2;
+  get_hashes(ki, h1, h2);
+  for (unsigned int i = 0; i < NUM_HASHES; ++i)
+  {
+    const uint64_t b = bit(h1, h2, i);
+    m_bits[b / 64].fetch_or(1ull << (b % 64));
+  }
+  ++m_inserted;
+}
+
+bool key_image_filter::may_contain(const crypto::key_image &ki) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  if (!enabled())
+    return true;
+  uint64_t h1, h2;
+  get_hashes(ki, h1, h2);
+  for (unsigned int i = 0; i < NUM_HASHES; ++i)
+  {
+    const uint64_t b = bit(h1, h2, i);
+    if (!(m_bits[b / 64].load() & (1ull << (b % 64))))
+      return false;
+  }
+  return true;
+}
+
+bool key_image_filter::needs_rebuild() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  return enabled() && m_inserted > m_capacity;
+}
+
+void key_image_filter::swap(key_image_filter &other)
+{
+  boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+  std::swap(m_bits, other.m_bits);
+  std::swap(m_nbits, other.m_nbits);
+  std::swap(m_capacity, other.m_capacity);
+  std::swap(m_salt[0], other.m_salt[0]);
+  std::swap(m_salt[1], other.m_salt[1]);
+  m_inserted = other.m_inserted.exchange(m_inserted);
+}
+
+}
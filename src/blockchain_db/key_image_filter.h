@@ -0,0 +1,114 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <boost/thread/shared_mutex.hpp>
+
+#include "crypto/crypto.h"
+
+namespace cryptonote
+{
+
+/**
+ * @brief an in memory bloom filter over spent key images
+ *
+ * Answers "definitely not spent" without touching the database. Key images
+ * are only ever added: a key image removed from the database (ie, when a
+ * block is popped) stays in the filter, as do key images added in a write
+ * transaction which is later aborted. Both only cause false positives, so
+ * the filter always holds a superset of the spent key images. Once more
+ * key images were added than it was sized for, needs_rebuild returns true
+ * and the owner should build a bigger one and swap it in.
+ *
+ * Lookups and inserts may run concurrently. An empty (default constructed)
+ * filter may contain anything.
+ */
+class key_image_filter
+{
+public:
+  key_image_filter();
+
+  /**
+   * @brief clears the filter and sizes it for a number of key images
+   *
+   * @param expected the number of key images which will be added
+   */
+  void reset(uint64_t expected);
+
+  /**
+   * @brief drops the filter, it then may contain anything
+   */
+  void clear();
+
+  /**
+   * @brief adds a key image to the filter
+   */
+  void insert(const crypto::key_image &ki);
+
+  /**
+   * @brief checks whether a key image may have been added
+   *
+   * @return false if the key image was definitely not added
+   */
+  bool may_contain(const crypto::key_image &ki) const;
+
+  /**
+   * @brief checks whether the filter holds more key images than it was sized for
+   */
+  bool needs_rebuild() const;
+
+  /**
+   * @brief gets the number of key images added since the last reset
+   */
+  uint64_t size() const { return m_inserted; }
+
+  /**
+   * @brief exchanges the contents of two filters
+   *
+   * @param other a filter nothing else is using concurrently
+   */
+  void swap(key_image_filter &other);
+
+private:
+  bool enabled() const { return m_nbits != 0; }
+  void get_hashes(const crypto::key_image &ki, uint64_t &h1, uint64_t &h2) const;
+  uint64_t bit(uint64_t h1, uint64_t h2, unsigned int i) const;
+
+  mutable boost::shared_mutex m_mutex;
+  std::unique_ptr<std::atomic<uint64_t>[]> m_bits;
+  uint64_t m_nbits;
+  uint64_t m_capacity;
+  std::atomic<uint64_t> m_inserted;
+  uint64_t m_salt[2];
+};
+
+}
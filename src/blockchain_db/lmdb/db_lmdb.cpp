@@ -54,7 +54,7 @@ using epee::string_tools::pod_to_hex;
 using namespace crypto;
 
 // Increase when the DB structure changes
-#define VERSION 5
+#define VERSION 6
 
 namespace
 {
@@ -186,6 +186,7 @@ namespace
  * blocks           block ID     block blob
  * block_heights    block hash   block height
  * block_info       block ID     {block metadata}
+ * rct_distribution chunk ID     [cumulative rct outputs...]
  *
  * txs_pruned       txn ID       pruned txn blob
  * txs_prunable     txn ID       prunable txn blob
@@ -211,10 +212,15 @@ namespace
  * (DUPFIXED saves 8 bytes per record.)
  *
  * The output_amounts table doesn't use a dummy key, but uses DUPSORT.
+ *
+ * The rct_distribution table holds the cumulative number of rct outputs at
+ * each height, packed RCT_DISTRIBUTION_CHUNK_SIZE heights to a record, so a
+ * range of the distribution can be copied out of the map a chunk at a time.
  */
 const char* const LMDB_BLOCKS = "blocks";
 const char* const LMDB_BLOCK_HEIGHTS = "block_heights";
 const char* const LMDB_BLOCK_INFO = "block_info";
+const char* const LMDB_RCT_DISTRIBUTION = "rct_distribution";
 
 const char* const LMDB_TXS = "txs";
 const char* const LMDB_TXS_PRUNED = "txs_pruned";
@@ -238,6 +244,8 @@ const char* const LMDB_HF_VERSIONS = "hf_versions";
 
 const char* const LMDB_PROPERTIES = "properties";
 
+const uint64_t RCT_DISTRIBUTION_CHUNK_SIZE = 512;
+
 const char zerokey[8] = {0};
 const MDB_val zerokval = { sizeof(zerokey), (void *)zerokey };
 
@@ -550,7 +558,7 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   CRITICAL_REGION_LOCAL(m_synchronization_lock);
-  const uint64_t add_size = 1LL << 30;
+  const uint64_t add_size = increase_size > 0 ? increase_size : 1LL << 30;
 
   // check disk capacity
   try
@@ -578,15 +586,11 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   mdb_env_stat(m_env, &mst);
 
-  // add 1Gb per resize, instead of doing a percentage increase
+  // add 1Gb per resize, instead of doing a percentage increase.
+  // If given, use increase_size instead. This is currently used for
+  // increasing by an estimated size at start of new batch txn.
   uint64_t new_mapsize = (uint64_t) mei.me_mapsize + add_size;
 
-  // If given, use increase_size instead of above way of resizing.
-  // This is currently used for increasing by an estimated size at start of new
-  // batch txn.
-  if (increase_size > 0)
-    new_mapsize = mei.me_mapsize + increase_size;
-
   new_mapsize += (new_mapsize % mst.ms_psize);
 
   mdb_txn_safe::prevent_new_txns();
@@ -610,10 +614,22 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
     throw0(DB_ERROR(lmdb_error("Failed to set new mapsize: ", result).c_str()));
 
   MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
+  ++m_resizes;
 
   mdb_txn_safe::allow_new_txns();
 }
 
+uint64_t BlockchainLMDB::get_map_used(uint64_t *map_size) const
+{
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
+  MDB_stat mst;
+  mdb_env_stat(m_env, &mst);
+  if (map_size)
+    *map_size = mei.me_mapsize;
+  return mst.ms_psize * mei.me_last_pgno;
+}
+
 // threshold_size is used for batch transactions
 bool BlockchainLMDB::need_resize(uint64_t threshold_size) const
 {
@@ -669,7 +685,18 @@ void BlockchainLMDB::check_and_resize_for_batch(uint64_t batch_num_blocks, uint6
   const uint64_t min_increase_size = 512 * (1 << 20);
   uint64_t threshold_size = 0;
   uint64_t increase_size = 0;
-  if (batch_num_blocks > 0)
+  const uint64_t measured_size = batch_num_blocks > 0 && batch_bytes > 0 ? m_batch_tuner.estimate_growth(batch_bytes) : 0;
+  if (measured_size > 0)
+  {
+    // Once enough batches were measured, predict from how much the db really
+    // grew per byte of block data, and keep room for many batches ahead. The
+    // map can only be resized with no transaction open, readers included, so
+    // resizing rarely, at a batch boundary, is what keeps readers going.
+    threshold_size = measured_size * RESIZE_LOOKAHEAD_BATCHES;
+    increase_size = std::max(threshold_size, min_increase_size);
+    MCDEBUG("perf.db", "measured batch size: " << measured_size << ", threshold: " << threshold_size << ", increase size: " << increase_size);
+  }
+  else if (batch_num_blocks > 0)
   {
     threshold_size = get_estimated_batch_size(batch_num_blocks, batch_bytes);
     MDEBUG("calculated batch size: " << threshold_size);
@@ -836,6 +863,8 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block info to db transaction: ", result).c_str()));
 
+  add_rct_distribution(m_height, bi.bi_cum_rct);
+
   result = mdb_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
@@ -881,6 +910,75 @@ void BlockchainLMDB::remove_block()
 
   if ((result = mdb_cursor_del(m_cur_block_info, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block info to db transaction: ", result).c_str()));
+
+  remove_rct_distribution(m_height - 1);
+}
+
+void BlockchainLMDB::add_rct_distribution(uint64_t height, uint64_t cum_rct)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+  int result;
+
+  CURSOR(rct_distribution)
+
+  const uint64_t chunk = height / RCT_DISTRIBUTION_CHUNK_SIZE;
+  const uint64_t offset = height % RCT_DISTRIBUTION_CHUNK_SIZE;
+  MDB_val_set(k, chunk);
+  if (offset == 0)
+  {
+    MDB_val_set(v, cum_rct);
+    if ((result = mdb_cursor_put(m_cur_rct_distribution, &k, &v, MDB_APPEND)))
+      throw0(DB_ERROR(lmdb_error("Failed to add rct distribution to db transaction: ", result).c_str()));
+    return;
+  }
+
+  MDB_val v;
+  if ((result = mdb_cursor_get(m_cur_rct_distribution, &k, &v, MDB_SET)))
+    throw0(DB_ERROR(lmdb_error("Failed to get rct distribution chunk: ", result).c_str()));
+  if (v.mv_size != offset * sizeof(uint64_t))
+    throw0(DB_ERROR("Unexpected rct distribution chunk size"));
+
+  // the old data lives in the map, and may be overwritten by the put
+  uint64_t entries[RCT_DISTRIBUTION_CHUNK_SIZE];
+  memcpy(entries, v.mv_data, v.mv_size);
+  entries[offset] = cum_rct;
+  v.mv_data = entries;
+  v.mv_size = (offset + 1) * sizeof(uint64_t);
+  if ((result = mdb_cursor_put(m_cur_rct_distribution, &k, &v, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to add rct distribution to db transaction: ", result).c_str()));
+}
+
+void BlockchainLMDB::remove_rct_distribution(uint64_t height)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+  int result;
+
+  CURSOR(rct_distribution)
+
+  const uint64_t chunk = height / RCT_DISTRIBUTION_CHUNK_SIZE;
+  const uint64_t offset = height % RCT_DISTRIBUTION_CHUNK_SIZE;
+  MDB_val_set(k, chunk);
+  MDB_val v;
+  if ((result = mdb_cursor_get(m_cur_rct_distribution, &k, &v, MDB_SET)))
+    throw1(DB_ERROR(lmdb_error("Failed to get rct distribution chunk for removal: ", result).c_str()));
+  if (v.mv_size != (offset + 1) * sizeof(uint64_t))
+    throw1(DB_ERROR("Attempting to remove rct distribution entry that is not the last one"));
+
+  if (offset == 0)
+  {
+    if ((result = mdb_cursor_del(m_cur_rct_distribution, 0)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of rct distribution to db transaction: ", result).c_str()));
+    return;
+  }
+
+  uint64_t entries[RCT_DISTRIBUTION_CHUNK_SIZE];
+  memcpy(entries, v.mv_data, offset * sizeof(uint64_t));
+  v.mv_data = entries;
+  v.mv_size = offset * sizeof(uint64_t);
+  if ((result = mdb_cursor_put(m_cur_rct_distribution, &k, &v, 0)))
+    throw1(DB_ERROR(lmdb_error("Failed to add removal of rct distribution to db transaction: ", result).c_str()));
 }
 
 uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, const std::pair<transaction, blobdata_ref>& txp, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash)
@@ -1259,6 +1357,9 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
 
   CURSOR(spent_keys)
 
+  // before the db, so the filter never misses a key image a reader can see
+  m_spent_keys_filter.insert(k_image);
+
   MDB_val k = {sizeof(k_image), (void *)&k_image};
   if (auto result = mdb_cursor_put(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_NODUPDATA)) {
     if (result == MDB_KEYEXIST)
@@ -1286,6 +1387,79 @@ void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
     if (result)
         throw1(DB_ERROR(lmdb_error("Error adding removal of key image to db transaction", result).c_str()));
   }
+  // the filter keeps the key image: it can't tell whether this txn will be committed
+}
+
+void BlockchainLMDB::rebuild_spent_keys_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to rebuild the key image filter with a write txn open in ")+__FUNCTION__).c_str()));
+
+  unsigned int env_flags = 0;
+  mdb_env_get_flags(m_env, &env_flags);
+
+  TIME_MEASURE_START(t);
+  try
+  {
+    // Key images a writer adds between reading m_spent_keys and the swap below
+    // would only be in the filter being replaced, and would then read as not
+    // spent. Holding a write txn keeps every other writer out until the new
+    // filter is live. A read only environment has no writers.
+    mdb_txn_safe txn;
+    if (env_flags & MDB_RDONLY)
+    {
+      if (auto mdb_res = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, txn))
+        throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
+    }
+    else
+    {
+      // this thread's read txn, if any, can't stay open alongside a write txn
+      if (m_tinfo.get())
+      {
+        if (m_tinfo->m_ti_rflags.m_rf_txn)
+          mdb_txn_reset(m_tinfo->m_ti_rtxn);
+        memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+      }
+      if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, txn))
+        throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
+    }
+
+    MDB_stat db_stats;
+    if (auto result = mdb_stat(txn, m_spent_keys, &db_stats))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_spent_keys: ", result).c_str()));
+
+    key_image_filter filter;
+    filter.reset(db_stats.ms_entries);
+
+    MDB_cursor *cursor;
+    if (auto result = mdb_cursor_open(txn, m_spent_keys, &cursor))
+      throw0(DB_ERROR(lmdb_error("Failed to open cursor: ", result).c_str()));
+    MDB_val k = zerokval, v;
+    MDB_cursor_op op = MDB_FIRST;
+    int ret;
+    while ((ret = mdb_cursor_get(cursor, &k, &v, op)) == 0)
+    {
+      filter.insert(*(const crypto::key_image*)v.mv_data);
+      op = MDB_NEXT;
+    }
+    mdb_cursor_close(cursor);
+    if (ret != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate key images: ", ret).c_str()));
+
+    m_spent_keys_filter.swap(filter);
+    txn.abort();
+  }
+  catch (const std::exception &e)
+  {
+    // an empty filter is always right, just not useful
+    MERROR("Failed to build spent key image filter: " << e.what());
+    m_spent_keys_filter.clear();
+    return;
+  }
+  TIME_MEASURE_FINISH(t);
+  MINFO("Built spent key image filter for " << m_spent_keys_filter.size() << " key images in " << t << " ms");
 }
 
 BlockchainLMDB::~BlockchainLMDB()
@@ -1302,7 +1476,8 @@ BlockchainLMDB::~BlockchainLMDB()
     BlockchainLMDB::close();
 }
 
-BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
+BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB(),
+  m_batch_tuner(BLOCKS_SYNCHRONIZING_DEFAULT_COUNT, BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   // initialize folder to something "safe" just in case
@@ -1315,6 +1490,11 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_batch_num_blocks = 0;
+  m_batch_bytes = 0;
+  m_batch_start_used = 0;
+  m_batch_start_time = 0;
+  m_resizes = 0;
 
   // reset may also need changing when initialize things here
 
@@ -1422,6 +1602,13 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   lmdb_db_open(txn, LMDB_BLOCK_INFO, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for m_block_info");
   lmdb_db_open(txn, LMDB_BLOCK_HEIGHTS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for m_block_heights");
+  // this subdb was added in version 6. An older read-only DB will not have it,
+  // and will be rejected by the version check below.
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_RCT_DISTRIBUTION, MDB_INTEGERKEY | MDB_CREATE, m_rct_distribution, "Failed to open db handle for m_rct_distribution");
+  else if (auto res = mdb_dbi_open(txn, LMDB_RCT_DISTRIBUTION, MDB_INTEGERKEY, &m_rct_distribution))
+    if (res != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to open db handle for m_rct_distribution: ", res).c_str()));
 
   lmdb_db_open(txn, LMDB_TXS, MDB_INTEGERKEY | MDB_CREATE, m_txs, "Failed to open db handle for m_txs");
   lmdb_db_open(txn, LMDB_TXS_PRUNED, MDB_INTEGERKEY | MDB_CREATE, m_txs_pruned, "Failed to open db handle for m_txs_pruned");
@@ -1513,6 +1700,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       txn.commit();
       m_open = true;
       migrate(db_version);
+      rebuild_spent_keys_filter();
       return;
     }
 #endif
@@ -1559,6 +1747,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   txn.commit();
 
   m_open = true;
+  rebuild_spent_keys_filter();
   // from here, init should be finished
 }
 
@@ -1576,6 +1765,7 @@ void BlockchainLMDB::close()
   // FIXME: not yet thread safe!!!  Use with care.
   mdb_env_close(m_env);
   m_open = false;
+  m_spent_keys_filter.clear();
 }
 
 void BlockchainLMDB::sync()
@@ -1615,6 +1805,8 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_info: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_block_heights, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_heights: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_rct_distribution, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_rct_distribution: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs_pruned, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_txs_pruned: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs_prunable, 0))
@@ -2536,6 +2728,54 @@ std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs(const std
   return res;
 }
 
+std::vector<uint64_t> BlockchainLMDB::get_rct_output_distribution(uint64_t start_height, size_t count) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  std::vector<uint64_t> res;
+  int result;
+
+  if (count == 0)
+    return res;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(rct_distribution);
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_blocks, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+  if (start_height >= db_stats.ms_entries || count > db_stats.ms_entries - start_height)
+    throw0(BLOCK_DNE(std::string("Attempt to get rct distribution from height " + std::to_string(start_height + count - 1) + " failed -- block size not in db").c_str()));
+
+  res.resize(count);
+  uint64_t *dst = res.data();
+  uint64_t chunk = start_height / RCT_DISTRIBUTION_CHUNK_SIZE;
+  uint64_t offset = start_height % RCT_DISTRIBUTION_CHUNK_SIZE;
+  MDB_val_set(k, chunk);
+  MDB_val v;
+  MDB_cursor_op op = MDB_SET;
+  while (count > 0)
+  {
+    result = mdb_cursor_get(m_cur_rct_distribution, &k, &v, op);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve rct distribution from the db: ", result).c_str()));
+    op = MDB_NEXT;
+    uint64_t found_chunk;
+    memcpy(&found_chunk, k.mv_data, sizeof(found_chunk));
+    if (found_chunk != chunk || v.mv_size <= offset * sizeof(uint64_t))
+      throw0(DB_ERROR(("Unexpected rct distribution chunk at height " + std::to_string(chunk * RCT_DISTRIBUTION_CHUNK_SIZE + offset)).c_str()));
+    const size_t n = std::min<size_t>(count, v.mv_size / sizeof(uint64_t) - offset);
+    memcpy(dst, (const uint64_t*)v.mv_data + offset, n * sizeof(uint64_t));
+    dst += n;
+    count -= n;
+    ++chunk;
+    offset = 0;
+  }
+
+  TXN_POSTFIX_RDONLY();
+  return res;
+}
+
 uint64_t BlockchainLMDB::get_top_block_timestamp() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3185,6 +3425,41 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  TXN_PREFIX_RDONLY();
+
+  std::vector<block_blob_refs_t> refs;
+  get_blocks_from(start_height, min_block_count, max_block_count, max_tx_count, max_size, refs, pruned, skip_coinbase, get_miner_tx_hash);
+
+  blocks.reserve(blocks.size() + refs.size());
+  for (const block_blob_refs_t &ref: refs)
+  {
+    blocks.resize(blocks.size() + 1);
+    auto &current_block = blocks.back();
+
+    current_block.first.first.assign(reinterpret_cast<const char*>(ref.block.data()), ref.block.size());
+    current_block.first.second = ref.miner_tx_hash;
+
+    current_block.second.reserve(ref.txs.size());
+    for (const auto &tx: ref.txs)
+    {
+      cryptonote::blobdata tx_blob;
+      tx_blob.reserve(tx.pruned.size() + tx.prunable.size());
+      tx_blob.assign(reinterpret_cast<const char*>(tx.pruned.data()), tx.pruned.size());
+      tx_blob.append(reinterpret_cast<const char*>(tx.prunable.data()), tx.prunable.size());
+      current_block.second.push_back(std::make_pair(tx.hash, std::move(tx_blob)));
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
+}
+
+bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<block_blob_refs_t>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
   TXN_PREFIX_RDONLY();
   RCURSOR(blocks);
   RCURSOR(tx_indices);
@@ -3213,13 +3488,13 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
     blocks.resize(blocks.size() + 1);
     auto &current_block = blocks.back();
 
-    current_block.first.first.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    current_block.block = {reinterpret_cast<const uint8_t*>(v.mv_data), v.mv_size};
     size += v.mv_size;
 
     cryptonote::block b;
-    if (!parse_and_validate_block_from_blob(current_block.first.first, b))
+    if (!parse_and_validate_block_from_blob(cryptonote::blobdata_ref{reinterpret_cast<const char*>(v.mv_data), v.mv_size}, b))
       throw0(DB_ERROR("Invalid block"));
-    current_block.first.second = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
+    current_block.miner_tx_hash = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
 
     // get the tx_id for the first tx (the first block's coinbase tx)
     if (h == start_height)
@@ -3251,26 +3526,28 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
 
     op = MDB_NEXT;
 
-    current_block.second.reserve(b.tx_hashes.size());
+    current_block.txs.reserve(b.tx_hashes.size());
     num_txes += b.tx_hashes.size() + (skip_coinbase ? 0 : 1);
     for (const auto &tx_hash: b.tx_hashes)
     {
+      block_blob_refs_t::tx_refs tx;
+      tx.hash = tx_hash;
+
       // get pruned data
-      cryptonote::blobdata tx_blob;
       result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &v, op);
       if (result)
         throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-      tx_blob.assign((const char*)v.mv_data, v.mv_size);
+      tx.pruned = {reinterpret_cast<const uint8_t*>(v.mv_data), v.mv_size};
 
       if (!pruned)
       {
         result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &v, op);
         if (result)
           throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-        tx_blob.append(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+        tx.prunable = {reinterpret_cast<const uint8_t*>(v.mv_data), v.mv_size};
       }
-      current_block.second.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
-      size += current_block.second.back().second.size();
+      size += tx.pruned.size() + tx.prunable.size();
+      current_block.txs.push_back(tx);
     }
 
     if (blocks.size() >= min_block_count && num_txes >= max_tx_count)
@@ -3538,6 +3815,9 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (!m_spent_keys_filter.may_contain(img))
+    return false;
+
   bool ret;
 
   TXN_PREFIX_RDONLY();
@@ -3550,6 +3830,39 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   return ret;
 }
 
+void BlockchainLMDB::has_key_images(const epee::span<const crypto::key_image> &imgs, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  spent.assign(imgs.size(), false);
+
+  // look up what the filter can't rule out, in db order so the cursor stays on the same pages
+  std::vector<size_t> lookups;
+  lookups.reserve(imgs.size());
+  for (size_t i = 0; i < imgs.size(); ++i)
+    if (m_spent_keys_filter.may_contain(imgs[i]))
+      lookups.push_back(i);
+  if (lookups.empty())
+    return;
+  std::sort(lookups.begin(), lookups.end(), [&imgs](size_t a, size_t b) {
+    MDB_val va = {sizeof(imgs[a]), (void *)&imgs[a]};
+    MDB_val vb = {sizeof(imgs[b]), (void *)&imgs[b]};
+    return compare_hash32(&va, &vb) < 0;
+  });
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
+
+  for (size_t i: lookups)
+  {
+    MDB_val k = {sizeof(imgs[i]), (void *)&imgs[i]};
+    spent[i] = (mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
 bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3803,6 +4116,10 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
   m_write_txn = m_write_batch_txn;
 
   m_batch_active = true;
+  m_batch_num_blocks = batch_num_blocks;
+  m_batch_bytes = batch_bytes;
+  m_batch_start_used = get_map_used();
+  m_batch_start_time = epee::misc_utils::get_ns_count();
   memset(&m_wcursors, 0, sizeof(m_wcursors));
   if (m_tinfo.get())
   {
@@ -3866,9 +4183,11 @@ void BlockchainLMDB::batch_stop()
   check_open();
   LOG_PRINT_L3("batch transaction: committing...");
   TIME_MEASURE_START(time1);
+  TIME_MEASURE_NS_START(commit_time);
   try
   {
     m_write_txn->commit();
+    TIME_MEASURE_NS_PAUSE(commit_time);
     TIME_MEASURE_FINISH(time1);
     time_commit1 += time1;
     cleanup_batch();
@@ -3878,6 +4197,12 @@ void BlockchainLMDB::batch_stop()
     cleanup_batch();
     throw;
   }
+  const uint64_t write_time = epee::misc_utils::get_ns_count() - commit_time - m_batch_start_time;
+  const uint64_t used = get_map_used();
+  m_batch_tuner.on_batch(m_batch_num_blocks, m_batch_bytes, used > m_batch_start_used ? used - m_batch_start_used : 0,
+      write_time / 1000, commit_time / 1000);
+  if (m_spent_keys_filter.needs_rebuild())
+    rebuild_spent_keys_filter();
   LOG_PRINT_L3("batch transaction: end");
 }
 
@@ -4025,6 +4350,9 @@ void BlockchainLMDB::block_wtxn_stop()
       delete m_write_txn;
       m_write_txn = nullptr;
       memset(&m_wcursors, 0, sizeof(m_wcursors));
+
+      if (m_spent_keys_filter.needs_rebuild())
+        rebuild_spent_keys_filter();
 	}
   }
 }
@@ -4137,48 +4465,77 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
   TIME_MEASURE_START(db3);
   check_open();
   outputs.clear();
-  outputs.reserve(offsets.size());
+
+  // look outputs up in key order, once each, so the cursor moves forward through
+  // output_amounts instead of going back to the root for every ring member
+  const auto amount_at = [&amounts](size_t i) { return amounts.size() == 1 ? amounts[0] : amounts[i]; };
+  std::vector<size_t> order(offsets.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    const uint64_t amount_a = amount_at(a), amount_b = amount_at(b);
+    return amount_a < amount_b || (amount_a == amount_b && offsets[a] < offsets[b]);
+  });
+
+  std::vector<output_data_t> data(offsets.size());
+  std::vector<bool> found(offsets.size(), false);
 
   TXN_PREFIX_RDONLY();
 
   RCURSOR(output_amounts);
 
-  for (size_t i = 0; i < offsets.size(); ++i)
+  for (size_t n = 0; n < order.size(); ++n)
   {
-    const uint64_t amount = amounts.size() == 1 ? amounts[0] : amounts[i];
+    const size_t i = order[n];
+    const uint64_t amount = amount_at(i);
+    if (n > 0 && amount_at(order[n - 1]) == amount && offsets[order[n - 1]] == offsets[i])
+    {
+      data[i] = data[order[n - 1]];
+      found[i] = found[order[n - 1]];
+      continue;
+    }
+
     MDB_val_set(k, amount);
     MDB_val_set(v, offsets[i]);
 
     auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
     if (get_result == MDB_NOTFOUND)
-    {
-      if (allow_partial)
-      {
-        MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
-        break;
-      }
-      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(offsets[i]) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
-    }
+      continue;
     else if (get_result)
       throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output pubkey from the db", get_result).c_str()));
 
     if (amount == 0)
     {
       const outkey *okp = (const outkey *)v.mv_data;
-      outputs.push_back(okp->data);
+      data[i] = okp->data;
     }
     else
     {
       const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
-      outputs.resize(outputs.size() + 1);
-      output_data_t &data = outputs.back();
-      memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
-      data.commitment = rct::zeroCommit(amount);
+      memcpy(&data[i], &okp->data, sizeof(pre_rct_output_data_t));
+      data[i].commitment = rct::zeroCommit(amount);
     }
+    found[i] = true;
+  }
+
+  // results are in request order, and stop at the first missing output if partial results are fine
+  const auto missing = std::find(found.begin(), found.end(), false);
+  if (missing != found.end())
+  {
+    const size_t i = missing - found.begin();
+    if (!allow_partial)
+    {
+      const uint64_t amount = amount_at(i);
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(offsets[i]) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
+    }
+    MDEBUG("Partial result: " << i << "/" << offsets.size());
+    data.resize(i);
   }
 
   TXN_POSTFIX_RDONLY();
 
+  outputs = std::move(data);
+
   TIME_MEASURE_FINISH(db3);
   LOG_PRINT_L3("db3: " << db3);
 }
@@ -4544,6 +4901,16 @@ uint64_t BlockchainLMDB::get_database_size() const
   return size;
 }
 
+db_batch_stats BlockchainLMDB::get_batch_stats() const
+{
+  db_batch_stats stats = db_batch_stats();
+  m_batch_tuner.get_stats(stats);
+  if (m_open)
+    stats.map_used = get_map_used(&stats.map_size);
+  stats.resizes = m_resizes;
+  return stats;
+}
+
 void BlockchainLMDB::fixup()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -5677,6 +6044,106 @@ void BlockchainLMDB::migrate_4_5()
   txn.commit();
 }
 
+void BlockchainLMDB::migrate_5_6()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+
+  MGINFO_YELLOW("Migrating blockchain from DB version 5 to 6 - this may take a while:");
+
+  do {
+    LOG_PRINT_L1("populating rct distribution:");
+
+    /* the whole table is only 8 bytes per block, so it is built in a single txn,
+     * and an interrupted migration just starts over
+     */
+    result = mdb_txn_begin(m_env, NULL, MDB_RDONLY, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    const uint64_t blockchain_height = db_stats.ms_entries;
+    txn.abort();
+
+    // make room for the whole table, with as much again for the btree pages
+    const uint64_t table_size = blockchain_height * sizeof(uint64_t) * 2;
+    if (need_resize(table_size))
+      do_resize(std::max<uint64_t>(table_size, 1 << 30));
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+    result = mdb_drop(txn, m_rct_distribution, 0);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to empty rct_distribution table: ", result).c_str()));
+
+    MDB_cursor *c_block_info, *c_dist;
+    result = mdb_cursor_open(txn, m_block_info, &c_block_info);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_info: ", result).c_str()));
+    result = mdb_cursor_open(txn, m_rct_distribution, &c_dist);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for rct_distribution: ", result).c_str()));
+
+    uint64_t entries[RCT_DISTRIBUTION_CHUNK_SIZE];
+    uint64_t height = 0, next_report = 100000;
+    MDB_cursor_op op = MDB_GET_MULTIPLE;
+    result = mdb_cursor_get(c_block_info, &k, &v, MDB_FIRST);
+    while (result == 0) {
+      result = mdb_cursor_get(c_block_info, &k, &v, op);
+      if (result)
+        break;
+      op = MDB_NEXT_MULTIPLE;
+
+      const mdb_block_info *bi = (const mdb_block_info*)v.mv_data;
+      const size_t n_records = v.mv_size / sizeof(mdb_block_info);
+      for (size_t n = 0; n < n_records; ++n, ++bi) {
+        if (bi->bi_height != height)
+          throw0(DB_ERROR(("Unexpected block_info height " + std::to_string(bi->bi_height) + ", expected " + std::to_string(height)).c_str()));
+        entries[height % RCT_DISTRIBUTION_CHUNK_SIZE] = bi->bi_cum_rct;
+        ++height;
+        if (height % RCT_DISTRIBUTION_CHUNK_SIZE == 0 || height == blockchain_height) {
+          uint64_t chunk = (height - 1) / RCT_DISTRIBUTION_CHUNK_SIZE;
+          MDB_val_set(ck, chunk);
+          MDB_val cv = {(height - chunk * RCT_DISTRIBUTION_CHUNK_SIZE) * sizeof(uint64_t), (void*)entries};
+          result = mdb_cursor_put(c_dist, &ck, &cv, MDB_APPEND);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to put a record into rct_distribution: ", result).c_str()));
+        }
+      }
+      if (height >= next_report) {
+        LOGIF(el::Level::Info) {
+          std::cout << height << " / " << blockchain_height << "  \r" << std::flush;
+        }
+        next_report += 100000;
+      }
+    }
+    if (result && result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to get a record from block_info: ", result).c_str()));
+    if (height != blockchain_height)
+      throw0(DB_ERROR(("Found " + std::to_string(height) + " block_info records, expected " + std::to_string(blockchain_height)).c_str()));
+
+    txn.commit();
+  } while(0);
+
+  uint32_t version = 6;
+  v.mv_data = (void *)&version;
+  v.mv_size = sizeof(version);
+  MDB_val_str(vk, "version");
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  result = mdb_put(txn, m_properties, &vk, &v, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+  txn.commit();
+}
+
 void BlockchainLMDB::migrate(const uint32_t oldversion)
 {
   if (oldversion < 1)
@@ -5689,6 +6156,8 @@ void BlockchainLMDB::migrate(const uint32_t oldversion)
     migrate_3_4();
   if (oldversion < 5)
     migrate_4_5();
+  if (oldversion < 6)
+    migrate_5_6();
 }
 
 }  // namespace cryptonote
@@ -29,6 +29,8 @@
 #include <atomic>
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/batch_tuner.h"
+#include "blockchain_db/key_image_filter.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
 #include <boost/thread/tss.hpp>
@@ -50,6 +52,7 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_blocks;
   MDB_cursor *m_txc_block_heights;
   MDB_cursor *m_txc_block_info;
+  MDB_cursor *m_txc_rct_distribution;
 
   MDB_cursor *m_txc_output_txs;
   MDB_cursor *m_txc_output_amounts;
@@ -77,6 +80,7 @@ typedef struct mdb_txn_cursors
 #define m_cur_blocks	m_cursors->m_txc_blocks
 #define m_cur_block_heights	m_cursors->m_txc_block_heights
 #define m_cur_block_info	m_cursors->m_txc_block_info
+#define m_cur_rct_distribution	m_cursors->m_txc_rct_distribution
 #define m_cur_output_txs	m_cursors->m_txc_output_txs
 #define m_cur_output_amounts	m_cursors->m_txc_output_amounts
 #define m_cur_txs	m_cursors->m_txc_txs
@@ -99,6 +103,7 @@ typedef struct mdb_rflags
   bool m_rf_blocks;
   bool m_rf_block_heights;
   bool m_rf_block_info;
+  bool m_rf_rct_distribution;
   bool m_rf_output_txs;
   bool m_rf_output_amounts;
   bool m_rf_txs;
@@ -214,6 +219,8 @@ public:
 
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const;
 
+  virtual std::vector<uint64_t> get_rct_output_distribution(uint64_t start_height, size_t count) const;
+
   virtual uint64_t get_block_timestamp(const uint64_t& height) const;
 
   virtual uint64_t get_top_block_timestamp() const;
@@ -255,6 +262,7 @@ public:
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_pruned_tx_blobs_from(const crypto::hash& h, size_t count, std::vector<cryptonote::blobdata> &bd) const;
   virtual bool get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const;
+  virtual bool get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<block_blob_refs_t>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const;
   virtual bool get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const;
 
@@ -281,6 +289,7 @@ public:
   virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_id, size_t n_txes) const;
 
   virtual bool has_key_image(const crypto::key_image& img) const;
+  virtual void has_key_images(const epee::span<const crypto::key_image> &imgs, std::vector<bool> &spent) const;
 
   virtual void add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata_ref &blob, const txpool_tx_meta_t& meta);
   virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& meta);
@@ -358,6 +367,7 @@ public:
 
 private:
   void do_resize(uint64_t size_increase=0);
+  uint64_t get_map_used(uint64_t *map_size=NULL) const;
 
   bool need_resize(uint64_t threshold_size=0) const;
   void check_and_resize_for_batch(uint64_t batch_num_blocks, uint64_t batch_bytes);
@@ -399,6 +409,10 @@ private:
 
   virtual void remove_spent_key(const crypto::key_image& k_image);
 
+  // (re)builds m_spent_keys_filter from m_spent_keys, holding off other writers until the
+  // new filter is swapped in; the calling thread must not have a write txn open
+  void rebuild_spent_keys_filter();
+
   uint64_t num_outputs() const;
 
   // Hard fork
@@ -415,11 +429,16 @@ private:
 
   virtual uint64_t get_database_size() const;
 
+  virtual db_batch_stats get_batch_stats() const;
+
   std::vector<uint64_t> get_block_info_64bit_fields(uint64_t start_height, size_t count, off_t offset) const;
 
   uint64_t get_max_block_size();
   void add_max_block_size(uint64_t sz);
 
+  void add_rct_distribution(uint64_t height, uint64_t cum_rct);
+  void remove_rct_distribution(uint64_t height);
+
   // fix up anything that may be wrong due to past bugs
   virtual void fixup();
 
@@ -441,6 +460,9 @@ private:
   // migrate from DB version 4 to 5
   void migrate_4_5();
 
+  // migrate from DB version 5 to 6
+  void migrate_5_6();
+
   void cleanup_batch();
 
 private:
@@ -449,6 +471,7 @@ private:
   MDB_dbi m_blocks;
   MDB_dbi m_block_heights;
   MDB_dbi m_block_info;
+  MDB_dbi m_rct_distribution;
 
   MDB_dbi m_txs;
   MDB_dbi m_txs_pruned;
@@ -486,6 +509,17 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  // rules out most unspent key images without a lookup in m_spent_keys
+  key_image_filter m_spent_keys_filter;
+
+  // measures batches to size the next ones and the map growth
+  batch_tuner m_batch_tuner;
+  uint64_t m_batch_num_blocks;
+  uint64_t m_batch_bytes;
+  uint64_t m_batch_start_used;
+  uint64_t m_batch_start_time;
+  std::atomic<uint64_t> m_resizes;
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -498,6 +532,9 @@ private:
 #endif
 
   constexpr static float RESIZE_PERCENT = 0.9f;
+
+  // once measured, grow the map when fewer batches than this would still fit
+  constexpr static uint64_t RESIZE_LOOKAHEAD_BATCHES = 16;
 };
 
 }  // namespace cryptonote
@@ -0,0 +1,222 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace tools
+{
+  /**
+   * @brief A fixed memory, sharded set used as a cache
+   *
+   * Values live in buckets of BUCKET_SLOTS slots (open addressing, a value can
+   * only be in the bucket it hashes to). When a bucket is full, a victim is
+   * picked with the CLOCK algorithm: values that were looked up since the hand
+   * last passed get a second chance.
+   *
+   * has() is lock free. Each slot carries a sequence number which is odd while
+   * the slot is being written, and a reader only reports a hit if the value it
+   * read matched and the sequence number was the same even value before and
+   * after. add() takes the lock of the value's shard only. has() never returns
+   * true for a value which was not added, but values may be evicted any time.
+   *
+   * @tparam T trivially copyable, with a size multiple of 8 bytes
+   * @tparam DEFAULT_SIZE the number of entries when not given at construction
+   */
+  template<typename T, size_t DEFAULT_SIZE, typename Hash = std::hash<T>>
+  class concurrent_set_cache
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+    static_assert(sizeof(T) % sizeof(uint64_t) == 0, "T's size must be a multiple of 8 bytes");
+
+  public:
+    static constexpr const size_t BUCKET_SLOTS = 8;
+    static constexpr const size_t SHARDS = 16;
+
+    concurrent_set_cache(size_t max_size = DEFAULT_SIZE)
+    {
+      resize(max_size);
+    }
+
+    /**
+     * @brief reallocates the cache for (at least) max_size values
+     *
+     * Drops all values. Not thread safe.
+     */
+    void resize(size_t max_size)
+    {
+      size_t buckets = 1;
+      while (buckets * BUCKET_SLOTS * SHARDS < max_size)
+        buckets <<= 1;
+      for (shard &s: m_shards)
+      {
+        s.slots.reset(new slot[buckets * BUCKET_SLOTS]());
+        s.hands.assign(buckets, 0);
+        s.bucket_mask = buckets - 1;
+      }
+    }
+
+    size_t capacity() const
+    {
+      return SHARDS * (m_shards[0].bucket_mask + 1) * BUCKET_SLOTS;
+    }
+
+    void add(const T& value)
+    {
+      uint64_t words[WORDS];
+      memcpy(words, &value, sizeof(T));
+      size_t bucket_index;
+      shard &s = locate(value, bucket_index);
+      slot *bucket = &s.slots[bucket_index * BUCKET_SLOTS];
+
+      std::lock_guard<std::mutex> lock(s.mutex);
+      slot *empty = NULL;
+      for (size_t i = 0; i < BUCKET_SLOTS; ++i)
+      {
+        const uint64_t seq = bucket[i].seq.load(std::memory_order_relaxed);
+        if (seq == 0)
+        {
+          if (!empty)
+            empty = &bucket[i];
+        }
+        else if (matches(bucket[i], words))
+        {
+          return;
+        }
+      }
+
+      if (!empty)
+      {
+        uint8_t &hand = s.hands[bucket_index];
+        // bounded, readers may keep setting the bits we clear
+        for (size_t n = 0; n < 2 * BUCKET_SLOTS && bucket[hand].referenced.exchange(false, std::memory_order_relaxed); ++n)
+          hand = (hand + 1) % BUCKET_SLOTS;
+        empty = &bucket[hand];
+        hand = (hand + 1) % BUCKET_SLOTS;
+      }
+      store(*empty, words);
+    }
+
+    bool has(const T& value) const
+    {
+      uint64_t words[WORDS];
+      memcpy(words, &value, sizeof(T));
+      size_t bucket_index;
+      const shard &s = locate(value, bucket_index);
+      const slot *bucket = &s.slots[bucket_index * BUCKET_SLOTS];
+
+      for (size_t i = 0; i < BUCKET_SLOTS; ++i)
+      {
+        const slot &sl = bucket[i];
+        const uint64_t seq = sl.seq.load(std::memory_order_acquire);
+        if (seq == 0 || (seq & 1))
+          continue;
+        const bool match = matches(sl, words);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sl.seq.load(std::memory_order_relaxed) != seq)
+          continue; // overwritten while we were reading it
+        if (match)
+        {
+          sl.referenced.store(true, std::memory_order_relaxed);
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    static constexpr const size_t WORDS = sizeof(T) / sizeof(uint64_t);
+
+    struct slot
+    {
+      std::atomic<uint64_t> seq; // 0 when empty, odd while being written
+      std::atomic<uint64_t> words[WORDS];
+      mutable std::atomic<bool> referenced;
+    };
+
+    struct shard
+    {
+      std::mutex mutex;
+      std::unique_ptr<slot[]> slots;
+      std::vector<uint8_t> hands; // CLOCK hand of each bucket
+      size_t bucket_mask;
+    };
+
+    static bool matches(const slot &sl, const uint64_t (&words)[WORDS])
+    {
+      for (size_t i = 0; i < WORDS; ++i)
+        if (sl.words[i].load(std::memory_order_relaxed) != words[i])
+          return false;
+      return true;
+    }
+
+    static void store(slot &sl, const uint64_t (&words)[WORDS])
+    {
+      const uint64_t seq = sl.seq.load(std::memory_order_relaxed);
+      sl.seq.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      for (size_t i = 0; i < WORDS; ++i)
+        sl.words[i].store(words[i], std::memory_order_relaxed);
+      sl.seq.store(seq + 2, std::memory_order_release);
+      sl.referenced.store(false, std::memory_order_relaxed);
+    }
+
+    size_t mix(const T& value) const
+    {
+      // spread the bits, the std::hash of some types is just their first bytes
+      uint64_t h = Hash()(value);
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdull;
+      h ^= h >> 33;
+      return h;
+    }
+
+    shard &locate(const T& value, size_t &bucket_index)
+    {
+      const uint64_t h = mix(value);
+      shard &s = m_shards[h % SHARDS];
+      bucket_index = (h / SHARDS) & s.bucket_mask;
+      return s;
+    }
+
+    const shard &locate(const T& value, size_t &bucket_index) const
+    {
+      return const_cast<concurrent_set_cache*>(this)->locate(value, bucket_index);
+    }
+
+    shard m_shards[SHARDS];
+  };
+}
@@ -31,12 +31,114 @@
 #include "cryptonote_config.h"
 #include "common/util.h"
 
-static __thread int depth = 0;
+// how long a waiter sleeps before looking for runnable tasks again
+#define THREADPOOL_WAITER_POLL_MS 10
+
 static __thread bool is_leaf = false;
+static __thread tools::threadpool *current_pool = NULL;
+static __thread int current_worker = -1;
+static __thread size_t steal_seed = 0;
 
 namespace tools
 {
-threadpool::threadpool(unsigned int max_threads) : running(true), active(0) {
+struct threadpool::entry {
+  waiter *wo;
+  std::function<void()> f;
+  bool leaf;
+};
+
+// Chase-Lev work stealing deque (Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013).
+// Only the owner thread may push and pop, any thread may steal.
+class threadpool::work_deque {
+public:
+  work_deque(): top(0), bottom(0), buffer(new ring(64)) {}
+  ~work_deque() {
+    while (pop()) ;
+    delete buffer.load();
+  }
+
+  void push(std::unique_ptr<entry> e) {
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+    ring *r = buffer.load(std::memory_order_relaxed);
+    if (b - t > r->capacity - 1) {
+      // stealers may still be reading the old ring, keep it until we die
+      ring *bigger = r->grow(b, t);
+      retired.emplace_back(r);
+      buffer.store(bigger, std::memory_order_release);
+      r = bigger;
+    }
+    r->put(b, e.release());
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  std::unique_ptr<entry> pop() {
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    ring *r = buffer.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    entry *e = NULL;
+    if (t <= b) {
+      e = r->get(b);
+      if (t == b) {
+        // last one, race against stealers
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+          e = NULL;
+        bottom.store(b + 1, std::memory_order_relaxed);
+      }
+    } else {
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return std::unique_ptr<entry>(e);
+  }
+
+  std::unique_ptr<entry> steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+      return NULL;
+    ring *r = buffer.load(std::memory_order_acquire);
+    entry *e = r->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      return NULL;
+    return std::unique_ptr<entry>(e);
+  }
+
+  bool empty() const {
+    return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct ring {
+    ring(int64_t capacity): capacity(capacity), slots(new std::atomic<entry*>[capacity]) {}
+    entry *get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_acquire); }
+    void put(int64_t i, entry *e) { slots[i & (capacity - 1)].store(e, std::memory_order_release); }
+    ring *grow(int64_t b, int64_t t) const {
+      ring *r = new ring(capacity * 2);
+      for (int64_t i = t; i < b; ++i)
+        r->put(i, get(i));
+      return r;
+    }
+    const int64_t capacity;
+    std::unique_ptr<std::atomic<entry*>[]> slots;
+  };
+
+  alignas(64) std::atomic<int64_t> top;
+  alignas(64) std::atomic<int64_t> bottom;
+  std::atomic<ring*> buffer;
+  std::vector<std::unique_ptr<ring>> retired;
+};
+
+struct threadpool::worker {
+  worker(unsigned int index): index(index) {}
+  const unsigned int index;
+  work_deque queues[num_priorities];
+};
+
+threadpool::threadpool(unsigned int max_threads) : injected(0), sleeping(0), running(true) {
   create(max_threads);
 }
 
@@ -63,6 +165,18 @@ void threadpool::destroy() {
     catch (...) { /* ignore */ }
   }
   threads.clear();
+
+  // hand leftover tasks to the injector, so they run after a recycle
+  const boost::unique_lock<boost::mutex> lock(injector_mutex);
+  for (const auto &w: workers) {
+    for (size_t p = 0; p < num_priorities; ++p) {
+      while (std::unique_ptr<entry> e = w->queues[p].pop()) {
+        injector[p].push_back(std::move(e));
+        ++injected;
+      }
+    }
+  }
+  workers.clear();
 }
 
 void threadpool::recycle() {
@@ -70,37 +184,47 @@ void threadpool::recycle() {
   create(max);
 }
 
+void threadpool::recycle(unsigned int max_threads) {
+  destroy();
+  create(max_threads);
+}
+
 void threadpool::create(unsigned int max_threads) {
   const boost::unique_lock<boost::mutex> lock(mutex);
   boost::thread::attributes attrs;
   attrs.set_stack_size(THREAD_STACK_SIZE);
   max = max_threads ? max_threads : tools::get_max_concurrency();
-  size_t i = max ? max - 1 : 0;
+  const size_t nthreads = max ? max - 1 : 0;
   running = true;
-  while(i--) {
-    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, false)));
-  }
+  // all workers must exist before any thread starts stealing from them
+  for (size_t i = 0; i < nthreads; ++i)
+    workers.emplace_back(new worker(i));
+  for (size_t i = 0; i < nthreads; ++i)
+    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, workers[i].get())));
 }
 
-void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf) {
+void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf, priority prio) {
   CHECK_AND_ASSERT_THROW_MES(!is_leaf, "A leaf routine is using a thread pool");
-  boost::unique_lock<boost::mutex> lock(mutex);
-  if (!leaf && ((active == max && !queue.empty()) || depth > 0)) {
-    // if all available threads are already running
-    // and there's work waiting, just run in current thread
-    lock.unlock();
-    ++depth;
-    is_leaf = leaf;
-    f();
-    --depth;
-    is_leaf = false;
+  std::unique_ptr<entry> e(new entry{obj, std::move(f), leaf});
+  const size_t p = static_cast<size_t>(prio);
+  if (obj)
+    obj->inc();
+  if (current_pool == this && current_worker >= 0) {
+    workers[current_worker]->queues[p].push(std::move(e));
   } else {
-    if (obj)
-      obj->inc();
+    const boost::unique_lock<boost::mutex> lock(injector_mutex);
     if (leaf)
-      queue.push_front({obj, f, leaf});
+      injector[p].push_front(std::move(e));
     else
-      queue.push_back({obj, f, leaf});
+      injector[p].push_back(std::move(e));
+    ++injected;
+  }
+
+  // pairs with the fence in run, so a thread going to sleep either sees
+  // this task or is counted in sleeping and gets woken up
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load() > 0) {
+    const boost::unique_lock<boost::mutex> lock(mutex);
     has_work.notify_one();
   }
 }
@@ -129,10 +253,20 @@ threadpool::waiter::~waiter()
 }
 
 bool threadpool::waiter::wait() {
-  pool.run(true);
-  boost::unique_lock<boost::mutex> lock(mt);
-  while(num)
-    cv.wait(lock);
+  while (true) {
+    {
+      boost::unique_lock<boost::mutex> lock(mt);
+      if (!num)
+        break;
+    }
+    // help out instead of blocking, our own tasks may be among the pending ones
+    if (pool.run_one())
+      continue;
+    boost::unique_lock<boost::mutex> lock(mt);
+    if (!num)
+      break;
+    cv.wait_for(lock, boost::chrono::milliseconds(THREADPOOL_WAITER_POLL_MS));
+  }
   return !error();
 }
 
@@ -148,33 +282,81 @@ void threadpool::waiter::dec() {
     cv.notify_all();
 }
 
-void threadpool::run(bool flush) {
-  boost::unique_lock<boost::mutex> lock(mutex);
+std::unique_ptr<threadpool::entry> threadpool::take(worker *self) {
+  const size_t nworkers = workers.size();
+  for (size_t p = num_priorities; p-- > 0; ) {
+    if (self) {
+      if (std::unique_ptr<entry> e = self->queues[p].pop())
+        return e;
+    }
+    if (injected.load() > 0) {
+      const boost::unique_lock<boost::mutex> lock(injector_mutex);
+      if (!injector[p].empty()) {
+        std::unique_ptr<entry> e = std::move(injector[p].front());
+        injector[p].pop_front();
+        --injected;
+        return e;
+      }
+    }
+    const size_t start = self ? self->index + 1 : steal_seed++;
+    for (size_t i = 0; i < nworkers; ++i) {
+      worker *victim = workers[(start + i) % nworkers].get();
+      if (victim == self)
+        continue;
+      if (std::unique_ptr<entry> e = victim->queues[p].steal())
+        return e;
+    }
+  }
+  return NULL;
+}
+
+bool threadpool::has_pending_work() const {
+  if (injected.load() > 0)
+    return true;
+  for (const auto &w: workers)
+    for (size_t p = 0; p < num_priorities; ++p)
+      if (!w->queues[p].empty())
+        return true;
+  return false;
+}
+
+void threadpool::execute(std::unique_ptr<entry> e) {
+  const bool was_leaf = is_leaf;
+  is_leaf = e->leaf;
+  {
+    // destroy the task's captures before signalling the waiter
+    std::function<void()> f = std::move(e->f);
+    try { f(); }
+    catch (const std::exception &ex) { if (e->wo) e->wo->set_error(); try { MERROR("Exception in threadpool job: " << ex.what()); } catch (...) {} }
+  }
+  is_leaf = was_leaf;
+  if (e->wo)
+    e->wo->dec();
+}
+
+bool threadpool::run_one() {
+  worker *self = current_pool == this && current_worker >= 0 ? workers[current_worker].get() : NULL;
+  std::unique_ptr<entry> e = take(self);
+  if (!e)
+    return false;
+  execute(std::move(e));
+  return true;
+}
+
+void threadpool::run(worker *self) {
+  current_pool = this;
+  current_worker = self->index;
   while (running) {
-    entry e;
-    while(queue.empty() && running)
-    {
-      if (flush)
-        return;
+    if (run_one())
+      continue;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    ++sleeping;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (running && !has_pending_work())
       has_work.wait(lock);
-    }
-    if (!running) break;
-
-    active++;
-    e = std::move(queue.front());
-    queue.pop_front();
-    lock.unlock();
-    ++depth;
-    is_leaf = e.leaf;
-    try { e.f(); }
-    catch (const std::exception &ex) { e.wo->set_error(); try { MERROR("Exception in threadpool job: " << ex.what()); } catch (...) {} }
-    --depth;
-    is_leaf = false;
-
-    if (e.wo)
-      e.wo->dec();
-    lock.lock();
-    active--;
+    --sleeping;
   }
+  current_pool = NULL;
+  current_worker = -1;
 }
 }
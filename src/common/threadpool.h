@@ -30,16 +30,25 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <atomic>
 #include <cstddef>
 #include <deque>
 #include <functional>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <stdexcept>
 
 namespace tools
 {
-//! A global thread pool
+//! A global work stealing thread pool
+//
+// Each pool thread owns one Chase-Lev deque per priority class. Tasks submitted
+// from a pool thread go to its own deque (and are popped LIFO by that thread),
+// tasks submitted from any other thread go to a global injector queue. Idle
+// threads take from their own deque, then the injector, then steal (FIFO) from
+// the other threads, always looking at higher priority work first. A thread
+// waiting on a waiter runs pending tasks while it waits.
 class threadpool
 {
 public:
@@ -55,6 +64,12 @@ public:
     return new threadpool(max_threads);
   }
 
+  // Scheduling class of a task. Pending high priority tasks are always
+  // picked before pending normal priority ones, which lets latency sensitive
+  // (eg, RPC facing) work overtake background verification.
+  enum class priority { normal = 0, high = 1 };
+  static constexpr const size_t num_priorities = 2;
+
   // The waiter lets the caller know when all of its
   // tasks are completed.
   class waiter {
@@ -75,11 +90,14 @@ public:
 
   // Submit a task to the pool. The waiter pointer may be
   // NULL if the caller doesn't care to wait for the
-  // task to finish.
-  void submit(waiter *waiter, std::function<void()> f, bool leaf = false);
+  // task to finish. Leaf tasks may not submit tasks themselves.
+  void submit(waiter *waiter, std::function<void()> f, bool leaf = false, priority prio = priority::normal);
 
   // destroy and recreate threads
   void recycle();
+  // destroy and recreate threads, for a concurrency of max_threads (0 for the
+  // number of cores), with no worker threads at all for 1
+  void recycle(unsigned int max_threads);
 
   unsigned int get_max_concurrency() const;
 
@@ -89,19 +107,24 @@ public:
     threadpool(unsigned int max_threads = 0);
     void destroy();
     void create(unsigned int max_threads);
-    typedef struct entry {
-      waiter *wo;
-      std::function<void()> f;
-      bool leaf;
-    } entry;
-    std::deque<entry> queue;
+    struct entry;
+    class work_deque;
+    struct worker;
+    std::unique_ptr<entry> take(worker *self);
+    bool run_one();
+    bool has_pending_work() const;
+    void execute(std::unique_ptr<entry> e);
+    std::deque<std::unique_ptr<entry>> injector[num_priorities];
+    std::atomic<size_t> injected;
+    boost::mutex injector_mutex;
+    std::vector<std::unique_ptr<worker>> workers;
     boost::condition_variable has_work;
     boost::mutex mutex;
+    std::atomic<unsigned int> sleeping;
     std::vector<boost::thread> threads;
-    unsigned int active;
     unsigned int max;
-    bool running;
-    void run(bool flush = false);
+    std::atomic<bool> running;
+    void run(worker *self);
 };
 
 }
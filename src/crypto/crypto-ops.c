@@ -1712,6 +1712,40 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* Same as ge_tobytes for n points, writing 32 * n bytes to s. The Z
+   coordinates are inverted together (Montgomery's trick), so the whole batch
+   costs one field inversion and 3 (n - 1) extra multiplications. scratch must
+   hold n field elements. No Z may be zero, which holds for any point reached
+   from a valid encoding. */
+void ge_p2_batch_tobytes(unsigned char *s, const ge_p2 *h, fe *scratch, size_t n) {
+  fe recip;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0) {
+    return;
+  }
+  fe_copy(scratch[0], h[0].Z);
+  for (i = 1; i < n; i++) {
+    fe_mul(scratch[i], scratch[i - 1], h[i].Z);
+  }
+  fe_invert(recip, scratch[n - 1]);
+  for (i = n - 1; i > 0; i--) {
+    fe z;
+    fe_mul(z, recip, scratch[i - 1]);
+    fe_mul(recip, recip, h[i].Z);
+    fe_mul(x, h[i].X, z);
+    fe_mul(y, h[i].Y, z);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+  }
+  fe_mul(x, h[0].X, recip);
+  fe_mul(y, h[0].Y, recip);
+  fe_tobytes(s, y);
+  s[31] ^= fe_isnegative(x) << 7;
+}
+
 /* From sc_reduce.c */
 
 /*
@@ -2036,10 +2070,16 @@ static void ge_cached_cmov(ge_cached *t, const ge_cached *u, unsigned char b) {
 /* Assumes that a[31] <= 127 */
 void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   signed char e[64];
+
+  ge_scalarmult_recode(e, a);
+  ge_scalarmult_recoded(r, e, A);
+}
+
+/* Signed radix 16 recoding of a, as used by ge_scalarmult. Callers
+   multiplying many points by the same scalar can do this once and use
+   ge_scalarmult_recoded for each point. Assumes that a[31] <= 127 */
+void ge_scalarmult_recode(signed char *e, const unsigned char *a) {
   int carry, carry2, i;
-  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
-  ge_p1p1 t;
-  ge_p3 u;
 
   carry = 0; /* 0..1 */
   for (i = 0; i < 31; i++) {
@@ -2053,6 +2093,13 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   carry2 = (carry + 8) >> 4; /* 0..8 */
   e[62] = carry - (carry2 << 4); /* -8..7 */
   e[63] = carry2; /* 0..8 */
+}
+
+void ge_scalarmult_recoded(ge_p2 *r, const signed char *e, const ge_p3 *A) {
+  int i;
+  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
+  ge_p1p1 t;
+  ge_p3 u;
 
   ge_p3_to_cached(&Ai[0], A);
   for (i = 0; i < 7; i++) {
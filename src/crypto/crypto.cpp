@@ -202,6 +202,44 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::generate_key_derivations(const public_key *keys, size_t count, const secret_key &key, key_derivation *derivations, bool *valid) {
+    // The scalar recoding is done once for the whole set, and the results are
+    // normalized KEY_DERIVATION_BATCH at a time so they share one field inversion.
+    // Decompression needs a square root per point and can't be batched that way.
+    static const size_t KEY_DERIVATION_BATCH = 64;
+    signed char e[64];
+    ge_p2 points[KEY_DERIVATION_BATCH];
+    fe scratch[KEY_DERIVATION_BATCH];
+    size_t indices[KEY_DERIVATION_BATCH];
+    unsigned char out[KEY_DERIVATION_BATCH * 32];
+    bool all_valid = true;
+    assert(sc_check(&key) == 0);
+    ge_scalarmult_recode(e, &unwrap(key));
+    size_t i = 0;
+    while (i < count) {
+      size_t n = 0;
+      for (; i < count && n < KEY_DERIVATION_BATCH; ++i) {
+        ge_p3 point;
+        ge_p2 point2;
+        ge_p1p1 point3;
+        valid[i] = ge_frombytes_vartime(&point, &keys[i]) == 0;
+        if (!valid[i]) {
+          all_valid = false;
+          continue;
+        }
+        ge_scalarmult_recoded(&point2, e, &point);
+        ge_mul8(&point3, &point2);
+        ge_p1p1_to_p2(&points[n], &point3);
+        indices[n++] = i;
+      }
+      ge_p2_batch_tobytes(out, points, scratch, n);
+      for (size_t j = 0; j < n; ++j)
+        memcpy(&derivations[indices[j]], out + 32 * j, 32);
+    }
+    memwipe(e, sizeof(e));
+    return all_valid;
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     struct {
       key_derivation derivation;
@@ -64,6 +64,18 @@ namespace cryptonote
       return 1024 * 1024; // 1 MB
     case cryptonote::NOTIFY_GET_TXPOOL_COMPLEMENT::ID:
       return 1024 * 1024 * 4; // 4 MB
+    case cryptonote::NOTIFY_NEW_COMPACT_BLOCK::ID:
+      return 1024 * 1024 * 4; // 4 MB, prefilled transactions are capped well below
+    case cryptonote::NOTIFY_GET_TXPOOL_SKETCH::ID:
+      return 1024 * 1024 * 4; // 4 MB, more than TXPOOL_SKETCH_MAX_CELLS take
+    case cryptonote::NOTIFY_TXPOOL_SKETCH_FAILED::ID:
+      return 4096;
+    case cryptonote::NOTIFY_REQUEST_BLOCK_HEADERS::ID:
+      return 1024 * 1024; // 1 MB
+    case cryptonote::NOTIFY_RESPONSE_BLOCK_HEADERS::ID:
+      return 1024 * 1024 * 16; // 16 MB, more than CURRENCY_PROTOCOL_MAX_HEADERS_RESPONSE_SIZE
+    case cryptonote::NOTIFY_TXPOOL_SKETCH_DECODED::ID:
+      return 4096;
     default:
       break;
     };
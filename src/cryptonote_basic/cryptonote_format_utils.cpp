@@ -30,6 +30,7 @@
 
 #include <atomic>
 #include <boost/algorithm/string.hpp>
+#include "int-util.h"
 #include "wipeable_string.h"
 #include "string_tools.h"
 #include "string_tools_lexical.h"
@@ -1270,6 +1271,20 @@ namespace cryptonote
     return h;
   }
   //---------------------------------------------------------------
+  uint64_t get_transaction_short_id(const crypto::hash& tx_hash, uint64_t salt)
+  {
+    // 48 bit ids, salted so that collisions cannot be made for everyone at once
+    char data[sizeof(salt) + sizeof(tx_hash)];
+    salt = swap64le(salt);
+    memcpy(data, &salt, sizeof(salt));
+    memcpy(data + sizeof(salt), &tx_hash, sizeof(tx_hash));
+    crypto::hash h;
+    crypto::cn_fast_hash(data, sizeof(data), h);
+    uint64_t id;
+    memcpy(&id, &h, sizeof(id));
+    return swap64le(id) & 0xffffffffffffull;
+  }
+  //---------------------------------------------------------------
   bool get_transaction_hash(const transaction& t, crypto::hash& res)
   {
     return get_transaction_hash(t, res, NULL);
@@ -154,7 +154,10 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS                 0x02
+#define P2P_SUPPORT_FLAG_TXPOOL_SKETCH                  0x04
+#define P2P_SUPPORT_FLAG_BLOCK_HEADERS                  0x08
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_TXPOOL_SKETCH | P2P_SUPPORT_FLAG_BLOCK_HEADERS)
 
 #define RPC_IP_FAILS_BEFORE_BLOCK                       3
 
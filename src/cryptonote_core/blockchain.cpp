@@ -56,7 +56,6 @@
 #include "common/notify.h"
 #include "common/varint.h"
 #include "common/pruning.h"
-#include "common/data_cache.h"
 #include "time_helper.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -79,6 +78,9 @@ using epee::string_tools::pod_to_hex;
 extern "C" void slow_hash_allocate_state();
 extern "C" void slow_hash_free_state();
 
+// Only RCT sigs of this type get their verification results cached
+static constexpr const std::uint8_t RCT_CACHE_TYPE = rct::RCTTypeBulletproofPlus;
+
 DISABLE_VS_WARNINGS(4267)
 
 #define MERROR_VER(x) MCERROR("verify", x)
@@ -86,6 +88,33 @@ DISABLE_VS_WARNINGS(4267)
 // used to overestimate the block reward when estimating a per kB to use
 #define BLOCK_REWARD_OVERESTIMATE (10 * 1000000000000)
 
+// a span of blocks being verified ahead of being added, see precompute_incoming_blocks
+struct Blockchain::precomputed_span
+{
+  uint64_t height;                          // height of the first block
+  uint64_t chain_height;                    // chain height when the span was precomputed
+  crypto::hash chain_top;                   // top block hash when the span was precomputed
+  std::vector<block_complete_entry> entries;
+  std::vector<block> blocks;
+  std::vector<crypto::hash> seeds;          // RandomX seeds for the first seeds.size() blocks
+  std::vector<std::unordered_map<crypto::hash, crypto::hash>> longhashes;
+  std::vector<std::vector<crypto::hash>> rct_verified;
+  std::unique_ptr<tools::threadpool::waiter> waiter;
+};
+
+// number of recent top blocks whose metadata is kept for snapshot readers
+#define CHAIN_TIPS_HISTORY_SIZE 64
+
+// the blockchain whose read_snapshot the calling thread holds, if any
+static thread_local const Blockchain *t_read_snapshot = NULL;
+
+// takes m_blockchain_lock, unless the calling thread holds a snapshot, whose
+// db read txn already gives it a consistent view
+#define BLOCKCHAIN_READ_LOCK() \
+  std::unique_lock<epee::critical_section> blockchain_read_lock(m_blockchain_lock, std::defer_lock); \
+  if (!in_read_snapshot()) \
+    blockchain_read_lock.lock()
+
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_reset_timestamps_and_difficulties_height(true), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
@@ -99,6 +128,9 @@ Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_btc_valid(false),
   m_batch_success(true),
   m_prepare_height(0),
+  m_pipeline_block_import(false),
+  m_headers_first_sync(false),
+  m_validated_headers_height(0),
   m_rct_ver_cache()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -110,6 +142,70 @@ Blockchain::~Blockchain()
   catch (const std::exception &e) { /* ignore */ }
 }
 //------------------------------------------------------------------
+Blockchain::read_snapshot::read_snapshot(const Blockchain &blockchain):
+  m_guard(blockchain.m_db), m_previous(t_read_snapshot), m_height(0), m_top_hash(crypto::null_hash)
+{
+  t_read_snapshot = &blockchain;
+  // both read from the txn, so they agree, whatever the writer is doing
+  m_height = blockchain.m_db->height();
+  if (m_height > 0)
+  {
+    m_top_hash = blockchain.m_db->top_block_hash();
+    m_tip = blockchain.find_chain_tip(m_top_hash);
+  }
+}
+//------------------------------------------------------------------
+Blockchain::read_snapshot::~read_snapshot()
+{
+  t_read_snapshot = m_previous;
+}
+//------------------------------------------------------------------
+bool Blockchain::in_read_snapshot() const
+{
+  return t_read_snapshot == this;
+}
+//------------------------------------------------------------------
+void Blockchain::publish_chain_tip()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if (m_db->height() == 0)
+    return;
+
+  auto tip = std::make_shared<chain_tip>();
+  try
+  {
+    tip->top_hash = m_db->top_block_hash(&tip->height);
+    ++tip->height;
+    tip->next_difficulty = get_difficulty_for_next_block();
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to get chain tip metadata: " << e.what());
+    return;
+  }
+  tip->block_weight_limit = m_current_block_cumul_weight_limit;
+  tip->block_weight_median = m_current_block_cumul_weight_median;
+
+  // blocks added in a batch are not visible to readers until it is committed,
+  // so keep the last few tips, not just the current one
+  boost::unique_lock<boost::mutex> lock(m_chain_tips_lock);
+  if (!m_chain_tips.empty() && m_chain_tips.back()->top_hash == tip->top_hash)
+    m_chain_tips.pop_back();
+  m_chain_tips.push_back(std::move(tip));
+  while (m_chain_tips.size() > CHAIN_TIPS_HISTORY_SIZE)
+    m_chain_tips.pop_front();
+}
+//------------------------------------------------------------------
+std::shared_ptr<const Blockchain::chain_tip> Blockchain::find_chain_tip(const crypto::hash &top_hash) const
+{
+  boost::unique_lock<boost::mutex> lock(m_chain_tips_lock);
+  for (auto it = m_chain_tips.rbegin(); it != m_chain_tips.rend(); ++it)
+    if ((*it)->top_hash == top_hash)
+      return *it;
+  return nullptr;
+}
+//------------------------------------------------------------------
 bool Blockchain::have_tx(const crypto::hash &id) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -130,11 +226,18 @@ bool Blockchain::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
   return  m_db->has_key_image(key_im);
 }
 //------------------------------------------------------------------
+void Blockchain::have_key_images_as_spent(const epee::span<const crypto::key_image> &key_images, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // WARNING: this function does not take m_blockchain_lock, see have_tx_keyimg_as_spent
+  m_db->has_key_images(key_images, spent);
+}
+//------------------------------------------------------------------
 // This function makes sure that each "input" in an input (mixins) exists
 // and collects the public key for each from the transaction it was included in
 // via the visitor passed to it.
 template <class visitor_t>
-bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height) const
+bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height, const std::vector<output_data_t> *ring_outputs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -163,6 +266,11 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
       found = true;
     }
   }
+  if (!found && ring_outputs && ring_outputs->size() == absolute_offsets.size())
+  {
+    outputs = *ring_outputs;
+    found = true;
+  }
 
   if (!found)
   {
@@ -265,6 +373,45 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::get_ring_outputs(const transaction &tx, std::vector<std::vector<output_data_t>> &ring_outputs) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  ring_outputs.clear();
+  ring_outputs.resize(tx.vin.size());
+
+  std::vector<uint64_t> amounts, offsets;
+  std::vector<size_t> ring_sizes;
+  ring_sizes.reserve(tx.vin.size());
+  for (const auto &txin: tx.vin)
+  {
+    if (txin.type() != typeid(txin_to_key))
+      return;
+    const txin_to_key &in_to_key = boost::get<txin_to_key>(txin);
+    const std::vector<uint64_t> absolute_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
+    amounts.insert(amounts.end(), absolute_offsets.size(), in_to_key.amount);
+    offsets.insert(offsets.end(), absolute_offsets.begin(), absolute_offsets.end());
+    ring_sizes.push_back(absolute_offsets.size());
+  }
+  if (offsets.empty())
+    return;
+
+  std::vector<output_data_t> outputs;
+  try
+  {
+    m_db->get_output_key(epee::span<const uint64_t>(amounts.data(), amounts.size()), offsets, outputs, true);
+  }
+  catch (const std::exception &e)
+  {
+    MDEBUG("Failed to get ring members for tx " << get_transaction_hash(tx) << ": " << e.what());
+    return;
+  }
+
+  // partial results stop at the first missing output, inputs from there on are left empty
+  size_t start = 0;
+  for (size_t i = 0; i < ring_sizes.size() && start + ring_sizes[i] <= outputs.size(); start += ring_sizes[i++])
+    ring_outputs[i].assign(outputs.begin() + start, outputs.begin() + start + ring_sizes[i]);
+}
+//------------------------------------------------------------------
 uint64_t Blockchain::get_current_blockchain_height() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -457,6 +604,7 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
     if (!update_next_cumulative_weight_limit())
       return false;
   }
+  publish_chain_tip();
 
   if (m_hardfork->get_current_version() >= RX_BLOCK_VERSION)
   {
@@ -519,6 +667,9 @@ bool Blockchain::deinit()
   m_async_pool.join_all();
   m_async_service.stop();
 
+  // the next span of incoming blocks may still be being verified
+  drop_precomputed_span();
+
   // as this should be called if handling a SIGSEGV, need to check
   // if m_db is a NULL pointer (and thus may have caused the illegal
   // memory operation), otherwise we may cause a loop.
@@ -579,6 +730,7 @@ void Blockchain::pop_blocks(uint64_t nblocks)
 
   if (stop_batch)
     m_db->batch_stop();
+  publish_chain_tip();
 
   if (m_hardfork->get_current_version() >= RX_BLOCK_VERSION)
   {
@@ -698,7 +850,7 @@ bool Blockchain::reset_and_set_genesis_block(const block& b)
 crypto::hash Blockchain::get_tail_id(uint64_t& height) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
   return m_db->top_block_hash(&height);
 }
 //------------------------------------------------------------------
@@ -803,7 +955,7 @@ crypto::hash Blockchain::get_pending_block_id_by_height(uint64_t height) const
 bool Blockchain::get_block_by_hash(const crypto::hash &h, block &blk, bool *orphan) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
 
   // try to find block in main chain
   try
@@ -2153,7 +2305,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata,block>>& blocks, std::vector<cryptonote::blobdata>& txs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
   if(start_offset >= m_db->height())
     return false;
 
@@ -2175,7 +2327,7 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
 bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata,block>>& blocks) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
   const uint64_t height = m_db->height();
   if(start_offset >= height)
     return false;
@@ -2193,6 +2345,25 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, size_t max_size) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  BLOCKCHAIN_READ_LOCK();
+  db_rtxn_guard rtxn_guard(m_db);
+  size_t size = 0;
+  for (const crypto::hash &id: arg.blocks)
+  {
+    uint64_t height;
+    if (!m_db->block_exists(id, &height))
+      break;
+    blobdata blob = m_db->get_block_blob_from_height(height);
+    size += blob.size();
+    if (size > max_size && !rsp.headers.empty())
+      break;
+    rsp.headers.push_back(std::move(blob));
+  }
+}
+//------------------------------------------------------------------
 //TODO: This function *looks* like it won't need to be rewritten
 //      to use BlockchainDB, as it calls other functions that were,
 //      but it warrants some looking into later.
@@ -2274,7 +2445,7 @@ bool Blockchain::get_alternative_blocks(std::vector<block>& blocks) const
 size_t Blockchain::get_alternative_blocks_count() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
   return m_db->get_alt_block_count();
 }
 //------------------------------------------------------------------
@@ -2308,7 +2479,7 @@ crypto::public_key Blockchain::get_output_key(uint64_t amount, uint64_t global_i
 bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
 
   res.outs.clear();
   res.outs.reserve(req.outputs.size());
@@ -2392,12 +2563,10 @@ bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height,
     return false;
   if (amount == 0)
   {
-    std::vector<uint64_t> heights;
-    heights.reserve(to_height + 1 - start_height);
     const uint64_t real_start_height = start_height > 0 ? start_height-1 : start_height;
-    for (uint64_t h = real_start_height; h <= to_height; ++h)
-      heights.push_back(h);
-    distribution = m_db->get_block_cumulative_rct_outputs(heights);
+    if (to_height < real_start_height)
+      return true;
+    distribution = m_db->get_rct_output_distribution(real_start_height, to_height + 1 - real_start_height);
     if (start_height > 0)
     {
       base = distribution[0];
@@ -2495,7 +2664,7 @@ template<class t_ids_container, class t_blocks_container, class t_missed_contain
 bool Blockchain::get_blocks(const t_ids_container& block_ids, t_blocks_container& blocks, t_missed_container& missed_bs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
 
   reserve_container(blocks, block_ids.size());
   for (const auto& block_hash : block_ids)
@@ -2580,7 +2749,7 @@ static bool fill(BlockchainDB *db, const crypto::hash &tx_hash, tx_blob_entry &t
 bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::blobdata>& txs, std::vector<crypto::hash>& missed_txs, bool pruned) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
 
   txs.reserve(txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2604,7 +2773,7 @@ bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>& txs_ids
 bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>& txs_ids, std::vector<tx_blob_entry>& txs, std::vector<crypto::hash>& missed_txs, bool pruned) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
 
   txs.reserve(txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2640,7 +2809,7 @@ template<class t_ids_container, class t_tx_container, class t_missed_container>
 bool Blockchain::get_split_transactions_blobs(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
 
   reserve_container(txs, txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2674,7 +2843,7 @@ template<class t_ids_container, class t_tx_container, class t_missed_container>
 bool Blockchain::get_transactions(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs, bool pruned) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
 
   reserve_container(txs, txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2771,6 +2940,40 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
+  if (!find_supplement_start(req_start_block, qblock_ids, total_height, top_hash, start_height))
+    return false;
+
+  db_rtxn_guard rtxn_guard(m_db);
+  top_hash = m_db->top_block_hash(&total_height);
+  ++total_height;
+  blocks.reserve(std::min(std::min(max_block_count, (size_t)10000), (size_t)(total_height - start_height)));
+  CHECK_AND_ASSERT_MES(m_db->get_blocks_from(start_height, 3, max_block_count, max_tx_count, FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE, blocks, pruned, true, get_miner_tx_hash),
+      false, "Error getting blocks");
+
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count, const std::function<bool(const std::vector<block_blob_refs_t>&)> &f) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  if (!find_supplement_start(req_start_block, qblock_ids, total_height, top_hash, start_height))
+    return false;
+
+  // the blobs point into the db, they stay valid as long as this read txn
+  db_rtxn_guard rtxn_guard(m_db);
+  top_hash = m_db->top_block_hash(&total_height);
+  ++total_height;
+  std::vector<block_blob_refs_t> blocks;
+  CHECK_AND_ASSERT_MES(m_db->get_blocks_from(start_height, 3, max_block_count, max_tx_count, FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE, blocks, pruned, true, get_miner_tx_hash),
+      false, "Error getting blocks");
+
+  return f(blocks);
+}
+//------------------------------------------------------------------
+bool Blockchain::find_supplement_start(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height) const
+{
   // if a specific start height has been requested
   if(req_start_block > 0)
   {
@@ -2790,14 +2993,6 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
       return false;
     }
   }
-
-  db_rtxn_guard rtxn_guard(m_db);
-  top_hash = m_db->top_block_hash(&total_height);
-  ++total_height;
-  blocks.reserve(std::min(std::min(max_block_count, (size_t)10000), (size_t)(total_height - start_height)));
-  CHECK_AND_ASSERT_MES(m_db->get_blocks_from(start_height, 3, max_block_count, max_tx_count, FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE, blocks, pruned, true, get_miner_tx_hash),
-      false, "Error getting blocks");
-
   return true;
 }
 //------------------------------------------------------------------
@@ -2950,7 +3145,7 @@ bool Blockchain::check_for_double_spend(const transaction& tx, key_images_contai
 bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes, std::vector<std::vector<uint64_t>>& indexs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
   uint64_t tx_index;
   if (!m_db->tx_exists(tx_id, tx_index))
   {
@@ -2966,7 +3161,7 @@ bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes
 bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_READ_LOCK();
   uint64_t tx_index;
   if (!m_db->tx_exists(tx_id, tx_index))
   {
@@ -3208,13 +3403,16 @@ bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context
 bool Blockchain::have_tx_keyimges_as_spent(const transaction &tx) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  std::vector<crypto::key_image> key_images;
+  key_images.reserve(tx.vin.size());
   for (const txin_v& in: tx.vin)
   {
     CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, in_to_key, true);
-    if(have_tx_keyimg_as_spent(in_to_key.k_image))
-      return true;
+    key_images.push_back(in_to_key.k_image);
   }
-  return false;
+  std::vector<bool> spent;
+  have_key_images_as_spent(epee::to_span(key_images), spent);
+  return std::find(spent.begin(), spent.end(), true) != spent.end();
 }
 bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &pubkeys)
 {
@@ -3465,6 +3663,21 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
   uint64_t max_used_block_height = 0;
   if (!pmax_used_block_height)
     pmax_used_block_height = &max_used_block_height;
+
+  // one lookup for all the key images, the inputs are checked to be txin_to_key below
+  std::vector<crypto::key_image> key_images;
+  key_images.reserve(tx.vin.size());
+  for (const auto& txin : tx.vin)
+    if (txin.type() == typeid(txin_to_key))
+      key_images.push_back(boost::get<txin_to_key>(txin).k_image);
+  std::vector<bool> spent;
+  have_key_images_as_spent(epee::to_span(key_images), spent);
+
+  // likewise for the ring members, unless they were gathered with the rest of their block
+  std::vector<std::vector<output_data_t>> ring_outputs;
+  if (m_scan_table.find(tx_prefix_hash) == m_scan_table.end())
+    get_ring_outputs(tx, ring_outputs);
+
   for (const auto& txin : tx.vin)
   {
     // make sure output being spent is of type txin_to_key, rather than
@@ -3475,7 +3688,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     // make sure tx output has key offset(s) (is signed to be used)
     CHECK_AND_ASSERT_MES(in_to_key.key_offsets.size(), false, "empty in_to_key.key_offsets in transaction with id " << get_transaction_hash(tx));
 
-    if(have_tx_keyimg_as_spent(in_to_key.k_image))
+    if(spent[sig_index])
     {
       MERROR_VER("Key image already spent in blockchain: " << epee::string_tools::pod_to_hex(in_to_key.k_image));
       tvc.m_double_spend = true;
@@ -3490,7 +3703,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
     // make sure that output being spent matches up correctly with the
     // signature spending it.
-    if (!check_tx_input(tx.version, in_to_key, tx_prefix_hash, tx.version == 1 ? tx.signatures[sig_index] : std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height, hf_version))
+    if (!check_tx_input(tx.version, in_to_key, tx_prefix_hash, tx.version == 1 ? tx.signatures[sig_index] : std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height, hf_version, ring_outputs.empty() ? NULL : &ring_outputs[sig_index]))
     {
       MERROR_VER("Failed to check ring signature for tx " << get_transaction_hash(tx) << "  vin key with k_image: " << in_to_key.k_image << "  sig_index: " << sig_index);
       if (pmax_used_block_height) // a default value of NULL is used when called from Blockchain::handle_block_to_main_chain()
@@ -3540,7 +3753,6 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
   }
 
   // Warn that new RCT types are present, and thus the cache is not being used effectively
-  static constexpr const std::uint8_t RCT_CACHE_TYPE = rct::RCTTypeBulletproofPlus;
   if (tx.rct_signatures.type > RCT_CACHE_TYPE)
   {
     MWARNING("RCT cache is not caching new verification results. Please update RCT_CACHE_TYPE!");
@@ -3857,7 +4069,7 @@ bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time, uint8_t hf_versi
 // This function locates all outputs associated with a given input (mixins)
 // and validates that they exist and are usable.  It also checks the ring
 // signature for each input.
-bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version) const
+bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version, const std::vector<output_data_t> *ring_outputs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -3899,7 +4111,7 @@ bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, cons
 
   // collect output keys
   outputs_visitor vi(output_keys, *this, hf_version);
-  if (!scan_outputkeys_for_indexes(tx_version, txin, vi, tx_prefix_hash, pmax_related_block_height))
+  if (!scan_outputkeys_for_indexes(tx_version, txin, vi, tx_prefix_hash, pmax_related_block_height, ring_outputs))
   {
     MERROR_VER("Failed to get output keys for tx with amount = " << print_money(txin.amount) << " and count indexes " << txin.key_offsets.size());
     return false;
@@ -4425,7 +4637,7 @@ leave:
 
   // appears to be a NOP *and* is called elsewhere.  wat?
   m_tx_pool.on_blockchain_inc(new_height, id);
-  get_difficulty_for_next_block(); // just to cache it
+  publish_chain_tip(); // also caches the next difficulty
   invalidate_block_template_cache();
 
   const uint8_t new_hf_version = get_current_hard_fork_version();
@@ -4704,6 +4916,12 @@ void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const b
     if (m_cancel)
        break;
     crypto::hash id = get_block_hash(block);
+    // already hashed while the previous span was being added
+    if (m_blocks_longhash_table.find(id) != m_blocks_longhash_table.end())
+    {
+      ++height;
+      continue;
+    }
     crypto::hash pow = get_block_longhash(this, block, height++, 0);
     map.emplace(id, pow);
   }
@@ -4712,6 +4930,303 @@ void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const b
   TIME_MEASURE_FINISH(t);
 }
 
+//------------------------------------------------------------------
+void Blockchain::block_longhash_seeded_worker(uint64_t height, const epee::span<const block> &blocks, const epee::span<const crypto::hash> &seeds, std::unordered_map<crypto::hash, crypto::hash> &map) const
+{
+  TIME_MEASURE_START(t);
+  slow_hash_allocate_state();
+
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (m_cancel)
+       break;
+    crypto::hash id = get_block_hash(blocks[i]);
+    crypto::hash pow = get_block_longhash(this, blocks[i], height++, &seeds[i], 0);
+    map.emplace(id, pow);
+  }
+
+  slow_hash_free_state();
+  TIME_MEASURE_FINISH(t);
+}
+
+//------------------------------------------------------------------
+static bool is_rct_span_batchable(const rct::rctSig &rv)
+{
+  // same layout requirements as the semantics checks done on tx admission
+  switch (rv.type)
+  {
+    case rct::RCTTypeBulletproof:
+    case rct::RCTTypeBulletproof2:
+    case rct::RCTTypeCLSAG:
+      return rv.p.bulletproofs.size() == 1 && !rv.p.bulletproofs[0].V.empty() && rv.p.bulletproofs[0].V.size() <= BULLETPROOF_MAX_OUTPUTS;
+    case rct::RCTTypeBulletproofPlus:
+      return rv.p.bulletproofs_plus.size() == 1 && !rv.p.bulletproofs_plus[0].V.empty() && rv.p.bulletproofs_plus[0].V.size() <= BULLETPROOF_PLUS_MAX_OUTPUTS;
+    default:
+      return false;
+  }
+}
+
+//------------------------------------------------------------------
+static void parse_rct_span(const epee::span<const blobdata* const> &tx_blobs, std::vector<transaction> &txs, const std::atomic<bool> &cancel)
+{
+  txs.reserve(tx_blobs.size());
+  for (const blobdata *blob : tx_blobs)
+  {
+    if (cancel)
+      return;
+    transaction tx;
+    if (!parse_and_validate_tx_from_blob(*blob, tx))
+      continue; // will be rejected when the block's txes are handled
+    if (tx.version < 2 || !is_rct_span_batchable(tx.rct_signatures))
+      continue;
+    txs.push_back(std::move(tx));
+  }
+}
+
+//------------------------------------------------------------------
+// one multiexp for all the range proofs not already known to be good
+static std::vector<bool> verify_rct_span_semantics(std::vector<transaction> &txs, const std::unordered_set<crypto::hash> &preverified)
+{
+  std::vector<bool> good(txs.size(), true);
+  std::vector<size_t> pending;
+  std::vector<const rct::rctSig*> rvv;
+  pending.reserve(txs.size());
+  rvv.reserve(txs.size());
+  for (size_t i = 0; i < txs.size(); ++i)
+  {
+    if (preverified.find(get_transaction_hash(txs[i])) != preverified.end())
+      continue;
+    pending.push_back(i);
+    rvv.push_back(&txs[i].rct_signatures);
+  }
+  if (!rvv.empty() && !rct::verRctSemanticsSimple(rvv))
+  {
+    MDEBUG("Batch RCT semantics check failed for " << rvv.size() << " txes from incoming blocks, verifying one at a time");
+    for (size_t i: pending)
+      good[i] = pending.size() > 1 && rct::verRctSemanticsSimple(txs[i].rct_signatures);
+  }
+  return good;
+}
+
+//------------------------------------------------------------------
+void Blockchain::rct_span_semantics_worker(const epee::span<const blobdata* const> &tx_blobs, std::vector<crypto::hash> &verified) const
+{
+  std::vector<transaction> txs;
+  parse_rct_span(tx_blobs, txs, m_cancel);
+  if (txs.empty() || m_cancel)
+    return;
+  const std::vector<bool> good = verify_rct_span_semantics(txs, {});
+  for (size_t i = 0; i < txs.size(); ++i)
+    if (good[i])
+      verified.push_back(get_transaction_hash(txs[i]));
+}
+
+//------------------------------------------------------------------
+void Blockchain::rct_span_verify_worker(const epee::span<const blobdata* const> &tx_blobs, std::vector<crypto::hash> &verified) const
+{
+  TIME_MEASURE_START(t);
+
+  std::vector<transaction> txs;
+  parse_rct_span(tx_blobs, txs, m_cancel);
+  if (txs.empty() || m_cancel)
+    return;
+
+  // semantics of txes from a precomputed span are already in m_rct_semantics_preverified
+  const std::vector<bool> good = verify_rct_span_semantics(txs, m_rct_semantics_preverified);
+
+  for (size_t i = 0; i < txs.size(); ++i)
+  {
+    if (m_cancel)
+      return;
+    if (!good[i])
+      continue;
+    transaction &tx = txs[i];
+    verified.push_back(get_transaction_hash(tx));
+
+    // older types are not cached, check_tx_inputs would verify them all over again
+    if (tx.rct_signatures.type != RCT_CACHE_TYPE)
+      continue;
+
+    // ring signatures can only be checked if the whole ring was already in the db
+    const auto its = m_scan_table.find(get_transaction_prefix_hash(tx));
+    if (its == m_scan_table.end())
+      continue;
+    rct::ctkeyM mix_ring;
+    mix_ring.reserve(tx.vin.size());
+    for (const auto &txin : tx.vin)
+    {
+      const txin_to_key *in_to_key = boost::get<txin_to_key>(&txin);
+      if (!in_to_key)
+        break;
+      const auto it = its->second.find(in_to_key->k_image);
+      if (it == its->second.end() || it->second.size() != in_to_key->key_offsets.size())
+        break;
+      mix_ring.emplace_back();
+      mix_ring.back().reserve(it->second.size());
+      for (const output_data_t &output : it->second)
+        mix_ring.back().push_back(rct::ctkey({rct::pk2rct(output.pubkey), output.commitment}));
+    }
+    if (mix_ring.size() != tx.vin.size())
+      continue;
+
+    // a hit in check_tx_inputs requires the same tx and mix ring, so caching here is safe
+    if (!ver_rct_non_semantics_simple_cached(tx, mix_ring, m_rct_ver_cache, RCT_CACHE_TYPE))
+      MDEBUG("Ring signature check failed for tx " << get_transaction_hash(tx) << " from incoming blocks");
+  }
+
+  TIME_MEASURE_FINISH(t);
+  MDEBUG("Verified RCT proofs of " << txs.size() << " txes from incoming blocks in " << t << " ms");
+}
+
+//------------------------------------------------------------------
+bool Blockchain::is_rct_semantics_preverified(const crypto::hash &txid) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_rct_semantics_preverified.find(txid) != m_rct_semantics_preverified.end();
+}
+
+//------------------------------------------------------------------
+void Blockchain::precompute_incoming_blocks(uint64_t height, std::vector<block_complete_entry> blocks_entry)
+{
+  if (!m_pipeline_block_import || blocks_entry.empty())
+    return;
+
+  drop_precomputed_span();
+
+  std::unique_ptr<precomputed_span> span(new precomputed_span());
+  span->height = height;
+  span->blocks.resize(blocks_entry.size());
+  for (size_t i = 0; i < blocks_entry.size(); ++i)
+  {
+    if (!parse_and_validate_block_from_blob(blocks_entry[i].block, span->blocks[i]))
+      return; // will be rejected when its turn comes
+  }
+
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    span->chain_height = m_db->height();
+    if (height < span->chain_height || height + blocks_entry.size() < m_blocks_hash_check.size())
+      return;
+    span->chain_top = m_db->top_block_hash();
+
+    // seed heights only go up, so once a seed is not in the chain yet, the remaining
+    // blocks are left for prepare_handle_incoming_blocks
+    for (size_t i = 0; i < span->blocks.size(); ++i)
+    {
+      crypto::hash seed = crypto::null_hash;
+      if (span->blocks[i].major_version >= RX_BLOCK_VERSION)
+      {
+        const uint64_t seed_height = rx_seedheight(height + i);
+        if (seed_height >= span->chain_height)
+          break;
+        seed = m_db->get_block_hash_from_height(seed_height);
+      }
+      span->seeds.push_back(seed);
+    }
+  }
+
+  span->entries = std::move(blocks_entry);
+  tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+  span->waiter.reset(new tools::threadpool::waiter(tpool));
+  // not a leaf, the worker splits the span between pool threads
+  tpool.submit(span->waiter.get(), boost::bind(&Blockchain::precompute_span_worker, this, std::ref(*span)));
+
+  MDEBUG("Precomputing " << span->blocks.size() << " incoming blocks at height " << height);
+  boost::unique_lock<boost::mutex> lock(m_precomputed_span_lock);
+  m_precomputed_span = std::move(span);
+}
+
+//------------------------------------------------------------------
+void Blockchain::precompute_span_worker(precomputed_span &span) const
+{
+  TIME_MEASURE_START(t);
+  tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+  tools::threadpool::waiter waiter(tpool);
+
+  size_t threads = std::min<size_t>(tpool.get_max_concurrency(), m_max_prepare_blocks_threads);
+  const size_t nhashes = span.seeds.size();
+  if (nhashes > 0 && threads > 0)
+  {
+    const size_t batch_size = (nhashes + threads - 1) / threads;
+    span.longhashes.resize(threads);
+    for (size_t i = 0, start = 0; i < threads && start < nhashes; ++i, start += batch_size)
+    {
+      const size_t nblocks = std::min(batch_size, nhashes - start);
+      tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_seeded_worker, this, span.height + start,
+          epee::span<const block>(&span.blocks[start], nblocks), epee::span<const crypto::hash>(&span.seeds[start], nblocks),
+          std::ref(span.longhashes[i])), true);
+    }
+  }
+
+  std::vector<const blobdata*> rct_tx_blobs;
+  for (const auto &entry : span.entries)
+  {
+    if (entry.pruned)
+      continue;
+    for (const auto &tx_blob : entry.txs)
+      rct_tx_blobs.push_back(&tx_blob.blob);
+  }
+  if (!rct_tx_blobs.empty())
+  {
+    threads = std::min<size_t>(tpool.get_max_concurrency(), rct_tx_blobs.size());
+    const size_t batch_size = (rct_tx_blobs.size() + threads - 1) / threads;
+    span.rct_verified.resize(threads);
+    for (size_t i = 0, start = 0; i < threads && start < rct_tx_blobs.size(); ++i, start += batch_size)
+    {
+      const size_t nblobs = std::min(batch_size, rct_tx_blobs.size() - start);
+      // not a leaf, RCT verification submits to the pool itself
+      tpool.submit(&waiter, boost::bind(&Blockchain::rct_span_semantics_worker, this, epee::span<const blobdata* const>(&rct_tx_blobs[start], nblobs), std::ref(span.rct_verified[i])));
+    }
+  }
+
+  if (!waiter.wait())
+    throw std::runtime_error("Failed to precompute incoming blocks");
+  TIME_MEASURE_FINISH(t);
+  if (m_show_time_stats)
+    MDEBUG("Precomputed " << nhashes << "/" << span.blocks.size() << " block hashes and " << rct_tx_blobs.size() << " txes at height " << span.height << " in " << t << " ms");
+}
+
+//------------------------------------------------------------------
+std::unique_ptr<Blockchain::precomputed_span> Blockchain::take_precomputed_span(uint64_t height)
+{
+  std::unique_ptr<precomputed_span> span;
+  {
+    boost::unique_lock<boost::mutex> lock(m_precomputed_span_lock);
+    span = std::move(m_precomputed_span);
+  }
+  if (!span)
+    return span;
+
+  if (!span->waiter->wait())
+  {
+    MDEBUG("Precomputing incoming blocks at height " << span->height << " failed, dropping");
+    span.reset();
+  }
+  else if (span->height != height)
+  {
+    MDEBUG("Precomputed incoming blocks are for height " << span->height << ", not " << height << ", dropping");
+    span.reset();
+  }
+  else if (m_db->height() < span->chain_height || m_db->get_block_hash_from_height(span->chain_height - 1) != span->chain_top)
+  {
+    MDEBUG("Chain was reorganized since incoming blocks at height " << span->height << " were precomputed, dropping");
+    span.reset();
+  }
+  return span;
+}
+
+//------------------------------------------------------------------
+void Blockchain::drop_precomputed_span()
+{
+  std::unique_ptr<precomputed_span> span;
+  {
+    boost::unique_lock<boost::mutex> lock(m_precomputed_span_lock);
+    span = std::move(m_precomputed_span);
+  }
+  if (span)
+    span->waiter->wait();
+}
+
 //------------------------------------------------------------------
 bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 {
@@ -4733,7 +5248,11 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
       }
     }
     else
+    {
       m_db->batch_abort();
+      // the next span was precomputed on top of blocks which are now gone
+      drop_precomputed_span();
+    }
     success = true;
   }
   catch (const std::exception &e)
@@ -4773,6 +5292,9 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   m_blocks_longhash_table.clear();
   m_scan_table.clear();
   m_blocks_txs_check.clear();
+  m_rct_semantics_preverified.clear();
+
+  trim_validated_headers();
 
   // when we're well clear of the precomputed hashes, free the memory
   if (!m_blocks_hash_check.empty() && m_db->height() > m_blocks_hash_check.size() + 4096)
@@ -4927,6 +5449,215 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
   return usable;
 }
 
+uint64_t Blockchain::get_validated_headers_height() const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t db_height = m_db->height();
+  if (m_validated_headers.empty() || m_validated_headers_height > db_height)
+    return db_height;
+  return std::max<uint64_t>(db_height, m_validated_headers_height + m_validated_headers.size());
+}
+
+uint64_t Blockchain::get_checked_headers_height(uint64_t height, const std::vector<std::pair<crypto::hash, uint64_t>> &ids) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t db_height = m_db->height();
+  if (m_validated_headers.empty() || m_validated_headers_height > db_height)
+    return db_height;
+  const uint64_t top = m_validated_headers_height + m_validated_headers.size();
+  for (uint64_t h = std::max(height, db_height); h < top && h - height < ids.size(); ++h)
+  {
+    const crypto::hash &id = m_validated_headers[h - m_validated_headers_height].id;
+    if (ids[h - height].first != id)
+    {
+      MDEBUG("Block " << ids[h - height].first << " at " << h << " is not the one of the validated header, " << id);
+      return db_height;
+    }
+  }
+  return std::max(db_height, top);
+}
+
+void Blockchain::trim_validated_headers()
+{
+  if (m_validated_headers.empty())
+    return;
+  const uint64_t db_height = m_db->height();
+  while (!m_validated_headers.empty() && m_validated_headers_height < db_height)
+  {
+    m_validated_headers.pop_front();
+    ++m_validated_headers_height;
+  }
+  if (!m_validated_headers.empty() && m_validated_headers_height == db_height && m_validated_headers.front().prev_id == m_db->top_block_hash())
+    return;
+  if (!m_validated_headers.empty())
+    MDEBUG("Dropping " << m_validated_headers.size() << " validated block headers at " << m_validated_headers_height << ", the chain went another way");
+  m_validated_headers.clear();
+  m_validated_headers_height = 0;
+}
+
+bool Blockchain::prevalidate_block_headers(uint64_t height, const std::vector<blobdata> &headers, const std::vector<crypto::hash> &hashes, uint64_t &nvalidated)
+{
+  // headers are the block blobs without the txes, ie, header, miner tx and tx hashes,
+  // which is all the proof of work commits to
+  nvalidated = 0;
+  CHECK_AND_ASSERT_MES(headers.size() == hashes.size(), false, "Unexpected hashes size");
+  if (headers.empty() || height == 0)
+    return true;
+
+  TIME_MEASURE_START(t);
+  std::vector<block> blocks(headers.size());
+  for (size_t i = 0; i < headers.size(); ++i)
+  {
+    crypto::hash id;
+    if (!parse_and_validate_block_from_blob(headers[i], blocks[i], id))
+    {
+      MERROR_VER("Failed to parse block header at height " << height + i);
+      return false;
+    }
+    if (id != hashes[i])
+    {
+      MERROR_VER("Block header at height " << height + i << " has hash " << id << ", expected " << hashes[i]);
+      return false;
+    }
+    if (i > 0 && blocks[i].prev_id != hashes[i - 1])
+    {
+      MERROR_VER("Block header " << id << " at height " << height + i << " does not build on the previous one");
+      return false;
+    }
+  }
+
+  std::vector<crypto::hash> seeds(blocks.size(), crypto::null_hash);
+  std::vector<difficulty_type> difficulties(blocks.size());
+  std::vector<difficulty_type> cumulative_difficulties(blocks.size());
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    trim_validated_headers();
+    const uint64_t db_height = m_db->height();
+    const uint64_t top = m_validated_headers.empty() ? db_height : m_validated_headers_height + m_validated_headers.size();
+    const auto get_id = [&](uint64_t h) { return h < db_height ? m_db->get_block_hash_from_height(h) : m_validated_headers[h - m_validated_headers_height].id; };
+    if (height != top || blocks.front().prev_id != get_id(height - 1))
+    {
+      MDEBUG("Block headers at " << height << " do not build on the validated ones, up to " << top);
+      return true;
+    }
+
+    // difficulties follow from the timestamps, same as get_next_difficulty_for_alternative_chain
+    std::vector<uint64_t> window_timestamps;
+    std::vector<difficulty_type> window_cumulative_difficulties;
+    uint64_t start = height - std::min<uint64_t>(height, DIFFICULTY_BLOCKS_COUNT);
+    if (start == 0)
+      ++start; // skip genesis block
+    for (uint64_t h = start; h < height; ++h)
+    {
+      if (h < db_height)
+      {
+        window_timestamps.push_back(m_db->get_block_timestamp(h));
+        window_cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(h));
+      }
+      else
+      {
+        const validated_header &header = m_validated_headers[h - m_validated_headers_height];
+        window_timestamps.push_back(header.timestamp);
+        window_cumulative_difficulties.push_back(header.cumulative_difficulty);
+      }
+    }
+    difficulty_type cumulative_difficulty = height - 1 < db_height ? m_db->get_block_cumulative_difficulty(height - 1) : m_validated_headers.back().cumulative_difficulty;
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      const uint64_t block_height = height + i;
+      const uint8_t hf_version = get_ideal_hard_fork_version(block_height);
+      if (!prevalidate_miner_transaction(blocks[i], block_height, hf_version))
+      {
+        MERROR_VER("Block header " << hashes[i] << " at height " << block_height << " has an invalid miner transaction");
+        return false;
+      }
+
+      if (m_fixed_difficulty)
+        difficulties[i] = m_fixed_difficulty;
+      else
+        difficulties[i] = next_difficulty(window_timestamps, window_cumulative_difficulties, hf_version < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2);
+      CHECK_AND_ASSERT_MES(difficulties[i], false, "!!!!!!! DIFFICULTY OVERHEAD !!!!!!!");
+      cumulative_difficulty += difficulties[i];
+      cumulative_difficulties[i] = cumulative_difficulty;
+      window_timestamps.push_back(blocks[i].timestamp);
+      window_cumulative_difficulties.push_back(cumulative_difficulty);
+      if (window_timestamps.size() > DIFFICULTY_BLOCKS_COUNT)
+      {
+        window_timestamps.erase(window_timestamps.begin());
+        window_cumulative_difficulties.erase(window_cumulative_difficulties.begin());
+      }
+
+      // seeds are far enough behind to be in the chain, the validated headers, or these
+      if (blocks[i].major_version >= RX_BLOCK_VERSION)
+      {
+        const uint64_t seed_height = rx_seedheight(block_height);
+        seeds[i] = seed_height < height ? get_id(seed_height) : hashes[seed_height - height];
+      }
+    }
+  }
+
+  // hash in parallel, splitting each seed epoch between the threads, so that
+  // none has to switch RandomX seed within its batch
+  tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+  const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), m_max_prepare_blocks_threads));
+  std::vector<std::pair<size_t, size_t>> batches;
+  for (size_t start = 0, end; start < blocks.size(); start = end)
+  {
+    for (end = start + 1; end < blocks.size() && seeds[end] == seeds[start]; ++end);
+    const size_t batch_size = (end - start + threads - 1) / threads;
+    for (size_t i = start; i < end; i += batch_size)
+      batches.push_back(std::make_pair(i, std::min(batch_size, end - i)));
+  }
+  std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(batches.size());
+  tools::threadpool::waiter waiter(tpool);
+  for (size_t i = 0; i < batches.size(); ++i)
+  {
+    const size_t start = batches[i].first, nblocks = batches[i].second;
+    tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_seeded_worker, this, height + start,
+        epee::span<const block>(&blocks[start], nblocks), epee::span<const crypto::hash>(&seeds[start], nblocks),
+        std::ref(maps[i])), true);
+  }
+  if (!waiter.wait())
+    return false;
+  if (m_cancel)
+    return true;
+
+  std::vector<crypto::hash> pows(blocks.size());
+  for (size_t i = 0, batch = 0; i < blocks.size(); ++i)
+  {
+    if (i >= batches[batch].first + batches[batch].second)
+      ++batch;
+    const auto it = maps[batch].find(hashes[i]);
+    CHECK_AND_ASSERT_MES(it != maps[batch].end(), false, "Block header " << hashes[i] << " was not hashed");
+    if (!check_hash(it->second, difficulties[i]))
+    {
+      MERROR_VER("Block header " << hashes[i] << " at height " << height + i << " does not have enough proof of work: " << it->second << ", difficulty " << difficulties[i]);
+      return false;
+    }
+    pows[i] = it->second;
+  }
+
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  trim_validated_headers();
+  const uint64_t top = m_validated_headers.empty() ? m_db->height() : m_validated_headers_height + m_validated_headers.size();
+  const crypto::hash top_hash = m_validated_headers.empty() ? m_db->top_block_hash() : m_validated_headers.back().id;
+  if (height != top || blocks.front().prev_id != top_hash)
+  {
+    MDEBUG("The chain moved on while block headers at " << height << " were checked, not keeping them");
+    return true;
+  }
+  if (m_validated_headers.empty())
+    m_validated_headers_height = height;
+  for (size_t i = 0; i < blocks.size(); ++i)
+    m_validated_headers.push_back({hashes[i], blocks[i].prev_id, pows[i], blocks[i].timestamp, cumulative_difficulties[i]});
+  nvalidated = blocks.size();
+
+  TIME_MEASURE_FINISH(t);
+  MDEBUG("Validated " << blocks.size() << " block headers at " << height << " in " << t << " ms, up to " << m_validated_headers_height + m_validated_headers.size());
+  return true;
+}
+
 bool Blockchain::has_block_weights(uint64_t height, uint64_t nblocks) const
 {
   CHECK_AND_ASSERT_MES(nblocks > 0, false, "nblocks is 0");
@@ -4999,6 +5730,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     return true;
 
   bool blocks_exist = false;
+  std::unique_ptr<precomputed_span> precomputed;
   tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
   unsigned threads = tpool.get_max_concurrency();
   blocks.resize(blocks_entry.size());
@@ -5061,6 +5793,22 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     if (!blocks_exist)
     {
       m_blocks_longhash_table.clear();
+      precomputed = take_precomputed_span(height);
+      if (precomputed)
+      {
+        for (const auto &map : precomputed->longhashes)
+          m_blocks_longhash_table.insert(map.begin(), map.end());
+        MDEBUG("Using " << m_blocks_longhash_table.size() << " block hashes precomputed while the previous span was added");
+      }
+      // and those checked with the headers, ahead of the blocks
+      for (size_t i = 0; i < blocks.size(); ++i)
+      {
+        if (height + i < m_validated_headers_height || height + i >= m_validated_headers_height + m_validated_headers.size())
+          continue;
+        const validated_header &header = m_validated_headers[height + i - m_validated_headers_height];
+        if (header.id == get_block_hash(blocks[i]))
+          m_blocks_longhash_table.emplace(header.id, header.pow);
+      }
       uint64_t thread_height = height;
       tools::threadpool::waiter waiter(tpool);
       m_prepare_height = height;
@@ -5104,6 +5852,13 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   m_fake_pow_calc_time = 0;
 
   m_scan_table.clear();
+  m_rct_semantics_preverified.clear();
+  if (precomputed)
+  {
+    for (const auto &v : precomputed->rct_verified)
+      m_rct_semantics_preverified.insert(v.begin(), v.end());
+    precomputed.reset();
+  }
 
   TIME_MEASURE_FINISH(prepare);
   m_fake_pow_calc_time = prepare / blocks_entry.size();
@@ -5120,6 +5875,9 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   // [output] stores all output_data_t for each absolute_offset
   std::map<uint64_t, std::vector<output_data_t>> tx_map;
   std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes(total_txs);
+  // [input] unpruned tx blobs for span wide RCT verification
+  std::vector<const blobdata*> rct_tx_blobs;
+  rct_tx_blobs.reserve(total_txs);
 
 #define SCAN_TABLE_QUIT(m) \
         do { \
@@ -5146,6 +5904,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       if (!parse_and_validate_tx_base_from_blob(tx_blob.blob, tx))
         SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
       cryptonote::get_transaction_prefix_hash(tx, tx_prefix_hash);
+      if (!entry.pruned && tx.version >= 2)
+        rct_tx_blobs.push_back(&tx_blob.blob);
 
       auto its = m_scan_table.find(tx_prefix_hash);
       if (its != m_scan_table.end())
@@ -5291,6 +6051,31 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       MDEBUG("Prepare scantable took: " << scantable << " ms");
   }
 
+  // verify the RCT proofs of the whole span, split in one batch per thread
+  if (!rct_tx_blobs.empty())
+  {
+    TIME_MEASURE_START(rctverify);
+    threads = std::min<size_t>(tpool.get_max_concurrency(), rct_tx_blobs.size());
+    const size_t batch_size = (rct_tx_blobs.size() + threads - 1) / threads;
+    std::vector<std::vector<crypto::hash>> verified(threads);
+    tools::threadpool::waiter waiter(tpool);
+    for (size_t i = 0, start = 0; i < threads && start < rct_tx_blobs.size(); ++i, start += batch_size)
+    {
+      const size_t nblobs = std::min(batch_size, rct_tx_blobs.size() - start);
+      // not a leaf, RCT verification submits to the pool itself
+      tpool.submit(&waiter, boost::bind(&Blockchain::rct_span_verify_worker, this, epee::span<const blobdata* const>(&rct_tx_blobs[start], nblobs), std::ref(verified[i])));
+    }
+    if (!waiter.wait())
+      return false;
+    if (m_cancel)
+      return false;
+    for (const auto &v : verified)
+      m_rct_semantics_preverified.insert(v.begin(), v.end());
+    TIME_MEASURE_FINISH(rctverify);
+    if(m_show_time_stats)
+      MDEBUG("Prepare RCT verification took: " << rctverify << " ms (" << m_rct_semantics_preverified.size() << "/" << rct_tx_blobs.size() << " txes)");
+  }
+
   return true;
 }
 
@@ -5353,6 +6138,12 @@ void Blockchain::set_user_options(uint64_t maxthreads, bool sync_on_blocks, uint
   m_max_prepare_blocks_threads = maxthreads;
 }
 
+void Blockchain::set_rct_ver_cache_size(size_t entries)
+{
+  m_rct_ver_cache.resize(entries);
+  MINFO("RCT verification cache size set to " << m_rct_ver_cache.capacity());
+}
+
 void Blockchain::add_block_notify(BlockNotifyCallback&& notify)
 {
   if (notify)
@@ -42,6 +42,7 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <atomic>
+#include <deque>
 #include <functional>
 #include <unordered_map>
 #include <unordered_set>
@@ -112,6 +113,64 @@ namespace cryptonote
       uint64_t already_generated_coins; //!< the total coins minted after that block
     };
 
+    /**
+     * @brief metadata about a top block which is costly to derive from the db
+     *
+     * Recorded each time the top block changes, so snapshot readers can use
+     * it without taking the blockchain lock.
+     */
+    struct chain_tip
+    {
+      crypto::hash top_hash; //!< the top block's hash
+      uint64_t height; //!< the chain height, ie the top block's height + 1
+      difficulty_type next_difficulty; //!< the difficulty for the next block
+      uint64_t block_weight_limit; //!< the cumulative block weight limit for the next block
+      uint64_t block_weight_median; //!< the block weight median for the next block
+    };
+
+    /**
+     * @brief a consistent, read only view of the chain and the txpool
+     *
+     * Holds a db read txn for its lifetime. Getters which only read the db,
+     * when called by the thread owning the snapshot, read from that txn and
+     * skip the blockchain and txpool locks, so they neither wait for block
+     * import nor hold it up.
+     *
+     * Keep snapshots short lived: an open read txn keeps the db from reusing
+     * pages and from growing its map. Never take the blockchain or txpool
+     * locks, or call a getter which does, while holding one: a db resize
+     * waits for all read txns to end with the blockchain lock held.
+     */
+    class read_snapshot
+    {
+    public:
+      explicit read_snapshot(const Blockchain &blockchain);
+      ~read_snapshot();
+      read_snapshot(const read_snapshot&) = delete;
+      read_snapshot& operator=(const read_snapshot&) = delete;
+
+      //! the chain height as of the snapshot
+      uint64_t height() const { return m_height; }
+      //! the top block hash as of the snapshot, null hash for an empty chain
+      const crypto::hash &top_hash() const { return m_top_hash; }
+      //! metadata for the snapshot's top block, NULL if no longer known
+      const chain_tip *tip() const { return m_tip.get(); }
+
+    private:
+      db_rtxn_guard m_guard;
+      const Blockchain *m_previous;
+      uint64_t m_height;
+      crypto::hash m_top_hash;
+      std::shared_ptr<const chain_tip> m_tip;
+    };
+
+    /**
+     * @brief checks whether the calling thread reads from a snapshot of this blockchain
+     *
+     * @return true if the calling thread holds a read_snapshot of this blockchain
+     */
+    bool in_read_snapshot() const;
+
     /**
      * @brief Blockchain destructor
      */
@@ -256,6 +315,22 @@ namespace cryptonote
      */
     bool cleanup_handle_incoming_blocks(bool force_sync = false);
 
+    /**
+     * @brief starts verifying a span of blocks which is to be added after the current one
+     *
+     * When pipelined block import is enabled, the block hashes, proof of work
+     * and RCT semantics of the span are computed on the compute threadpool
+     * while the current span is being added and committed. Nothing is written
+     * to the database. The results are only used by the next call to
+     * prepare_handle_incoming_blocks, and only if it is for the expected
+     * height on top of the chain the precomputation saw; in every other case,
+     * including a failed batch, they are thrown away.
+     *
+     * @param height the height the first block of the span is expected to have
+     * @param blocks_entry the blocks of the span
+     */
+    void precompute_incoming_blocks(uint64_t height, std::vector<block_complete_entry> blocks_entry);
+
     /**
      * @brief search the blockchain for a transaction by hash
      *
@@ -288,6 +363,17 @@ namespace cryptonote
      */
     bool have_tx_keyimg_as_spent(const crypto::key_image &key_im) const;
 
+    /**
+     * @brief check if key images are already spent on the blockchain
+     *
+     * Same as have_tx_keyimg_as_spent, but for many key images at once,
+     * which is cheaper than checking them one at a time.
+     *
+     * @param key_images the key images to search for
+     * @param spent return-by-reference whether each key image is spent
+     */
+    void have_key_images_as_spent(const epee::span<const crypto::key_image> &key_images, std::vector<bool> &spent) const;
+
     /**
      * @brief get the current height of the blockchain
      *
@@ -495,6 +581,18 @@ namespace cryptonote
      */
     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const;
 
+    /**
+     * @brief get recent blocks for a foreign chain, without copying them out of the db
+     *
+     * Same as above, but the blobs passed to f point into the database, and are
+     * only valid until f returns.
+     *
+     * @param f called with the blocks and their transactions
+     *
+     * @return false if no block was found in common or if f returned false, otherwise true
+     */
+    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count, const std::function<bool(const std::vector<block_blob_refs_t>&)> &f) const;
+
     /**
      * @brief retrieves a set of blocks and their transactions, and possibly other transactions
      *
@@ -509,6 +607,19 @@ namespace cryptonote
      */
     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp);
 
+    /**
+     * @brief retrieves the headers of a set of blocks
+     *
+     * Headers are the block blobs, without the transactions. They are given
+     * for the requested blocks in order, up to the first one not in the main
+     * chain, or the one which takes the response over the size limit.
+     *
+     * @param arg the request
+     * @param rsp return-by-reference the response to fill in
+     * @param max_size the size the headers should stay within
+     */
+    void handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, size_t max_size) const;
+
     /**
      * @brief get number of outputs of an amount past the minimum spendable age
      *
@@ -812,6 +923,41 @@ namespace cryptonote
     void set_user_options(uint64_t maxthreads, bool sync_on_blocks, uint64_t sync_threshold,
         blockchain_db_sync_mode sync_mode, bool fast_sync);
 
+    /**
+     * @brief sets the number of entries of the RCT verification cache
+     *
+     * @param entries max number of cached verification results
+     */
+    void set_rct_ver_cache_size(size_t entries);
+
+    /**
+     * @brief enables or disables verifying the next span of blocks while the current one is added
+     *
+     * @param enabled whether precompute_incoming_blocks does anything
+     */
+    void set_pipeline_block_import(bool enabled) { m_pipeline_block_import = enabled; }
+
+    /**
+     * @brief gets whether the next span of blocks is verified while the current one is added
+     *
+     * @return true if pipelined block import is enabled
+     */
+    bool get_pipeline_block_import() const { return m_pipeline_block_import; }
+
+    /**
+     * @brief enables or disables checking block headers before asking for the blocks during chain synchronization
+     *
+     * @param enabled whether headers are to be synced first
+     */
+    void set_headers_first_sync(bool enabled) { m_headers_first_sync = enabled; }
+
+    /**
+     * @brief gets whether block headers are checked before asking for the blocks during chain synchronization
+     *
+     * @return true if headers first sync is enabled
+     */
+    bool get_headers_first_sync() const { return m_headers_first_sync; }
+
     /**
      * @brief sets a block notify object to call for every new block
      *
@@ -1037,6 +1183,102 @@ namespace cryptonote
     void block_longhash_worker(uint64_t height, const epee::span<const block> &blocks,
         std::unordered_map<crypto::hash, crypto::hash> &map) const;
 
+    /**
+     * @brief computes the long hashes of a set of blocks using known RandomX seeds
+     *
+     * Does not look at the chain, so it may run while blocks are being added.
+     *
+     * @param height the height of the first block
+     * @param blocks the blocks to be hashed
+     * @param seeds the RandomX seed hash for each block (ignored for older blocks)
+     * @param map return-by-reference the hashes for each block
+     */
+    void block_longhash_seeded_worker(uint64_t height, const epee::span<const block> &blocks,
+        const epee::span<const crypto::hash> &seeds, std::unordered_map<crypto::hash, crypto::hash> &map) const;
+
+    /**
+     * @brief batch verifies the RCT semantics of a set of transactions, without ring signatures
+     *
+     * @param tx_blobs the (unpruned) transaction blobs to verify
+     * @param verified return-by-reference the hashes of the transactions whose RCT semantics passed
+     */
+    void rct_span_semantics_worker(const epee::span<const blobdata* const> &tx_blobs,
+        std::vector<crypto::hash> &verified) const;
+
+    struct precomputed_span;
+
+    /**
+     * @brief hashes and verifies a span of blocks given to precompute_incoming_blocks
+     *
+     * @param span the span to work on
+     */
+    void precompute_span_worker(precomputed_span &span) const;
+
+    /**
+     * @brief takes the precomputed span, if it is the one starting at the given height
+     *
+     * Waits for the precomputation to finish. A span for another height or
+     * which was precomputed against a chain which has since been reorganized
+     * is dropped. Must be called with the blockchain lock held.
+     *
+     * @param height the height the span must start at
+     *
+     * @return the precomputed span, or NULL if there is no usable one
+     */
+    std::unique_ptr<precomputed_span> take_precomputed_span(uint64_t height);
+
+    /**
+     * @brief waits for and throws away any precomputed span
+     */
+    void drop_precomputed_span();
+
+    /**
+     * @brief drops the validated headers of blocks now in the chain
+     *
+     * All of them are dropped if they do not build on the chain anymore.
+     * Must be called with the blockchain lock held.
+     */
+    void trim_validated_headers();
+
+    /**
+     * @brief finds the height to start returning blocks for find_blockchain_supplement from
+     *
+     * Must be called with the blockchain lock held.
+     *
+     * @return false if req_start_block is past our chain, or no block was found in common
+     */
+    bool find_supplement_start(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height) const;
+
+    /**
+     * @brief batch verifies the RCT proofs of a set of transactions from incoming blocks
+     *
+     * Range proofs of all the transactions are verified together in a single
+     * call to verRctSemanticsSimple, so they share one multiexp.  If that fails,
+     * each transaction is verified on its own to find the offender(s).  CLSAG
+     * challenges chain through hashes and cannot be folded into the same
+     * multiexp, so ring signatures are verified one transaction at a time
+     * against the ring members found in m_scan_table, and the results are
+     * stored in the RCT verification cache for check_tx_inputs to pick up.
+     * Only transactions of the cached RCT type get their ring signatures
+     * checked here, as check_tx_inputs would verify the others again anyway.
+     * Transactions already in m_rct_semantics_preverified (ie, verified with
+     * a precomputed span) are left out of the batch.
+     *
+     * @param tx_blobs the (unpruned) transaction blobs to verify
+     * @param verified return-by-reference the hashes of the transactions whose RCT semantics passed
+     */
+    void rct_span_verify_worker(const epee::span<const blobdata* const> &tx_blobs,
+        std::vector<crypto::hash> &verified) const;
+
+    /**
+     * @brief checks whether a transaction's RCT semantics were verified while preparing incoming blocks
+     *
+     * @param txid the transaction hash
+     *
+     * @return true if the RCT semantics of this transaction are known to be good
+     */
+    bool is_rct_semantics_preverified(const crypto::hash &txid) const;
+
     /**
      * @brief returns a set of known alternate chains
      *
@@ -1056,6 +1298,9 @@ namespace cryptonote
 
     bool is_within_compiled_block_hash_area() const { return is_within_compiled_block_hash_area(m_db->height()); }
     uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights);
+    bool prevalidate_block_headers(uint64_t height, const std::vector<blobdata> &headers, const std::vector<crypto::hash> &hashes, uint64_t &nvalidated);
+    uint64_t get_validated_headers_height() const;
+    uint64_t get_checked_headers_height(uint64_t height, const std::vector<std::pair<crypto::hash, uint64_t>> &ids) const;
     uint32_t get_blockchain_pruning_seed() const { return m_db->get_blockchain_pruning_seed(); }
     bool prune_blockchain(uint32_t pruning_seed = 0);
     bool update_blockchain_pruning();
@@ -1138,6 +1383,10 @@ namespace cryptonote
 
     mutable epee::critical_section m_blockchain_lock; // TODO: add here reader/writer lock
 
+    // recent top blocks' metadata, newest last, see read_snapshot
+    std::deque<std::shared_ptr<const chain_tip>> m_chain_tips;
+    mutable boost::mutex m_chain_tips_lock;
+
     // main chain
     size_t m_current_block_cumul_weight_limit;
     size_t m_current_block_cumul_weight_median;
@@ -1150,6 +1399,7 @@ namespace cryptonote
     std::vector<std::pair<crypto::hash, crypto::hash>> m_blocks_hash_of_hashes;
     std::vector<std::pair<crypto::hash, uint64_t>> m_blocks_hash_check;
     std::vector<crypto::hash> m_blocks_txs_check;
+    std::unordered_set<crypto::hash> m_rct_semantics_preverified;
 
     blockchain_db_sync_mode m_db_sync_mode;
     bool m_fast_sync;
@@ -1223,6 +1473,24 @@ namespace cryptonote
     uint64_t m_prepare_nblocks;
     std::vector<block> *m_prepare_blocks;
 
+    // next span verified while the current one is added, see precompute_incoming_blocks
+    bool m_pipeline_block_import;
+    std::unique_ptr<precomputed_span> m_precomputed_span;
+    boost::mutex m_precomputed_span_lock;
+
+    // headers past the chain top checked ahead of their blocks, see prevalidate_block_headers
+    struct validated_header
+    {
+      crypto::hash id;
+      crypto::hash prev_id;
+      crypto::hash pow;
+      uint64_t timestamp;
+      difficulty_type cumulative_difficulty;
+    };
+    bool m_headers_first_sync;
+    std::deque<validated_header> m_validated_headers;
+    uint64_t m_validated_headers_height; // height of the first of m_validated_headers
+
     // cache for verifying transaction RCT non semantics
     mutable rct_ver_cache_t m_rct_ver_cache;
 
@@ -1249,11 +1517,24 @@ namespace cryptonote
      * @param tx_prefix_hash the hash of the associated transaction_prefix
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
      * @param tx_version version of the tx, if > 1 we also get commitments
+     * @param ring_outputs if not NULL, the outputs of the input set, already fetched from the db
      *
      * @return false if any keys are not found or any inputs are not unlocked, otherwise true
      */
     template<class visitor_t>
-    inline bool scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height = NULL) const;
+    inline bool scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height = NULL, const std::vector<output_data_t> *ring_outputs = NULL) const;
+
+    /**
+     * @brief fetches the outputs of the input sets of all of a transaction's inputs at once
+     *
+     * All ring members are looked up with a single (sorted) database query.
+     * An input whose outputs could not all be found gets an empty list, and
+     * is left for scan_outputkeys_for_indexes to look up and report on.
+     *
+     * @param tx the transaction
+     * @param ring_outputs return-by-reference the outputs of each input's input set
+     */
+    void get_ring_outputs(const transaction &tx, std::vector<std::vector<output_data_t>> &ring_outputs) const;
 
     /**
      * @brief collect output public keys of a transaction input set
@@ -1273,10 +1554,11 @@ namespace cryptonote
      * @param rct_signatures the ringCT signatures, which are only valid if tx version > 1
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
      * @param hf_version the consensus rules version to use
+     * @param ring_outputs if not NULL, the outputs of the input set, already fetched from the db
      *
      * @return false if any output is not yet unlocked, or is missing, otherwise true
      */
-    bool check_tx_input(size_t tx_version,const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version) const;
+    bool check_tx_input(size_t tx_version,const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, const rct::rctSig &rct_signatures, std::vector<rct::ctkey> &output_keys, uint64_t* pmax_related_block_height, uint8_t hf_version, const std::vector<output_data_t> *ring_outputs = NULL) const;
 
     /**
      * @brief validate a transaction's inputs and their keys
@@ -1550,6 +1832,20 @@ namespace cryptonote
      * @return true
      */
     bool update_next_cumulative_weight_limit(uint64_t *long_term_effective_median_block_weight = NULL);
+
+    /**
+     * @brief records metadata about the current top block for snapshot readers
+     */
+    void publish_chain_tip();
+
+    /**
+     * @brief looks up recorded metadata about a top block
+     *
+     * @param top_hash the top block's hash
+     *
+     * @return the metadata, or NULL if it was not recorded or dropped since
+     */
+    std::shared_ptr<const chain_tip> find_chain_tip(const crypto::hash &top_hash) const;
     void return_tx_to_pool(std::vector<std::pair<transaction, blobdata>> &txs);
 
     /**
@@ -158,6 +158,26 @@ namespace cryptonote
   , "Max number of threads to use when preparing block hashes in groups."
   , 4
   };
+  static const command_line::arg_descriptor<bool> arg_pipeline_block_import  = {
+    "pipeline-block-import"
+  , "Verify the next span of blocks while the current one is being added during chain synchronization."
+  , false
+  };
+  static const command_line::arg_descriptor<bool> arg_headers_first_sync  = {
+    "headers-first-sync"
+  , "During chain synchronization, check the proof of work of block headers from peers which support it before asking for the blocks."
+  , false
+  };
+  static const command_line::arg_descriptor<size_t> arg_rct_ver_cache_size  = {
+    "rct-ver-cache-size"
+  , "Number of RCT signature verification results to cache."
+  , RCT_VER_CACHE_SIZE
+  };
+  static const command_line::arg_descriptor<size_t> arg_tx_cache_size  = {
+    "tx-cache-size"
+  , "Max size in bytes of the cache of parsed transactions (0 to disable)."
+  , DEFAULT_TX_CACHE_SIZE
+  };
   static const command_line::arg_descriptor<uint64_t> arg_show_time_stats  = {
     "show-time-stats"
   , "Show time-stats when processing blocks/txs and disk synchronization."
@@ -332,6 +352,10 @@ namespace cryptonote
     command_line::add_arg(desc, arg_fixed_difficulty);
     command_line::add_arg(desc, arg_dns_checkpoints);
     command_line::add_arg(desc, arg_prep_blocks_threads);
+    command_line::add_arg(desc, arg_rct_ver_cache_size);
+    command_line::add_arg(desc, arg_tx_cache_size);
+    command_line::add_arg(desc, arg_pipeline_block_import);
+    command_line::add_arg(desc, arg_headers_first_sync);
     command_line::add_arg(desc, arg_fast_block_sync);
     command_line::add_arg(desc, arg_show_time_stats);
     command_line::add_arg(desc, arg_block_sync_size);
@@ -623,6 +647,9 @@ namespace cryptonote
 
     m_blockchain_storage.set_user_options(blocks_threads,
         sync_on_blocks, sync_threshold, sync_mode, fast_sync);
+    m_blockchain_storage.set_rct_ver_cache_size(command_line::get_arg(vm, arg_rct_ver_cache_size));
+    m_blockchain_storage.set_pipeline_block_import(command_line::get_arg(vm, arg_pipeline_block_import));
+    m_blockchain_storage.set_headers_first_sync(command_line::get_arg(vm, arg_headers_first_sync));
 
     try
     {
@@ -676,6 +703,9 @@ namespace cryptonote
     r = m_blockchain_storage.init(db.release(), m_nettype, m_offline, regtest ? &regtest_test_options : test_options, fixed_difficulty, get_checkpoints);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
+    m_tx_cache.set_max_bytes(command_line::get_arg(vm, arg_tx_cache_size));
+    m_mempool.set_tx_cache(&m_tx_cache);
+
     r = m_mempool.init(max_txpool_weight, m_nettype == FAKECHAIN);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
 
@@ -751,6 +781,7 @@ namespace cryptonote
     m_miner.stop();
     m_mempool.deinit();
     m_blockchain_storage.deinit();
+    m_tx_cache.clear();
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -899,6 +930,7 @@ namespace cryptonote
     }
 
     std::vector<const rct::rctSig*> rvv;
+    std::vector<bool> preverified(tx_info.size(), false);
     for (size_t n = 0; n < tx_info.size(); ++n)
     {
       if (!check_tx_semantic(*tx_info[n].tx, keeped_by_block))
@@ -951,6 +983,12 @@ namespace cryptonote
             tx_info[n].result = false;
             break;
           }
+          // already batch verified along with the rest of its block span
+          if (keeped_by_block && m_blockchain_storage.is_rct_semantics_preverified(tx_info[n].tx_hash))
+          {
+            preverified[n] = true;
+            break;
+          }
           rvv.push_back(&rv); // delayed batch verification
           break;
         case rct::RCTTypeBulletproofPlus:
@@ -962,6 +1000,12 @@ namespace cryptonote
             tx_info[n].result = false;
             break;
           }
+          // already batch verified along with the rest of its block span
+          if (keeped_by_block && m_blockchain_storage.is_rct_semantics_preverified(tx_info[n].tx_hash))
+          {
+            preverified[n] = true;
+            break;
+          }
           rvv.push_back(&rv); // delayed batch verification
           break;
         default:
@@ -979,7 +1023,7 @@ namespace cryptonote
       const bool assumed_bad = rvv.size() == 1; // if there's only one tx, it must be the bad one
       for (size_t n = 0; n < tx_info.size(); ++n)
       {
-        if (!tx_info[n].result)
+        if (!tx_info[n].result || preverified[n])
           continue;
         if (tx_info[n].tx->rct_signatures.type != rct::RCTTypeBulletproof && tx_info[n].tx->rct_signatures.type != rct::RCTTypeBulletproof2 && tx_info[n].tx->rct_signatures.type != rct::RCTTypeCLSAG && tx_info[n].tx->rct_signatures.type != rct::RCTTypeBulletproofPlus)
           continue;
@@ -1011,6 +1055,8 @@ namespace cryptonote
 
     tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
     tools::threadpool::waiter waiter(tpool);
+    // txes submitted through RPC get ahead of background verification
+    const tools::threadpool::priority prio = tx_relay == relay_method::local ? tools::threadpool::priority::high : tools::threadpool::priority::normal;
     epee::span<tx_blob_entry>::const_iterator it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
       tpool.submit(&waiter, [&, i, it] {
@@ -1024,7 +1070,7 @@ namespace cryptonote
           tvc[i].m_verifivation_failed = true;
           results[i].res = false;
         }
-      });
+      }, false, prio);
     }
     if (!waiter.wait())
       return false;
@@ -1056,7 +1102,7 @@ namespace cryptonote
             tvc[i].m_verifivation_failed = true;
             results[i].res = false;
           }
-        });
+        }, false, prio);
       }
     }
     if (!waiter.wait())
@@ -1206,11 +1252,7 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
-    spent.clear();
-    for(auto& ki: key_im)
-    {
-      spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
-    }
+    m_blockchain_storage.have_key_images_as_spent(epee::to_span(key_im), spent);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -1221,7 +1263,12 @@ namespace cryptonote
     if (block_sync_size > 0)
       res = block_sync_size;
     else if (height >= quick_height)
-      res = BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
+    {
+      // the db tunes this from how long its batches take to commit
+      res = m_blockchain_storage.get_db().get_batch_stats().suggested_batch_blocks;
+      if (res == 0)
+        res = BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
+    }
     else
       res = BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4;
 
@@ -1493,6 +1540,11 @@ namespace cryptonote
     return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, top_hash, start_height, pruned, get_miner_tx_hash, max_block_count, max_tx_count);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count, const std::function<bool(const std::vector<block_blob_refs_t>&)> &f) const
+  {
+    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, total_height, top_hash, start_height, pruned, get_miner_tx_hash, max_block_count, max_tx_count, f);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
   {
     return m_blockchain_storage.get_outs(req, res);
@@ -1636,6 +1688,21 @@ namespace cryptonote
     m_incoming_tx_lock.unlock();
     return success;
   }
+  //-----------------------------------------------------------------------------------------------
+  void core::precompute_incoming_blocks(uint64_t height, std::vector<block_complete_entry> blocks_entry)
+  {
+    m_blockchain_storage.precompute_incoming_blocks(height, std::move(blocks_entry));
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_pipeline_block_import() const
+  {
+    return m_blockchain_storage.get_pipeline_block_import();
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_headers_first_sync() const
+  {
+    return m_blockchain_storage.get_headers_first_sync();
+  }
 
   //-----------------------------------------------------------------------------------------------
   bool core::handle_incoming_block(const blobdata& block_blob, const block *b, block_verification_context& bvc, bool update_miner_blocktemplate)
@@ -1716,7 +1783,21 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::parse_tx_from_blob(transaction& tx, crypto::hash& tx_hash, const blobdata& blob) const
   {
-    return parse_and_validate_tx_from_blob(blob, tx, tx_hash);
+    const std::shared_ptr<const cached_tx> cached = m_tx_cache.parse(blob);
+    if (!cached)
+      return false;
+    tx = cached->tx;
+    tx_hash = cached->txid;
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  std::shared_ptr<const transaction> core::parse_tx_from_blob(crypto::hash& tx_hash, const blobdata& blob) const
+  {
+    const std::shared_ptr<const cached_tx> cached = m_tx_cache.parse(blob);
+    if (!cached)
+      return nullptr;
+    tx_hash = cached->txid;
+    return std::shared_ptr<const transaction>(cached, &cached->tx);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::check_tx_syntax(const transaction& tx) const
@@ -1782,6 +1863,11 @@ namespace cryptonote
     return m_blockchain_storage.handle_get_objects(arg, rsp);
   }
   //-----------------------------------------------------------------------------------------------
+  void core::handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, size_t max_size) const
+  {
+    m_blockchain_storage.handle_get_block_headers(arg, rsp, max_size);
+  }
+  //-----------------------------------------------------------------------------------------------
   crypto::hash core::get_block_id_by_height(uint64_t height) const
   {
     return m_blockchain_storage.get_block_id_by_height(height);
@@ -1830,6 +1916,7 @@ namespace cryptonote
     m_block_rate_interval.do_call(boost::bind(&core::check_block_rate, this));
     m_blockchain_pruning_interval.do_call(boost::bind(&core::update_blockchain_pruning, this));
     m_diff_recalc_interval.do_call(boost::bind(&core::recalculate_difficulties, this));
+    m_tx_cache_stats_interval.do_call(boost::bind(&core::log_tx_cache_stats, this));
     m_miner.on_idle();
     m_mempool.on_idle();
     return true;
@@ -2068,6 +2155,16 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::log_tx_cache_stats()
+  {
+    const tx_cache::stats stats = m_tx_cache.get_stats();
+    const uint64_t lookups = stats.hits + stats.misses;
+    MINFO("Parsed tx cache: " << stats.entries << " txes, " << stats.bytes << "/" << m_tx_cache.get_max_bytes() << " bytes, "
+        << stats.hits << "/" << lookups << " hits (" << (lookups ? stats.hits * 100 / lookups : 0) << "%), "
+        << stats.evictions << " evictions");
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::recalculate_difficulties()
   {
     m_blockchain_storage.recalculate_difficulties();
@@ -2092,6 +2189,16 @@ namespace cryptonote
     return m_mempool.get_complement(hashes, txes);
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_pool_short_id_salt() const
+  {
+    return m_mempool.get_short_id_salt();
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::find_pool_transactions_by_short_ids(const std::vector<uint64_t> &short_ids, std::vector<crypto::hash> &hashes) const
+  {
+    m_mempool.find_transactions_by_short_ids(short_ids, hashes);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::update_blockchain_pruning()
   {
     return m_blockchain_storage.update_blockchain_pruning();
@@ -2117,6 +2224,21 @@ namespace cryptonote
     return get_blockchain_storage().prevalidate_block_hashes(height, hashes, weights);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::prevalidate_block_headers(uint64_t height, const std::vector<blobdata> &headers, const std::vector<crypto::hash> &hashes, uint64_t &nvalidated)
+  {
+    return get_blockchain_storage().prevalidate_block_headers(height, headers, hashes, nvalidated);
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_validated_headers_height() const
+  {
+    return get_blockchain_storage().get_validated_headers_height();
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_checked_headers_height(uint64_t height, const std::vector<std::pair<crypto::hash, uint64_t>> &ids) const
+  {
+    return get_blockchain_storage().get_checked_headers_height(height, ids);
+  }
+  //-----------------------------------------------------------------------------------------------
   uint64_t core::get_free_space() const
   {
     boost::filesystem::path path(m_config_folder);
@@ -43,6 +43,7 @@
 #include "common/download.h"
 #include "common/command_line.h"
 #include "blockchain_and_pool.h"
+#include "tx_cache.h"
 #include "cryptonote_basic/miner.h"
 #include "cryptonote_basic/connection_context.h"
 #include "warnings.h"
@@ -103,6 +104,13 @@ namespace cryptonote
      */
      bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context);
 
+     /**
+      * @copydoc Blockchain::handle_get_block_headers
+      *
+      * @note see Blockchain::handle_get_block_headers
+      */
+     void handle_get_block_headers(const NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, size_t max_size) const;
+
      /**
       * @brief calls various idle routines
       *
@@ -193,6 +201,27 @@ namespace cryptonote
       * @note see Blockchain::cleanup_handle_incoming_blocks
       */
      bool cleanup_handle_incoming_blocks(bool force_sync = false);
+
+     /**
+      * @copydoc Blockchain::precompute_incoming_blocks
+      *
+      * @note see Blockchain::precompute_incoming_blocks
+      */
+     void precompute_incoming_blocks(uint64_t height, std::vector<block_complete_entry> blocks_entry);
+
+     /**
+      * @copydoc Blockchain::get_pipeline_block_import
+      *
+      * @note see Blockchain::get_pipeline_block_import
+      */
+     bool get_pipeline_block_import() const;
+
+     /**
+      * @copydoc Blockchain::get_headers_first_sync
+      *
+      * @note see Blockchain::get_headers_first_sync
+      */
+     bool get_headers_first_sync() const;
      	     	
      /**
       * @brief check the size of a block against the current maximum
@@ -599,6 +628,13 @@ namespace cryptonote
       */
      bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const;
 
+     /**
+      * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, uint64_t&, crypto::hash&, uint64_t&, bool, bool, size_t, size_t, const std::function<bool(const std::vector<block_blob_refs_t>&)>&) const
+      *
+      * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, uint64_t&, crypto::hash&, uint64_t&, bool, bool, size_t, size_t, const std::function<bool(const std::vector<block_blob_refs_t>&)>&) const
+      */
+     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& total_height, crypto::hash& top_hash, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count, const std::function<bool(const std::vector<block_blob_refs_t>&)> &f) const;
+
      /**
       * @copydoc Blockchain::get_tx_outputs_gindexs
       *
@@ -663,6 +699,36 @@ namespace cryptonote
       */
      const Blockchain& get_blockchain_storage()const{return m_blockchain_storage;}
 
+     /**
+      * @brief parses a full (unpruned) transaction blob, through the parsed tx cache
+      *
+      * @param tx return-by-reference the parsed transaction
+      * @param tx_hash return-by-reference the transaction's hash
+      * @param blob the transaction blob
+      *
+      * @return true if the blob parsed, otherwise false
+      */
+     bool parse_tx_from_blob(transaction& tx, crypto::hash& tx_hash, const blobdata& blob) const;
+
+     /**
+      * @brief parses a full (unpruned) transaction blob, through the parsed tx cache
+      *
+      * Unlike the above, the transaction is shared with the cache rather than copied.
+      *
+      * @param tx_hash return-by-reference the transaction's hash
+      * @param blob the transaction blob
+      *
+      * @return the parsed transaction, or nullptr if the blob did not parse
+      */
+     std::shared_ptr<const transaction> parse_tx_from_blob(crypto::hash& tx_hash, const blobdata& blob) const;
+
+     /**
+      * @brief gets the cache of parsed transactions
+      *
+      * @return a reference to the cache shared by the pool, RPC and P2P
+      */
+     tx_cache& get_tx_cache(){return m_tx_cache;}
+
      /**
       * @copydoc tx_memory_pool::print_pool
       *
@@ -840,6 +906,39 @@ namespace cryptonote
       */
      uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights);
 
+     /**
+      * @brief check the proof of work of block headers ahead of their blocks
+      *
+      * The headers must build on the validated headers, or the chain if there
+      * are none, else they are left alone. The proof of work of those which
+      * pass is kept for when the blocks come in.
+      *
+      * @param height the height of the first header
+      * @param headers the block blobs, without their transactions
+      * @param hashes the hashes the headers must have
+      * @param nvalidated return-by-reference number of headers added to the validated ones
+      *
+      * @return false if any header is invalid, true otherwise
+      */
+     bool prevalidate_block_headers(uint64_t height, const std::vector<blobdata> &headers, const std::vector<crypto::hash> &hashes, uint64_t &nvalidated);
+
+     /**
+      * @brief get the height following the last block header validated ahead of its block
+      *
+      * @return the height of the next header to validate, which is the chain height if there are none
+      */
+     uint64_t get_validated_headers_height() const;
+
+     /**
+      * @brief get the height up to which blocks can be asked for with their header checked
+      *
+      * @param height the height of the first of the ids
+      * @param ids the ids of the blocks, with their weights
+      *
+      * @return the validated headers height if the ids agree with the validated headers, the chain height otherwise
+      */
+     uint64_t get_checked_headers_height(uint64_t height, const std::vector<std::pair<crypto::hash, uint64_t>> &ids) const;
+
      /**
       * @brief get free disk space on the blockchain partition
       *
@@ -915,6 +1014,20 @@ namespace cryptonote
       */
      bool get_txpool_complement(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &txes);
 
+     /**
+      * @copydoc tx_memory_pool::get_short_id_salt
+      *
+      * @note see tx_memory_pool::get_short_id_salt
+      */
+     uint64_t get_pool_short_id_salt() const;
+
+     /**
+      * @copydoc tx_memory_pool::find_transactions_by_short_ids
+      *
+      * @note see tx_memory_pool::find_transactions_by_short_ids
+      */
+     void find_pool_transactions_by_short_ids(const std::vector<uint64_t> &short_ids, std::vector<crypto::hash> &hashes) const;
+
    private:
 
      /**
@@ -961,13 +1074,6 @@ namespace cryptonote
       */
      bool load_state_data();
 
-     /**
-      * @copydoc parse_tx_from_blob(transaction&, crypto::hash&, crypto::hash&, const blobdata&) const
-      *
-      * @note see parse_tx_from_blob(transaction&, crypto::hash&, crypto::hash&, const blobdata&) const
-      */
-     bool parse_tx_from_blob(transaction& tx, crypto::hash& tx_hash, const blobdata& blob) const;
-
      /**
       * @brief check a transaction's syntax
       *
@@ -1086,6 +1192,13 @@ namespace cryptonote
       */
      bool check_block_rate();
 
+     /**
+      * @brief logs the hit rate of the parsed transaction cache
+      *
+      * @return true
+      */
+     bool log_tx_cache_stats();
+
      /**
       * @brief recalculate difficulties after the last difficulty checklpoint to circumvent the annoying 'difficulty drift' bug
       *
@@ -1101,6 +1214,8 @@ namespace cryptonote
      tx_memory_pool& m_mempool; //!< ref to transaction pool instance in m_bap
      Blockchain& m_blockchain_storage; //!< ref to Blockchain instance in m_bap
 
+     mutable tx_cache m_tx_cache; //!< parsed transactions, shared with the pool
+
      i_cryptonote_protocol* m_pprotocol; //!< cryptonote protocol instance
 
      epee::critical_section m_incoming_tx_lock; //!< incoming transaction lock
@@ -1119,6 +1234,7 @@ namespace cryptonote
      epee::math_helper::once_a_time_seconds<90, false> m_block_rate_interval; //!< interval for checking block rate
      epee::math_helper::once_a_time_seconds<60*60*5, true> m_blockchain_pruning_interval; //!< interval for incremental blockchain pruning
      epee::math_helper::once_a_time_seconds<60*60*24*7, false> m_diff_recalc_interval; //!< interval for recalculating difficulties
+     epee::math_helper::once_a_time_seconds<60*10, false> m_tx_cache_stats_interval; //!< interval for logging parsed tx cache stats
 
      std::atomic<bool> m_starter_message_showed; //!< has the "daemon will sync now" message been shown?
 
@@ -0,0 +1,186 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "tx_cache.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "txcache"
+
+namespace cryptonote
+{
+
+tx_cache::tx_cache(size_t max_bytes):
+  m_max_bytes(max_bytes),
+  m_bytes(0),
+  m_hits(0),
+  m_misses(0),
+  m_evictions(0)
+{
+}
+
+void tx_cache::set_max_bytes(size_t max_bytes)
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  m_max_bytes = max_bytes;
+  evict();
+}
+
+size_t tx_cache::get_max_bytes() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  return m_max_bytes;
+}
+
+std::shared_ptr<const cached_tx> tx_cache::find(const crypto::hash &txid)
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  const auto i = m_by_txid.find(txid);
+  if (i == m_by_txid.end())
+  {
+    ++m_misses;
+    return nullptr;
+  }
+  ++m_hits;
+  m_lru.splice(m_lru.begin(), m_lru, i->second);
+  return i->second->tx;
+}
+
+std::shared_ptr<const cached_tx> tx_cache::parse(const blobdata_ref &blob)
+{
+  const bool enabled = get_max_bytes() != 0;
+  const crypto::hash blob_hash = enabled ? crypto::cn_fast_hash(blob.data(), blob.size()) : crypto::null_hash;
+  if (enabled)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const auto i = m_by_blob.find(blob_hash);
+    if (i != m_by_blob.end())
+    {
+      ++m_hits;
+      m_lru.splice(m_lru.begin(), m_lru, i->second);
+      return i->second->tx;
+    }
+    ++m_misses;
+  }
+
+  // parse without the lock held, another thread may do the same, add will keep only one
+  std::shared_ptr<cached_tx> tx = std::make_shared<cached_tx>();
+  if (!parse_and_validate_tx_from_blob(blob, tx->tx, tx->txid))
+    return nullptr;
+  tx->prefix_hash = get_transaction_prefix_hash(tx->tx);
+  tx->blob_size = blob.size();
+  tx->tx.set_blob_size(tx->blob_size);
+  tx->weight = get_transaction_weight(tx->tx, tx->blob_size);
+
+  if (enabled)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    add(tx, blob_hash);
+  }
+  return tx;
+}
+
+void tx_cache::insert(const transaction &tx, const crypto::hash &txid, const blobdata_ref &blob)
+{
+  if (tx.pruned)
+    return;
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_max_bytes == 0 || m_by_txid.find(txid) != m_by_txid.end())
+      return;
+  }
+
+  std::shared_ptr<cached_tx> ctx = std::make_shared<cached_tx>();
+  ctx->tx = tx;
+  ctx->txid = txid;
+  ctx->tx.set_hash(txid);
+  ctx->prefix_hash = get_transaction_prefix_hash(ctx->tx);
+  ctx->blob_size = blob.size();
+  ctx->tx.set_blob_size(ctx->blob_size);
+  ctx->weight = get_transaction_weight(ctx->tx, ctx->blob_size);
+  const crypto::hash blob_hash = crypto::cn_fast_hash(blob.data(), blob.size());
+
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  add(ctx, blob_hash);
+}
+
+void tx_cache::clear()
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  m_by_txid.clear();
+  m_by_blob.clear();
+  m_lru.clear();
+  m_bytes = 0;
+}
+
+tx_cache::stats tx_cache::get_stats() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  stats s;
+  s.hits = m_hits;
+  s.misses = m_misses;
+  s.evictions = m_evictions;
+  s.entries = m_lru.size();
+  s.bytes = m_bytes;
+  return s;
+}
+
+size_t tx_cache::cost(const cached_tx &tx)
+{
+  return tx.blob_size + sizeof(cached_tx);
+}
+
+void tx_cache::add(std::shared_ptr<const cached_tx> tx, const crypto::hash &blob_hash)
+{
+  if (m_by_txid.find(tx->txid) != m_by_txid.end())
+    return;
+  const size_t bytes = cost(*tx);
+  if (bytes > m_max_bytes)
+    return;
+  const crypto::hash txid = tx->txid;
+  m_lru.push_front({std::move(tx), blob_hash});
+  m_by_txid[txid] = m_lru.begin();
+  m_by_blob[blob_hash] = m_lru.begin();
+  m_bytes += bytes;
+  evict();
+}
+
+void tx_cache::evict()
+{
+  while (m_bytes > m_max_bytes && !m_lru.empty())
+  {
+    const entry &e = m_lru.back();
+    m_bytes -= cost(*e.tx);
+    m_by_txid.erase(e.tx->txid);
+    m_by_blob.erase(e.blob_hash);
+    m_lru.pop_back();
+    ++m_evictions;
+  }
+}
+
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "crypto/hash.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/blobdatatype.h"
+
+namespace cryptonote
+{
+
+static constexpr const size_t DEFAULT_TX_CACHE_SIZE = 64 * 1024 * 1024;
+
+/**
+ * @brief a parsed transaction along with the values derived from its blob
+ */
+struct cached_tx
+{
+  transaction tx;
+  crypto::hash txid;
+  crypto::hash prefix_hash;
+  uint64_t weight;
+  size_t blob_size;
+};
+
+/**
+ * @brief a bounded LRU of parsed, unpruned transactions
+ *
+ * The same transaction blob tends to be parsed several times: when it is
+ * received, when a fluffy block which includes it comes in, when it is
+ * taken out of the pool as part of a block, and when RPC clients ask for
+ * it as JSON. This keeps the parsed transactions around, shared by all of
+ * them. Entries are found either by txid, or by the blob they were parsed
+ * from, and are immutable once cached; callers needing to modify one must
+ * copy it.
+ *
+ * The size budget is in serialized bytes, the parsed objects take a little
+ * more memory than that.
+ */
+class tx_cache
+{
+public:
+  struct stats
+  {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+  };
+
+  explicit tx_cache(size_t max_bytes = DEFAULT_TX_CACHE_SIZE);
+
+  /**
+   * @brief sets the size budget, evicting entries if needed
+   *
+   * @param max_bytes the budget, in serialized bytes, 0 disables the cache
+   */
+  void set_max_bytes(size_t max_bytes);
+
+  size_t get_max_bytes() const;
+
+  /**
+   * @brief gets a transaction by txid
+   *
+   * @return the transaction, or nullptr if it is not cached
+   */
+  std::shared_ptr<const cached_tx> find(const crypto::hash &txid);
+
+  /**
+   * @brief gets the transaction for a full (unpruned) blob, parsing it if needed
+   *
+   * @param blob the transaction blob
+   *
+   * @return the transaction, or nullptr if the blob does not parse
+   */
+  std::shared_ptr<const cached_tx> parse(const blobdata_ref &blob);
+
+  /**
+   * @brief caches a transaction that the caller already parsed
+   *
+   * Pruned transactions are ignored.
+   *
+   * @param tx the transaction, parsed from blob
+   * @param txid the transaction's hash
+   * @param blob the blob it was parsed from
+   */
+  void insert(const transaction &tx, const crypto::hash &txid, const blobdata_ref &blob);
+
+  /**
+   * @brief drops all entries, but keeps the counters
+   */
+  void clear();
+
+  stats get_stats() const;
+
+private:
+  struct entry
+  {
+    std::shared_ptr<const cached_tx> tx;
+    crypto::hash blob_hash;
+  };
+  typedef std::list<entry> lru_t;
+
+  static size_t cost(const cached_tx &tx);
+  void add(std::shared_ptr<const cached_tx> tx, const crypto::hash &blob_hash);
+  void evict();
+
+  mutable boost::mutex m_mutex;
+  lru_t m_lru; //!< most recently used first
+  std::unordered_map<crypto::hash, lru_t::iterator> m_by_txid;
+  std::unordered_map<crypto::hash, lru_t::iterator> m_by_blob;
+  size_t m_max_bytes;
+  size_t m_bytes;
+  uint64_t m_hits;
+  uint64_t m_misses;
+  uint64_t m_evictions;
+};
+
+}
@@ -34,6 +34,7 @@
 #include <vector>
 
 #include "tx_pool.h"
+#include "tx_cache.h"
 #include "cryptonote_tx_utils.h"
 #include "cryptonote_basic/cryptonote_boost_serialization.h"
 #include "cryptonote_config.h"
@@ -52,6 +53,17 @@
 
 DISABLE_VS_WARNINGS(4244 4345 4503) //'boost::foreach_detail_::or_' : decorated name length exceeded, name was truncated
 
+// takes the pool and blockchain locks, unless the calling thread holds a
+// blockchain snapshot, whose db read txn covers the pool tables too
+#define TXPOOL_READ_LOCK() \
+  std::unique_lock<epee::critical_section> txpool_read_lock(m_transactions_lock, std::defer_lock); \
+  std::unique_lock<Blockchain> blockchain_read_lock(m_blockchain, std::defer_lock); \
+  if (!m_blockchain.in_read_snapshot()) \
+  { \
+    txpool_read_lock.lock(); \
+    blockchain_read_lock.lock(); \
+  }
+
 using namespace crypto;
 
 namespace cryptonote
@@ -127,7 +139,7 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_mine_stem_txes(false), m_next_check(std::time(nullptr))
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_mine_stem_txes(false), m_tx_cache(NULL), m_next_check(std::time(nullptr))
   {
     // class code expects unsigned values throughout
     if (m_next_check < time_t(0))
@@ -135,6 +147,8 @@ namespace cryptonote
 
     m_added_txs_start_time = (time_t)0;
     m_removed_txs_start_time = (time_t)0;
+    // 0 is reserved for "no salt" in the sync data
+    do m_short_id_salt = crypto::rand<uint64_t>(); while (m_short_id_salt == 0);
     // We don't set these to "now" already here as we don't know how long it takes from construction
     // of the pool until it "goes to work". It's safer to set when the first actual txs enter the
     // corresponding lists.
@@ -397,6 +411,9 @@ namespace cryptonote
     tvc.m_verifivation_failed = false;
     m_txpool_weight += tx_weight;
 
+    if (m_tx_cache)
+      m_tx_cache->insert(tx, id, blob);
+
     ++m_cookie;
 
     MINFO("Transaction added to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)(tx_weight ? tx_weight : 1)) << ", count: " << m_added_txs_by_id.size());
@@ -600,15 +617,11 @@ namespace cryptonote
       {
         tx = ci->second;
       }
-      else if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(txblob, tx) : parse_and_validate_tx_from_blob(txblob, tx)))
+      else if (!parse_pool_tx(id, txblob, meta.pruned, tx))
       {
         MERROR("Failed to parse tx from txpool");
         return false;
       }
-      else
-      {
-        tx.set_hash(id);
-      }
       tx_weight = meta.weight;
       fee = meta.fee;
       relayed = meta.relayed;
@@ -634,15 +647,36 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::parse_pool_tx(const crypto::hash &txid, const cryptonote::blobdata_ref &txblob, bool pruned, transaction &tx) const
+  {
+    if (m_tx_cache && !pruned)
+    {
+      const std::shared_ptr<const cached_tx> cached = m_tx_cache->find(txid);
+      if (cached)
+      {
+        tx = cached->tx;
+        return true;
+      }
+    }
+    if (!(pruned ? parse_and_validate_tx_base_from_blob(txblob, tx) : parse_and_validate_tx_from_blob(txblob, tx)))
+      return false;
+    tx.set_hash(txid);
+    if (m_tx_cache && !pruned)
+      m_tx_cache->insert(tx, txid, txblob);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_transaction_info(const crypto::hash &txid, tx_details &td, bool include_sensitive_data, bool include_blob) const
   {
     PERF_TIMER(get_transaction_info);
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    TXPOOL_READ_LOCK();
 
     try
     {
-      LockedTXN lock(m_blockchain.get_db());
+      const bool in_snapshot = m_blockchain.in_read_snapshot();
+      std::unique_ptr<LockedTXN> lock;
+      if (!in_snapshot)
+        lock.reset(new LockedTXN(m_blockchain.get_db()));
       txpool_tx_meta_t meta;
       if (!m_blockchain.get_txpool_tx_meta(txid, meta))
       {
@@ -655,20 +689,17 @@ namespace cryptonote
         return false;
       }
       cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
-      auto ci = m_parsed_tx_cache.find(txid);
+      // m_parsed_tx_cache is only safe to read with the pool lock held
+      auto ci = in_snapshot ? m_parsed_tx_cache.end() : m_parsed_tx_cache.find(txid);
       if (ci != m_parsed_tx_cache.end())
       {
         td.tx = ci->second;
       }
-      else if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(txblob, td.tx) : parse_and_validate_tx_from_blob(txblob, td.tx)))
+      else if (!parse_pool_tx(txid, txblob, meta.pruned, td.tx))
       {
         MERROR("Failed to parse tx from txpool");
         return false;
       }
-      else
-      {
-        td.tx.set_hash(txid);
-      }
       td.blob_size = txblob.size();
       td.weight = meta.weight;
       td.fee = meta.fee;
@@ -696,8 +727,7 @@ namespace cryptonote
   //------------------------------------------------------------------
   bool tx_memory_pool::get_transactions_info(const std::vector<crypto::hash>& txids, std::vector<std::pair<crypto::hash, tx_details>>& txs, bool include_sensitive) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    TXPOOL_READ_LOCK();
 
     txs.clear();
 
@@ -746,6 +776,32 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::find_transactions_by_short_ids(const std::vector<uint64_t> &short_ids, std::vector<crypto::hash> &hashes) const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+
+    hashes.assign(short_ids.size(), crypto::null_hash);
+    for (size_t i = 0; i < short_ids.size(); ++i)
+    {
+      const auto range = m_txs_by_short_id.equal_range(short_ids[i]);
+      if (range.first == range.second || std::next(range.first) != range.second)
+        continue;
+      // like for fluffy blocks, a stem tx is as good as missing, or we'd
+      // tell the peer we had it
+      const crypto::hash &txid = range.first->second;
+      try
+      {
+        if (m_blockchain.get_db().txpool_has_tx(txid, relay_category::broadcasted))
+          hashes[i] = txid;
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to look up txpool transaction " << txid << ": " << e.what());
+      }
+    }
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::on_idle()
   {
     m_remove_stuck_tx_interval.do_call([this](){return remove_stuck_transactions();});
@@ -948,15 +1004,13 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_transactions_count(bool include_sensitive) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    TXPOOL_READ_LOCK();
     return m_blockchain.get_txpool_tx_count(include_sensitive);
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::vector<transaction>& txs, bool include_sensitive) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    TXPOOL_READ_LOCK();
     const relay_category category = include_sensitive ? relay_category::all : relay_category::broadcasted;
     txs.reserve(m_blockchain.get_txpool_tx_count(include_sensitive));
     m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata_ref *bd){
@@ -975,8 +1029,7 @@ namespace cryptonote
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_sensitive) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    TXPOOL_READ_LOCK();
     const relay_category category = include_sensitive ? relay_category::all : relay_category::broadcasted;
     txs.reserve(m_blockchain.get_txpool_tx_count(include_sensitive));
     m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata_ref *bd){
@@ -1351,8 +1404,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_transaction(const crypto::hash& id, cryptonote::blobdata& txblob, relay_category tx_category) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    TXPOOL_READ_LOCK();
     try
     {
       return m_blockchain.get_txpool_tx_blob(id, txblob, tx_category);
@@ -1381,8 +1433,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx(const crypto::hash &id, relay_category tx_category) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    TXPOOL_READ_LOCK();
     return m_blockchain.get_db().txpool_has_tx(id, tx_category);
   }
   //---------------------------------------------------------------------------------
@@ -1447,23 +1498,23 @@ namespace cryptonote
   {
     struct transaction_parser
     {
-      transaction_parser(const cryptonote::blobdata_ref &txblob, const crypto::hash &txid, transaction &tx): txblob(txblob), txid(txid), tx(tx), parsed(false) {}
+      transaction_parser(const tx_memory_pool &pool, const cryptonote::blobdata_ref &txblob, const crypto::hash &txid, transaction &tx): pool(pool), txblob(txblob), txid(txid), tx(tx), parsed(false) {}
       cryptonote::transaction &operator()()
       {
         if (!parsed)
         {
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          if (!pool.parse_pool_tx(txid, txblob, false, tx))
             throw std::runtime_error("failed to parse transaction blob");
-          tx.set_hash(txid);
           parsed = true;
         }
         return tx;
       }
+      const tx_memory_pool &pool;
       const cryptonote::blobdata_ref &txblob;
       const crypto::hash &txid;
       transaction &tx;
       bool parsed;
-    } lazy_tx(txblob, txid, tx);
+    } lazy_tx(*this, txblob, txid, tx);
 
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
@@ -1835,6 +1886,12 @@ namespace cryptonote
     if (it == m_added_txs_by_id.end())
     {
        m_added_txs_by_id.insert(std::make_pair(txid, now));
+
+       // validate() forgets m_added_txs_by_id, but not the txes
+       const uint64_t short_id = get_transaction_short_id(txid, m_short_id_salt);
+       const auto range = m_txs_by_short_id.equal_range(short_id);
+       if (std::find_if(range.first, range.second, [&txid](const std::pair<const uint64_t, crypto::hash> &e) { return e.second == txid; }) == range.second)
+         m_txs_by_short_id.emplace(short_id, txid);
     }
     else
     {
@@ -1886,6 +1943,16 @@ namespace cryptonote
     {
       MDEBUG("Removing tx " << txid << " from tx pool, but it was not found in the map of added txs");
     }
+
+    const auto range = m_txs_by_short_id.equal_range(get_transaction_short_id(txid, m_short_id_salt));
+    for (auto i = range.first; i != range.second; ++i)
+    {
+      if (i->second == txid)
+      {
+        m_txs_by_short_id.erase(i);
+        break;
+      }
+    }
     track_removed_tx(txid, sensitive);
   }
   //---------------------------------------------------------------------------------
@@ -1935,6 +2002,7 @@ namespace cryptonote
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
     m_txs_by_fee_and_receive_time.clear();
     m_added_txs_by_id.clear();
+    m_txs_by_short_id.clear();
     m_added_txs_start_time = (time_t)0;
     m_removed_txs_by_time.clear();
     m_removed_txs_start_time = (time_t)0;
@@ -55,6 +55,7 @@
 namespace cryptonote
 {
   class Blockchain;
+  class tx_cache;
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -405,6 +406,13 @@ namespace cryptonote
      */
     void set_txpool_max_weight(size_t bytes);
 
+    /**
+     * @brief set the cache of parsed transactions to share with the core
+     *
+     * @param cache the cache, or NULL to always parse from the pool's blobs
+     */
+    void set_tx_cache(tx_cache *cache) { m_tx_cache = cache; }
+
     /**
      * @brief reduce the cumulative txpool weight by the weight provided
      *
@@ -472,6 +480,23 @@ namespace cryptonote
      */
     bool get_complement(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &txes) const;
 
+    /**
+     * @brief get the salt this pool's short transaction ids are made with
+     *
+     * Peers are told this salt, so they can announce blocks to us with
+     * short ids instead of full transaction hashes.
+     */
+    uint64_t get_short_id_salt() const { return m_short_id_salt; }
+
+    /**
+     * @brief looks up broadcasted transactions by their short id
+     *
+     * @param short_ids the short ids, made with this pool's salt
+     * @param hashes return-by-reference the matching hashes, null_hash where
+     *        no transaction, or more than one, matches
+     */
+    void find_transactions_by_short_ids(const std::vector<uint64_t> &short_ids, std::vector<crypto::hash> &hashes) const;
+
     /**
      * @brief get info necessary for update of pool-related info in a wallet, preferably incremental
      *
@@ -488,6 +513,18 @@ namespace cryptonote
      */
     tx_memory_pool(Blockchain& bchs);
 
+    /**
+     * @brief parses a transaction stored in the pool, going through the tx cache if set
+     *
+     * @param txid the transaction's hash
+     * @param txblob the transaction blob from the pool
+     * @param pruned whether the blob is pruned
+     * @param tx return-by-reference the parsed transaction
+     *
+     * @return true on success, false if the blob does not parse
+     */
+    bool parse_pool_tx(const crypto::hash &txid, const cryptonote::blobdata_ref &txblob, bool pruned, transaction &tx) const;
+
     /**
      * @brief insert key images into m_spent_key_images
      *
@@ -629,6 +666,10 @@ private:
     // Info when transactions entered the pool, accessible by txid
     std::unordered_map<crypto::hash, time_t> m_added_txs_by_id;
 
+    // txids by short id, for compact block reconstruction
+    std::unordered_multimap<uint64_t, crypto::hash> m_txs_by_short_id;
+    uint64_t m_short_id_salt;
+
     // Info at what time the pool started to track the adding of transactions
     time_t m_added_txs_start_time;
 
@@ -674,6 +715,8 @@ private:
 
     std::unordered_map<crypto::hash, transaction> m_parsed_tx_cache;
 
+    tx_cache *m_tx_cache; //!< parsed transactions shared with the core, may be NULL
+
     //! Next timestamp that a DB check for relayable txes is allowed
     std::atomic<time_t> m_next_check;
 
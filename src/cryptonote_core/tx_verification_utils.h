@@ -28,16 +28,17 @@
 
 #pragma once
 
-#include "common/data_cache.h"
+#include "common/concurrent_set_cache.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 
 namespace cryptonote
 {
 
-// Modifying this value should not affect consensus. You can adjust it for performance needs
+// Modifying this value should not affect consensus. You can adjust it for performance needs,
+// and at runtime with --rct-ver-cache-size
 static constexpr const size_t RCT_VER_CACHE_SIZE = 8192;
 
-using rct_ver_cache_t = ::tools::data_cache<::crypto::hash, RCT_VER_CACHE_SIZE>;
+using rct_ver_cache_t = ::tools::concurrent_set_cache<::crypto::hash, RCT_VER_CACHE_SIZE>;
 
 /**
  * @brief Cached version of rct::verRctNonSemanticsSimple
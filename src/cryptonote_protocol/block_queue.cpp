@@ -28,6 +28,7 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <cmath>
 #include <vector>
 #include <unordered_map>
 #include <boost/uuid/nil_generator.hpp>
@@ -49,12 +50,26 @@ namespace std {
   };
 }
 
+namespace
+{
+  // weight of the latest span in the peer score moving averages
+  constexpr const float SCORE_WEIGHT = 0.25f;
+  // spans a peer must have sent before its score is used for scheduling
+  constexpr const uint64_t MIN_SCORED_SPANS = 2;
+  // slowest peers still get spans this fraction of the full size
+  constexpr const float MIN_SPAN_SIZE_RATIO = 0.25f;
+  // another peer must be expected to beat the one holding up the next span
+  // by this much, even when unlucky, to download it again
+  constexpr const float REREQUEST_MARGIN = 1.5f;
+}
+
 namespace cryptonote
 {
 
 void block_queue::add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, const epee::net_utils::network_address &addr, float rate, size_t size)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  update_peer_score(connection_id, rate, size, bcel.size());
   std::vector<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
   blocks.insert(span(height, std::move(bcel), connection_id, addr, rate, size));
@@ -113,6 +128,13 @@ void block_queue::flush_stale_spans(const std::set<boost::uuids::uuid> &live_con
       erase_block(j);
     }
   }
+  for (auto i = peer_scores.begin(); i != peer_scores.end(); )
+  {
+    if (live_connections.find(i->first) == live_connections.end())
+      i = peer_scores.erase(i);
+    else
+      ++i;
+  }
 }
 
 bool block_queue::remove_span(uint64_t start_block_height, std::vector<crypto::hash> *hashes)
@@ -241,6 +263,7 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
     MDEBUG("reserve_span: early out: first_block_height " << first_block_height << ", last_block_height " << last_block_height << ", max_blocks " << max_blocks);
     return std::make_pair(0, 0);
   }
+  max_blocks = get_span_size(connection_id, max_blocks);
   if (block_hashes.size() > last_block_height)
   {
     MDEBUG("reserve_span: more block hashes than fit within last_block_height: " << block_hashes.size() << " and " << last_block_height);
@@ -326,7 +349,7 @@ std::pair<uint64_t, uint64_t> block_queue::get_next_span_if_scheduled(std::vecto
   return std::make_pair(i->start_block_height, i->nblocks);
 }
 
-void block_queue::reset_next_span_time(boost::posix_time::ptime t)
+void block_queue::reset_next_span_time(const boost::uuids::uuid &connection_id, boost::posix_time::ptime t)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   CHECK_AND_ASSERT_THROW_MES(!blocks.empty(), "No next span to reset time");
@@ -334,6 +357,10 @@ void block_queue::reset_next_span_time(boost::posix_time::ptime t)
   CHECK_AND_ASSERT_THROW_MES(i != blocks.end(), "No next span to reset time");
   CHECK_AND_ASSERT_THROW_MES(i->blocks.empty(), "Next span is not empty");
   (boost::posix_time::ptime&)i->time = t; // sod off, time doesn't influence sorting
+  (boost::uuids::uuid&)i->rerequest_connection_id = connection_id; // nor does this
+  auto score = peer_scores.find(i->connection_id);
+  if (score != peer_scores.end())
+    ++score->second.rerequested;
 }
 
 void block_queue::set_span_hashes(uint64_t start_height, const boost::uuids::uuid &connection_id, std::vector<crypto::hash> hashes)
@@ -374,6 +401,22 @@ bool block_queue::get_next_span(uint64_t &height, std::vector<cryptonote::block_
   return false;
 }
 
+bool block_queue::get_span(uint64_t height, std::vector<cryptonote::block_complete_entry> &bcel) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  for (const auto &span: blocks)
+  {
+    if (span.start_block_height > height)
+      break;
+    if (span.start_block_height == height && !span.blocks.empty())
+    {
+      bcel = span.blocks;
+      return true;
+    }
+  }
+  return false;
+}
+
 bool block_queue::has_next_span(const boost::uuids::uuid &connection_id, bool &filled, boost::posix_time::ptime &time) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
@@ -540,4 +583,104 @@ bool block_queue::foreach(std::function<bool(const span&)> f) const
   return true;
 }
 
+std::map<boost::uuids::uuid, block_queue::peer_score> block_queue::get_peer_scores() const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  return peer_scores;
+}
+
+void block_queue::update_peer_score(const boost::uuids::uuid &connection_id, float rate, size_t size, uint64_t nblocks)
+{
+  if (rate <= 0.0f || size == 0 || nblocks == 0)
+    return;
+  // the caller measured rate over the whole span, from request to arrival
+  const float span_time = size / rate;
+  block_size = block_size > 0.0f ? block_size + SCORE_WEIGHT * (size / (float)nblocks - block_size) : size / (float)nblocks;
+  peer_score &score = peer_scores[connection_id];
+  if (score.spans == 0)
+  {
+    score.rate = rate;
+    score.span_time = span_time;
+  }
+  else
+  {
+    score.rate_dev += SCORE_WEIGHT * (std::abs(rate - score.rate) - score.rate_dev);
+    score.rate += SCORE_WEIGHT * (rate - score.rate);
+    score.span_time_dev += SCORE_WEIGHT * (std::abs(span_time - score.span_time) - score.span_time_dev);
+    score.span_time += SCORE_WEIGHT * (span_time - score.span_time);
+  }
+  ++score.spans;
+  MTRACE("Score for " << connection_id << ": " << score.rate << " +/- " << score.rate_dev << " B/s, " << score.span_time << " +/- " << score.span_time_dev << " s per span");
+}
+
+float block_queue::get_expected_span_time(const boost::uuids::uuid &connection_id, uint64_t nblocks, bool pessimistic) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_scores.find(connection_id);
+  if (i == peer_scores.end() || i->second.spans < MIN_SCORED_SPANS || block_size <= 0.0f)
+    return -1.0f;
+  // unlucky is two deviations slower, but no worse than four times slower
+  const peer_score &score = i->second;
+  const float rate = pessimistic ? std::max(score.rate - 2 * score.rate_dev, score.rate / 4) : score.rate;
+  return nblocks * block_size / rate;
+}
+
+uint64_t block_queue::get_span_size(const boost::uuids::uuid &connection_id, uint64_t max_blocks) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_scores.find(connection_id);
+  if (i == peer_scores.end() || i->second.spans < MIN_SCORED_SPANS)
+    return max_blocks;
+
+  // size spans so they take about as long whoever downloads them, so a slow
+  // peer does not sit on a large span the others are done with long before
+  float best_rate = 0.0f;
+  for (const auto &e: peer_scores)
+    if (e.second.spans >= MIN_SCORED_SPANS)
+      best_rate = std::max(best_rate, e.second.rate);
+  const float ratio = std::min(1.0f, std::max(MIN_SPAN_SIZE_RATIO, i->second.rate / best_rate));
+  return std::max<uint64_t>(1, max_blocks * ratio + 0.5f);
+}
+
+bool block_queue::should_rerequest_next_span(const boost::uuids::uuid &connection_id, uint64_t blockchain_height, boost::posix_time::ptime time) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  if (blocks.empty())
+    return false;
+  const span &next = *blocks.begin();
+  if (next.start_block_height > blockchain_height || !next.blocks.empty() || next.connection_id == connection_id)
+    return false;
+
+  const float ours = get_expected_span_time(connection_id, next.nblocks, true);
+  if (ours < 0.0f)
+    return false;
+
+  // once asked of another peer too, the span is waited for from that one, since
+  // time was reset then; comparing against the holder would have every faster
+  // peer fetch it again
+  const bool rerequested = !next.rerequest_connection_id.is_nil();
+  if (rerequested && next.rerequest_connection_id == connection_id)
+    return false;
+  const boost::uuids::uuid &pending = rerequested ? next.rerequest_connection_id : next.connection_id;
+  const float remaining = get_remaining_span_time(pending, next.nblocks, next.time, time);
+  if (ours * REREQUEST_MARGIN >= remaining)
+    return false;
+  MDEBUG("Next span " << next.start_block_height << " from " << pending << " expected in " << remaining << " s, "
+      << connection_id << " expected to get it in " << ours << " s");
+  return true;
+}
+
+float block_queue::get_remaining_span_time(const boost::uuids::uuid &connection_id, uint64_t nblocks, boost::posix_time::ptime since, boost::posix_time::ptime time) const
+{
+  // with nothing known of the peer, guess it needs as long again as it took
+  // so far; a peer later than even its unlucky case may never deliver, count
+  // it as having to start over
+  const float elapsed = (time - since).total_microseconds() / 1e6f;
+  const float expected = get_expected_span_time(connection_id, nblocks);
+  if (expected < 0.0f)
+    return elapsed;
+  const float late = get_expected_span_time(connection_id, nblocks, true);
+  return elapsed > late ? expected : std::max(0.0f, expected - elapsed);
+}
+
 }
@@ -30,12 +30,14 @@
 
 #pragma once
 
+#include <map>
 #include <string>
 #include <vector>
 #include <set>
 #include <unordered_set>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/uuid/uuid.hpp>
+#include <boost/uuid/nil_generator.hpp>
 #include "net/net_utils_base.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -59,16 +61,28 @@ namespace cryptonote
       size_t size;
       boost::posix_time::ptime time;
       epee::net_utils::network_address origin{};
+      boost::uuids::uuid rerequest_connection_id; //!< peer this span was also asked of, at time, if any
 
       span(uint64_t start_block_height, std::vector<cryptonote::block_complete_entry> blocks, const boost::uuids::uuid &connection_id, const epee::net_utils::network_address &addr, float rate, size_t size):
-        start_block_height(start_block_height), blocks(std::move(blocks)), connection_id(connection_id), nblocks(this->blocks.size()), rate(rate), size(size), time(boost::date_time::min_date_time), origin(addr) {}
+        start_block_height(start_block_height), blocks(std::move(blocks)), connection_id(connection_id), nblocks(this->blocks.size()), rate(rate), size(size), time(boost::date_time::min_date_time), origin(addr), rerequest_connection_id(boost::uuids::nil_uuid()) {}
       span(uint64_t start_block_height, uint64_t nblocks, const boost::uuids::uuid &connection_id, const epee::net_utils::network_address &addr, boost::posix_time::ptime time):
-        start_block_height(start_block_height), connection_id(connection_id), nblocks(nblocks), rate(0.0f), size(0), time(time), origin(addr) {}
+        start_block_height(start_block_height), connection_id(connection_id), nblocks(nblocks), rate(0.0f), size(0), time(time), origin(addr), rerequest_connection_id(boost::uuids::nil_uuid()) {}
 
       bool operator<(const span &s) const { return start_block_height < s.start_block_height; }
     };
     typedef std::set<span> block_map;
 
+    //! what we know of how fast a peer serves spans, from the spans it sent
+    struct peer_score
+    {
+      float rate; //!< bytes/s, moving average
+      float rate_dev; //!< moving average of the deviation from rate
+      float span_time; //!< seconds from request to arrival, moving average
+      float span_time_dev; //!< moving average of the deviation from span_time
+      uint64_t spans; //!< spans received
+      uint64_t rerequested; //!< spans it held up that we asked another peer for
+    };
+
   public:
     void add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, const epee::net_utils::network_address &addr, float rate, size_t size);
     void add_blocks(uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, const epee::net_utils::network_address &addr, boost::posix_time::ptime time = boost::date_time::min_date_time);
@@ -83,9 +97,10 @@ namespace cryptonote
     std::pair<uint64_t, uint64_t> reserve_span(uint64_t first_block_height, uint64_t last_block_height, uint64_t max_blocks, const boost::uuids::uuid &connection_id, const epee::net_utils::network_address &addr, bool sync_pruned_blocks, uint32_t local_pruning_seed, uint32_t pruning_seed, uint64_t blockchain_height, const std::vector<std::pair<crypto::hash, uint64_t>> &block_hashes, boost::posix_time::ptime time = boost::posix_time::microsec_clock::universal_time());
     uint64_t get_next_needed_height(uint64_t blockchain_height) const;
     std::pair<uint64_t, uint64_t> get_next_span_if_scheduled(std::vector<crypto::hash> &hashes, boost::uuids::uuid &connection_id, boost::posix_time::ptime &time) const;
-    void reset_next_span_time(boost::posix_time::ptime t = boost::posix_time::microsec_clock::universal_time());
+    void reset_next_span_time(const boost::uuids::uuid &connection_id, boost::posix_time::ptime t = boost::posix_time::microsec_clock::universal_time());
     void set_span_hashes(uint64_t start_height, const boost::uuids::uuid &connection_id, std::vector<crypto::hash> hashes);
     bool get_next_span(uint64_t &height, std::vector<cryptonote::block_complete_entry> &bcel, boost::uuids::uuid &connection_id, epee::net_utils::network_address &addr, bool filled = true) const;
+    bool get_span(uint64_t height, std::vector<cryptonote::block_complete_entry> &bcel) const;
     bool has_next_span(const boost::uuids::uuid &connection_id, bool &filled, boost::posix_time::ptime &time) const;
     bool has_next_span(uint64_t height, bool &filled, boost::posix_time::ptime &time, boost::uuids::uuid &connection_id) const;
     size_t get_data_size() const;
@@ -96,17 +111,25 @@ namespace cryptonote
     float get_speed(const boost::uuids::uuid &connection_id) const;
     float get_download_rate(const boost::uuids::uuid &connection_id) const;
     bool foreach(std::function<bool(const span&)> f) const;
+    std::map<boost::uuids::uuid, peer_score> get_peer_scores() const;
+    float get_expected_span_time(const boost::uuids::uuid &connection_id, uint64_t nblocks, bool pessimistic = false) const;
+    uint64_t get_span_size(const boost::uuids::uuid &connection_id, uint64_t max_blocks) const;
+    bool should_rerequest_next_span(const boost::uuids::uuid &connection_id, uint64_t blockchain_height, boost::posix_time::ptime time = boost::posix_time::microsec_clock::universal_time()) const;
     bool requested(const crypto::hash &hash) const;
     bool have(const crypto::hash &hash) const;
 
   private:
     void erase_block(block_map::iterator j);
     inline bool requested_internal(const crypto::hash &hash) const;
+    void update_peer_score(const boost::uuids::uuid &connection_id, float rate, size_t size, uint64_t nblocks);
+    float get_remaining_span_time(const boost::uuids::uuid &connection_id, uint64_t nblocks, boost::posix_time::ptime since, boost::posix_time::ptime time) const;
 
   private:
     block_map blocks;
     mutable boost::recursive_mutex mutex;
     std::unordered_set<crypto::hash> requested_hashes;
     std::unordered_set<crypto::hash> have_blocks;
+    std::map<boost::uuids::uuid, peer_score> peer_scores;
+    float block_size = 0.0f; //!< bytes, moving average over all spans
   };
 }
@@ -0,0 +1,108 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_config.h"
+#include "compact_block.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.cn"
+
+namespace cryptonote
+{
+  bool make_compact_block(const block &b, const std::vector<tx_blob_entry> &txs, const std::unordered_set<crypto::hash> &lacked,
+      uint64_t salt, uint64_t current_blockchain_height, NOTIFY_NEW_COMPACT_BLOCK::request &req)
+  {
+    if (!get_block_hash(b, req.block_hash))
+      return false;
+    block stripped = b;
+    stripped.tx_hashes.clear();
+    stripped.invalidate_hashes();
+    req.block = block_to_blob(stripped);
+    req.current_blockchain_height = current_blockchain_height;
+
+    req.short_ids.clear();
+    req.short_ids.reserve(b.tx_hashes.size() * COMPACT_BLOCK_SHORT_ID_SIZE);
+    req.prefilled_tx_indices.clear();
+    req.prefilled_txs.clear();
+    const bool can_prefill = !lacked.empty() && txs.size() == b.tx_hashes.size();
+    size_t prefill_bytes = 0;
+    for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+    {
+      const uint64_t short_id = get_transaction_short_id(b.tx_hashes[i], salt);
+      for (size_t byte = 0; byte < COMPACT_BLOCK_SHORT_ID_SIZE; ++byte)
+        req.short_ids.push_back((char)(short_id >> (8 * byte)));
+      if (can_prefill && lacked.count(b.tx_hashes[i]) && prefill_bytes + txs[i].blob.size() <= COMPACT_BLOCK_MAX_PREFILL_BYTES)
+      {
+        prefill_bytes += txs[i].blob.size();
+        req.prefilled_tx_indices.push_back(i);
+        req.prefilled_txs.push_back(txs[i].blob);
+      }
+    }
+    return true;
+  }
+
+  bool get_compact_block_short_ids(const NOTIFY_NEW_COMPACT_BLOCK::request &req, std::vector<uint64_t> &short_ids)
+  {
+    if (req.short_ids.size() % COMPACT_BLOCK_SHORT_ID_SIZE)
+    {
+      MDEBUG("Compact block short ids are not a multiple of " << COMPACT_BLOCK_SHORT_ID_SIZE << " bytes");
+      return false;
+    }
+    const size_t n_txes = req.short_ids.size() / COMPACT_BLOCK_SHORT_ID_SIZE;
+    if (n_txes > CRYPTONOTE_MAX_TX_PER_BLOCK)
+    {
+      MDEBUG("Compact block has too many transactions");
+      return false;
+    }
+    if (req.prefilled_tx_indices.size() != req.prefilled_txs.size())
+    {
+      MDEBUG("Compact block has " << req.prefilled_tx_indices.size() << " prefilled indices, but " << req.prefilled_txs.size() << " transactions");
+      return false;
+    }
+    for (size_t i = 0; i < req.prefilled_tx_indices.size(); ++i)
+    {
+      if (req.prefilled_tx_indices[i] >= n_txes || (i > 0 && req.prefilled_tx_indices[i] <= req.prefilled_tx_indices[i - 1]))
+      {
+        MDEBUG("Compact block prefilled indices are out of range or not increasing");
+        return false;
+      }
+    }
+
+    short_ids.resize(n_txes);
+    const unsigned char *ptr = (const unsigned char*)req.short_ids.data();
+    for (size_t i = 0; i < n_txes; ++i)
+    {
+      uint64_t short_id = 0;
+      for (size_t byte = 0; byte < COMPACT_BLOCK_SHORT_ID_SIZE; ++byte)
+        short_id |= ((uint64_t)*ptr++) << (8 * byte);
+      short_ids[i] = short_id;
+    }
+    return true;
+  }
+}
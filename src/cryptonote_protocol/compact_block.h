@@ -0,0 +1,73 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+#include "crypto/hash.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_protocol_defs.h"
+
+namespace cryptonote
+{
+  //! bytes per short tx id in a compact block
+  constexpr const size_t COMPACT_BLOCK_SHORT_ID_SIZE = 6;
+  //! most tx data a compact block prefills, the peer requests the rest
+  constexpr const size_t COMPACT_BLOCK_MAX_PREFILL_BYTES = 1024 * 1024;
+
+  /**
+   * @brief makes a compact block announcement for one peer
+   *
+   * Transactions are sent as short ids salted with the peer's salt, except
+   * for those the peer is predicted to lack, which are sent in full as long
+   * as they fit in COMPACT_BLOCK_MAX_PREFILL_BYTES.
+   *
+   * @param b the block
+   * @param txs the block's transaction blobs, in block order, may be empty
+   * @param lacked hashes of the transactions to prefill
+   * @param salt the peer's short id salt
+   * @param current_blockchain_height the height to announce
+   * @param req return-by-reference the announcement
+   *
+   * @return false if the block could not be serialized
+   */
+  bool make_compact_block(const block &b, const std::vector<tx_blob_entry> &txs, const std::unordered_set<crypto::hash> &lacked,
+      uint64_t salt, uint64_t current_blockchain_height, NOTIFY_NEW_COMPACT_BLOCK::request &req);
+
+  /**
+   * @brief gets the short ids out of a compact block, checking its layout
+   *
+   * @param req the announcement
+   * @param short_ids return-by-reference the short ids, in block order
+   *
+   * @return false if the short ids or prefilled transactions are malformed
+   */
+  bool get_compact_block_short_ids(const NOTIFY_NEW_COMPACT_BLOCK::request &req, std::vector<uint64_t> &short_ids);
+}
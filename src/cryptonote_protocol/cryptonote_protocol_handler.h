@@ -56,6 +56,8 @@ DISABLE_VS_WARNINGS(4355)
 
 #define LOCALHOST_INT 2130706433
 #define CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT 100
+#define CURRENCY_PROTOCOL_MAX_HEADERS_REQUEST_COUNT 1000
+#define CURRENCY_PROTOCOL_MAX_HEADERS_RESPONSE_SIZE (1024 * 1024 * 8)
 static_assert(CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT >= BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4, "Invalid CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT");
 
 namespace cryptonote
@@ -96,6 +98,12 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
       HANDLE_NOTIFY_T2(NOTIFY_GET_TXPOOL_COMPLEMENT, &cryptonote_protocol_handler::handle_notify_get_txpool_complement)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_GET_TXPOOL_SKETCH, &cryptonote_protocol_handler::handle_notify_get_txpool_sketch)
+      HANDLE_NOTIFY_T2(NOTIFY_TXPOOL_SKETCH_FAILED, &cryptonote_protocol_handler::handle_notify_txpool_sketch_failed)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_request_block_headers)
+      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_response_block_headers)
+      HANDLE_NOTIFY_T2(NOTIFY_TXPOOL_SKETCH_DECODED, &cryptonote_protocol_handler::handle_notify_txpool_sketch_decoded)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -144,12 +152,19 @@ namespace cryptonote
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
     int handle_notify_get_txpool_complement(int command, NOTIFY_GET_TXPOOL_COMPLEMENT::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_notify_get_txpool_sketch(int command, NOTIFY_GET_TXPOOL_SKETCH::request& arg, cryptonote_connection_context& context);
+    int handle_notify_txpool_sketch_failed(int command, NOTIFY_TXPOOL_SKETCH_FAILED::request& arg, cryptonote_connection_context& context);
+    int handle_notify_txpool_sketch_decoded(int command, NOTIFY_TXPOOL_SKETCH_DECODED::request& arg, cryptonote_connection_context& context);
+    int handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
+    int handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
     virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const boost::uuids::uuid& source, epee::net_utils::zone zone, relay_method tx_relay);
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
+    bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context, const std::unordered_set<crypto::hash> &lacked_txs);
     bool should_drop_connection(cryptonote_connection_context& context, uint32_t next_stripe);
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span = false);
     size_t get_synchronizing_connections_count();
@@ -165,7 +180,10 @@ namespace cryptonote
     int try_add_next_blocks(cryptonote_connection_context &context);
     void notify_new_stripe(cryptonote_connection_context &context, uint32_t stripe);
     size_t skip_unneeded_hashes(cryptonote_connection_context& context, bool check_block_queue) const;
-    bool request_txpool_complement(cryptonote_connection_context &context);
+    bool request_txpool_complement(cryptonote_connection_context &context, uint32_t support_flags);
+    bool request_txpool_sketch(cryptonote_connection_context &context, size_t difference);
+    bool should_check_block_headers(cryptonote_connection_context &context);
+    bool request_block_headers(cryptonote_connection_context &context);
     void hit_score(cryptonote_connection_context &context, int32_t score);
 
     t_core& m_core;
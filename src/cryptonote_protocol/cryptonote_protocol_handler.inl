@@ -39,6 +39,8 @@
 #include <ctime>
 
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_protocol/compact_block.h"
+#include "cryptonote_protocol/txpool_sketch.h"
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
 #include "common/pruning.h"
@@ -378,6 +380,7 @@ namespace cryptonote
     }
     context.m_remote_blockchain_height = hshd.current_height;
     context.m_pruning_seed = hshd.pruning_seed;
+    context.m_compact_block_salt = hshd.compact_block_salt;
 
     uint64_t target = m_core.get_target_blockchain_height();
     if (target == 0)
@@ -459,6 +462,7 @@ namespace cryptonote
     hshd.cumulative_difficulty_top64 = ((wide_cumulative_difficulty >> 64) & 0xffffffffffffffff).convert_to<uint64_t>();
     hshd.current_height +=1;
     hshd.pruning_seed = m_core.get_blockchain_pruning_seed();
+    hshd.compact_block_salt = m_core.get_pool_short_id_salt();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -600,42 +604,18 @@ namespace cryptonote
       std::vector<uint64_t> need_tx_indices;
       need_tx_indices.reserve(new_block.tx_hashes.size());
         
-      transaction tx;
       crypto::hash tx_hash;
 
+      // the txes we had to be sent are likely missing from our peers' pools too
+      std::unordered_set<crypto::hash> lacked_txs;
+
       for(auto& tx_blob: arg.b.txs)
       {
-        if(parse_and_validate_tx_from_blob(tx_blob.blob, tx))
+        // goes through the core's parsed tx cache, so handle_incoming_tx below does not parse it again
+        if(m_core.parse_tx_from_blob(tx_hash, tx_blob.blob))
         {
-          try
-          {
-            if(!get_transaction_hash(tx, tx_hash))
-            {
-              LOG_PRINT_CCONTEXT_L1
-              (
-                  "NOTIFY_NEW_FLUFFY_BLOCK: get_transaction_hash failed"
-                  << ", dropping connection"
-              );
-              
-              drop_connection(context, false, false);
-              m_core.resume_mine();
-              return 1;
-            }
-          }
-          catch(...)
-          {
-            LOG_PRINT_CCONTEXT_L1
-            (
-                "NOTIFY_NEW_FLUFFY_BLOCK: get_transaction_hash failed"
-                << ", exception thrown"
-                << ", dropping connection"
-            );
-                        
-            drop_connection(context, false, false);
-            m_core.resume_mine();
-            return 1;
-          }
-          
+          lacked_txs.insert(tx_hash);
+
           // hijacking m_requested objects in connection context to patch up
           // a possible DOS vector pointed out by @monero-moo where peers keep
           // sending (0...n-1) transactions.
@@ -811,7 +791,7 @@ namespace cryptonote
           NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
           reg_arg.current_blockchain_height = arg.current_blockchain_height;
           reg_arg.b = b;
-          relay_block(reg_arg, context);
+          relay_block(reg_arg, context, lacked_txs);
         }
         else if( bvc.m_marked_as_orphaned )
         {
@@ -851,6 +831,105 @@ namespace cryptonote
         
     return 1;
   }  
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE(context << "Received NOTIFY_NEW_COMPACT_BLOCK " << arg.block_hash << " (height " << arg.current_blockchain_height << ", "
+        << arg.short_ids.size() / COMPACT_BLOCK_SHORT_ID_SIZE << " txes, " << arg.prefilled_txs.size() << " prefilled)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized()) // can happen if a peer connection goes to normal but another thread still hasn't finished adding queued blocks
+    {
+      LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+      return 1;
+    }
+
+    block new_block;
+    std::vector<uint64_t> short_ids;
+    if(!parse_and_validate_block_from_blob(arg.block, new_block) || !new_block.tx_hashes.empty() || !get_compact_block_short_ids(arg, short_ids))
+    {
+      LOG_ERROR_CCONTEXT
+      (
+        "sent wrong compact block: failed to parse and validate block: "
+        << epee::string_tools::buff_to_hex_nodelimer(arg.block)
+        << ", dropping connection"
+      );
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    if(m_core.have_block(arg.block_hash))
+      return 1;
+
+    // short ids are salted with the salt we sent in our sync data
+    std::vector<crypto::hash> tx_hashes;
+    m_core.find_pool_transactions_by_short_ids(short_ids, tx_hashes);
+    const uint64_t salt = m_core.get_pool_short_id_salt();
+
+    NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+    fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+    fluffy_arg.b.txs.reserve(arg.prefilled_txs.size());
+    crypto::hash tx_hash;
+    for(size_t i = 0; i < arg.prefilled_txs.size(); ++i)
+    {
+      const uint64_t tx_idx = arg.prefilled_tx_indices[i];
+      // goes through the core's parsed tx cache, so handling it as part of the block does not parse it again
+      if(!m_core.parse_tx_from_blob(tx_hash, arg.prefilled_txs[i]) || get_transaction_short_id(tx_hash, salt) != short_ids[tx_idx])
+      {
+        LOG_ERROR_CCONTEXT("sent wrong prefilled tx at index " << tx_idx << " in compact block " << arg.block_hash << ", dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      tx_hashes[tx_idx] = tx_hash;
+      fluffy_arg.b.txs.push_back({std::move(arg.prefilled_txs[i]), crypto::null_hash});
+    }
+
+    std::vector<uint64_t> need_tx_indices;
+    for(size_t tx_idx = 0; tx_idx < tx_hashes.size(); ++tx_idx)
+      if(tx_hashes[tx_idx] == crypto::null_hash)
+        need_tx_indices.push_back(tx_idx);
+
+    if(need_tx_indices.empty())
+    {
+      new_block.tx_hashes = std::move(tx_hashes);
+      new_block.invalidate_hashes();
+      if(get_block_hash(new_block) == arg.block_hash)
+      {
+        // from here on, this is a fluffy block with all its txes known
+        MDEBUG("Rebuilt compact block " << arg.block_hash << " from " << short_ids.size() - fluffy_arg.b.txs.size() << " pool txes");
+        fluffy_arg.b.block = block_to_blob(new_block);
+        return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+      }
+      // a short id matched the wrong pool tx, ask for the full block
+      MDEBUG("Compact block " << arg.block_hash << " did not rebuild, short id collision");
+    }
+
+    // the peer answers with a fluffy block carrying the full tx hashes and the
+    // txes we could not find, so prefilled txes must be in the pool by then
+    for(const auto &tx_blob: fluffy_arg.b.txs)
+    {
+      crypto::hash prefilled_hash;
+      if(!m_core.parse_tx_from_blob(prefilled_hash, tx_blob.blob) || m_core.pool_has_tx(prefilled_hash))
+        continue;
+      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      if(!m_core.handle_incoming_tx(tx_blob, tvc, relay_method::block, true) || tvc.m_verifivation_failed)
+      {
+        LOG_PRINT_CCONTEXT_L1("Block verification failed: transaction verification failed, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+    }
+
+    MDEBUG("We are missing " << need_tx_indices.size() << " txes for compact block " << arg.block_hash);
+    NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+    missing_tx_req.block_hash = arg.block_hash;
+    missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+    missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+    MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_FLUFFY_MISSING_TX: missing_tx_indices.size()=" << missing_tx_req.missing_tx_indices.size() );
+    post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+    return 1;
+  }
   //------------------------------------------------------------------------------------------------------------------------  
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context)
@@ -981,6 +1060,121 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_get_txpool_sketch(int command, NOTIFY_GET_TXPOOL_SKETCH::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_GET_TXPOOL_SKETCH (" << arg.sketch.size() << " bytes, pool size " << arg.pool_size << ")");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    txpool_sketch theirs;
+    if (!theirs.parse(arg.sketch))
+    {
+      LOG_ERROR_CCONTEXT("sent invalid txpool sketch, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    std::vector<crypto::hash> hashes;
+    if (!m_core.get_pool_transaction_hashes(hashes, false))
+    {
+      LOG_ERROR_CCONTEXT("failed to get txpool hashes");
+      return 1;
+    }
+
+    // the difference is at least the difference in sizes, no point in
+    // hashing the pool if that already can not be decoded
+    std::vector<uint64_t> ours_only, theirs_only;
+    const uint64_t size_difference = std::max<uint64_t>(hashes.size(), arg.pool_size) - std::min<uint64_t>(hashes.size(), arg.pool_size);
+    bool decoded = txpool_sketch::get_cells_for_difference(size_difference) <= theirs.size();
+    std::unordered_map<uint64_t, crypto::hash> short_ids;
+    if (decoded)
+    {
+      txpool_sketch ours(theirs.size());
+      short_ids.reserve(hashes.size());
+      for (const crypto::hash &txid: hashes)
+      {
+        const uint64_t short_id = get_transaction_short_id(txid, arg.salt);
+        if (short_ids.emplace(short_id, txid).second)
+          ours.add(short_id);
+      }
+      decoded = ours.subtract(theirs) && ours.decode(ours_only, theirs_only);
+    }
+    if (!decoded)
+    {
+      NOTIFY_TXPOOL_SKETCH_FAILED::request r;
+      r.pool_size = hashes.size();
+      MLOG_P2P_MESSAGE("-->>NOTIFY_TXPOOL_SKETCH_FAILED: pool_size=" << r.pool_size);
+      post_notify<NOTIFY_TXPOOL_SKETCH_FAILED>(r, context);
+      return 1;
+    }
+
+    NOTIFY_NEW_TRANSACTIONS::request new_txes;
+    for (uint64_t short_id: ours_only)
+    {
+      const auto i = short_ids.find(short_id);
+      if (i == short_ids.end())
+        continue;
+      cryptonote::blobdata blob;
+      if (m_core.get_pool_transaction(i->second, blob, relay_category::broadcasted))
+        new_txes.txs.push_back(std::move(blob));
+    }
+    MDEBUG(context << "txpool sketch decoded, " << ours_only.size() << " txes only in ours, " << theirs_only.size() << " only in theirs");
+    if (!new_txes.txs.empty())
+    {
+      MLOG_P2P_MESSAGE
+      (
+          "-->>NOTIFY_NEW_TRANSACTIONS: "
+          << ", txs.size()=" << new_txes.txs.size()
+      );
+
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(new_txes, context);
+    }
+
+    // lets the peer know the exchange is over, so a stray failure notice
+    // does not start another one
+    NOTIFY_TXPOOL_SKETCH_DECODED::request r;
+    r.txs_sent = new_txes.txs.size();
+    MLOG_P2P_MESSAGE("-->>NOTIFY_TXPOOL_SKETCH_DECODED: txs_sent=" << r.txs_sent);
+    post_notify<NOTIFY_TXPOOL_SKETCH_DECODED>(r, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_txpool_sketch_failed(int command, NOTIFY_TXPOOL_SKETCH_FAILED::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_TXPOOL_SKETCH_FAILED (pool size " << arg.pool_size << ")");
+    const size_t difference = context.m_txpool_sketch_difference;
+    if (difference == 0)
+    {
+      MDEBUG(context << "did not send a txpool sketch, ignoring");
+      return 1;
+    }
+
+    // grow the sketch at least geometrically so a large difference costs
+    // a handful of round trips, request_txpool_sketch falls back to the
+    // full list when it would not be any smaller anymore
+    const uint64_t pool_size = m_core.get_pool_transactions_count(false);
+    const uint64_t size_difference = std::max<uint64_t>(pool_size, arg.pool_size) - std::min<uint64_t>(pool_size, arg.pool_size);
+    if (!request_txpool_sketch(context, std::max<uint64_t>(2 * difference, difference + size_difference)))
+      MERROR(context << "Failed to request txpool sketch");
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_txpool_sketch_decoded(int command, NOTIFY_TXPOOL_SKETCH_DECODED::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_TXPOOL_SKETCH_DECODED (" << arg.txs_sent << " txes sent)");
+    if (context.m_txpool_sketch_difference == 0)
+    {
+      MDEBUG(context << "did not send a txpool sketch, ignoring");
+      return 1;
+    }
+    MDEBUG(context << "txpool reconciled with a sketch for a difference of " << context.m_txpool_sketch_difference);
+    context.m_txpool_sketch_difference = 0;
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTIONS (" << arg.txs.size() << " txes)");
@@ -1113,6 +1307,31 @@ namespace cryptonote
     return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    if (context.m_state == cryptonote_connection_context::state_before_handshake)
+    {
+      LOG_ERROR_CCONTEXT("Requested block headers before handshake, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_BLOCK_HEADERS (" << arg.blocks.size() << " blocks)");
+    if (arg.blocks.size() > CURRENCY_PROTOCOL_MAX_HEADERS_REQUEST_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("Requested block headers count is too big (" << arg.blocks.size() << ") expected not more then " << CURRENCY_PROTOCOL_MAX_HEADERS_REQUEST_COUNT);
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    NOTIFY_RESPONSE_BLOCK_HEADERS::request rsp;
+    m_core.handle_get_block_headers(arg, rsp, CURRENCY_PROTOCOL_MAX_HEADERS_RESPONSE_SIZE);
+    context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
+    MLOG_P2P_MESSAGE("-->>NOTIFY_RESPONSE_BLOCK_HEADERS: headers.size()=" << rsp.headers.size() << " of " << arg.blocks.size());
+    post_notify<NOTIFY_RESPONSE_BLOCK_HEADERS>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
 
 
   template<class t_core>
@@ -1530,6 +1749,15 @@ namespace cryptonote
             return 1;
           }
 
+          // the next span gets verified on the compute threadpool while this one is added and committed,
+          // it is only used if it ends up being added on top of this one
+          if (m_core.get_pipeline_block_import())
+          {
+            std::vector<cryptonote::block_complete_entry> next_blocks;
+            if (m_block_queue.get_span(start_height + blocks.size(), next_blocks))
+              m_core.precompute_incoming_blocks(start_height + blocks.size(), std::move(next_blocks));
+          }
+
           uint64_t block_process_time_full = 0, transactions_process_time_full = 0;
           size_t num_txs = 0, blockidx = 0;
           for(const block_complete_entry& block_entry: blocks)
@@ -1916,6 +2144,12 @@ skip:
           return true;
         }
 
+        if (m_block_queue.should_rerequest_next_span(context.m_connection_id, blockchain_height, now))
+        {
+          MDEBUG(context << " we should download it as we expect to get it well before " << connection_id << " does");
+          return true;
+        }
+
         // in standby, be ready to double download early since we're idling anyway
         // let the fastest peer trigger first
         const double dl_speed = context.m_max_speed_down;
@@ -2241,7 +2475,7 @@ skip:
               req.blocks.push_back(hash);
               context.m_requested_objects.insert(hash);
             }
-            m_block_queue.reset_next_span_time();
+            m_block_queue.reset_next_span_time(context.m_connection_id);
           }
         }
       }
@@ -2272,8 +2506,30 @@ skip:
         const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
         static const uint64_t bp_fork_height = m_core.get_earliest_ideal_height_for_version(8);
         bool sync_pruned_blocks = m_sync_pruned_blocks && first_block_height >= bp_fork_height && m_core.get_blockchain_pruning_seed();
-        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_remote_address, sync_pruned_blocks, m_core.get_blockchain_pruning_seed(), context.m_pruning_seed, context.m_remote_blockchain_height, context.m_needed_objects);
-        MDEBUG(context << " span from " << first_block_height << ": " << span.first << "/" << span.second);
+        if (should_check_block_headers(context))
+        {
+          // with headers first, only the blocks whose header was checked are asked for
+          const uint64_t headers_height = m_core.get_checked_headers_height(first_block_height, context.m_needed_objects);
+          const size_t nchecked = headers_height > first_block_height ? std::min<uint64_t>(headers_height - first_block_height, context.m_needed_objects.size()) : 0;
+          const std::vector<std::pair<crypto::hash, uint64_t>> checked_objects(context.m_needed_objects.begin(), context.m_needed_objects.begin() + nchecked);
+          span = m_block_queue.reserve_span(first_block_height, first_block_height + nchecked - 1, count_limit, context.m_connection_id, context.m_remote_address, sync_pruned_blocks, m_core.get_blockchain_pruning_seed(), context.m_pruning_seed, context.m_remote_blockchain_height, checked_objects);
+          MDEBUG(context << " span from " << first_block_height << ", checked up to " << headers_height << ": " << span.first << "/" << span.second);
+
+          // if none are left to ask for, ask for the next headers, or for the chain
+          // again if the needed blocks start past the checked headers
+          if (span.second == 0)
+          {
+            if (request_block_headers(context))
+              return true;
+            if (context.m_needed_objects.empty())
+              goto skip;
+          }
+        }
+        else
+        {
+          span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_remote_address, sync_pruned_blocks, m_core.get_blockchain_pruning_seed(), context.m_pruning_seed, context.m_remote_blockchain_height, context.m_needed_objects);
+          MDEBUG(context << " span from " << first_block_height << ": " << span.first << "/" << span.second);
+        }
         if (span.second > 0)
         {
           const uint32_t stripe = tools::get_pruning_stripe(span.first, context.m_remote_blockchain_height, CRYPTONOTE_PRUNING_LOG_STRIPES);
@@ -2527,7 +2783,7 @@ skip:
           MDEBUG(context << "not ready, ignoring");
           return true;
         }
-        if (!request_txpool_complement(context))
+        if (!request_txpool_complement(context, support_flags))
         {
           MERROR(context << "Failed to request txpool complement");
           return true;
@@ -2701,7 +2957,8 @@ skip:
     }
     context.m_last_response_height -= arg.m_block_ids.size() - n_use_blocks;
 
-    if (!request_missing_objects(context, false))
+    // with headers first, the blocks are asked for once their headers are checked
+    if (!request_block_headers(context) && !request_missing_objects(context, false))
     {
       LOG_ERROR_CCONTEXT("Failed to request missing objects, dropping connection");
       drop_connection(context, false, false);
@@ -2716,7 +2973,94 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_BLOCK_HEADERS (" << arg.headers.size() << " headers)");
+    MLOG_PEER_STATE("received block headers");
+
+    if (context.m_expect_response != NOTIFY_RESPONSE_BLOCK_HEADERS::ID)
+    {
+      LOG_ERROR_CCONTEXT("Got NOTIFY_RESPONSE_BLOCK_HEADERS out of the blue, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    context.m_expect_response = 0;
+    context.m_last_request_time = boost::date_time::not_a_date_time;
+
+    // the headers are for the needed blocks from the height they were asked from
+    const uint64_t headers_height = context.m_expect_height;
+    const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
+    std::vector<crypto::hash> hashes;
+    if (!context.m_needed_objects.empty() && headers_height >= first_block_height)
+    {
+      for (size_t i = headers_height - first_block_height; i < context.m_needed_objects.size() && hashes.size() < arg.headers.size(); ++i)
+        hashes.push_back(context.m_needed_objects[i].first);
+    }
+    if (arg.headers.size() > CURRENCY_PROTOCOL_MAX_HEADERS_REQUEST_COUNT || hashes.size() < arg.headers.size())
+    {
+      LOG_ERROR_CCONTEXT("sent more block headers than requested, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // we only ask for blocks from the peer's own chain entry, at least one of
+    // them, so a peer with the capability has no reason to send none back
+    if (arg.headers.empty())
+    {
+      LOG_ERROR_CCONTEXT("sent no block headers, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+
+    uint64_t nvalidated = 0;
+    if (!m_core.prevalidate_block_headers(headers_height, arg.headers, hashes, nvalidated))
+    {
+      LOG_ERROR_CCONTEXT("sent invalid block headers, dropping connection");
+      drop_connection_with_score(context, P2P_IP_FAILS_BEFORE_BLOCK, false);
+      return 1;
+    }
+
+    // ask for the blocks up to the last checked header only, the chain past it will
+    // be asked for again once those are requested; if none could be checked because
+    // the headers checked so far moved on meanwhile, ask again from where they are now,
+    // and if they did not, the headers do not build on the blocks the peer sent before
+    if (nvalidated > 0)
+    {
+      const size_t keep = headers_height + nvalidated - first_block_height;
+      MDEBUG(context << nvalidated << " block headers checked from " << headers_height << ", asking for " << keep << "/" << context.m_needed_objects.size() << " blocks");
+      context.m_last_response_height -= context.m_needed_objects.size() - keep;
+      context.m_needed_objects.resize(keep);
+    }
+    else if (m_core.get_validated_headers_height() != headers_height)
+    {
+      MDEBUG(context << "block headers from " << headers_height << " could not be checked, validated headers now up to " << m_core.get_validated_headers_height());
+      if (request_block_headers(context))
+        return 1;
+    }
+    else
+    {
+      LOG_ERROR_CCONTEXT("sent block headers which do not build on its previous blocks, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    if (!request_missing_objects(context, false))
+    {
+      LOG_ERROR_CCONTEXT("Failed to request missing objects, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context)
+  {
+    return relay_block(arg, exclude_context, {});
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context, const std::unordered_set<crypto::hash> &lacked_txs)
   {
     NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
     fluffy_arg.current_blockchain_height = arg.current_blockchain_height;    
@@ -2724,14 +3068,20 @@ skip:
     fluffy_arg.b = arg.b;
     fluffy_arg.b.txs = fluffy_txs;
 
-    // sort peers between fluffy ones and others
+    // sort peers between compact ones, fluffy ones and others
     std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    std::vector<std::pair<boost::uuids::uuid, uint64_t>> compactConnections;
+    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       // peer_id also filters out connections before handshake
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id && context.m_remote_address.get_zone() == epee::net_utils::zone::public_)
       {
-        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS) && context.m_compact_block_salt)
+        {
+          LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING SHORT TX IDS");
+          compactConnections.push_back({context.m_connection_id, context.m_compact_block_salt});
+        }
+        else if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
           fluffyConnections.push_back({context.m_remote_address.get_zone(), context.m_connection_id});
@@ -2745,6 +3095,33 @@ skip:
       return true;
     });
 
+    // each compact peer gets short ids salted its own way
+    if (!compactConnections.empty())
+    {
+      block b;
+      if (parse_and_validate_block_from_blob(arg.b.block, b))
+      {
+        NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+        for (const auto &connection: compactConnections)
+        {
+          if (!make_compact_block(b, arg.b.txs, lacked_txs, connection.second, arg.current_blockchain_height, compact_arg))
+          {
+            fluffyConnections.push_back({epee::net_utils::zone::public_, connection.first});
+            continue;
+          }
+          epee::levin::message_writer compactBlob{8 * 1024};
+          epee::serialization::store_t_to_binary(compact_arg, compactBlob.buffer);
+          m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, std::move(compactBlob), {{epee::net_utils::zone::public_, connection.first}});
+        }
+      }
+      else
+      {
+        MERROR("Failed to parse block to relay, relaying it fluffy");
+        for (const auto &connection: compactConnections)
+          fluffyConnections.push_back({epee::net_utils::zone::public_, connection.first});
+      }
+    }
+
     // send fluffy ones first, we want to encourage people to run that
     if (!fluffyConnections.empty())
     {
@@ -2774,8 +3151,12 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
-  bool t_cryptonote_protocol_handler<t_core>::request_txpool_complement(cryptonote_connection_context &context)
+  bool t_cryptonote_protocol_handler<t_core>::request_txpool_complement(cryptonote_connection_context &context, uint32_t support_flags)
   {
+    if (support_flags & P2P_SUPPORT_FLAG_TXPOOL_SKETCH)
+      return request_txpool_sketch(context, TXPOOL_SKETCH_INITIAL_DIFFERENCE);
+
+    context.m_txpool_sketch_difference = 0;
     NOTIFY_GET_TXPOOL_COMPLEMENT::request r = {};
     if (!m_core.get_pool_transaction_hashes(r.hashes, false))
     {
@@ -2789,6 +3170,98 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::request_txpool_sketch(cryptonote_connection_context &context, size_t difference)
+  {
+    std::vector<crypto::hash> hashes;
+    if (!m_core.get_pool_transaction_hashes(hashes, false))
+    {
+      MERROR("Failed to get txpool hashes");
+      return false;
+    }
+
+    const size_t cells = txpool_sketch::get_cells_for_difference(difference);
+    if (cells > TXPOOL_SKETCH_MAX_CELLS || cells * TXPOOL_SKETCH_CELL_SIZE >= hashes.size() * sizeof(crypto::hash))
+    {
+      MDEBUG(context << "txpool sketch for a difference of " << difference << " would not be smaller than our txpool hashes, sending those");
+      return request_txpool_complement(context, 0);
+    }
+
+    NOTIFY_GET_TXPOOL_SKETCH::request r;
+    r.salt = crypto::rand<uint64_t>();
+    r.pool_size = hashes.size();
+    txpool_sketch sketch(cells);
+    std::unordered_set<uint64_t> short_ids;
+    short_ids.reserve(hashes.size());
+    for (const crypto::hash &txid: hashes)
+    {
+      // a colliding short id added twice would cancel itself out
+      const uint64_t short_id = get_transaction_short_id(txid, r.salt);
+      if (short_ids.insert(short_id).second)
+        sketch.add(short_id);
+    }
+    r.sketch = sketch.serialize();
+    context.m_txpool_sketch_difference = difference;
+    MLOG_P2P_MESSAGE("-->>NOTIFY_GET_TXPOOL_SKETCH: cells=" << sketch.size() << ", pool_size=" << r.pool_size);
+    post_notify<NOTIFY_GET_TXPOOL_SKETCH>(r, context);
+    MLOG_PEER_STATE("requesting txpool sketch");
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::should_check_block_headers(cryptonote_connection_context &context)
+  {
+    // past the compiled in block hashes, the proof of work of the headers of the
+    // needed blocks is checked first, so no peer can have us download blocks of a bogus chain
+    if (!m_core.get_headers_first_sync() || context.m_needed_objects.empty())
+      return false;
+    if (m_core.is_within_compiled_block_hash_area(context.m_last_response_height))
+      return false;
+    uint32_t support_flags = 0;
+    m_p2p->for_connection(context.m_connection_id, [&support_flags](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t f)->bool{
+      support_flags = f;
+      return true;
+    });
+    return support_flags & P2P_SUPPORT_FLAG_BLOCK_HEADERS;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::request_block_headers(cryptonote_connection_context &context)
+  {
+    if (!should_check_block_headers(context))
+      return false;
+
+    // headers up to the validated height were checked already, the needed blocks
+    // must agree with them: if they do not, only those below the chain height can
+    // be asked for, and if they are all checked, there is nothing to ask for
+    const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
+    const uint64_t headers_height = m_core.get_checked_headers_height(first_block_height, context.m_needed_objects);
+    if (headers_height < m_core.get_validated_headers_height() || headers_height > context.m_last_response_height)
+      return false;
+
+    // the needed blocks start past the checked headers, so the chain between
+    // them is asked for again
+    if (headers_height < first_block_height)
+    {
+      MDEBUG(context << "needed blocks start at " << first_block_height << ", past the checked block headers, up to " << headers_height);
+      context.m_needed_objects.clear();
+      context.m_last_response_height = headers_height - 1;
+      return false;
+    }
+
+    NOTIFY_REQUEST_BLOCK_HEADERS::request req;
+    for (size_t i = headers_height - first_block_height; i < context.m_needed_objects.size() && req.blocks.size() < CURRENCY_PROTOCOL_MAX_HEADERS_REQUEST_COUNT; ++i)
+      req.blocks.push_back(context.m_needed_objects[i].first);
+
+    context.m_last_request_time = boost::posix_time::microsec_clock::universal_time();
+    context.m_expect_height = headers_height;
+    context.m_expect_response = NOTIFY_RESPONSE_BLOCK_HEADERS::ID;
+    MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_BLOCK_HEADERS: blocks.size()=" << req.blocks.size() << " from " << headers_height);
+    post_notify<NOTIFY_REQUEST_BLOCK_HEADERS>(req, context);
+    MLOG_PEER_STATE("requesting block headers");
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   void t_cryptonote_protocol_handler<t_core>::hit_score(cryptonote_connection_context &context, int32_t score)
   {
     if (score <= 0)
@@ -33,6 +33,8 @@
 #include <boost/uuid/uuid_io.hpp>
 #include <chrono>
 #include <deque>
+#include <map>
+#include <memory>
 #include <stdexcept>
 #include <utility>
 
@@ -85,6 +87,13 @@ namespace levin
     using fluff_duration = crypto::random_poisson_subseconds::result_type;
     constexpr const fluff_duration fluff_average_out{fluff_duration{fluff_average_in} / 2};
 
+    /*! During tx bursts, flush times are rounded up to a grid which widens
+        with the deepest fluff queue, so connections flush together and share
+        one message for the same txs instead of each getting its own. Below
+        `fluff_coalesce_txs` queued txs the timers are left alone. */
+    constexpr const std::size_t fluff_coalesce_txs = 100;
+    constexpr const fluff_duration fluff_coalesce_max{std::chrono::seconds{1}};
+
     /*! Select a randomized duration from 0 to `range`. The precision will be to
         the systems `steady_clock`. As an example, supplying 3 seconds to this
         function will select a duration from [0, 3] seconds, and the increments
@@ -262,6 +271,20 @@ namespace levin
 
   namespace detail
   {
+    std::chrono::steady_clock::duration get_fluff_coalesce_window(const std::size_t depth)
+    {
+      const fluff_duration window{fluff_stepsize{1} * (depth / fluff_coalesce_txs)};
+      return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::min(window, fluff_coalesce_max));
+    }
+
+    std::chrono::steady_clock::time_point get_fluff_flush_time(const std::chrono::steady_clock::time_point flush_time, const std::chrono::steady_clock::duration window)
+    {
+      if (!window.count())
+        return flush_time;
+      const auto since_epoch = flush_time.time_since_epoch();
+      return flush_time + (window - since_epoch % window) % window;
+    }
+
     struct zone
     {
       explicit zone(boost::asio::io_service& io_service, std::shared_ptr<connections> p2p, epee::byte_slice noise_in, epee::net_utils::zone zone, bool pad_txs)
@@ -288,7 +311,7 @@ namespace levin
       boost::asio::steady_timer flush_txs;
       boost::asio::io_service::strand strand;
       struct context_t {
-        std::vector<cryptonote::blobdata> fluff_txs;
+        std::vector<std::shared_ptr<const cryptonote::blobdata>> fluff_txs; //!< Shared by all connections queueing the same tx
         std::chrono::steady_clock::time_point flush_time;
         bool m_is_income;
       };
@@ -368,7 +391,7 @@ namespace levin
 
         const auto now = std::chrono::steady_clock::now();
         auto next_flush = std::chrono::steady_clock::time_point::max();
-        std::vector<std::pair<std::vector<blobdata>, boost::uuids::uuid>> connections{};
+        std::vector<std::pair<std::vector<std::shared_ptr<const blobdata>>, boost::uuids::uuid>> connections{};
         for (auto &e: zone_->contexts)
         {
           auto &id = e.first;
@@ -393,13 +416,36 @@ namespace levin
 	   network is therefore replacing the sybil protection of Dandelion++.
 	   Dandelion++ stem phase over i2p/tor is also worth investigating
 	   (with/without "noise"?). */
+        const auto less = [](const std::shared_ptr<const blobdata>& a, const std::shared_ptr<const blobdata>& b) { return *a < *b; };
+        const auto equal = [](const std::shared_ptr<const blobdata>& a, const std::shared_ptr<const blobdata>& b) { return *a == *b; };
+        std::map<std::vector<const blobdata*>, std::vector<boost::uuids::uuid>> messages;
         for (auto& connection : connections)
         {
-          std::sort(connection.first.begin(), connection.first.end()); // don't leak receive order
-          connection.first.erase(std::unique(connection.first.begin(), connection.first.end()),
+          std::sort(connection.first.begin(), connection.first.end(), less); // don't leak receive order
+          connection.first.erase(std::unique(connection.first.begin(), connection.first.end(), equal),
                                   connection.first.end());
-          make_payload_send_txs(*zone_->p2p, std::move(connection.first), connection.second, zone_->pad_txs, true);
+
+          std::vector<const blobdata*> txs;
+          txs.reserve(connection.first.size());
+          for (const auto& tx : connection.first)
+            txs.push_back(tx.get());
+          messages[std::move(txs)].push_back(connection.second);
+        }
+
+        // connections flushing the same txs share one serialized message
+        for (const auto& message : messages)
+        {
+          std::vector<blobdata> txs;
+          txs.reserve(message.first.size());
+          for (const blobdata* tx : message.first)
+            txs.push_back(*tx);
+
+          const epee::byte_slice blob = make_tx_message(std::move(txs), zone_->pad_txs, true).finalize_notify(NOTIFY_NEW_TRANSACTIONS::ID);
+          for (const auto& destination : message.second)
+            zone_->p2p->send(blob.clone(), destination);
         }
+        if (!messages.empty())
+          MDEBUG("Fluffed to " << connections.size() << " connection(s) with " << messages.size() << " distinct message(s)");
 
         if (next_flush != std::chrono::steady_clock::time_point::max())
           fluff_flush::queue(std::move(zone_), next_flush);
@@ -434,6 +480,16 @@ namespace levin
         crypto::random_poisson_subseconds in_duration(fluff_average_in);
         crypto::random_poisson_subseconds out_duration(fluff_average_out);
 
+        // one copy of each tx, referenced from every connection's queue
+        std::vector<std::shared_ptr<const blobdata>> shared_txs;
+        shared_txs.reserve(txs.size());
+        for (const blobdata& tx : txs)
+          shared_txs.push_back(std::make_shared<const blobdata>(tx));
+
+        std::size_t depth = txs.size();
+        for (const auto &e: zone->contexts)
+          depth = std::max(depth, e.second.fluff_txs.size() + txs.size());
+        const auto window = detail::get_fluff_coalesce_window(depth);
 
         MDEBUG("Queueing " << txs.size() << " transaction(s) for Dandelion++ fluffing");
         for (auto &e: zone->contexts)
@@ -444,11 +500,11 @@ namespace levin
           if (source != id && (zone->nzone == epee::net_utils::zone::public_ || !context.m_is_income))
           {
             if (context.fluff_txs.empty())
-              context.flush_time = now + (context.m_is_income ? in_duration() : out_duration());
+              context.flush_time = detail::get_fluff_flush_time(now + (context.m_is_income ? in_duration() : out_duration()), window);
 
             next_flush = std::min(next_flush, context.flush_time);
-            context.fluff_txs.reserve(context.fluff_txs.size() + txs.size());
-            context.fluff_txs.insert(context.fluff_txs.end(), txs.begin(), txs.end());
+            context.fluff_txs.reserve(context.fluff_txs.size() + shared_txs.size());
+            context.fluff_txs.insert(context.fluff_txs.end(), shared_txs.begin(), shared_txs.end());
           }
         }
 
@@ -30,6 +30,7 @@
 
 #include <boost/asio/io_service.hpp>
 #include <boost/uuid/uuid.hpp>
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -61,6 +62,12 @@ namespace levin
   {
     using p2p_context = nodetool::p2p_connection_context_t<cryptonote::cryptonote_connection_context>;
     struct zone; //!< Internal data needed for zone notifications
+
+    //! \return Grid fluff flush times are rounded up to while a queue is `depth` txs deep, zero outside of bursts.
+    std::chrono::steady_clock::duration get_fluff_coalesce_window(std::size_t depth);
+
+    //! \return `flush_time` rounded up to a multiple of `window`, or unchanged if `window` is zero.
+    std::chrono::steady_clock::time_point get_fluff_flush_time(std::chrono::steady_clock::time_point flush_time, std::chrono::steady_clock::duration window);
   } // detail
 
   using connections = epee::levin::async_protocol_handler_config<detail::p2p_context>;
@@ -0,0 +1,190 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "misc_log_ex.h"
+#include "txpool_sketch.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.cn"
+
+namespace
+{
+  constexpr const size_t SUBTABLES = 3;
+  constexpr const uint64_t SHORT_ID_MASK = 0xffffffffffff;
+
+  // short ids are salted hashes already, this only needs to spread them
+  // differently for each subtable and for the check sum
+  uint64_t mix(uint64_t x)
+  {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+  }
+
+  uint32_t get_check_sum(uint64_t short_id)
+  {
+    return mix(short_id ^ 0x5bd1e9955bd1e995) >> 32;
+  }
+}
+
+namespace cryptonote
+{
+  txpool_sketch::txpool_sketch(size_t cells):
+    m_cells((std::max(cells, TXPOOL_SKETCH_MIN_CELLS) + SUBTABLES - 1) / SUBTABLES * SUBTABLES, cell{0, 0, 0})
+  {
+  }
+
+  size_t txpool_sketch::get_cells_for_difference(size_t difference)
+  {
+    // peeling succeeds most of the time with 1.23 cells per id for large
+    // differences, small ones need more slack
+    const size_t cells = std::max(TXPOOL_SKETCH_MIN_CELLS, difference + difference / 2 + 12);
+    return (cells + SUBTABLES - 1) / SUBTABLES * SUBTABLES;
+  }
+
+  void txpool_sketch::toggle(uint64_t short_id, uint32_t count)
+  {
+    const size_t subtable_size = m_cells.size() / SUBTABLES;
+    const uint32_t check_sum = get_check_sum(short_id);
+    for (size_t i = 0; i < SUBTABLES; ++i)
+    {
+      cell &c = m_cells[i * subtable_size + mix(short_id + i) % subtable_size];
+      c.count += count;
+      c.key_sum ^= short_id;
+      c.check_sum ^= check_sum;
+    }
+  }
+
+  void txpool_sketch::add(uint64_t short_id)
+  {
+    toggle(short_id & SHORT_ID_MASK, 1);
+  }
+
+  bool txpool_sketch::subtract(const txpool_sketch &other)
+  {
+    if (other.m_cells.size() != m_cells.size())
+      return false;
+    for (size_t i = 0; i < m_cells.size(); ++i)
+    {
+      m_cells[i].count -= other.m_cells[i].count;
+      m_cells[i].key_sum ^= other.m_cells[i].key_sum;
+      m_cells[i].check_sum ^= other.m_cells[i].check_sum;
+    }
+    return true;
+  }
+
+  bool txpool_sketch::is_pure(const cell &c)
+  {
+    const int32_t count = (int32_t)c.count;
+    return (count == 1 || count == -1) && (c.key_sum & ~SHORT_ID_MASK) == 0 && c.check_sum == get_check_sum(c.key_sum);
+  }
+
+  bool txpool_sketch::decode(std::vector<uint64_t> &ours, std::vector<uint64_t> &theirs) const
+  {
+    ours.clear();
+    theirs.clear();
+    txpool_sketch left = *this;
+    std::vector<size_t> pure;
+    for (size_t i = 0; i < left.m_cells.size(); ++i)
+      if (is_pure(left.m_cells[i]))
+        pure.push_back(i);
+
+    // each peeled id empties at least one cell, so a difference can not
+    // have more ids than there are cells
+    while (!pure.empty() && ours.size() + theirs.size() <= m_cells.size())
+    {
+      const cell c = left.m_cells[pure.back()];
+      pure.pop_back();
+      if (!is_pure(c))
+        continue;
+      (c.count == 1 ? ours : theirs).push_back(c.key_sum);
+      left.toggle(c.key_sum, 0u - c.count);
+      const size_t subtable_size = m_cells.size() / SUBTABLES;
+      for (size_t i = 0; i < SUBTABLES; ++i)
+      {
+        const size_t idx = i * subtable_size + mix(c.key_sum + i) % subtable_size;
+        if (is_pure(left.m_cells[idx]))
+          pure.push_back(idx);
+      }
+    }
+
+    for (const cell &c: left.m_cells)
+      if (c.count != 0 || c.key_sum != 0 || c.check_sum != 0)
+        return false;
+    return true;
+  }
+
+  std::string txpool_sketch::serialize() const
+  {
+    std::string blob;
+    blob.reserve(m_cells.size() * TXPOOL_SKETCH_CELL_SIZE);
+    for (const cell &c: m_cells)
+    {
+      for (size_t byte = 0; byte < 4; ++byte)
+        blob.push_back((char)(c.count >> (8 * byte)));
+      for (size_t byte = 0; byte < 6; ++byte)
+        blob.push_back((char)(c.key_sum >> (8 * byte)));
+      for (size_t byte = 0; byte < 4; ++byte)
+        blob.push_back((char)(c.check_sum >> (8 * byte)));
+    }
+    return blob;
+  }
+
+  bool txpool_sketch::parse(const std::string &blob)
+  {
+    if (blob.size() % TXPOOL_SKETCH_CELL_SIZE)
+    {
+      MDEBUG("Txpool sketch is not a multiple of " << TXPOOL_SKETCH_CELL_SIZE << " bytes");
+      return false;
+    }
+    const size_t n_cells = blob.size() / TXPOOL_SKETCH_CELL_SIZE;
+    if (n_cells < TXPOOL_SKETCH_MIN_CELLS || n_cells > TXPOOL_SKETCH_MAX_CELLS || n_cells % SUBTABLES)
+    {
+      MDEBUG("Txpool sketch has an invalid number of cells: " << n_cells);
+      return false;
+    }
+
+    m_cells.resize(n_cells);
+    const unsigned char *ptr = (const unsigned char*)blob.data();
+    for (cell &c: m_cells)
+    {
+      c.count = 0;
+      for (size_t byte = 0; byte < 4; ++byte)
+        c.count |= ((uint32_t)*ptr++) << (8 * byte);
+      c.key_sum = 0;
+      for (size_t byte = 0; byte < 6; ++byte)
+        c.key_sum |= ((uint64_t)*ptr++) << (8 * byte);
+      c.check_sum = 0;
+      for (size_t byte = 0; byte < 4; ++byte)
+        c.check_sum |= ((uint32_t)*ptr++) << (8 * byte);
+    }
+    return true;
+  }
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cryptonote
+{
+  //! bytes per cell of a serialized txpool sketch
+  constexpr const size_t TXPOOL_SKETCH_CELL_SIZE = 14;
+  //! fewest cells a txpool sketch has
+  constexpr const size_t TXPOOL_SKETCH_MIN_CELLS = 30;
+  //! pool difference the first sketch sent to a peer is sized for
+  constexpr const size_t TXPOOL_SKETCH_INITIAL_DIFFERENCE = 32;
+  //! most cells a peer may send us in a txpool sketch
+  constexpr const size_t TXPOOL_SKETCH_MAX_CELLS = 3 * 65536;
+
+  /**
+   * @brief an invertible bloom lookup table of short tx ids
+   *
+   * Each short id is added to one cell in each of three subtables. Subtracting
+   * the sketch of another set cancels out the ids both sets have, and what is
+   * left can be listed as long as the difference is small enough for the
+   * number of cells, about two thirds of them.
+   */
+  class txpool_sketch
+  {
+  public:
+    //! makes an empty sketch with at least `cells` cells
+    explicit txpool_sketch(size_t cells = TXPOOL_SKETCH_MIN_CELLS);
+
+    //! the number of cells needed to decode a difference of `difference` ids
+    static size_t get_cells_for_difference(size_t difference);
+
+    //! adds a short id, which must not be added twice
+    void add(uint64_t short_id);
+
+    /**
+     * @brief removes another set's ids from this sketch
+     *
+     * @return false if the sketches have a different number of cells
+     */
+    bool subtract(const txpool_sketch &other);
+
+    /**
+     * @brief lists the ids left after subtract
+     *
+     * @param ours return-by-reference ids only in this sketch's set
+     * @param theirs return-by-reference ids only in the subtracted set
+     *
+     * @return false if the difference is too large to be decoded
+     */
+    bool decode(std::vector<uint64_t> &ours, std::vector<uint64_t> &theirs) const;
+
+    //! the number of cells
+    size_t size() const { return m_cells.size(); }
+
+    //! serializes the cells, TXPOOL_SKETCH_CELL_SIZE bytes each
+    std::string serialize() const;
+
+    /**
+     * @brief loads a sketch serialized by a peer
+     *
+     * @return false if the blob is malformed or has too many cells
+     */
+    bool parse(const std::string &blob);
+
+  private:
+    struct cell
+    {
+      //! wraps, a peer's cells may hold anything; -1 is stored as 0xffffffff
+      uint32_t count;
+      uint64_t key_sum;
+      uint32_t check_sum;
+    };
+
+    void toggle(uint64_t short_id, uint32_t count);
+    static bool is_pure(const cell &c);
+
+    std::vector<cell> m_cells;
+  };
+}
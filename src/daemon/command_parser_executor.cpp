@@ -1053,7 +1053,7 @@ bool t_command_parser_executor::set_bootstrap_daemon(const std::vector<std::stri
 
 bool t_command_parser_executor::flush_cache(const std::vector<std::string>& args)
 {
-  bool bad_txs = false, bad_blocks = false;
+  bool bad_txs = false, bad_blocks = false, rpc_responses = false;
   std::string arg;
 
   if (args.empty())
@@ -1066,14 +1066,16 @@ bool t_command_parser_executor::flush_cache(const std::vector<std::string>& args
       bad_txs = true;
     else if (arg == "bad-blocks")
       bad_blocks = true;
+    else if (arg == "rpc-responses")
+      rpc_responses = true;
     else
       goto show_list;
   }
-  return m_executor.flush_cache(bad_txs, bad_blocks);
+  return m_executor.flush_cache(bad_txs, bad_blocks, rpc_responses);
 
 show_list:
   std::cout << "Invalid cache type: " << arg << std::endl;
-  std::cout << "Cache types: bad-txs bad-blocks" << std::endl;
+  std::cout << "Cache types: bad-txs bad-blocks rpc-responses" << std::endl;
   return true;
 }
 
@@ -72,7 +72,7 @@ public:
   void run()
   {
     MGINFO("Starting " << m_description << " RPC server...");
-    if (!m_server.run(2, false))
+    if (!m_server.run(m_server.get_threads_needed(), false))
     {
       throw std::runtime_error("Failed to start " + m_description + " RPC server.");
     }
@@ -82,6 +82,7 @@ public:
   void stop()
   {
     MGINFO("Stopping " << m_description << " RPC server...");
+    m_server.stop_dispatcher();
     m_server.send_stop_signal();
     m_server.timed_wait_server_stop(5000);
   }
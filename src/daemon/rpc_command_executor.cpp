@@ -2292,7 +2292,9 @@ bool t_rpc_command_executor::sync_info()
       tools::success_msg_writer() << address << "  " << p.info.peer_id << "  " <<
           epee::string_tools::pad_string(p.info.state, 16) << "  " <<
           epee::string_tools::pad_string(epee::string_tools::to_string_hex(p.info.pruning_seed), 8) << "  " << p.info.height << "  "  <<
-          p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued";
+          p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued" <<
+          (p.spans ? ", " + std::to_string(p.spans) + " spans at " + std::to_string(p.span_rate/1000) + " kB/s, " +
+            std::to_string(p.span_time) + " +/- " + std::to_string(p.span_time_dev) + " ms each, " + std::to_string(p.rerequested_spans) + " re-requested" : "");
     }
 
     uint64_t total_size = 0;
@@ -2447,7 +2449,7 @@ bool t_rpc_command_executor::set_bootstrap_daemon(
     return true;
 }
 
-bool t_rpc_command_executor::flush_cache(bool bad_txs, bool bad_blocks)
+bool t_rpc_command_executor::flush_cache(bool bad_txs, bool bad_blocks, bool rpc_responses)
 {
     cryptonote::COMMAND_RPC_FLUSH_CACHE::request req;
     cryptonote::COMMAND_RPC_FLUSH_CACHE::response res;
@@ -2456,6 +2458,7 @@ bool t_rpc_command_executor::flush_cache(bool bad_txs, bool bad_blocks)
 
     req.bad_txs = bad_txs;
     req.bad_blocks = bad_blocks;
+    req.rpc_responses = rpc_responses;
 
     if (m_is_rpc)
     {
@@ -51,6 +51,7 @@ using namespace epee;
 #include "net/local_ip.h"
 #include "net/parse.h"
 #include "storages/http_abstract_invoke.h"
+#include "storages/portable_storage_to_bin.h"
 #include "crypto/hash.h"
 #include "rpc/rpc_args.h"
 #include "rpc/rpc_handler.h"
@@ -76,6 +77,9 @@ using namespace epee;
 #define RESTRICTED_SPENT_KEY_IMAGES_COUNT 5000
 #define RESTRICTED_BLOCK_COUNT 1000
 
+// responses about blocks this close to the top are also keyed by the top hash
+#define RESPONSE_CACHE_SHALLOW_DEPTH 10
+
 #define RPC_TRACKER(rpc) \
   PERF_TIMER(rpc); \
   RPCTracker tracker(#rpc, PERF_TIMER_NAME(rpc))
@@ -144,6 +148,27 @@ namespace
   {
     store_128(difficulty, sdiff, swdiff, stop64);
   }
+
+  // the block headers in a response, in the order they get serialized
+  void get_block_headers(cryptonote::COMMAND_RPC_GET_BLOCK::response &res, std::vector<cryptonote::block_header_response*> &headers)
+  {
+    headers.push_back(&res.block_header);
+  }
+  void get_block_headers(cryptonote::COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::response &res, std::vector<cryptonote::block_header_response*> &headers)
+  {
+    headers.push_back(&res.block_header);
+    for (auto &header: res.block_headers)
+      headers.push_back(&header);
+  }
+  void get_block_headers(cryptonote::COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response &res, std::vector<cryptonote::block_header_response*> &headers)
+  {
+    headers.push_back(&res.block_header);
+  }
+  void get_block_headers(cryptonote::COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response &res, std::vector<cryptonote::block_header_response*> &headers)
+  {
+    for (auto &header: res.headers)
+      headers.push_back(&header);
+  }
 }
 
 namespace cryptonote
@@ -163,6 +188,11 @@ namespace cryptonote
     command_line::add_arg(desc, arg_rpc_payment_difficulty);
     command_line::add_arg(desc, arg_rpc_payment_credits);
     command_line::add_arg(desc, arg_rpc_payment_allow_free_loopback);
+    command_line::add_arg(desc, arg_rpc_threads);
+    command_line::add_arg(desc, arg_rpc_queue_size);
+    command_line::add_arg(desc, arg_rpc_expensive_threads);
+    command_line::add_arg(desc, arg_rpc_expensive_queue_size);
+    command_line::add_arg(desc, arg_rpc_response_cache_size);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(
@@ -174,8 +204,56 @@ namespace cryptonote
     , m_was_bootstrap_ever_used(false)
     , disable_rpc_ban(false)
     , m_rpc_payment_allow_free_loopback(false)
+    , m_response_cache(std::make_shared<rpc_response_cache>(0))
+    , m_response_cache_enabled(false)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context)
+  {
+    MINFO("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+
+    // the ticket holds the call's worker slot until the response is sent,
+    // a streamed body keeps it until its writer is done
+    const auto ticket = std::make_shared<rpc_dispatcher::ticket>();
+    const rpc_dispatcher::cost_class cost_class = rpc_dispatcher::classify(query_info.m_URI, query_info.m_body);
+    if (!m_dispatcher.admit(cost_class, *ticket))
+    {
+      MWARNING("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_URI << ": too many "
+          << (cost_class == rpc_dispatcher::cost_class_expensive ? "expensive" : "cheap") << " calls in progress, rejecting");
+      response.m_response_code = 503;
+      response.m_response_comment = "Service Unavailable";
+      response.m_additional_fields.push_back(std::make_pair("Retry-After", "1"));
+      return true;
+    }
+
+    response.m_response_code = 200;
+    response.m_response_comment = "Ok";
+    try
+    {
+      if (!handle_http_request_map(query_info, response, m_conn_context))
+      {
+        response.m_response_code = 404;
+        response.m_response_comment = "Not found";
+      }
+    }
+    catch (const std::exception &e)
+    {
+      MERROR(m_conn_context << "Exception in handle_http_request_map: " << e.what());
+      response.m_response_code = 500;
+      response.m_response_comment = "Internal Server Error";
+    }
+    if (response.m_body_writer)
+    {
+      std::function<bool(epee::net_utils::http::i_http_body_writer&)> body_writer = std::move(response.m_body_writer);
+      response.m_body_writer = [ticket, body_writer](epee::net_utils::http::i_http_body_writer& writer) {
+        const bool r = body_writer(writer);
+        ticket->release();
+        return r;
+      };
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::set_bootstrap_daemon(
     const std::string &address,
     const std::string &username_password,
@@ -290,6 +368,20 @@ namespace cryptonote
       }
     }
     disable_rpc_ban = rpc_config->disable_rpc_ban;
+    m_dispatcher.configure(rpc_dispatcher::cost_class_cheap, command_line::get_arg(vm, arg_rpc_threads), command_line::get_arg(vm, arg_rpc_queue_size));
+    m_dispatcher.configure(rpc_dispatcher::cost_class_expensive, command_line::get_arg(vm, arg_rpc_expensive_threads), command_line::get_arg(vm, arg_rpc_expensive_queue_size));
+    const uint64_t response_cache_size = command_line::get_arg(vm, arg_rpc_response_cache_size);
+    m_response_cache->set_max_bytes(response_cache_size * 1024 * 1024);
+    m_response_cache_enabled = response_cache_size > 0;
+    if (m_response_cache_enabled)
+    {
+      // a new block at height replaces whatever was at height and above on a reorg
+      std::weak_ptr<rpc_response_cache> response_cache = m_response_cache;
+      m_core.get_blockchain_storage().add_block_notify([response_cache](uint64_t height, epee::span<const block> blocks) {
+        if (std::shared_ptr<rpc_response_cache> cache = response_cache.lock())
+          cache->invalidate(height);
+      });
+    }
     const std::string data_dir{command_line::get_arg(vm, cryptonote::arg_data_dir)};
     std::string address = command_line::get_arg(vm, arg_rpc_payment_address);
     if (!address.empty() && allow_rpc_payment)
@@ -522,16 +614,36 @@ namespace cryptonote
 
     const bool restricted = m_restricted && ctx;
 
-    crypto::hash top_hash;
-    m_core.get_blockchain_top(res.height, top_hash);
-    ++res.height; // turn top block height into blockchain height
-    res.top_block_hash = string_tools::pod_to_hex(top_hash);
+    // chain and pool data below all come from the same snapshot, without
+    // waiting for block import. Nothing taking the blockchain lock may be
+    // called while it is held: a db resize waits for all read txns to end
+    // with that lock held.
+    boost::optional<Blockchain::chain_tip> tip;
+    {
+      const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
+      if (snapshot.tip())
+        tip = *snapshot.tip();
+      res.height = snapshot.height();
+      res.top_block_hash = string_tools::pod_to_hex(snapshot.top_hash());
+      res.tx_count = m_core.get_blockchain_storage().get_total_transactions() - res.height; //without coinbase
+      res.tx_pool_size = m_core.get_pool_transactions_count(!restricted);
+      res.alt_blocks_count = restricted ? 0 : m_core.get_blockchain_storage().get_alternative_blocks_count();
+      store_difficulty(m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(res.height - 1),
+          res.cumulative_difficulty, res.wide_cumulative_difficulty, res.cumulative_difficulty_top64);
+      res.adjusted_time = m_core.get_blockchain_storage().get_adjusted_time(res.height);
+    }
+    // without recorded metadata for the snapshot's top block, fall back to
+    // the locked getters, which may have moved on to a later block
+    if (!tip)
+    {
+      tip = Blockchain::chain_tip();
+      tip->next_difficulty = m_core.get_blockchain_storage().get_difficulty_for_next_block();
+      tip->block_weight_limit = m_core.get_blockchain_storage().get_current_cumulative_block_weight_limit();
+      tip->block_weight_median = m_core.get_blockchain_storage().get_current_cumulative_block_weight_median();
+    }
     res.target_height = m_p2p.get_payload_object().is_synchronized() ? 0 : m_core.get_target_blockchain_height();
-    store_difficulty(m_core.get_blockchain_storage().get_difficulty_for_next_block(), res.difficulty, res.wide_difficulty, res.difficulty_top64);
+    store_difficulty(tip->next_difficulty, res.difficulty, res.wide_difficulty, res.difficulty_top64);
     res.target = m_core.get_blockchain_storage().get_difficulty_target();
-    res.tx_count = m_core.get_blockchain_storage().get_total_transactions() - res.height; //without coinbase
-    res.tx_pool_size = m_core.get_pool_transactions_count(!restricted);
-    res.alt_blocks_count = restricted ? 0 : m_core.get_blockchain_storage().get_alternative_blocks_count();
     uint64_t total_conn = restricted ? 0 : m_p2p.get_public_connections_count();
     res.outgoing_connections_count = restricted ? 0 : m_p2p.get_public_outgoing_connections_count();
     res.incoming_connections_count = restricted ? 0 : (total_conn - res.outgoing_connections_count);
@@ -544,11 +656,8 @@ namespace cryptonote
     res.testnet = net_type == TESTNET;
     res.stagenet = net_type == STAGENET;
     res.nettype = net_type == MAINNET ? "mainnet" : net_type == TESTNET ? "testnet" : net_type == STAGENET ? "stagenet" : "fakechain";
-    store_difficulty(m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(res.height - 1),
-        res.cumulative_difficulty, res.wide_cumulative_difficulty, res.cumulative_difficulty_top64);
-    res.block_size_limit = res.block_weight_limit = m_core.get_blockchain_storage().get_current_cumulative_block_weight_limit();
-    res.block_size_median = res.block_weight_median = m_core.get_blockchain_storage().get_current_cumulative_block_weight_median();
-    res.adjusted_time = m_core.get_blockchain_storage().get_adjusted_time(res.height);
+    res.block_size_limit = res.block_weight_limit = tip->block_weight_limit;
+    res.block_size_median = res.block_weight_median = tip->block_weight_median;
 
     res.start_time = restricted ? 0 : (uint64_t)m_core.get_start_time();
     res.free_space = restricted ? std::numeric_limits<uint64_t>::max() : m_core.get_free_space();
@@ -571,6 +680,17 @@ namespace cryptonote
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     if (restricted)
       res.database_size = round_up(res.database_size, 5ull* 1024 * 1024 * 1024);
+    if (!restricted)
+    {
+      const db_batch_stats db_stats = m_core.get_blockchain_storage().get_db().get_batch_stats();
+      res.database_map_size = db_stats.map_size;
+      res.database_map_used = db_stats.map_used;
+      res.database_resizes = db_stats.resizes;
+      res.database_write_time = db_stats.write_time;
+      res.database_commit_time = db_stats.commit_time;
+      res.database_write_amplification = db_stats.write_amplification;
+      res.block_sync_size = m_core.get_block_sync_size(res.height);
+    }
     res.update_available = restricted ? false : m_core.is_update_available();
     res.version = restricted ? "" : MONERO_VERSION_FULL;
     res.synchronized = check_core_ready();
@@ -609,6 +729,88 @@ namespace cryptonote
   };
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res, const connection_context *ctx)
+  {
+    return get_blocks(req, res, NULL, ctx);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_bin(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, epee::byte_stream& body, const connection_context *ctx)
+  {
+    COMMAND_RPC_GET_BLOCKS_FAST::response res{};
+    if (!get_blocks(req, res, &body, ctx))
+      return false;
+    if (body.size() == 0) // the blocks were not streamed
+      return epee::serialization::store_t_to_binary(res, body);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  // Writes a get_blocks.bin response, with the block and tx blobs copied straight
+  // from the db into the output. res must not have any blocks, their entry is
+  // appended to the root section after the rest of res.
+  static void write_get_blocks_response(epee::byte_stream &out, COMMAND_RPC_GET_BLOCKS_FAST::response &res, const std::vector<block_blob_refs_t> &blocks, bool pruned)
+  {
+    using namespace epee::serialization;
+
+    size_t size = 1024;
+    for (const block_blob_refs_t &b: blocks)
+    {
+      size += 64 + b.block.size();
+      for (const auto &tx: b.txs)
+        size += 80 + tx.pruned.size() + tx.prunable.size();
+    }
+    out.reserve(size);
+
+    portable_storage ps;
+    res.store(ps);
+    ps.store_to_binary(out, blocks.empty() ? 0 : 1);
+    if (blocks.empty())
+      return;
+
+    // same layout as block_complete_entry, entries in the order a section would have them
+    pack_entry_name(out, "blocks");
+    pack_array_header(out, SERIALIZE_TYPE_OBJECT, blocks.size());
+    for (const block_blob_refs_t &b: blocks)
+    {
+      pack_varint(out, 1 + (pruned ? 1 : 0) + (b.txs.empty() ? 0 : 1));
+      pack_entry_name(out, "block");
+      out.put(SERIALIZE_TYPE_STRING);
+      put_string(out, b.block);
+      if (pruned)
+      {
+        pack_entry_name(out, "pruned");
+        out.put(SERIALIZE_TYPE_BOOL);
+        out.put(1);
+      }
+      if (b.txs.empty())
+        continue;
+      pack_entry_name(out, "txs");
+      if (pruned)
+      {
+        pack_array_header(out, SERIALIZE_TYPE_OBJECT, b.txs.size());
+        for (const auto &tx: b.txs)
+        {
+          pack_varint(out, 2);
+          pack_entry_name(out, "blob");
+          out.put(SERIALIZE_TYPE_STRING);
+          put_string(out, tx.pruned);
+          pack_entry_name(out, "prunable_hash");
+          out.put(SERIALIZE_TYPE_STRING);
+          put_string(out, epee::as_byte_span(crypto::null_hash));
+        }
+      }
+      else
+      {
+        pack_array_header(out, SERIALIZE_TYPE_STRING, b.txs.size());
+        for (const auto &tx: b.txs)
+        {
+          pack_varint(out, tx.pruned.size() + tx.prunable.size());
+          out.write(tx.pruned);
+          out.write(tx.prunable);
+        }
+      }
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res, epee::byte_stream *body, const connection_context *ctx)
   {
     RPC_TRACKER(get_blocks);
 
@@ -738,6 +940,60 @@ namespace cryptonote
         }
       }
 
+      if (body)
+      {
+        // stream the blobs from the db into the response, which is written while the db read txn is still open
+        bool streamed = false;
+        const bool r = m_core.find_blockchain_supplement(req.start_height, req.block_ids, res.current_height, res.top_block_hash, res.start_height, req.prune, !req.no_miner_tx, max_blocks, COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT,
+            [&](const std::vector<block_blob_refs_t> &bs) -> bool
+        {
+          CHECK_PAYMENT_SAME_TS(req, res, bs.size() * COST_PER_BLOCK);
+
+          size_t size = 0, ntxes = 0;
+          res.output_indices.reserve(bs.size());
+          for (const block_blob_refs_t &bd: bs)
+          {
+            size += bd.block.size();
+            ntxes += bd.txs.size();
+            res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
+            res.output_indices.back().indices.reserve(1 + bd.txs.size());
+            if (req.no_miner_tx)
+              res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
+            for (const auto &tx: bd.txs)
+              size += tx.pruned.size() + tx.prunable.size();
+
+            const size_t n_txes_to_lookup = bd.txs.size() + (req.no_miner_tx ? 0 : 1);
+            if (n_txes_to_lookup > 0)
+            {
+              std::vector<std::vector<uint64_t>> indices;
+              bool r = m_core.get_tx_outputs_gindexs(req.no_miner_tx ? bd.txs.front().hash : bd.miner_tx_hash, n_txes_to_lookup, indices);
+              if (!r || indices.size() != n_txes_to_lookup)
+              {
+                res.status = "Failed";
+                return true;
+              }
+              for (size_t i = 0; i < indices.size(); ++i)
+                res.output_indices.back().indices.push_back({std::move(indices[i])});
+            }
+          }
+
+          res.status = CORE_RPC_STATUS_OK;
+          write_get_blocks_response(*body, res, bs, req.prune);
+          streamed = true;
+          MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, size " << size << ", response size " << body->size());
+          return true;
+        });
+        if (!r)
+        {
+          res.status = "Failed";
+          add_host_fail(ctx);
+          return true;
+        }
+        if (!streamed)
+          res.output_indices.clear();
+        return true;
+      }
+
       std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > > bs;
       if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.top_block_hash, res.start_height, req.prune, !req.no_miner_tx, max_blocks, COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT))
       {
@@ -865,6 +1121,47 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_by_height_bin(const COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::request& req, epee::byte_stream& body, const connection_context *ctx)
+  {
+    COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::response res{};
+    if (!use_response_cache())
+    {
+      if (!on_get_blocks_by_height(req, res, ctx))
+        return false;
+      return epee::serialization::store_t_to_binary(res, body);
+    }
+
+    const std::string key = std::string("get_blocks_by_height.bin") + '\0' + epee::serialization::store_t_to_json(req, 0, false);
+    const uint64_t generation = m_response_cache->get_generation();
+    // the snapshot must not be held across the handler, which may call the bootstrap daemon
+    crypto::hash top_hash;
+    uint64_t height;
+    std::string cached;
+    bool hit;
+    {
+      const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
+      top_hash = snapshot.top_hash();
+      height = snapshot.height();
+      hit = m_response_cache->get(key, top_hash, height, cached);
+    }
+    if (!hit)
+    {
+      if (!on_get_blocks_by_height(req, res, ctx))
+        return false;
+      if (!epee::serialization::store_t_to_binary(res, body))
+        return false;
+      if (res.status != CORE_RPC_STATUS_OK || res.untrusted || req.heights.empty())
+        return true;
+      const uint64_t max_height = *std::max_element(req.heights.begin(), req.heights.end());
+      const bool shallow = max_height + RESPONSE_CACHE_SHALLOW_DEPTH >= height;
+      std::string serialized(reinterpret_cast<const char*>(body.data()), body.size());
+      m_response_cache->put(key, top_hash, shallow, generation, std::move(serialized), {}, max_height, height);
+      return true;
+    }
+    body.write(cached.data(), cached.size());
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_hashes(const COMMAND_RPC_GET_HASHES_FAST::request& req, COMMAND_RPC_GET_HASHES_FAST::response& res, const connection_context *ctx)
   {
     RPC_TRACKER(get_hashes);
@@ -909,6 +1206,7 @@ namespace cryptonote
       }
     }
 
+    const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
     if(!m_core.get_outs(req, res))
     {
       return true;
@@ -943,6 +1241,7 @@ namespace cryptonote
     req_bin.outputs = req.outputs;
     req_bin.get_txid = req.get_txid;
     cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::response res_bin;
+    const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
     if(!m_core.get_outs(req_bin, res_bin))
     {
       return true;
@@ -1019,6 +1318,9 @@ namespace cryptonote
       }
       vh.push_back(*reinterpret_cast<const crypto::hash*>(b.data()));
     }
+    // the chain and pool lookups see the same state, so a tx being mined
+    // meanwhile is found in exactly one of them
+    const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
     std::vector<crypto::hash> missed_txs;
     std::vector<std::tuple<crypto::hash, cryptonote::blobdata, crypto::hash, cryptonote::blobdata>> txs;
     bool r = m_core.get_split_transactions_blobs(vh, txs, missed_txs);
@@ -1147,9 +1449,10 @@ namespace cryptonote
           {
             // decode full tx to JSON
             tx_data = std::get<1>(tx) + std::get<3>(tx);
-            if (cryptonote::parse_and_validate_tx_from_blob(tx_data, t))
+            const std::shared_ptr<const cryptonote::cached_tx> cached = m_core.get_tx_cache().parse(tx_data);
+            if (cached)
             {
-              e.as_json = obj_to_json_str(t);
+              e.as_json = obj_to_json_str(const_cast<cryptonote::transaction&>(cached->tx));
             }
             else
             {
@@ -1166,10 +1469,10 @@ namespace cryptonote
         e.as_hex = string_tools::buff_to_hex_nodelimer(tx_data);
         if (req.decode_as_json)
         {
-          cryptonote::transaction t;
-          if (cryptonote::parse_and_validate_tx_from_blob(tx_data, t))
+          const std::shared_ptr<const cryptonote::cached_tx> cached = m_core.get_tx_cache().parse(tx_data);
+          if (cached)
           {
-            e.as_json = obj_to_json_str(t);
+            e.as_json = obj_to_json_str(const_cast<cryptonote::transaction&>(cached->tx));
           }
           else
           {
@@ -1708,6 +2011,7 @@ namespace cryptonote
     const bool request_has_rpc_origin = ctx != NULL;
     const bool allow_sensitive = !request_has_rpc_origin || !restricted;
 
+    const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
     size_t n_txes = m_core.get_pool_transactions_count(allow_sensitive);
     if (n_txes > 0)
     {
@@ -1732,6 +2036,7 @@ namespace cryptonote
     const bool request_has_rpc_origin = ctx != NULL;
     const bool allow_sensitive = !request_has_rpc_origin || !restricted;
 
+    const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
     size_t n_txes = m_core.get_pool_transactions_count(allow_sensitive);
     if (n_txes > 0)
     {
@@ -2483,6 +2788,7 @@ namespace cryptonote
 
     CHECK_CORE_READY();
     CHECK_PAYMENT_MIN1(req, res, COST_PER_BLOCK_HEADER, false);
+    const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
     uint64_t last_block_height;
     crypto::hash last_block_hash;
     m_core.get_blockchain_top(last_block_height, last_block_hash);
@@ -2582,7 +2888,8 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCK_HEADERS_RANGE>(invoke_http_mode::JON_RPC, "getblockheadersrange", req, res, r))
       return r;
 
-    const uint64_t bc_height = m_core.get_current_blockchain_height();
+    const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
+    const uint64_t bc_height = snapshot.height();
     if (req.start_height >= bc_height || req.end_height >= bc_height || req.start_height > req.end_height)
     {
       error_resp.code = CORE_RPC_ERROR_CODE_TOO_BIG_HEIGHT;
@@ -2735,6 +3042,76 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  template <typename COMMAND_TYPE>
+  bool core_rpc_server::get_cached_json_rpc(const char *method, bool (core_rpc_server::*handler)(const typename COMMAND_TYPE::request&, typename COMMAND_TYPE::response&, epee::json_rpc::error&, const connection_context*), const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, std::string& raw_result, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    if (!use_response_cache())
+      return (this->*handler)(req, res, error_resp, ctx);
+
+    const std::string key = std::string(method) + '\0' + epee::serialization::store_t_to_json(req, 0, false);
+    const uint64_t generation = m_response_cache->get_generation();
+    // the snapshot must not be held across the handler, which may call the bootstrap daemon
+    crypto::hash top_hash;
+    uint64_t height;
+    {
+      const Blockchain::read_snapshot snapshot(m_core.get_blockchain_storage());
+      top_hash = snapshot.top_hash();
+      height = snapshot.height();
+      if (m_response_cache->get(key, top_hash, height, raw_result))
+        return true;
+    }
+
+    if (!(this->*handler)(req, res, error_resp, ctx))
+      return false;
+    if (res.status != CORE_RPC_STATUS_OK || res.untrusted)
+      return true;
+
+    std::vector<block_header_response*> headers;
+    get_block_headers(res, headers);
+    std::vector<uint64_t> heights;
+    uint64_t max_height = 0;
+    bool shallow = false;
+    for (const block_header_response *header: headers)
+    {
+      if (header->hash.empty()) // not requested
+        continue;
+      if (header->orphan_status)
+        return true;
+      heights.push_back(header->height);
+      max_height = std::max(max_height, header->height);
+      shallow |= header->depth < RESPONSE_CACHE_SHALLOW_DEPTH;
+    }
+    if (heights.empty())
+      return true;
+    for (block_header_response *header: headers)
+      if (!header->hash.empty())
+        header->depth = rpc_response_cache::DEPTH_PLACEHOLDER;
+
+    std::string body = epee::serialization::store_t_to_json(res, 1);
+    raw_result = m_response_cache->put(key, top_hash, shallow, generation, std::move(body), std::move(heights), max_height, height);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_header_by_hash_cached(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::response& res, std::string& raw_result, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    return get_cached_json_rpc<COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH>("get_block_header_by_hash", &core_rpc_server::on_get_block_header_by_hash, req, res, raw_result, error_resp, ctx);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_header_by_height_cached(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response& res, std::string& raw_result, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    return get_cached_json_rpc<COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT>("get_block_header_by_height", &core_rpc_server::on_get_block_header_by_height, req, res, raw_result, error_resp, ctx);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_headers_range_cached(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response& res, std::string& raw_result, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    return get_cached_json_rpc<COMMAND_RPC_GET_BLOCK_HEADERS_RANGE>("get_block_headers_range", &core_rpc_server::on_get_block_headers_range, req, res, raw_result, error_resp, ctx);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_cached(const COMMAND_RPC_GET_BLOCK::request& req, COMMAND_RPC_GET_BLOCK::response& res, std::string& raw_result, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    return get_cached_json_rpc<COMMAND_RPC_GET_BLOCK>("get_block", &core_rpc_server::on_get_block, req, res, raw_result, error_resp, ctx);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_connections(const COMMAND_RPC_GET_CONNECTIONS::request& req, COMMAND_RPC_GET_CONNECTIONS::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
     RPC_TRACKER(get_connections);
@@ -3323,9 +3700,24 @@ namespace cryptonote
     res.target_height = m_p2p.get_payload_object().is_synchronized() ? 0 : m_core.get_target_blockchain_height();
     res.next_needed_pruning_seed = m_p2p.get_payload_object().get_next_needed_pruning_stripe().second;
 
+    const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
+    std::unordered_map<std::string, cryptonote::block_queue::peer_score> scores;
+    for (const auto &e: block_queue.get_peer_scores())
+      scores.emplace(epee::string_tools::pod_to_hex(e.first), e.second);
     for (const auto &c: m_p2p.get_payload_object().get_connections())
+    {
       res.peers.push_back({c});
-    const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
+      const auto i = scores.find(c.connection_id);
+      if (i == scores.end())
+        continue;
+      COMMAND_RPC_SYNC_INFO::peer &p = res.peers.back();
+      p.span_rate = i->second.rate + 0.5f;
+      p.span_rate_dev = i->second.rate_dev + 0.5f;
+      p.span_time = i->second.span_time * 1000 + 0.5f;
+      p.span_time_dev = i->second.span_time_dev * 1000 + 0.5f;
+      p.spans = i->second.spans;
+      p.rerequested_spans = i->second.rerequested;
+    }
     block_queue.foreach([&](const cryptonote::block_queue::span &span) {
       const std::string span_connection_id = epee::string_tools::pod_to_hex(span.connection_id);
       uint32_t speed = (uint32_t)(100.0f * block_queue.get_speed(span.connection_id) + 0.5f);
@@ -3384,7 +3776,7 @@ namespace cryptonote
       const uint64_t req_to_height = req.to_height ? req.to_height : (m_core.get_current_blockchain_height() - 1);
       for (uint64_t amount: req.amounts)
       {
-        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, [this](uint64_t height) { return m_core.get_blockchain_storage().get_db().get_block_hash_from_height(height); }, req.cumulative, m_core.get_current_blockchain_height());
+        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, req.cumulative);
         if (!data)
         {
           error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
@@ -3439,7 +3831,7 @@ namespace cryptonote
       const uint64_t req_to_height = req.to_height ? req.to_height : (m_core.get_current_blockchain_height() - 1);
       for (uint64_t amount: req.amounts)
       {
-        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, [this](uint64_t height) { return m_core.get_blockchain_storage().get_db().get_block_hash_from_height(height); }, req.cumulative, m_core.get_current_blockchain_height());
+        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, req.cumulative);
         if (!data)
         {
           res.status = "Failed to get output distribution";
@@ -3555,6 +3947,8 @@ namespace cryptonote
       m_core.flush_bad_txs_cache();
     if (req.bad_blocks)
       m_core.flush_invalid_blocks();
+    if (req.rpc_responses)
+      m_response_cache->clear();
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -3752,6 +4146,36 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_rpc_load(const COMMAND_RPC_GET_RPC_LOAD::request& req, COMMAND_RPC_GET_RPC_LOAD::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_rpc_load);
+
+    for (const auto &stats: m_dispatcher.get_stats())
+    {
+      res.classes.resize(res.classes.size() + 1);
+      COMMAND_RPC_GET_RPC_LOAD::cost_class &c = res.classes.back();
+      c.name = stats.name;
+      c.workers = stats.workers;
+      c.max_queue = stats.max_queue;
+      c.active = stats.active;
+      c.queued = stats.queued;
+      c.admitted = stats.admitted;
+      c.shed = stats.shed;
+      c.queue_depth_histogram = stats.queue_depth_histogram;
+      c.latency_histogram = stats.latency_histogram;
+    }
+
+    const rpc_response_cache::stats_t cache_stats = m_response_cache->get_stats();
+    res.response_cache.hits = cache_stats.hits;
+    res.response_cache.misses = cache_stats.misses;
+    res.response_cache.entries = cache_stats.entries;
+    res.response_cache.bytes = cache_stats.bytes;
+    res.response_cache.max_bytes = cache_stats.max_bytes;
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_rpc_access_data(const COMMAND_RPC_ACCESS_DATA::request& req, COMMAND_RPC_ACCESS_DATA::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
     RPC_TRACKER(rpc_access_data);
@@ -3878,4 +4302,34 @@ namespace cryptonote
     , "Allow free access from the loopback address (ie, the local host)"
     , false
     };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_threads = {
+      "rpc-threads"
+    , "Number of RPC calls served at once, not counting expensive calls"
+    , 2
+    };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_queue_size = {
+      "rpc-queue-size"
+    , "Number of RPC calls which may wait for a thread before further calls get a 503 reply"
+    , 8
+    };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_expensive_threads = {
+      "rpc-expensive-threads"
+    , "Number of expensive RPC calls (output histograms and distributions, generateblocks, etc) served at once"
+    , 1
+    };
+
+  const command_line::arg_descriptor<uint64_t> core_rpc_server::arg_rpc_response_cache_size = {
+      "rpc-response-cache-size"
+    , "Size in MB of the cache of serialized block and block header RPC responses, 0 to disable"
+    , 32
+    };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_expensive_queue_size = {
+      "rpc-expensive-queue-size"
+    , "Number of expensive RPC calls which may wait for a thread before further ones get a 503 reply"
+    , 2
+    };
 }  // namespace cryptonote
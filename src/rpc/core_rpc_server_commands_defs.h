@@ -101,7 +101,7 @@ inline const std::string get_rpc_status(const bool trusted_daemon, const std::st
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 3
-#define CORE_RPC_VERSION_MINOR 16
+#define CORE_RPC_VERSION_MINOR 19
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -753,6 +753,13 @@ inline const std::string get_rpc_status(const bool trusted_daemon, const std::st
       uint64_t height_without_bootstrap;
       bool was_bootstrap_ever_used;
       uint64_t database_size;
+      uint64_t database_map_size;
+      uint64_t database_map_used;
+      uint64_t database_resizes;
+      uint64_t database_write_time;
+      uint64_t database_commit_time;
+      double database_write_amplification;
+      uint64_t block_sync_size;
       bool update_available;
       bool busy_syncing;
       std::string version;
@@ -795,6 +802,13 @@ inline const std::string get_rpc_status(const bool trusted_daemon, const std::st
         KV_SERIALIZE(height_without_bootstrap)
         KV_SERIALIZE(was_bootstrap_ever_used)
         KV_SERIALIZE(database_size)
+        KV_SERIALIZE_OPT(database_map_size, (uint64_t)0)
+        KV_SERIALIZE_OPT(database_map_used, (uint64_t)0)
+        KV_SERIALIZE_OPT(database_resizes, (uint64_t)0)
+        KV_SERIALIZE_OPT(database_write_time, (uint64_t)0)
+        KV_SERIALIZE_OPT(database_commit_time, (uint64_t)0)
+        KV_SERIALIZE_OPT(database_write_amplification, 0.0)
+        KV_SERIALIZE_OPT(block_sync_size, (uint64_t)0)
         KV_SERIALIZE(update_available)
         KV_SERIALIZE(busy_syncing)
         KV_SERIALIZE(version)
@@ -2393,9 +2407,21 @@ inline const std::string get_rpc_status(const bool trusted_daemon, const std::st
     struct peer
     {
       connection_info info;
+      uint64_t span_rate;
+      uint64_t span_rate_dev;
+      uint32_t span_time;
+      uint32_t span_time_dev;
+      uint64_t spans;
+      uint64_t rerequested_spans;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(info)
+        KV_SERIALIZE_OPT(span_rate, (uint64_t)0)
+        KV_SERIALIZE_OPT(span_rate_dev, (uint64_t)0)
+        KV_SERIALIZE_OPT(span_time, (uint32_t)0)
+        KV_SERIALIZE_OPT(span_time_dev, (uint32_t)0)
+        KV_SERIALIZE_OPT(spans, (uint64_t)0)
+        KV_SERIALIZE_OPT(rerequested_spans, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -2777,11 +2803,13 @@ inline const std::string get_rpc_status(const bool trusted_daemon, const std::st
     {
       bool bad_txs;
       bool bad_blocks;
+      bool rpc_responses;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_request_base)
         KV_SERIALIZE_OPT(bad_txs, false)
         KV_SERIALIZE_OPT(bad_blocks, false)
+        KV_SERIALIZE_OPT(rpc_responses, false)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -2822,4 +2850,70 @@ inline const std::string get_rpc_status(const bool trusted_daemon, const std::st
     typedef epee::misc_utils::struct_init<response_t> response;
   };
 
+  struct COMMAND_RPC_GET_RPC_LOAD
+  {
+    struct request_t: public rpc_request_base
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct cost_class
+    {
+      std::string name;
+      uint32_t workers;
+      uint32_t max_queue;
+      uint32_t active;
+      uint32_t queued;
+      uint64_t admitted;
+      uint64_t shed;
+      std::vector<uint64_t> queue_depth_histogram;
+      std::vector<uint64_t> latency_histogram;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(workers)
+        KV_SERIALIZE(max_queue)
+        KV_SERIALIZE(active)
+        KV_SERIALIZE(queued)
+        KV_SERIALIZE(admitted)
+        KV_SERIALIZE(shed)
+        KV_SERIALIZE(queue_depth_histogram)
+        KV_SERIALIZE(latency_histogram)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct cache_stats
+    {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t entries;
+      uint64_t bytes;
+      uint64_t max_bytes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(hits)
+        KV_SERIALIZE(misses)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(bytes)
+        KV_SERIALIZE(max_bytes)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response_t: public rpc_response_base
+    {
+      std::vector<cost_class> classes;
+      cache_stats response_cache;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(classes)
+        KV_SERIALIZE(response_cache)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
 }
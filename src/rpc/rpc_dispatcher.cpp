@@ -0,0 +1,271 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include <boost/chrono/duration.hpp>
+#include "misc_log_ex.h"
+#include "net/jsonrpc_structs.h"
+#include "storages/portable_storage_template_helper.h"
+#include "core_rpc_server_commands_defs.h"
+#include "rpc_payment_costs.h"
+#include "rpc_dispatcher.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+// calls nominally costing at least this many credits go to the expensive class
+#define EXPENSIVE_CALL_COST 1000
+// nominal costs of calls RPC payment does not charge for
+#define TXIDS_LOOSE_CALL_COST 10000
+#define GENERATE_BLOCKS_CALL_COST 100000
+
+#define DEFAULT_MAX_QUEUE_WAIT std::chrono::seconds(10)
+
+namespace
+{
+  struct endpoint_cost
+  {
+    const char *endpoint;
+    uint64_t cost;
+  };
+
+  // nominal cost of a typical call, for endpoints whose cost depends on the request
+  const endpoint_cost endpoint_costs[] =
+  {
+    { "get_output_histogram", COST_PER_OUTPUT_HISTOGRAM },
+    { "get_output_distribution", COST_PER_OUTPUT_DISTRIBUTION },
+    { "/get_output_distribution.bin", COST_PER_OUTPUT_DISTRIBUTION },
+    { "get_coinbase_tx_sum", COST_PER_COINBASE_TX_SUM_BLOCK * 1000 },
+    { "get_txids_loose", TXIDS_LOOSE_CALL_COST },
+    { "generateblocks", GENERATE_BLOCKS_CALL_COST },
+  };
+
+  // charged like the call itself: the rct distribution (amount 0) is cheap,
+  // others are not; a body which does not parse costs a typical call
+  uint64_t get_output_distribution_cost(bool json_rpc, const std::string &body)
+  {
+    cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req;
+    if (json_rpc)
+    {
+      epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request> envelope;
+      if (!epee::serialization::load_t_from_json(envelope, body))
+        return COST_PER_OUTPUT_DISTRIBUTION;
+      req = std::move(envelope.params);
+    }
+    else if (!epee::serialization::load_t_from_binary(req, body))
+      return COST_PER_OUTPUT_DISTRIBUTION;
+
+    uint64_t cost = 0;
+    for (uint64_t amount: req.amounts)
+      cost += amount ? COST_PER_OUTPUT_DISTRIBUTION : COST_PER_OUTPUT_DISTRIBUTION_0;
+    return cost;
+  }
+
+  cryptonote::rpc_dispatcher::cost_class get_cost_class(uint64_t cost)
+  {
+    return cost >= EXPENSIVE_CALL_COST ? cryptonote::rpc_dispatcher::cost_class_expensive : cryptonote::rpc_dispatcher::cost_class_cheap;
+  }
+
+  const char *const class_names[cryptonote::rpc_dispatcher::cost_class_count] = { "cheap", "expensive" };
+
+  // 0 for 0, i for [2^(i-1), 2^i)
+  std::size_t log2_bucket(uint64_t value, std::size_t buckets)
+  {
+    std::size_t bucket = 0;
+    while (value)
+    {
+      ++bucket;
+      value >>= 1;
+    }
+    return std::min(bucket, buckets - 1);
+  }
+}
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_dispatcher::ticket::release()
+  {
+    if (!m_dispatcher)
+      return;
+    m_dispatcher->release(m_class, m_start);
+    m_dispatcher = nullptr;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_dispatcher::rpc_dispatcher():
+    m_max_queue_wait(DEFAULT_MAX_QUEUE_WAIT),
+    m_stopped(false)
+  {
+    for (class_state &s: m_classes)
+      memset(&s, 0, sizeof(s));
+    configure(cost_class_cheap, 2, 8);
+    configure(cost_class_expensive, 1, 2);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_dispatcher::configure(cost_class c, unsigned workers, unsigned max_queue)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    m_classes[c].workers = std::max(workers, 1u);
+    m_classes[c].max_queue = max_queue;
+    m_cond[c].notify_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  unsigned rpc_dispatcher::get_threads_needed() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    unsigned threads = SPARE_THREADS;
+    for (const class_state &s: m_classes)
+      threads += s.workers + s.max_queue;
+    return threads;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_dispatcher::cost_class rpc_dispatcher::classify(const std::string &uri, const std::string &body)
+  {
+    const bool json_rpc = uri == "/json_rpc";
+    std::string endpoint = uri;
+    if (json_rpc && !get_json_rpc_method(body, endpoint))
+      return cost_class_cheap;
+    if (endpoint == (json_rpc ? "get_output_distribution" : "/get_output_distribution.bin"))
+      return get_cost_class(get_output_distribution_cost(json_rpc, body));
+    return classify_endpoint(endpoint);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_dispatcher::cost_class rpc_dispatcher::classify_endpoint(const std::string &endpoint)
+  {
+    for (const endpoint_cost &e: endpoint_costs)
+      if (endpoint == e.endpoint)
+        return get_cost_class(e.cost);
+    return cost_class_cheap;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_dispatcher::get_json_rpc_method(const std::string &body, std::string &method)
+  {
+    // this only steers scheduling, so it does not need to be a full parser: the
+    // first "method" key wins and escapes are not handled (method names have none)
+    static const char key[] = "\"method\"";
+    size_t pos = body.find(key);
+    if (pos == std::string::npos)
+      return false;
+    pos += sizeof(key) - 1;
+    const auto skip_whitespace = [&body](size_t pos) {
+      while (pos < body.size() && strchr(" \t\r\n", body[pos]))
+        ++pos;
+      return pos;
+    };
+    pos = skip_whitespace(pos);
+    if (pos >= body.size() || body[pos] != ':')
+      return false;
+    pos = skip_whitespace(pos + 1);
+    if (pos >= body.size() || body[pos] != '"')
+      return false;
+    const size_t end = body.find('"', ++pos);
+    if (end == std::string::npos)
+      return false;
+    method = body.substr(pos, end - pos);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_dispatcher::admit(cost_class c, ticket &t)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    class_state &s = m_classes[c];
+    ++s.queue_depth_histogram[log2_bucket(s.queued, QUEUE_DEPTH_BUCKETS)];
+    if (m_stopped)
+      return false;
+
+    // queue behind any earlier waiters rather than racing them for a freed slot
+    if (s.active >= s.workers || s.queued > 0)
+    {
+      if (s.queued >= s.max_queue)
+      {
+        ++s.shed;
+        return false;
+      }
+      ++s.queued;
+      const bool ready = m_cond[c].wait_for(lock, boost::chrono::milliseconds(m_max_queue_wait.count()),
+          [this, &s]() { return m_stopped || s.active < s.workers; });
+      --s.queued;
+      if (!ready || m_stopped)
+      {
+        ++s.shed;
+        if (s.active < s.workers)
+          m_cond[c].notify_one();
+        return false;
+      }
+    }
+
+    ++s.active;
+    ++s.admitted;
+    t.release();
+    t.m_dispatcher = this;
+    t.m_class = c;
+    t.m_start = start;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_dispatcher::release(cost_class c, std::chrono::steady_clock::time_point start)
+  {
+    const uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    class_state &s = m_classes[c];
+    --s.active;
+    ++s.latency_histogram[log2_bucket(ms, LATENCY_BUCKETS)];
+    m_cond[c].notify_one();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::vector<rpc_dispatcher::class_stats> rpc_dispatcher::get_stats() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    std::vector<class_stats> stats(cost_class_count);
+    for (size_t c = 0; c < cost_class_count; ++c)
+    {
+      const class_state &s = m_classes[c];
+      class_stats &out = stats[c];
+      out.name = class_names[c];
+      out.workers = s.workers;
+      out.max_queue = s.max_queue;
+      out.active = s.active;
+      out.queued = s.queued;
+      out.admitted = s.admitted;
+      out.shed = s.shed;
+      out.queue_depth_histogram.assign(s.queue_depth_histogram, s.queue_depth_histogram + QUEUE_DEPTH_BUCKETS);
+      out.latency_histogram.assign(s.latency_histogram, s.latency_histogram + LATENCY_BUCKETS);
+    }
+    return stats;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_dispatcher::stop()
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    m_stopped = true;
+    for (boost::condition_variable &cond: m_cond)
+      cond.notify_all();
+  }
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace cryptonote
+{
+  //! Admission control for the RPC server's connection threads.
+  //!
+  //! Every request is assigned a cost class from its endpoint. Each class has
+  //! a fixed number of worker slots and a bounded queue in front of them; a
+  //! request that finds both full is shed, and the caller answers 503.
+  class rpc_dispatcher
+  {
+  public:
+    enum cost_class
+    {
+      cost_class_cheap = 0,
+      cost_class_expensive,
+      cost_class_count
+    };
+
+    //! connection threads kept beyond all classes' workers and queues, so a
+    //! call arriving when every class is full still gets a thread to be shed on
+    static constexpr const unsigned SPARE_THREADS = 2;
+    static constexpr const std::size_t QUEUE_DEPTH_BUCKETS = 8;
+    static constexpr const std::size_t LATENCY_BUCKETS = 16;
+
+    struct class_stats
+    {
+      std::string name;
+      unsigned workers;
+      unsigned max_queue;
+      unsigned active;
+      unsigned queued;
+      uint64_t admitted;
+      uint64_t shed;
+      //! bucket 0 counts requests which found an empty queue, bucket i
+      //! those which found [2^(i-1), 2^i) requests queued ahead of them
+      std::vector<uint64_t> queue_depth_histogram;
+      //! bucket i counts requests which completed (queueing included) in
+      //! less than 2^i ms, the last bucket holds everything slower
+      std::vector<uint64_t> latency_histogram;
+    };
+
+    //! Holds a worker slot until destroyed, then records the request's latency
+    class ticket
+    {
+    public:
+      ticket(): m_dispatcher(nullptr), m_class(cost_class_cheap) {}
+      ticket(const ticket&) = delete;
+      ticket &operator=(const ticket&) = delete;
+      ~ticket() { release(); }
+
+      void release();
+
+    private:
+      friend class rpc_dispatcher;
+
+      rpc_dispatcher *m_dispatcher;
+      cost_class m_class;
+      std::chrono::steady_clock::time_point m_start;
+    };
+
+    rpc_dispatcher();
+
+    void configure(cost_class c, unsigned workers, unsigned max_queue);
+    void set_max_queue_wait(std::chrono::milliseconds wait) { m_max_queue_wait = wait; }
+    //! number of connection threads needed so that no class can starve another,
+    //! nor a saturated server the calls it has to shed
+    unsigned get_threads_needed() const;
+
+    //! cost class of an RPC, by URI, or by method name for /json_rpc
+    static cost_class classify(const std::string &uri, const std::string &body);
+    static cost_class classify_endpoint(const std::string &endpoint);
+    //! cheap scan for the "method" member of a JSON-RPC request body
+    static bool get_json_rpc_method(const std::string &body, std::string &method);
+
+    //! waits for a worker slot; false if the class is saturated or the wait times out
+    bool admit(cost_class c, ticket &t);
+    std::vector<class_stats> get_stats() const;
+    void stop();
+
+  private:
+    struct class_state
+    {
+      unsigned workers;
+      unsigned max_queue;
+      unsigned active;
+      unsigned queued;
+      uint64_t admitted;
+      uint64_t shed;
+      uint64_t queue_depth_histogram[QUEUE_DEPTH_BUCKETS];
+      uint64_t latency_histogram[LATENCY_BUCKETS];
+    };
+
+    void release(cost_class c, std::chrono::steady_clock::time_point start);
+
+    mutable boost::mutex m_lock;
+    boost::condition_variable m_cond[cost_class_count];
+    class_state m_classes[cost_class_count];
+    std::chrono::milliseconds m_max_queue_wait;
+    bool m_stopped;
+  };
+}
@@ -0,0 +1,214 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <iterator>
+#include "misc_log_ex.h"
+#include "rpc_response_cache.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+namespace
+{
+  // a depth placeholder as written by store_t_to_json, a quote cannot appear unescaped in a value
+  const std::string depth_placeholder = "\"depth\": " + std::to_string(cryptonote::rpc_response_cache::DEPTH_PLACEHOLDER);
+  const size_t depth_placeholder_value_offset = depth_placeholder.size() - std::to_string(cryptonote::rpc_response_cache::DEPTH_PLACEHOLDER).size();
+
+  std::string shallow_key(const std::string &key, const crypto::hash &top_hash)
+  {
+    return key + '\0' + std::string(top_hash.data, sizeof(top_hash.data));
+  }
+}
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_response_cache::rpc_response_cache(size_t max_bytes):
+    m_max_bytes(max_bytes),
+    m_bytes(0),
+    m_generation(0),
+    m_max_cached_height(0),
+    m_shallow_entries(0),
+    m_hits(0),
+    m_misses(0)
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::set_max_bytes(size_t max_bytes)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    m_max_bytes = max_bytes;
+    while (m_bytes > m_max_bytes && !m_entries.empty())
+      erase(std::prev(m_entries.end()));
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  uint64_t rpc_response_cache::get_generation() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    return m_generation;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_response_cache::get(const std::string &key, const crypto::hash &top_hash, uint64_t chain_height, std::string &body)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+      it = m_index.find(shallow_key(key, top_hash));
+    if (it != m_index.end() && it->second->max_height >= chain_height)
+    {
+      // blocks were popped, and not replaced yet
+      erase(it->second);
+      it = m_index.end();
+    }
+    if (it == m_index.end())
+    {
+      ++m_misses;
+      return false;
+    }
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    body = render(*it->second, chain_height);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::string rpc_response_cache::put(const std::string &key, const crypto::hash &top_hash, bool shallow, uint64_t generation,
+      std::string body, std::vector<uint64_t> heights, uint64_t max_height, uint64_t chain_height)
+  {
+    entry_t e;
+    e.key = shallow ? shallow_key(key, top_hash) : key;
+    e.body = std::move(body);
+    e.heights = std::move(heights);
+    e.max_height = max_height;
+    e.shallow = shallow;
+    if (!e.heights.empty())
+    {
+      for (size_t pos = e.body.find(depth_placeholder); pos != std::string::npos; pos = e.body.find(depth_placeholder, pos + depth_placeholder.size()))
+        e.depth_offsets.push_back(pos + depth_placeholder_value_offset);
+    }
+    if (e.depth_offsets.size() != e.heights.size())
+    {
+      MERROR("Found " << e.depth_offsets.size() << " depths in RPC response, expected " << e.heights.size() << ", not caching");
+      e.heights.resize(e.depth_offsets.size(), chain_height - 1);
+      return render(e, chain_height);
+    }
+    std::string rendered = render(e, chain_height);
+
+    const size_t size = get_entry_size(e);
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    if (generation != m_generation || size > m_max_bytes)
+      return rendered;
+    const auto existing = m_index.find(e.key);
+    if (existing != m_index.end())
+      erase(existing->second);
+    while (m_bytes + size > m_max_bytes && !m_entries.empty())
+      erase(std::prev(m_entries.end()));
+
+    m_max_cached_height = std::max(m_max_cached_height, e.max_height);
+    if (e.shallow)
+      ++m_shallow_entries;
+    m_bytes += size;
+    m_entries.push_front(std::move(e));
+    m_index[m_entries.front().key] = m_entries.begin();
+    return rendered;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::invalidate(uint64_t height)
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    ++m_generation;
+    // the common case, a new block on top of a chain whose responses are all buried
+    if (height > m_max_cached_height && m_shallow_entries == 0)
+      return;
+    m_max_cached_height = 0;
+    for (auto it = m_entries.begin(); it != m_entries.end(); )
+    {
+      auto next = std::next(it);
+      if (it->shallow || it->max_height >= height)
+        erase(it);
+      else
+        m_max_cached_height = std::max(m_max_cached_height, it->max_height);
+      it = next;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::clear()
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    ++m_generation;
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+    m_max_cached_height = 0;
+    m_shallow_entries = 0;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_response_cache::stats_t rpc_response_cache::get_stats() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    stats_t stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.entries = m_entries.size();
+    stats.bytes = m_bytes;
+    stats.max_bytes = m_max_bytes;
+    return stats;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::string rpc_response_cache::render(const entry_t &e, uint64_t chain_height)
+  {
+    if (e.depth_offsets.empty())
+      return e.body;
+    const size_t placeholder_size = depth_placeholder.size() - depth_placeholder_value_offset;
+    std::string out;
+    out.reserve(e.body.size());
+    size_t pos = 0;
+    for (size_t i = 0; i < e.depth_offsets.size(); ++i)
+    {
+      out.append(e.body, pos, e.depth_offsets[i] - pos);
+      out += std::to_string(chain_height > e.heights[i] ? chain_height - e.heights[i] - 1 : 0);
+      pos = e.depth_offsets[i] + placeholder_size;
+    }
+    out.append(e.body, pos, std::string::npos);
+    return out;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_response_cache::get_entry_size(const entry_t &e)
+  {
+    return sizeof(e) + 2 * e.key.size() + e.body.size() + e.depth_offsets.size() * sizeof(size_t) + e.heights.size() * sizeof(uint64_t);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::erase(std::list<entry_t>::iterator it)
+  {
+    m_bytes -= get_entry_size(*it);
+    if (it->shallow)
+      --m_shallow_entries;
+    m_index.erase(it->key);
+    m_entries.erase(it);
+  }
+}
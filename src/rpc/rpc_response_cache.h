@@ -0,0 +1,103 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  //! Byte budgeted LRU cache of serialized RPC responses about blocks in the chain.
+  //!
+  //! JSON bodies may contain block header depths, which change with every new block:
+  //! those are serialized as DEPTH_PLACEHOLDER and filled in each time the body is
+  //! served. Responses about blocks near the top are stored under the top hash too,
+  //! the rest live until a block at or below their highest block gets replaced.
+  class rpc_response_cache
+  {
+  public:
+    static constexpr const uint64_t DEPTH_PLACEHOLDER = (uint64_t)-1;
+
+    struct stats_t
+    {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t entries;
+      uint64_t bytes;
+      uint64_t max_bytes;
+    };
+
+    explicit rpc_response_cache(size_t max_bytes);
+
+    void set_max_bytes(size_t max_bytes);
+    //! changes whenever entries get invalidated, a body computed before may not be put
+    uint64_t get_generation() const;
+
+    bool get(const std::string &key, const crypto::hash &top_hash, uint64_t chain_height, std::string &body);
+    //! body has a placeholder depth for each of heights, in order; returns it with depths filled in
+    std::string put(const std::string &key, const crypto::hash &top_hash, bool shallow, uint64_t generation,
+        std::string body, std::vector<uint64_t> heights, uint64_t max_height, uint64_t chain_height);
+
+    //! drops entries for responses including a block at height or above
+    void invalidate(uint64_t height);
+    void clear();
+    stats_t get_stats() const;
+
+  private:
+    struct entry_t
+    {
+      std::string key;
+      std::string body;
+      std::vector<size_t> depth_offsets;
+      std::vector<uint64_t> heights;
+      uint64_t max_height;
+      bool shallow;
+    };
+
+    static std::string render(const entry_t &e, uint64_t chain_height);
+    static size_t get_entry_size(const entry_t &e);
+    void erase(std::list<entry_t>::iterator it);
+
+    mutable boost::mutex m_lock;
+    std::list<entry_t> m_entries; // most recently used first
+    std::unordered_map<std::string, std::list<entry_t>::iterator> m_index;
+    size_t m_max_bytes;
+    size_t m_bytes;
+    uint64_t m_generation;
+    uint64_t m_max_cached_height;
+    size_t m_shallow_entries;
+    uint64_t m_hits;
+    uint64_t m_misses;
+  };
+}
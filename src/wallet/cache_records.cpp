@@ -0,0 +1,503 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "common/threadpool.h"
+#include "common/util.h"
+#include "crypto/crypto.h"
+#include "int-util.h"
+#include "memwipe.h"
+#include "misc_language.h"
+#include "misc_log_ex.h"
+#include "wallet_errors.h"
+#include "cache_records.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.cache_records"
+
+#define CACHE_RECORDS_FILE_MAGIC "Monero wallet cache records\001"
+#define CACHE_RECORDS_ERASED 1
+#define CACHE_RECORDS_DECRYPT_BATCH 1024
+// Below this size, superseded entries are left in the file instead of compacting it
+#define CACHE_RECORDS_MIN_COMPACT_SIZE (16 * 1024 * 1024)
+#define CACHE_RECORDS_COPY_CHUNK_SIZE (1024 * 1024)
+
+namespace
+{
+  const size_t header_size = sizeof(CACHE_RECORDS_FILE_MAGIC) - 1 + sizeof(uint64_t);
+  const size_t record_prefix_size = 1 + 1 + sizeof(tools::cache_records::record_key);
+  const size_t entry_prefix_size = sizeof(uint32_t) + sizeof(crypto::chacha_iv);
+
+  bool read_file_id(const std::string &filename, uint64_t &file_id)
+  {
+    std::ifstream istr(filename, std::ios_base::binary | std::ios_base::in);
+    char header[header_size];
+    if (!istr.read(header, header_size))
+      return false;
+    if (memcmp(header, CACHE_RECORDS_FILE_MAGIC, sizeof(CACHE_RECORDS_FILE_MAGIC) - 1))
+      return false;
+    memcpy(&file_id, header + sizeof(CACHE_RECORDS_FILE_MAGIC) - 1, sizeof(file_id));
+    file_id = SWAP64LE(file_id);
+    return true;
+  }
+
+  std::string make_plaintext(uint8_t column, uint8_t flags, const tools::cache_records::record_key &key, const std::string &data)
+  {
+    std::string plaintext;
+    plaintext.reserve(record_prefix_size + data.size());
+    plaintext.push_back(column);
+    plaintext.push_back(flags);
+    plaintext.append(key.data, sizeof(key.data));
+    plaintext.append(data);
+    return plaintext;
+  }
+}
+
+namespace tools
+{
+
+cache_records::cache_records(std::string filename):
+  m_filename(std::move(filename)),
+  m_live_size(0),
+  m_storing(false),
+  m_rewriting(false),
+  m_adopting(false),
+  m_new_live_size(0)
+{
+}
+
+cache_records::~cache_records()
+{
+  try { drop_compaction(); }
+  catch (...) { /* ignore */ }
+}
+
+cache_records::column_index &cache_records::get_column(std::vector<column_index> &index, uint8_t column)
+{
+  if (index.size() <= column)
+    index.resize(column + 1);
+  return index[column];
+}
+
+bool cache_records::load(const crypto::chacha_key &key, const state &st, std::vector<record> &records)
+{
+  drop_compaction();
+  records.clear();
+  m_index.clear();
+  m_live_size = 0;
+  m_state = state();
+  if (st.empty())
+    return true;
+
+  uint64_t file_id = 0;
+  if (!read_file_id(m_filename, file_id) || file_id != st.file_id)
+  {
+    // the cache may have been written just before the compacted file got renamed
+    const std::string new_filename = m_filename + ".new";
+    if (!read_file_id(new_filename, file_id) || file_id != st.file_id)
+    {
+      MERROR("Cache records file " << m_filename << " does not match the wallet cache");
+      return false;
+    }
+    MINFO("Finishing interrupted compaction of " << m_filename);
+    const std::error_code e = tools::replace_file(new_filename, m_filename);
+    if (e)
+    {
+      MERROR("Failed to rename " << new_filename << ": " << e.message());
+      return false;
+    }
+  }
+
+  // records may hold secret keys, so the plaintexts are wiped however the load ends
+  std::vector<std::string> plaintexts;
+  auto plaintexts_wiper = epee::misc_utils::create_scope_leave_handler([&plaintexts]() {
+    for (std::string &plaintext: plaintexts)
+      if (!plaintext.empty())
+        memwipe(&plaintext[0], plaintext.size());
+  });
+  std::vector<uint64_t> offsets;
+  std::vector<uint64_t> sizes;
+  try
+  {
+    boost::interprocess::file_mapping mapping(m_filename.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+    if (region.get_size() < st.length || st.length < header_size)
+    {
+      MERROR("Cache records file " << m_filename << " is shorter than the wallet cache expects");
+      return false;
+    }
+    const uint8_t *data = (const uint8_t*)region.get_address();
+
+    uint64_t offset = header_size;
+    while (offset < st.length)
+    {
+      if (st.length - offset < entry_prefix_size)
+        return false;
+      uint32_t size;
+      memcpy(&size, data + offset, sizeof(size));
+      size = SWAP32LE(size);
+      if (size < record_prefix_size || st.length - offset - entry_prefix_size < size)
+        return false;
+      offsets.push_back(offset);
+      sizes.push_back(entry_prefix_size + size);
+      offset += entry_prefix_size + size;
+    }
+
+    plaintexts.resize(offsets.size());
+    tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+    tools::threadpool::waiter waiter(tpool);
+    for (size_t i = 0; i < offsets.size(); i += CACHE_RECORDS_DECRYPT_BATCH)
+    {
+      const size_t n = std::min<size_t>(CACHE_RECORDS_DECRYPT_BATCH, offsets.size() - i);
+      tpool.submit(&waiter, [&, i, n]() {
+        for (size_t j = i; j < i + n; ++j)
+        {
+          const uint8_t *entry = data + offsets[j];
+          crypto::chacha_iv iv;
+          memcpy(&iv, entry + sizeof(uint32_t), sizeof(iv));
+          plaintexts[j].resize(sizes[j] - entry_prefix_size);
+          crypto::chacha20(entry + entry_prefix_size, plaintexts[j].size(), key, iv, &plaintexts[j][0]);
+        }
+      }, true);
+    }
+    if (!waiter.wait())
+      return false;
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to map cache records file " << m_filename << ": " << e.what());
+    return false;
+  }
+
+  // later entries supersede earlier ones
+  std::vector<std::unordered_map<record_key, size_t>> latest;
+  for (size_t i = 0; i < plaintexts.size(); ++i)
+  {
+    const std::string &plaintext = plaintexts[i];
+    const uint8_t column = plaintext[0];
+    const uint8_t flags = plaintext[1];
+    record_key k;
+    memcpy(k.data, plaintext.data() + 2, sizeof(k.data));
+    if (latest.size() <= column)
+      latest.resize(column + 1);
+    column_index &index = get_column(m_index, column);
+    auto it = index.find(k);
+    if (it != index.end())
+    {
+      m_live_size -= it->second.size;
+      index.erase(it);
+      latest[column].erase(k);
+    }
+    if (flags & CACHE_RECORDS_ERASED)
+      continue;
+    index[k] = {crypto::cn_fast_hash(plaintext.data(), plaintext.size()), offsets[i], sizes[i]};
+    m_live_size += sizes[i];
+    latest[column][k] = i;
+  }
+
+  for (size_t column = 0; column < latest.size(); ++column)
+  {
+    for (const auto &e: latest[column])
+    {
+      std::string &plaintext = plaintexts[e.second];
+      records.push_back({(uint8_t)column, e.first, plaintext.substr(record_prefix_size)});
+      memwipe(&plaintext[0], plaintext.size());
+      std::string().swap(plaintext);
+    }
+  }
+
+  m_state = st;
+  return true;
+}
+
+void cache_records::open_new_file(state &st)
+{
+  const std::string new_filename = m_filename + ".new";
+  m_ostr.open(new_filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+  THROW_WALLET_EXCEPTION_IF(!m_ostr.good(), error::file_save_error, new_filename);
+  st.file_id = crypto::rand<uint64_t>();
+  const uint64_t file_id = SWAP64LE(st.file_id);
+  m_ostr.write(CACHE_RECORDS_FILE_MAGIC, sizeof(CACHE_RECORDS_FILE_MAGIC) - 1);
+  m_ostr.write((const char*)&file_id, sizeof(file_id));
+  THROW_WALLET_EXCEPTION_IF(!m_ostr.good(), error::file_save_error, new_filename);
+  st.length = header_size;
+}
+
+void cache_records::start_compaction()
+{
+  if (m_compaction || m_state.length <= CACHE_RECORDS_MIN_COMPACT_SIZE || m_live_size >= m_state.length / 2)
+    return;
+  MDEBUG("Compacting " << m_filename << ": " << m_live_size << " live bytes out of " << m_state.length);
+
+  std::vector<std::pair<uint64_t, uint64_t>> live;
+  for (const auto &index: m_index)
+    for (const auto &e: index)
+      live.push_back(std::make_pair(e.second.offset, e.second.size));
+  std::sort(live.begin(), live.end());
+
+  m_compaction.reset(new compaction());
+  compaction *c = m_compaction.get();
+  c->snapshot_length = m_state.length;
+  const std::string filename = m_filename;
+  tools::threadpool::getInstanceForIO().submit(&c->waiter, [c, filename, live = std::move(live)]() {
+    try
+    {
+      // only the part of the old file up to the snapshot is read, later stores append past it
+      std::ifstream istr(filename, std::ios_base::binary | std::ios_base::in);
+      std::ofstream ostr(filename + ".new", std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+      c->new_state.file_id = crypto::rand<uint64_t>();
+      const uint64_t file_id = SWAP64LE(c->new_state.file_id);
+      ostr.write(CACHE_RECORDS_FILE_MAGIC, sizeof(CACHE_RECORDS_FILE_MAGIC) - 1);
+      ostr.write((const char*)&file_id, sizeof(file_id));
+      uint64_t length = header_size;
+      std::string buf;
+      for (const auto &e: live)
+      {
+        buf.resize(e.second);
+        istr.seekg(e.first);
+        istr.read(&buf[0], buf.size());
+        ostr.write(buf.data(), buf.size());
+        if (!istr.good() || !ostr.good())
+          throw std::runtime_error("I/O error");
+        c->offsets[e.first] = length;
+        length += e.second;
+      }
+      ostr.close();
+      if (!ostr.good())
+        throw std::runtime_error("I/O error");
+      c->new_state.length = length;
+      c->ok = true;
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to compact " << filename << ": " << e.what());
+    }
+    c->done = true;
+  }, true);
+}
+
+bool cache_records::adopt_compaction()
+{
+  compaction &c = *m_compaction;
+  c.waiter.wait();
+  if (!c.ok)
+  {
+    drop_compaction();
+    return false;
+  }
+
+  // bring over what was appended to the old file since the snapshot
+  const std::string new_filename = m_filename + ".new";
+  std::ifstream istr(m_filename, std::ios_base::binary | std::ios_base::in);
+  m_ostr.open(new_filename, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+  istr.seekg(c.snapshot_length);
+  std::string buf;
+  for (uint64_t left = m_state.length - c.snapshot_length; left > 0 && istr.good() && m_ostr.good(); )
+  {
+    buf.resize(std::min<uint64_t>(left, CACHE_RECORDS_COPY_CHUNK_SIZE));
+    istr.read(&buf[0], buf.size());
+    m_ostr.write(buf.data(), buf.size());
+    left -= buf.size();
+  }
+  if (!istr.good() || !m_ostr.good())
+  {
+    MERROR("Failed to finish compaction of " << m_filename);
+    m_ostr.close();
+    m_ostr.clear();
+    drop_compaction();
+    return false;
+  }
+  m_new_state = c.new_state;
+  m_new_state.length += m_state.length - c.snapshot_length;
+  return true;
+}
+
+void cache_records::drop_compaction()
+{
+  if (!m_compaction)
+    return;
+  m_compaction->waiter.wait();
+  m_compaction.reset();
+}
+
+uint64_t cache_records::relocate(uint64_t offset) const
+{
+  const compaction &c = *m_compaction;
+  if (offset >= c.snapshot_length)
+    return offset - c.snapshot_length + c.new_state.length;
+  const auto it = c.offsets.find(offset);
+  THROW_WALLET_EXCEPTION_IF(it == c.offsets.end(), error::wallet_internal_error, "Cache record missing from compacted file");
+  return it->second;
+}
+
+void cache_records::begin_store(const crypto::chacha_key &key, bool rewrite)
+{
+  abort_store();
+
+  boost::system::error_code ec;
+  const bool exists = boost::filesystem::exists(m_filename, ec) && !ec;
+  if (!rewrite && (m_state.empty() || !exists))
+    rewrite = true;
+
+  m_key = key;
+  m_new_index.clear();
+  m_new_live_size = 0;
+  m_rewriting = rewrite;
+  m_adopting = false;
+  if (rewrite)
+  {
+    drop_compaction();
+    open_new_file(m_new_state);
+  }
+  else
+  {
+    // drop anything appended by a store which did not get to write the wallet cache
+    boost::filesystem::resize_file(m_filename, m_state.length, ec);
+    THROW_WALLET_EXCEPTION_IF(ec, error::file_save_error, m_filename);
+    if (m_compaction && m_compaction->done)
+      m_adopting = adopt_compaction();
+    if (!m_adopting)
+    {
+      m_ostr.open(m_filename, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+      THROW_WALLET_EXCEPTION_IF(!m_ostr.good(), error::file_save_error, m_filename);
+      m_new_state = m_state;
+    }
+  }
+  m_storing = true;
+}
+
+uint64_t cache_records::append(const std::string &plaintext)
+{
+  const crypto::chacha_iv iv = crypto::rand<crypto::chacha_iv>();
+  std::string entry(entry_prefix_size + plaintext.size(), '\0');
+  const uint32_t size = SWAP32LE((uint32_t)plaintext.size());
+  memcpy(&entry[0], &size, sizeof(size));
+  memcpy(&entry[sizeof(size)], &iv, sizeof(iv));
+  crypto::chacha20(plaintext.data(), plaintext.size(), m_key, iv, &entry[entry_prefix_size]);
+  m_ostr.write(entry.data(), entry.size());
+  THROW_WALLET_EXCEPTION_IF(!m_ostr.good(), error::file_save_error, m_filename);
+  const uint64_t offset = m_new_state.length;
+  m_new_state.length += entry.size();
+  return offset;
+}
+
+void cache_records::put(uint8_t column, const record_key &key, const std::string &data)
+{
+  THROW_WALLET_EXCEPTION_IF(!m_storing, error::wallet_internal_error, "Cache records store not started");
+  THROW_WALLET_EXCEPTION_IF(data.size() > std::numeric_limits<uint32_t>::max() - record_prefix_size,
+      error::wallet_internal_error, "Cache record too large");
+  std::string plaintext = make_plaintext(column, 0, key, data);
+  auto plaintext_wiper = epee::misc_utils::create_scope_leave_handler([&plaintext]() {
+    memwipe(&plaintext[0], plaintext.size());
+  });
+  const crypto::hash digest = crypto::cn_fast_hash(plaintext.data(), plaintext.size());
+  const uint64_t size = entry_prefix_size + plaintext.size();
+  column_index &new_index = get_column(m_new_index, column);
+  THROW_WALLET_EXCEPTION_IF(new_index.find(key) != new_index.end(), error::wallet_internal_error, "Duplicate cache record");
+  m_new_live_size += size;
+
+  if (!m_rewriting && column < m_index.size())
+  {
+    const auto it = m_index[column].find(key);
+    if (it != m_index[column].end() && it->second.digest == digest)
+    {
+      new_index[key] = {digest, m_adopting ? relocate(it->second.offset) : it->second.offset, size};
+      return;
+    }
+  }
+  new_index[key] = {digest, append(plaintext), size};
+}
+
+cache_records::state cache_records::finish_store()
+{
+  THROW_WALLET_EXCEPTION_IF(!m_storing, error::wallet_internal_error, "Cache records store not started");
+  if (!m_rewriting)
+  {
+    for (size_t column = 0; column < m_index.size(); ++column)
+    {
+      const column_index &new_index = get_column(m_new_index, column);
+      for (const auto &e: m_index[column])
+        if (new_index.find(e.first) == new_index.end())
+          append(make_plaintext(column, CACHE_RECORDS_ERASED, e.first, std::string()));
+    }
+  }
+  m_ostr.close();
+  THROW_WALLET_EXCEPTION_IF(!m_ostr.good(), error::file_save_error, m_filename);
+  return m_new_state;
+}
+
+void cache_records::commit_store()
+{
+  THROW_WALLET_EXCEPTION_IF(!m_storing, error::wallet_internal_error, "Cache records store not started");
+  m_storing = false;
+  if (m_rewriting || m_adopting)
+  {
+    if (m_adopting)
+      m_compaction.reset();
+    const std::string new_filename = m_filename + ".new";
+    const std::error_code e = tools::replace_file(new_filename, m_filename);
+    THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_filename, e);
+  }
+  m_state = m_new_state;
+  m_index.swap(m_new_index);
+  m_live_size = m_new_live_size;
+  m_new_index.clear();
+  start_compaction();
+}
+
+void cache_records::abort_store()
+{
+  if (m_ostr.is_open())
+    m_ostr.close();
+  m_ostr.clear();
+  // a compacted file we started appending to can't be used again
+  if (m_storing && m_adopting)
+    m_compaction.reset();
+  m_storing = false;
+  m_adopting = false;
+  m_new_index.clear();
+}
+
+void cache_records::remove()
+{
+  abort_store();
+  drop_compaction();
+  boost::system::error_code ec;
+  boost::filesystem::remove(m_filename, ec);
+  boost::filesystem::remove(m_filename + ".new", ec);
+  m_state = state();
+  m_index.clear();
+  m_live_size = 0;
+}
+
+}
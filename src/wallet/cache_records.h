@@ -0,0 +1,153 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "crypto/chacha.h"
+#include "crypto/hash.h"
+#include "common/threadpool.h"
+#include "serialization/serialization.h"
+
+namespace tools
+{
+  // Append-only file of individually encrypted records, used to store the
+  // largest wallet cache containers one element at a time, so that storing
+  // the wallet only writes the elements that changed since the last store.
+  //
+  // The file starts with a magic and a random id, followed by entries of the
+  // form [u32 size][iv][chacha20(column | flags | key | data)]. Later entries
+  // for the same (column, key) supersede earlier ones, and an entry with the
+  // erased flag removes the record. Only the part of the file described by a
+  // state saved in the wallet cache is trusted, so a store interrupted before
+  // the cache is written leaves the previous state intact.
+  //
+  // Once superseded entries make up most of the file, the live ones are copied
+  // to a new file in the background. The next store appends whatever was
+  // written to the old file in the meantime, and continues in the new file.
+  class cache_records
+  {
+  public:
+    typedef crypto::hash record_key;
+
+    struct state
+    {
+      uint64_t file_id;
+      uint64_t length;
+
+      state(): file_id(0), length(0) {}
+      bool empty() const { return length == 0; }
+
+      BEGIN_SERIALIZE_OBJECT()
+        VERSION_FIELD(0)
+        FIELD(file_id)
+        VARINT_FIELD(length)
+      END_SERIALIZE()
+    };
+
+    struct record
+    {
+      uint8_t column;
+      record_key key;
+      std::string data;
+    };
+
+    cache_records(std::string filename);
+    ~cache_records();
+
+    const std::string &get_filename() const { return m_filename; }
+
+    // Reads the live records of the file part described by st, decrypting them in parallel.
+    // Finishes an interrupted compaction if the cache refers to the compacted file.
+    bool load(const crypto::chacha_key &key, const state &st, std::vector<record> &records);
+
+    // Starts storing a new version of the records: put every current record, then
+    // finish_store appends erasures for the ones that were not put, and returns the
+    // state to save in the wallet cache. The new state only becomes the base for the
+    // next store once commit_store is called after the wallet cache is safely written.
+    void begin_store(const crypto::chacha_key &key, bool rewrite);
+    void put(uint8_t column, const record_key &key, const std::string &data);
+    state finish_store();
+    void commit_store();
+    void abort_store();
+
+    // Removes the file and any leftover from an interrupted compaction
+    void remove();
+
+  private:
+    struct entry
+    {
+      crypto::hash digest;
+      uint64_t offset;
+      uint64_t size;
+    };
+    typedef std::unordered_map<record_key, entry> column_index;
+
+    struct compaction
+    {
+      compaction(): waiter(tools::threadpool::getInstanceForIO()), done(false), ok(false) {}
+      uint64_t snapshot_length;
+      state new_state;
+      std::unordered_map<uint64_t, uint64_t> offsets; // old offset -> offset in the new file
+      tools::threadpool::waiter waiter;
+      std::atomic<bool> done;
+      bool ok;
+    };
+
+    uint64_t append(const std::string &plaintext);
+    column_index &get_column(std::vector<column_index> &index, uint8_t column);
+    void open_new_file(state &st);
+    void start_compaction();
+    bool adopt_compaction();
+    void drop_compaction();
+    uint64_t relocate(uint64_t offset) const;
+
+    std::string m_filename;
+    state m_state;
+    std::vector<column_index> m_index;
+    uint64_t m_live_size;
+
+    std::unique_ptr<compaction> m_compaction;
+
+    // in progress store
+    bool m_storing;
+    bool m_rewriting; // everything is written again, to a new file
+    bool m_adopting; // continuing in the file written by a finished compaction
+    crypto::chacha_key m_key;
+    std::ofstream m_ostr;
+    state m_new_state;
+    std::vector<column_index> m_new_index;
+    uint64_t m_new_live_size;
+  };
+}
@@ -0,0 +1,172 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <limits>
+#include "misc_log_ex.h"
+#include "transfer_index.h"
+
+namespace tools
+{
+  namespace
+  {
+    const std::set<size_t> empty_indices;
+    const std::set<std::pair<uint64_t, size_t>> empty_pairs;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void transfer_index::clear()
+  {
+    m_entries.clear();
+    m_accounts.clear();
+    m_available.clear();
+  }
+  //----------------------------------------------------------------------------------------------------
+  void transfer_index::resize(size_t n)
+  {
+    while (m_entries.size() > n)
+    {
+      remove(m_entries.size() - 1, m_entries.back());
+      m_entries.pop_back();
+    }
+    m_entries.resize(n);
+  }
+  //----------------------------------------------------------------------------------------------------
+  void transfer_index::update(size_t idx, const entry &e)
+  {
+    if (idx >= m_entries.size())
+      m_entries.resize(idx + 1);
+    remove(idx, m_entries[idx]);
+    m_entries[idx] = e;
+    add(idx, e);
+  }
+  //----------------------------------------------------------------------------------------------------
+  void transfer_index::add(size_t idx, const entry &e)
+  {
+    if (!e.unspent && !e.available)
+      return;
+    account &a = m_accounts[e.subaddr.major];
+    if (e.available)
+    {
+      a.available.insert(idx);
+      a.available_by_amount.insert(std::make_pair(e.amount, idx));
+      m_available.insert(idx);
+    }
+    if (!e.counted || !e.unspent)
+      return;
+    balances &b = a.subaddresses.emplace(e.subaddr.minor, balances{{0, 0}, {0, 0}}).first->second;
+    b.amount[1] += e.amount;
+    ++b.count[1];
+    a.total[1] += e.amount;
+    if (e.available)
+    {
+      b.amount[0] += e.amount;
+      ++b.count[0];
+      a.total[0] += e.amount;
+    }
+    if (e.time_locked)
+      a.time_locked.insert(idx);
+    else
+      a.by_unlock_height.insert(std::make_pair(e.unlock_height, idx));
+  }
+  //----------------------------------------------------------------------------------------------------
+  void transfer_index::remove(size_t idx, const entry &e)
+  {
+    if (!e.unspent && !e.available)
+      return;
+    auto it = m_accounts.find(e.subaddr.major);
+    CHECK_AND_ASSERT_THROW_MES(it != m_accounts.end(), "Transfer index out of sync");
+    account &a = it->second;
+    if (e.available)
+    {
+      a.available.erase(idx);
+      a.available_by_amount.erase(std::make_pair(e.amount, idx));
+      m_available.erase(idx);
+    }
+    if (!e.counted || !e.unspent)
+      return;
+    auto bit = a.subaddresses.find(e.subaddr.minor);
+    CHECK_AND_ASSERT_THROW_MES(bit != a.subaddresses.end(), "Transfer index out of sync");
+    balances &b = bit->second;
+    b.amount[1] -= e.amount;
+    --b.count[1];
+    a.total[1] -= e.amount;
+    if (e.available)
+    {
+      b.amount[0] -= e.amount;
+      --b.count[0];
+      a.total[0] -= e.amount;
+    }
+    if (b.count[1] == 0)
+      a.subaddresses.erase(bit);
+    if (e.time_locked)
+      a.time_locked.erase(idx);
+    else
+      a.by_unlock_height.erase(std::make_pair(e.unlock_height, idx));
+  }
+  //----------------------------------------------------------------------------------------------------
+  uint64_t transfer_index::balance(uint32_t index_major, bool strict) const
+  {
+    const auto it = m_accounts.find(index_major);
+    return it == m_accounts.end() ? 0 : it->second.total[strict];
+  }
+  //----------------------------------------------------------------------------------------------------
+  std::map<uint32_t, uint64_t> transfer_index::balance_per_subaddress(uint32_t index_major, bool strict) const
+  {
+    std::map<uint32_t, uint64_t> amount_per_subaddr;
+    const auto it = m_accounts.find(index_major);
+    if (it == m_accounts.end())
+      return amount_per_subaddr;
+    for (const auto &b: it->second.subaddresses)
+      if (b.second.count[strict] > 0)
+        amount_per_subaddr.emplace_hint(amount_per_subaddr.end(), b.first, b.second.amount[strict]);
+    return amount_per_subaddr;
+  }
+  //----------------------------------------------------------------------------------------------------
+  const std::set<size_t> &transfer_index::available(uint32_t index_major) const
+  {
+    const auto it = m_accounts.find(index_major);
+    return it == m_accounts.end() ? empty_indices : it->second.available;
+  }
+  //----------------------------------------------------------------------------------------------------
+  const std::set<std::pair<uint64_t, size_t>> &transfer_index::available_by_amount(uint32_t index_major) const
+  {
+    const auto it = m_accounts.find(index_major);
+    return it == m_accounts.end() ? empty_pairs : it->second.available_by_amount;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void transfer_index::get_locked(uint32_t index_major, uint64_t height, std::vector<size_t> &indices) const
+  {
+    indices.clear();
+    const auto it = m_accounts.find(index_major);
+    if (it == m_accounts.end())
+      return;
+    const account &a = it->second;
+    for (auto i = a.by_unlock_height.upper_bound(std::make_pair(height, std::numeric_limits<size_t>::max())); i != a.by_unlock_height.end(); ++i)
+      indices.push_back(i->second);
+    indices.insert(indices.end(), a.time_locked.begin(), a.time_locked.end());
+  }
+}
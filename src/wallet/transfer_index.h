@@ -0,0 +1,105 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+#include "serialization/serialization.h"
+#include "cryptonote_basic/subaddress_index.h"
+
+namespace tools
+{
+  // Secondary indices over a wallet's transfers, so that balances and input
+  // selection do not need to walk every transfer the wallet ever received.
+  //
+  // Transfers are identified by their index in the wallet's container, and
+  // the owner calls update() with a fresh entry whenever the state of one
+  // changes. Per subaddress account, the index keeps:
+  //  - the strict and non strict balances, per subaddress and in total
+  //  - the available (unspent and not frozen) transfers, by index and by amount
+  //  - the transfers which may still be locked, by the height they unlock at
+  class transfer_index
+  {
+  public:
+    struct entry
+    {
+      cryptonote::subaddress_index subaddr;
+      uint64_t amount;
+      uint64_t unlock_height; // first chain height at which the transfer is spendable
+      bool time_locked;       // locked until a timestamp, unlock_height is a lower bound
+      bool available;         // neither spent nor frozen
+      bool unspent;           // not spent in a block, and not frozen
+      bool counted;           // counts towards the balance
+
+      entry(): subaddr{0, 0}, amount(0), unlock_height(0), time_locked(false), available(false), unspent(false), counted(false) {}
+    };
+
+    void clear();
+    size_t size() const { return m_entries.size(); }
+    void resize(size_t n);
+    void update(size_t idx, const entry &e);
+    const entry &get(size_t idx) const { return m_entries[idx]; }
+
+    uint64_t balance(uint32_t index_major, bool strict) const;
+    std::map<uint32_t, uint64_t> balance_per_subaddress(uint32_t index_major, bool strict) const;
+    const std::set<size_t> &available() const { return m_available; }
+    const std::set<size_t> &available(uint32_t index_major) const;
+    const std::set<std::pair<uint64_t, size_t>> &available_by_amount(uint32_t index_major) const;
+    void get_locked(uint32_t index_major, uint64_t height, std::vector<size_t> &indices) const;
+
+  private:
+    struct balances
+    {
+      uint64_t amount[2]; // indexed by strict
+      size_t count[2];
+    };
+
+    struct account
+    {
+      std::map<uint32_t, balances> subaddresses;
+      uint64_t total[2];
+      std::set<size_t> available;
+      std::set<std::pair<uint64_t, size_t>> available_by_amount;
+      std::set<std::pair<uint64_t, size_t>> by_unlock_height;
+      std::set<size_t> time_locked;
+
+      account(): total{0, 0} {}
+    };
+
+    void add(size_t idx, const entry &e);
+    void remove(size_t idx, const entry &e);
+
+    std::vector<entry> m_entries;
+    std::map<uint32_t, account> m_accounts;
+    std::set<size_t> m_available;
+  };
+}
@@ -139,6 +139,17 @@ using namespace cryptonote;
 
 #define FIRST_REFRESH_GRANULARITY     1024
 
+#define REFRESH_PIPELINE_DEPTH 4
+
+#define KEY_DERIVATION_BATCH_SIZE 256
+
+#define CACHE_RECORDS_TRANSFERS 0
+#define CACHE_RECORDS_CONFIRMED_TXS 1
+#define CACHE_RECORDS_UNCONFIRMED_TXS 2
+#define CACHE_RECORDS_PAYMENTS 3
+#define CACHE_RECORDS_TX_KEYS 4
+#define CACHE_RECORDS_PARSE_BATCH 256
+
 #define GAMMA_SHAPE 19.28
 #define GAMMA_SCALE (1/1.61)
 
@@ -1221,6 +1232,8 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, std
   m_ignore_outputs_above(MONEY_SUPPLY),
   m_ignore_outputs_below(0),
   m_track_uses(false),
+  m_refresh_pipeline_depth(REFRESH_PIPELINE_DEPTH),
+  m_last_refresh_stats{},
   m_is_background_wallet(false),
   m_background_sync_type(BackgroundSyncOff),
   m_background_syncing(false),
@@ -1237,6 +1250,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, std
   m_multisig_threshold(0),
   m_node_rpc_proxy(*m_http_client, m_daemon_rpc_mutex),
   m_account_public_address{crypto::null_pkey, crypto::null_pkey},
+  m_subaddresses_generation(0),
   m_subaddress_lookahead_major(SUBADDRESS_LOOKAHEAD_MAJOR),
   m_subaddress_lookahead_minor(SUBADDRESS_LOOKAHEAD_MINOR),
   m_original_keys_available(false),
@@ -1253,6 +1267,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, std
   m_rpc_version(0),
   m_export_format(ExportFormat::Binary),
   m_load_deprecated_formats(false),
+  m_columnar_cache(false),
   m_enable_multisig(false),
   m_pool_info_query_time(0),
   m_has_ever_refreshed_from_node(false),
@@ -1609,11 +1624,13 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
     {
       const uint32_t end = get_subaddress_clamped_sum((index2.major == index.major ? index.minor : 0), m_subaddress_lookahead_minor);
       const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, 0, end);
+      const boost::unique_lock<boost::shared_mutex> lock(m_subaddresses_mutex);
       for (index2.minor = 0; index2.minor < end; ++index2.minor)
       {
          const crypto::public_key &D = pkeys[index2.minor];
          m_subaddresses[D] = index2;
       }
+      ++m_subaddresses_generation;
     }
     m_subaddress_labels.resize(index.major + 1, {"Untitled account"});
     m_subaddress_labels[index.major].resize(index.minor + 1);
@@ -1626,11 +1643,13 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
     const uint32_t begin = m_subaddress_labels[index.major].size();
     cryptonote::subaddress_index index2 = {index.major, begin};
     const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, index2.minor, end);
+    const boost::unique_lock<boost::shared_mutex> lock(m_subaddresses_mutex);
     for (; index2.minor < end; ++index2.minor)
     {
        const crypto::public_key &D = pkeys[index2.minor - begin];
        m_subaddresses[D] = index2;
     }
+    ++m_subaddresses_generation;
     m_subaddress_labels[index.major].resize(index.minor + 1);
   }
 }
@@ -1638,7 +1657,9 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
 void wallet2::create_one_off_subaddress(const cryptonote::subaddress_index& index)
 {
   const crypto::public_key pkey = get_subaddress_spend_public_key(index);
+  const boost::unique_lock<boost::shared_mutex> lock(m_subaddresses_mutex);
   m_subaddresses[pkey] = index;
+  ++m_subaddresses_generation;
 }
 //----------------------------------------------------------------------------------------------------
 std::string wallet2::get_subaddress_label(const cryptonote::subaddress_index& index) const
@@ -1970,6 +1991,7 @@ void wallet2::set_spent(size_t idx, uint64_t height)
   LOG_PRINT_L2("Setting SPENT at " << height << ": ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
   td.m_spent = true;
   td.m_spent_height = height;
+  update_transfer_index(idx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::set_unspent(size_t idx)
@@ -1979,6 +2001,7 @@ void wallet2::set_unspent(size_t idx)
   LOG_PRINT_L2("Setting UNSPENT: ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
   td.m_spent = false;
   td.m_spent_height = 0;
+  update_transfer_index(idx);
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::is_spent(const transfer_details &td, bool strict) const
@@ -2000,11 +2023,37 @@ bool wallet2::is_spent(size_t idx, bool strict) const
   return is_spent(td, strict);
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::update_transfer_index(size_t idx)
+{
+  CHECK_AND_ASSERT_THROW_MES(idx < m_transfers.size(), "Invalid index");
+  const transfer_details &td = m_transfers[idx];
+  tools::transfer_index::entry e;
+  e.subaddr = td.m_subaddr_index;
+  e.amount = td.amount();
+  // a superset of what is_transfer_unlocked considers locked, it gets the final say
+  e.unlock_height = td.m_block_height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE;
+  e.time_locked = td.m_tx.unlock_time >= CRYPTONOTE_MAX_BLOCK_NUMBER;
+  if (!e.time_locked)
+    e.unlock_height = std::max<uint64_t>(e.unlock_height, td.m_tx.unlock_time);
+  e.available = !is_spent(td, false) && !td.m_frozen;
+  e.unspent = !is_spent(td, true) && !td.m_frozen;
+  e.counted = td.amount() <= m_ignore_outputs_above && td.amount() >= m_ignore_outputs_below;
+  m_transfer_index.update(idx, e);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_transfer_index()
+{
+  m_transfer_index.clear();
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+    update_transfer_index(i);
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::freeze(size_t idx)
 {
   CHECK_AND_ASSERT_THROW_MES(idx < m_transfers.size(), "Invalid transfer_details index");
   transfer_details &td = m_transfers[idx];
   td.m_frozen = true;
+  update_transfer_index(idx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::thaw(size_t idx)
@@ -2012,6 +2061,7 @@ void wallet2::thaw(size_t idx)
   CHECK_AND_ASSERT_THROW_MES(idx < m_transfers.size(), "Invalid transfer_details index");
   transfer_details &td = m_transfers[idx];
   td.m_frozen = false;
+  update_transfer_index(idx);
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::frozen(size_t idx) const
@@ -2617,6 +2667,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
             }
             THROW_WALLET_EXCEPTION_IF(td.get_public_key() != tx_scan_info[o].in_ephemeral.pub, error::wallet_internal_error, "Inconsistent public keys");
 	    THROW_WALLET_EXCEPTION_IF(td.m_spent, error::wallet_internal_error, "Inconsistent spent status");
+            update_transfer_index(kit->second);
 
 	    LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << txid);
 	    if (!ignore_callbacks && 0 != m_callback)
@@ -2658,6 +2709,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           //   2) the wallet set the highest amount among them to transfer_details::m_amount, and
           //   3) the wallet somehow spent that output with an amount smaller than the above amount, causing inconsistency
           td.m_amount = amount;
+          update_transfer_index(it->second);
         }
       }
       else
@@ -3197,31 +3249,75 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
   THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
   THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(start_height), error::out_of_hashchain_bounds_error);
 
+  std::vector<tx_cache_data> tx_cache_data;
+  scan_parsed_blocks(start_height, parsed_blocks, tx_cache_data);
+  apply_parsed_blocks(start_height, blocks, parsed_blocks, tx_cache_data, blocks_added, output_tracker_cache);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_scanned_blocks(const uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> tx_cache_data, uint64_t& blocks_added)
+{
+  blocks_added = 0;
+
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(start_height), error::out_of_hashchain_bounds_error);
+
+  // drop what this wallet would not have cached itself, and blocks it already has, so they do not get derived
+  size_t txidx = 0;
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
+  {
+    THROW_WALLET_EXCEPTION_IF(txidx + 1 + parsed_blocks[i].txes.size() > tx_cache_data.size(), error::wallet_internal_error, "tx_cache_data too small");
+    const uint64_t height = start_height + i;
+    if (should_skip_block(parsed_blocks[i].block, height) || (height < m_blockchain.size() && m_blockchain[height] == parsed_blocks[i].hash))
+    {
+      for (size_t j = 0; j < 1 + parsed_blocks[i].txes.size(); ++j)
+        tx_cache_data[txidx + j] = wallet2::tx_cache_data();
+    }
+    txidx += 1 + parsed_blocks[i].txes.size();
+  }
+  THROW_WALLET_EXCEPTION_IF(txidx != tx_cache_data.size(), error::wallet_internal_error, "tx_cache_data size mismatch");
+
+  scan_cached_blocks(start_height, parsed_blocks, tx_cache_data);
+  apply_parsed_blocks(start_height, blocks, parsed_blocks, tx_cache_data, blocks_added);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_scanned_blocks(uint64_t &blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &last)
+{
+  std::list<crypto::hash> short_chain_history;
+  get_short_chain_history(short_chain_history);
+  if (m_refresh_from_block_height > m_blockchain.size() || m_skip_to_height > m_blockchain.size())
+  {
+    // like refresh, only pull hashes up to the refresh height
+    fast_refresh(std::max(m_refresh_from_block_height, m_skip_to_height), blocks_start_height, short_chain_history);
+    short_chain_history.clear();
+    get_short_chain_history(short_chain_history);
+  }
+  std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>> process_pool_txs;
+  bool error = false;
+  std::exception_ptr exception;
+  pull_and_parse_next_blocks(false, false, 0, blocks_start_height, short_chain_history, {}, {}, blocks, parsed_blocks, process_pool_txs, last, error, exception);
+  if (exception)
+    std::rethrow_exception(exception);
+  THROW_WALLET_EXCEPTION_IF(error, error::wallet_internal_error, "Failed to parse blocks from daemon");
+}
+//----------------------------------------------------------------------------------------------------
+uint64_t wallet2::scan_parsed_blocks(const uint64_t start_height, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const
+{
+  // This only reads wallet state which does not change while blocks are being added, except for
+  // the subaddress table, so it may run ahead of apply_parsed_blocks. The returned subaddress
+  // generation tells the caller whether the results are still current.
+  const uint64_t subaddresses_generation = m_subaddresses_generation.load();
+
   tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
   tools::threadpool::waiter waiter(tpool);
 
   size_t num_txes = 0;
-  std::vector<tx_cache_data> tx_cache_data;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  tx_cache_data.clear();
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
     num_txes += 1 + parsed_blocks[i].txes.size();
   tx_cache_data.resize(num_txes);
   size_t txidx = 0;
-  crypto::hash prev_block_id;
-  bool has_prev_block = m_blockchain.is_in_bounds(start_height - 1);
-  if (has_prev_block) {
-    prev_block_id = m_blockchain[start_height - 1];
-  }
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
-    if (has_prev_block) {
-      THROW_WALLET_EXCEPTION_IF(prev_block_id != parsed_blocks[i].block.prev_id, error::wallet_internal_error,
-          "Parent block hash mismatch at height " + std::to_string(start_height + i) +
-          ": expected " + string_tools::pod_to_hex(prev_block_id) +
-          ", but received a new block with prev_id " + string_tools::pod_to_hex(parsed_blocks[i].block.prev_id));
-    }
-    prev_block_id = parsed_blocks[i].hash;
-    has_prev_block = true;
-
     THROW_WALLET_EXCEPTION_IF(parsed_blocks[i].txes.size() != parsed_blocks[i].block.tx_hashes.size(),
         error::wallet_internal_error, "Mismatched parsed_blocks[i].txes.size() and parsed_blocks[i].block.tx_hashes.size()");
     if (should_skip_block(parsed_blocks[i].block, start_height + i))
@@ -3241,9 +3337,55 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
   THROW_WALLET_EXCEPTION_IF(txidx != num_txes, error::wallet_internal_error, "txidx does not match tx_cache_data size");
   THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
 
+  scan_cached_blocks(start_height, parsed_blocks, tx_cache_data);
+  return subaddresses_generation;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::cache_parsed_blocks(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const
+{
+  // Unlike scan_parsed_blocks, this does not skip blocks below the refresh height, so the result
+  // only depends on the refresh type and can be shared by all wallets using the same one
+  tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+  tools::threadpool::waiter waiter(tpool);
+
+  size_t num_txes = 0;
+  tx_cache_data.clear();
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
+    num_txes += 1 + parsed_blocks[i].txes.size();
+  tx_cache_data.resize(num_txes);
+  size_t txidx = 0;
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
+  {
+    THROW_WALLET_EXCEPTION_IF(parsed_blocks[i].txes.size() != parsed_blocks[i].block.tx_hashes.size(),
+        error::wallet_internal_error, "Mismatched parsed_blocks[i].txes.size() and parsed_blocks[i].block.tx_hashes.size()");
+    if (m_refresh_type != RefreshNoCoinbase)
+      tpool.submit(&waiter, [&, i, txidx](){ cache_tx_data(parsed_blocks[i].block.miner_tx, get_transaction_hash(parsed_blocks[i].block.miner_tx), tx_cache_data[txidx]); });
+    ++txidx;
+    for (size_t idx = 0; idx < parsed_blocks[i].txes.size(); ++idx)
+    {
+      tpool.submit(&waiter, [&, i, idx, txidx](){ cache_tx_data(parsed_blocks[i].txes[idx], parsed_blocks[i].block.tx_hashes[idx], tx_cache_data[txidx]); });
+      ++txidx;
+    }
+  }
+  THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::scan_cached_blocks(const uint64_t start_height, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const
+{
+  tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+  tools::threadpool::waiter waiter(tpool);
+  const size_t num_txes = tx_cache_data.size();
+  size_t txidx = 0;
+
   hw::device &hwdev =  m_account.get_device();
-  hw::reset_mode rst(hwdev);
-  hwdev.set_mode(hw::device::TRANSACTION_PARSE);
+  // the refresh pipeline scans several batches at once with the software device, which
+  // ignores the mode; the other devices are only ever scanned for one batch at a time
+  std::unique_ptr<hw::reset_mode> rst;
+  if (hwdev.get_type() != hw::device::device_type::SOFTWARE)
+  {
+    rst.reset(new hw::reset_mode(hwdev));
+    hwdev.set_mode(hw::device::TRANSACTION_PARSE);
+  }
   const cryptonote::account_keys &keys = m_account.get_keys();
 
   auto gender = [&](wallet2::is_out_data &iod) {
@@ -3255,19 +3397,59 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
     }
   };
 
-  for (size_t i = 0; i < tx_cache_data.size(); ++i)
+  if (hwdev.get_type() == hw::device::device_type::SOFTWARE)
   {
-    if (tx_cache_data[i].empty())
-      continue;
-    tpool.submit(&waiter, [&gender, &tx_cache_data, i]() {
-      auto &slot = tx_cache_data[i];
+    // With the view key in memory, derivations for the whole span are computed in
+    // batches that share the scalar recoding and a single field inversion
+    std::vector<wallet2::is_out_data*> iods;
+    for (auto &slot: tx_cache_data)
+    {
       for (auto &iod: slot.primary)
-        gender(iod);
+        iods.push_back(&iod);
       for (auto &iod: slot.additional)
-        gender(iod);
-    }, true);
+        iods.push_back(&iod);
+    }
+    for (size_t i = 0; i < iods.size(); i += KEY_DERIVATION_BATCH_SIZE)
+    {
+      const size_t n = std::min<size_t>(KEY_DERIVATION_BATCH_SIZE, iods.size() - i);
+      tpool.submit(&waiter, [&iods, &keys, i, n]() {
+        std::vector<crypto::public_key> pkeys(n);
+        std::vector<crypto::key_derivation> derivations(n);
+        std::unique_ptr<bool[]> valid(new bool[n]);
+        for (size_t j = 0; j < n; ++j)
+          pkeys[j] = iods[i + j]->pkey;
+        crypto::generate_key_derivations(pkeys.data(), n, keys.m_view_secret_key, derivations.data(), valid.get());
+        for (size_t j = 0; j < n; ++j)
+        {
+          if (valid[j])
+            iods[i + j]->derivation = derivations[j];
+          else
+          {
+            MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+            static_assert(sizeof(iods[i + j]->derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+            memcpy(&iods[i + j]->derivation, rct::identity().bytes, sizeof(iods[i + j]->derivation));
+          }
+        }
+      }, true);
+    }
+    THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+  }
+  else
+  {
+    for (size_t i = 0; i < tx_cache_data.size(); ++i)
+    {
+      if (tx_cache_data[i].empty())
+        continue;
+      tpool.submit(&waiter, [&gender, &tx_cache_data, i]() {
+        auto &slot = tx_cache_data[i];
+        for (auto &iod: slot.primary)
+          gender(iod);
+        for (auto &iod: slot.additional)
+          gender(iod);
+      }, true);
+    }
+    THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
   }
-  THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
 
   auto geniod = [&](const cryptonote::transaction &tx, size_t n_vouts, size_t txidx) {
     for (size_t k = 0; k < n_vouts; ++k)
@@ -3301,7 +3483,7 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
 
   txidx = 0;
   uint8_t hf_version_view_tags = get_view_tag_fork();
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
     if (should_skip_block(parsed_blocks[i].block, start_height + i))
     {
@@ -3317,7 +3499,10 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
       if (parsed_blocks[i].block.major_version >= hf_version_view_tags)
         geniods.push_back(geniod_params{ tx, n_vouts, txidx });
       else
-        tpool.submit(&waiter, [&, n_vouts, txidx](){ geniod(tx, n_vouts, txidx); }, true);
+        tpool.submit(&waiter, [&, n_vouts, txidx](){
+          const boost::shared_lock<boost::shared_mutex> lock(m_subaddresses_mutex);
+          geniod(tx, n_vouts, txidx);
+        }, true);
     }
     ++txidx;
     for (size_t j = 0; j < parsed_blocks[i].txes.size(); ++j)
@@ -3326,7 +3511,10 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
       if (parsed_blocks[i].block.major_version >= hf_version_view_tags)
         geniods.push_back(geniod_params{ parsed_blocks[i].txes[j], parsed_blocks[i].txes[j].vout.size(), txidx });
       else
-        tpool.submit(&waiter, [&, i, j, txidx](){ geniod(parsed_blocks[i].txes[j], parsed_blocks[i].txes[j].vout.size(), txidx); }, true);
+        tpool.submit(&waiter, [&, i, j, txidx](){
+          const boost::shared_lock<boost::shared_mutex> lock(m_subaddresses_mutex);
+          geniod(parsed_blocks[i].txes[j], parsed_blocks[i].txes[j].vout.size(), txidx);
+        }, true);
       ++txidx;
     }
   }
@@ -3345,7 +3533,8 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
     {
       size_t batch_end = std::min(batch_start + GENIOD_BATCH_SIZE, geniods.size());
       THROW_WALLET_EXCEPTION_IF(batch_end < batch_start, error::wallet_internal_error, "Thread batch end overflow");
-      tpool.submit(&waiter, [&geniods, &geniod, batch_start, batch_end]() {
+      tpool.submit(&waiter, [this, &geniods, &geniod, batch_start, batch_end]() {
+        const boost::shared_lock<boost::shared_mutex> lock(m_subaddresses_mutex);
         for (size_t i = batch_start; i < batch_end; ++i)
         {
           const geniod_params &gp = geniods[i];
@@ -3360,6 +3549,31 @@ void wallet2::process_parsed_blocks(const uint64_t start_height, const std::vect
   THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
 
   hwdev.set_mode(hw::device::NONE);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::apply_parsed_blocks(const uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, const std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache)
+{
+  blocks_added = 0;
+
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(start_height), error::out_of_hashchain_bounds_error);
+
+  crypto::hash prev_block_id;
+  bool has_prev_block = m_blockchain.is_in_bounds(start_height - 1);
+  if (has_prev_block) {
+    prev_block_id = m_blockchain[start_height - 1];
+  }
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (has_prev_block) {
+      THROW_WALLET_EXCEPTION_IF(prev_block_id != parsed_blocks[i].block.prev_id, error::wallet_internal_error,
+          "Parent block hash mismatch at height " + std::to_string(start_height + i) +
+          ": expected " + string_tools::pod_to_hex(prev_block_id) +
+          ", but received a new block with prev_id " + string_tools::pod_to_hex(parsed_blocks[i].block.prev_id));
+    }
+    prev_block_id = parsed_blocks[i].hash;
+    has_prev_block = true;
+  }
 
   size_t current_index = start_height;
   size_t tx_cache_data_offset = 0;
@@ -4022,8 +4236,6 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
   tools::threadpool::waiter waiter(tpool);
   uint64_t blocks_start_height;
-  std::vector<cryptonote::block_complete_entry> blocks;
-  std::vector<parsed_block> parsed_blocks;
   // TODO moneromooo-monero says this about the "refreshed" variable:
   // "I had to reorder some code to fix... a timing info leak IIRC. In turn, this undid something I had fixed before, ... a subtle race condition with the txpool.
   // It was pretty subtle IIRC, and so I needed time to think about how to refix it after the move, and I never got to it."
@@ -4070,39 +4282,193 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   // leak allowing a passive adversary with traffic analysis capability to
   // infer when we get an incoming output
 
-  bool first = true, last = false;
-  while(m_run.load(std::memory_order_relaxed) && blocks_fetched < max_blocks)
-  {
-    uint64_t next_blocks_start_height;
-    std::vector<cryptonote::block_complete_entry> next_blocks;
-    std::vector<parsed_block> next_parsed_blocks;
+  // Blocks go through three stages: the fetch stage pulls and parses batches from the daemon, up
+  // to m_refresh_pipeline_depth batches ahead of the wallet, each fetched batch is scanned for our
+  // outputs on the compute threadpool, and the scanned batches are added to the wallet in order
+  // here. Hardware devices keep per-mode state, so with those a batch is only scanned right
+  // before it is added. So is it when the compute threadpool has no worker threads, since a
+  // task submitted there only runs once its waiter is waited on.
+  struct refresh_batch
+  {
+    uint64_t start_height;
+    std::vector<cryptonote::block_complete_entry> blocks;
+    std::vector<parsed_block> parsed_blocks;
+    std::vector<wallet2::tx_cache_data> tx_cache;
+    uint64_t subaddresses_generation;
+    bool scanning;
+    bool scanned;
+    bool last;
     bool error;
     std::exception_ptr exception;
+  };
+  struct refresh_pipeline
+  {
+    boost::mutex mutex;
+    boost::condition_variable cv;
+    std::deque<std::shared_ptr<refresh_batch>> queue;
+    bool stop = false;
+    bool done = false;
+  };
+
+  const bool scan_ahead = hwdev.get_type() == hw::device::device_type::SOFTWARE && tpool.get_max_concurrency() > 1;
+  const size_t pipeline_depth = m_refresh_pipeline_depth;
+  tools::threadpool& io_tpool = tools::threadpool::getInstanceForIO();
+  tools::threadpool::waiter io_waiter(io_tpool);
+  refresh_stats &stats = m_last_refresh_stats;
+  stats = {};
+  const auto ms_since = [](const std::chrono::steady_clock::time_point &t) -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t).count();
+  };
+
+  auto scan_stage = [&](refresh_pipeline &pipeline, const std::shared_ptr<refresh_batch> &batch) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<tx_cache_data> tx_cache_data;
+    uint64_t subaddresses_generation = 0;
+    bool scanned = true;
     try
     {
-      // pull the next set of blocks while we're processing the current one
-      error = false;
-      exception = NULL;
-      next_blocks.clear();
-      next_parsed_blocks.clear();
-      added_blocks = 0;
-      if (!first && blocks.empty())
+      subaddresses_generation = scan_parsed_blocks(batch->start_height, batch->parsed_blocks, tx_cache_data);
+    }
+    catch (...)
+    {
+      // the batch gets scanned again before being added, which reports the error
+      scanned = false;
+    }
+    const boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+    batch->tx_cache = std::move(tx_cache_data);
+    batch->subaddresses_generation = subaddresses_generation;
+    batch->scanned = scanned;
+    batch->scanning = false;
+    stats.scan_ms += ms_since(start);
+    pipeline.cv.notify_all();
+  };
+
+  auto fetch_stage = [&](refresh_pipeline &pipeline) {
+    std::shared_ptr<refresh_batch> prev = std::make_shared<refresh_batch>();
+    bool first = true;
+    while (true)
+    {
       {
-        m_node_rpc_proxy.set_height(m_blockchain.size());
+        const auto start = std::chrono::steady_clock::now();
+        boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+        while (!pipeline.stop && pipeline.queue.size() >= pipeline_depth)
+          pipeline.cv.wait(lock);
+        stats.fetch_stall_ms += ms_since(start);
+        if (pipeline.stop || !m_run.load(std::memory_order_relaxed))
+          break;
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      std::shared_ptr<refresh_batch> batch = std::make_shared<refresh_batch>();
+      pull_and_parse_next_blocks(first, try_incremental, start_height, batch->start_height, short_chain_history, prev->blocks, prev->parsed_blocks, batch->blocks, batch->parsed_blocks, process_pool_txs, batch->last, batch->error, batch->exception);
+
+      // the daemon sent the same blocks again, we're done
+      const bool repeated = !first && !batch->error && batch->start_height == prev->start_height;
+      const bool end = repeated || batch->error || batch->last || batch->blocks.empty();
+      first = false;
+      {
+        const boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+        stats.fetch_ms += ms_since(start);
+        if (!repeated)
+        {
+          batch->scanning = scan_ahead && !batch->error && !batch->blocks.empty();
+          pipeline.queue.push_back(batch);
+          stats.max_queue_depth = std::max(stats.max_queue_depth, pipeline.queue.size());
+        }
+        pipeline.cv.notify_all();
+      }
+      if (batch->scanning)
+        tpool.submit(&waiter, [&scan_stage, &pipeline, batch](){ scan_stage(pipeline, batch); });
+      if (end)
         break;
+      prev = std::move(batch);
+    }
+
+    const boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+    pipeline.done = true;
+    pipeline.cv.notify_all();
+  };
+
+  while(m_run.load(std::memory_order_relaxed) && blocks_fetched < max_blocks)
+  {
+    refresh_pipeline pipeline;
+    auto stop_pipeline = [&]() {
+      {
+        const boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+        pipeline.stop = true;
+        pipeline.cv.notify_all();
       }
-      if (!last)
-        tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(first, try_incremental, start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, process_pool_txs, last, error, exception);});
+      // the fetch stage submits the scans, so it has to be waited for first
+      THROW_WALLET_EXCEPTION_IF(!io_waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+    };
+
+    try
+    {
+      added_blocks = 0;
+      io_tpool.submit(&io_waiter, [&fetch_stage, &pipeline](){ fetch_stage(pipeline); });
 
-      if (!first)
+      bool finished = false;
+      while (m_run.load(std::memory_order_relaxed) && blocks_fetched < max_blocks)
       {
+        std::shared_ptr<refresh_batch> batch;
+        {
+          const auto start = std::chrono::steady_clock::now();
+          boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+          while (pipeline.queue.empty() ? !pipeline.done : pipeline.queue.front()->scanning)
+            pipeline.cv.wait(lock);
+          stats.apply_stall_ms += ms_since(start);
+          if (pipeline.queue.empty())
+          {
+            finished = true;
+            break;
+          }
+          batch = std::move(pipeline.queue.front());
+          pipeline.queue.pop_front();
+          pipeline.cv.notify_all();
+        }
+
+        // handle error from async fetching thread
+        if (batch->error)
+        {
+          if (batch->exception)
+            std::rethrow_exception(batch->exception);
+          else
+            throw std::runtime_error("proxy exception in refresh thread");
+        }
+
+        m_has_ever_refreshed_from_node = true;
+
+        if (batch->blocks.empty())
+        {
+          finished = true;
+          break;
+        }
+
+        // if we've got at least 10 blocks to refresh, assume we're starting
+        // a long refresh, and setup a tracking output cache if we need to
+        if (m_track_uses && (!output_tracker_cache || output_tracker_cache->empty()) && batch->blocks.size() >= 10)
+          output_tracker_cache = create_output_tracker_cache();
+
         try
         {
-          process_parsed_blocks(blocks_start_height, blocks, parsed_blocks, added_blocks, output_tracker_cache.get());
+          // outputs to subaddresses added since the batch was scanned would have been missed
+          if (!batch->scanned || batch->subaddresses_generation != m_subaddresses_generation.load())
+          {
+            const auto start = std::chrono::steady_clock::now();
+            if (batch->scanned)
+              ++stats.rescans;
+            batch->subaddresses_generation = scan_parsed_blocks(batch->start_height, batch->parsed_blocks, batch->tx_cache);
+            stats.scan_ms += ms_since(start);
+          }
+          const auto start = std::chrono::steady_clock::now();
+          apply_parsed_blocks(batch->start_height, batch->blocks, batch->parsed_blocks, batch->tx_cache, added_blocks, output_tracker_cache.get());
+          stats.apply_ms += ms_since(start);
         }
         catch (const tools::error::out_of_hashchain_bounds_error&)
         {
           MINFO("Daemon claims next refresh block is out of hash chain bounds, resetting hash chain");
+          stop_pipeline();
           uint64_t stop_height = m_blockchain.offset();
           std::vector<crypto::hash> tip(m_blockchain.size() - m_blockchain.offset());
           for (size_t i = m_blockchain.offset(); i < m_blockchain.size(); ++i)
@@ -4126,75 +4492,48 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
         catch (const std::exception &e)
         {
           MERROR("Error parsing blocks: " << e.what());
-          exception = std::current_exception();
-          error = true;
+          throw;
         }
         blocks_fetched += added_blocks;
+        added_blocks = 0;
+        ++stats.batches;
+        stats.blocks += batch->blocks.size();
       }
-      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
-
-      // handle error from async fetching thread
-      if (error)
-      {
-        if (exception)
-          std::rethrow_exception(exception);
-        else
-          throw std::runtime_error("proxy exception in refresh thread");
-      }
-
-      m_has_ever_refreshed_from_node = true;
 
-      if(!first && blocks_start_height == next_blocks_start_height)
-      {
+      stop_pipeline();
+      if (finished)
         m_node_rpc_proxy.set_height(m_blockchain.size());
-        break;
-      }
-
-      first = false;
-
-      // if we've got at least 10 blocks to refresh, assume we're starting
-      // a long refresh, and setup a tracking output cache if we need to
-      if (m_track_uses && (!output_tracker_cache || output_tracker_cache->empty()) && next_blocks.size() >= 10)
-        output_tracker_cache = create_output_tracker_cache();
-
-      // switch to the new blocks from the daemon
-      blocks_start_height = next_blocks_start_height;
-      blocks = std::move(next_blocks);
-      parsed_blocks = std::move(next_parsed_blocks);
+      break;
     }
     catch (const tools::error::password_needed&)
     {
       blocks_fetched += added_blocks;
-      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+      stop_pipeline();
       throw;
     }
     catch (const error::deprecated_rpc_access&)
     {
-      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+      stop_pipeline();
       throw;
     }
     catch (const error::reorg_depth_error&)
     {
-      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+      stop_pipeline();
       throw;
     }
     catch (const error::incorrect_fork_version&)
     {
-      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+      stop_pipeline();
       throw;
     }
     catch (const std::exception&)
     {
       blocks_fetched += added_blocks;
-      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+      stop_pipeline();
       if(try_count < 3)
       {
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
-        first = true;
-        last = false;
         start_height = 0;
-        blocks.clear();
-        parsed_blocks.clear();
         short_chain_history.clear();
         get_short_chain_history(short_chain_history, 1);
         ++try_count;
@@ -4224,6 +4563,9 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   if (m_background_syncing || m_is_background_wallet)
     m_background_sync_data.first_refresh_done = true;
 
+  LOG_PRINT_L1("Refresh pipeline: " << stats.batches << " batches, " << stats.blocks << " blocks, fetch " << stats.fetch_ms << " ms (stalled "
+      << stats.fetch_stall_ms << " ms), scan " << stats.scan_ms << " ms (" << stats.rescans << " rescans), apply " << stats.apply_ms
+      << " ms (stalled " << stats.apply_stall_ms << " ms), max queue depth " << stats.max_queue_depth);
   LOG_PRINT_L1("Refresh done, blocks received: " << blocks_fetched << ", balance (all accounts): " << print_money(balance_all(false)) << ", unlocked: " << print_money(unlocked_balance_all(false)));
 }
 //----------------------------------------------------------------------------------------------------
@@ -4341,6 +4683,7 @@ wallet2::detached_blockchain_data wallet2::detach_blockchain(uint64_t height, st
     dbd.detached_tx_hashes.insert(std::move(m_transfers[i].m_txid));
   MDEBUG(transfers_detached << " transfers detached / expected " << dbd.detached_tx_hashes.size());
   m_transfers.erase(it, m_transfers.end());
+  m_transfer_index.resize(m_transfers.size());
 
   uint64_t blocks_detached = 0;
   dbd.original_chain_size = m_blockchain.size();
@@ -4412,6 +4755,7 @@ bool wallet2::clear()
 {
   m_blockchain.clear();
   m_transfers.clear();
+  m_transfer_index.clear();
   m_key_images.clear();
   m_pub_keys.clear();
   m_unconfirmed_txs.clear();
@@ -4430,6 +4774,7 @@ bool wallet2::clear()
   m_pool_info_query_time = 0;
   m_skip_to_height = 0;
   m_background_sync_data = background_sync_data_t{};
+  m_cache_records_state = tools::cache_records::state();
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -4437,6 +4782,7 @@ void wallet2::clear_soft(bool keep_key_images)
 {
   m_blockchain.clear();
   m_transfers.clear();
+  m_transfer_index.clear();
   if (!keep_key_images)
     m_key_images.clear();
   m_pub_keys.clear();
@@ -4464,6 +4810,7 @@ void wallet2::clear_user_data()
     i->second.m_dests.clear();
   for (auto i = m_transfers.begin(); i != m_transfers.end(); ++i)
     i->m_frozen = false;
+  rebuild_transfer_index();
   m_tx_keys.clear();
   m_tx_notes.clear();
   m_address_book.clear();
@@ -4705,6 +5052,9 @@ boost::optional<wallet2::keys_file_data> wallet2::get_keys_file_data(const crypt
   value2.SetInt(m_load_deprecated_formats);
   json.AddMember("load_deprecated_formats", value2, json.GetAllocator());
 
+  value2.SetInt(m_columnar_cache ? 1 : 0);
+  json.AddMember("columnar_cache", value2, json.GetAllocator());
+
   value2.SetUint(1);
   json.AddMember("encrypted_secret_keys", value2, json.GetAllocator());
 
@@ -4969,6 +5319,7 @@ bool wallet2::load_keys_buf(const std::string& keys_buf, const epee::wipeable_st
     m_original_keys_available = false;
     m_export_format = ExportFormat::Binary;
     m_load_deprecated_formats = false;
+    m_columnar_cache = false;
     m_device_name = "";
     m_device_derivation_path = "";
     m_key_device_type = hw::device::device_type::SOFTWARE;
@@ -5156,6 +5507,9 @@ bool wallet2::load_keys_buf(const std::string& keys_buf, const epee::wipeable_st
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, load_deprecated_formats, int, Int, false, false);
     m_load_deprecated_formats = field_load_deprecated_formats;
 
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, columnar_cache, int, Int, false, false);
+    m_columnar_cache = field_columnar_cache;
+
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, device_name, std::string, String, false, std::string());
     if (m_device_name.empty())
     {
@@ -6431,6 +6785,7 @@ void wallet2::generate_chacha_key_from_password(const epee::wipeable_string &pas
 void wallet2::load(const std::string& wallet_, const epee::wipeable_string& password, const std::string& keys_buf, const std::string& cache_buf)
 {
   clear();
+  m_cache_records.reset();
   prepare_file_names(wallet_);
 
   // determine if loading from file system or string buffer
@@ -6642,11 +6997,161 @@ void wallet2::load_wallet_cache(const bool use_fs, const std::string& cache_buf)
         ar >> *this;
       }
     }
+    if (!m_cache_records_state.empty())
+    {
+      THROW_WALLET_EXCEPTION_IF(!use_fs, error::wallet_internal_error, "Cannot load cache records from a buffer");
+      load_cache_records();
+    }
     THROW_WALLET_EXCEPTION_IF(
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
       error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
   }
+  rebuild_transfer_index();
+}
+//----------------------------------------------------------------------------------------------------
+static tools::cache_records::record_key transfer_record_key(uint64_t idx)
+{
+  tools::cache_records::record_key key = crypto::null_hash;
+  idx = SWAP64LE(idx);
+  memcpy(key.data, &idx, sizeof(idx));
+  return key;
+}
+//----------------------------------------------------------------------------------------------------
+template<typename T>
+static void put_cache_record(tools::cache_records &records, uint8_t column, const tools::cache_records::record_key &key, T &value, std::string &data)
+{
+  data.clear();
+  THROW_WALLET_EXCEPTION_IF(!::serialization::dump_binary(value, data), tools::error::wallet_internal_error, "Failed to serialize cache record");
+  records.put(column, key, data);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_cache_records()
+{
+  const tools::cache_records::state state = m_cache_records_state;
+  m_cache_records_state = tools::cache_records::state();
+  m_cache_records.reset(new tools::cache_records(m_wallet_file + ".records"));
+  std::vector<tools::cache_records::record> records;
+  const std::string &filename = m_cache_records->get_filename();
+  THROW_WALLET_EXCEPTION_IF(!m_cache_records->load(get_cache_key(), state, records), error::file_read_error, filename);
+
+  std::vector<const tools::cache_records::record*> transfers;
+  for (const auto &record: records)
+    if (record.column == CACHE_RECORDS_TRANSFERS)
+      transfers.push_back(&record);
+  THROW_WALLET_EXCEPTION_IF(!m_transfers.empty() && !transfers.empty(), error::wallet_internal_error, "Transfers found in both the wallet cache and the records file");
+  if (!transfers.empty())
+    m_transfers.resize(transfers.size());
+
+  // transfers are keyed by their index, and all indices below their count must be present
+  tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+  tools::threadpool::waiter waiter(tpool);
+  std::atomic<bool> valid(true);
+  for (size_t i = 0; i < transfers.size(); i += CACHE_RECORDS_PARSE_BATCH)
+  {
+    const size_t n = std::min<size_t>(CACHE_RECORDS_PARSE_BATCH, transfers.size() - i);
+    tpool.submit(&waiter, [&, i, n]() {
+      for (size_t j = i; j < i + n; ++j)
+      {
+        uint64_t idx;
+        memcpy(&idx, transfers[j]->key.data, sizeof(idx));
+        idx = SWAP64LE(idx);
+        if (idx >= m_transfers.size() || !::serialization::parse_binary(transfers[j]->data, m_transfers[idx]))
+          valid = false;
+      }
+    }, true);
+  }
+  THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+  THROW_WALLET_EXCEPTION_IF(!valid, error::file_read_error, filename);
+
+  for (auto &record: records)
+  {
+    switch (record.column)
+    {
+      case CACHE_RECORDS_TRANSFERS:
+        break;
+      case CACHE_RECORDS_CONFIRMED_TXS:
+      {
+        confirmed_transfer_details ctd;
+        THROW_WALLET_EXCEPTION_IF(!::serialization::parse_binary(record.data, ctd), error::file_read_error, filename);
+        m_confirmed_txs.emplace(record.key, std::move(ctd));
+        break;
+      }
+      case CACHE_RECORDS_UNCONFIRMED_TXS:
+      {
+        unconfirmed_transfer_details utd;
+        THROW_WALLET_EXCEPTION_IF(!::serialization::parse_binary(record.data, utd), error::file_read_error, filename);
+        m_unconfirmed_txs.emplace(record.key, std::move(utd));
+        break;
+      }
+      case CACHE_RECORDS_PAYMENTS:
+      {
+        // payments are keyed by their contents, and prefixed with their payment id
+        crypto::hash payment_id;
+        payment_details pd;
+        THROW_WALLET_EXCEPTION_IF(record.data.size() < sizeof(payment_id), error::file_read_error, filename);
+        memcpy(payment_id.data, record.data.data(), sizeof(payment_id));
+        THROW_WALLET_EXCEPTION_IF(!::serialization::parse_binary(record.data.substr(sizeof(payment_id)), pd), error::file_read_error, filename);
+        m_payments.emplace(payment_id, std::move(pd));
+        break;
+      }
+      case CACHE_RECORDS_TX_KEYS:
+      {
+        // copied as is rather than parsed, which would leave copies of the key in stream buffers
+        const bool r = record.data.size() == sizeof(crypto::secret_key);
+        crypto::secret_key tx_key;
+        if (r)
+          memcpy(&unwrap(unwrap(tx_key)), record.data.data(), sizeof(tx_key));
+        memwipe(&record.data[0], record.data.size());
+        THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, filename);
+        m_tx_keys.emplace(record.key, tx_key);
+        break;
+      }
+      default:
+        MWARNING("Ignoring unknown cache record column " << (unsigned)record.column);
+        break;
+    }
+  }
+  MDEBUG("Loaded " << m_transfers.size() << " transfers, " << m_confirmed_txs.size() << " confirmed txes, "
+      << m_unconfirmed_txs.size() << " unconfirmed txes, " << m_payments.size() << " payments and "
+      << m_tx_keys.size() << " tx keys from " << filename);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::store_cache_records(tools::cache_records &records, bool rewrite)
+{
+  records.begin_store(get_cache_key(), rewrite);
+  std::string data;
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+    put_cache_record(records, CACHE_RECORDS_TRANSFERS, transfer_record_key(i), m_transfers[i], data);
+  for (auto &e: m_confirmed_txs)
+    put_cache_record(records, CACHE_RECORDS_CONFIRMED_TXS, e.first, e.second, data);
+  for (auto &e: m_unconfirmed_txs)
+    put_cache_record(records, CACHE_RECORDS_UNCONFIRMED_TXS, e.first, e.second, data);
+  std::unordered_set<crypto::hash> payment_keys;
+  for (auto &e: m_payments)
+  {
+    data.assign(e.first.data, sizeof(e.first.data));
+    std::string details;
+    THROW_WALLET_EXCEPTION_IF(!::serialization::dump_binary(e.second, details), error::wallet_internal_error, "Failed to serialize payment");
+    data += details;
+    // identical payments get distinct keys by rehashing
+    crypto::hash key = crypto::cn_fast_hash(data.data(), data.size());
+    while (!payment_keys.insert(key).second)
+      key = crypto::cn_fast_hash(key.data, sizeof(key.data));
+    records.put(CACHE_RECORDS_PAYMENTS, key, data);
+  }
+  // tx keys serialize to their raw bytes, which are written directly so no stream buffer gets a copy
+  auto data_wiper = epee::misc_utils::create_scope_leave_handler([&data]() {
+    if (!data.empty())
+      memwipe(&data[0], data.size());
+  });
+  for (auto &e: m_tx_keys)
+  {
+    data.assign(reinterpret_cast<const char*>(&unwrap(unwrap(e.second))), sizeof(e.second));
+    records.put(CACHE_RECORDS_TX_KEYS, e.first, data);
+    memwipe(&data[0], data.size());
+  }
+  m_cache_records_state = records.finish_store();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_background_cache_on_open()
@@ -6832,8 +7337,29 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     return;
   }
 
-  // get wallet cache data
+  // get wallet cache data, with the transfers and confirmed txes going to the records
+  // file first if enabled. Those records are only used once the cache is written.
+  std::unique_ptr<tools::cache_records> new_cache_records;
+  tools::cache_records *cache_records = NULL;
+  auto cache_records_aborter = epee::misc_utils::create_scope_leave_handler([&, this]() {
+    m_cache_records_state = tools::cache_records::state();
+    if (cache_records)
+      cache_records->abort_store();
+  });
+  if (m_columnar_cache)
+  {
+    const std::string records_file = (same_file ? m_wallet_file : path) + ".records";
+    if (m_cache_records && m_cache_records->get_filename() == records_file)
+      cache_records = m_cache_records.get();
+    else
+    {
+      new_cache_records.reset(new tools::cache_records(records_file));
+      cache_records = new_cache_records.get();
+    }
+    store_cache_records(*cache_records, !same_file);
+  }
   boost::optional<wallet2::cache_file_data> cache_file_data = get_cache_file_data();
+  m_cache_records_state = tools::cache_records::state();
   THROW_WALLET_EXCEPTION_IF(cache_file_data == boost::none, error::wallet_internal_error, "failed to generate wallet cache data");
 
   const std::string new_file = same_file ? m_wallet_file + ".new" : path;
@@ -6917,6 +7443,19 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
       LOG_ERROR("error removing file: " << old_file);
     }
   }
+
+  // the cache now refers to the new records, if any, and no longer to the old ones
+  if (cache_records)
+  {
+    cache_records->commit_store();
+    cache_records = NULL;
+  }
+  if (new_cache_records || !m_columnar_cache)
+  {
+    if (m_cache_records)
+      m_cache_records->remove();
+    m_cache_records = std::move(new_cache_records);
+  }
   
   if (m_message_store.get_active())
   {
@@ -6969,9 +7508,10 @@ boost::optional<wallet2::cache_file_data> wallet2::get_cache_file_data()
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::balance(uint32_t index_major, bool strict) const
 {
-  uint64_t amount = 0;
-  for (const auto& i : balance_per_subaddress(index_major, strict))
-    amount += i.second;
+  uint64_t amount = m_transfer_index.balance(index_major, strict);
+  if (!strict)
+    for (const auto& i : unconfirmed_balance_per_subaddress(index_major))
+      amount += i.second;
   return amount;
 }
 //----------------------------------------------------------------------------------------------------
@@ -6995,97 +7535,70 @@ uint64_t wallet2::unlocked_balance(uint32_t index_major, bool strict, uint64_t *
 //----------------------------------------------------------------------------------------------------
 std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_major, bool strict) const
 {
-  std::map<uint32_t, uint64_t> amount_per_subaddr;
-  for (const auto& td: m_transfers)
+  std::map<uint32_t, uint64_t> amount_per_subaddr = m_transfer_index.balance_per_subaddress(index_major, strict);
+  if (!strict)
   {
-    if (td.amount() > m_ignore_outputs_above || td.amount() < m_ignore_outputs_below)
-      continue;
-    if (td.m_subaddr_index.major == index_major && !is_spent(td, strict) && !td.m_frozen)
-    {
-      auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-      if (found == amount_per_subaddr.end())
-        amount_per_subaddr[td.m_subaddr_index.minor] = td.amount();
-      else
-        found->second += td.amount();
-    }
+    for (const auto& i : unconfirmed_balance_per_subaddress(index_major))
+      amount_per_subaddr[i.first] += i.second;
   }
-  if (!strict)
+  return amount_per_subaddr;
+}
+//----------------------------------------------------------------------------------------------------
+std::map<uint32_t, uint64_t> wallet2::unconfirmed_balance_per_subaddress(uint32_t index_major) const
+{
+  std::map<uint32_t, uint64_t> amount_per_subaddr;
+  for (const auto& utx: m_unconfirmed_txs)
   {
-   for (const auto& utx: m_unconfirmed_txs)
-   {
     if (utx.second.m_subaddr_account == index_major && utx.second.m_state != wallet2::unconfirmed_transfer_details::failed)
     {
       // all changes go to 0-th subaddress (in the current subaddress account)
-      auto found = amount_per_subaddr.find(0);
-      if (found == amount_per_subaddr.end())
-        amount_per_subaddr[0] = utx.second.m_change;
-      else
-        found->second += utx.second.m_change;
+      amount_per_subaddr[0] += utx.second.m_change;
 
       // add transfers to same wallet
       for (const auto &dest: utx.second.m_dests) {
         auto index = get_subaddress_index(dest.addr);
         if (index && (*index).major == index_major)
-        {
-          auto found = amount_per_subaddr.find((*index).minor);
-          if (found == amount_per_subaddr.end())
-            amount_per_subaddr[(*index).minor] = dest.amount;
-          else
-            found->second += dest.amount;
-        }
+          amount_per_subaddr[(*index).minor] += dest.amount;
       }
     }
-   }
+  }
 
-   for (const auto& utx: m_unconfirmed_payments)
-   {
+  for (const auto& utx: m_unconfirmed_payments)
+  {
     if (utx.second.m_pd.m_subaddr_index.major == index_major)
     {
       amount_per_subaddr[utx.second.m_pd.m_subaddr_index.minor] += utx.second.m_pd.m_amount;
     }
-   }
   }
   return amount_per_subaddr;
 }
 //----------------------------------------------------------------------------------------------------
 std::map<uint32_t, std::pair<uint64_t, std::pair<uint64_t, uint64_t>>> wallet2::unlocked_balance_per_subaddress(uint32_t index_major, bool strict)
 {
+  // start from the full balance, and take out the transfers which are still locked
   std::map<uint32_t, std::pair<uint64_t, std::pair<uint64_t, uint64_t>>> amount_per_subaddr;
+  for (const auto& i : m_transfer_index.balance_per_subaddress(index_major, strict))
+    amount_per_subaddr.emplace_hint(amount_per_subaddr.end(), i.first, std::make_pair(i.second, std::make_pair(0, 0)));
   const uint64_t blockchain_height = get_blockchain_current_height();
   const uint64_t now = time(NULL);
-  for(const transfer_details& td: m_transfers)
+  std::vector<size_t> locked;
+  m_transfer_index.get_locked(index_major, blockchain_height, locked);
+  for (size_t idx: locked)
   {
-    if (td.amount() > m_ignore_outputs_above || td.amount() < m_ignore_outputs_below)
+    const transfer_details& td = m_transfers[idx];
+    if (is_spent(td, strict) || is_transfer_unlocked(td))
       continue;
-    if(td.m_subaddr_index.major == index_major && !is_spent(td, strict) && !td.m_frozen)
-    {
-      uint64_t amount = 0, blocks_to_unlock = 0, time_to_unlock = 0;
-      if (is_transfer_unlocked(td))
-      {
-        amount = td.amount();
-        blocks_to_unlock = 0;
-        time_to_unlock = 0;
-      }
-      else
-      {
-        uint64_t unlock_height = td.m_block_height + std::max<uint64_t>(CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE, CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS);
-        if (td.m_tx.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER && td.m_tx.unlock_time > unlock_height)
-          unlock_height = td.m_tx.unlock_time;
-        uint64_t unlock_time = td.m_tx.unlock_time >= CRYPTONOTE_MAX_BLOCK_NUMBER ? td.m_tx.unlock_time : 0;
-        blocks_to_unlock = unlock_height > blockchain_height ? unlock_height - blockchain_height : 0;
-        time_to_unlock = unlock_time > now ? unlock_time - now : 0;
-        amount = 0;
-      }
-      auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-      if (found == amount_per_subaddr.end())
-        amount_per_subaddr[td.m_subaddr_index.minor] = std::make_pair(amount, std::make_pair(blocks_to_unlock, time_to_unlock));
-      else
-      {
-        found->second.first += amount;
-        found->second.second.first = std::max(found->second.second.first, blocks_to_unlock);
-        found->second.second.second = std::max(found->second.second.second, time_to_unlock);
-      }
-    }
+    uint64_t unlock_height = td.m_block_height + std::max<uint64_t>(CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE, CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS);
+    if (td.m_tx.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER && td.m_tx.unlock_time > unlock_height)
+      unlock_height = td.m_tx.unlock_time;
+    uint64_t unlock_time = td.m_tx.unlock_time >= CRYPTONOTE_MAX_BLOCK_NUMBER ? td.m_tx.unlock_time : 0;
+    uint64_t blocks_to_unlock = unlock_height > blockchain_height ? unlock_height - blockchain_height : 0;
+    uint64_t time_to_unlock = unlock_time > now ? unlock_time - now : 0;
+    auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
+    THROW_WALLET_EXCEPTION_IF(found == amount_per_subaddr.end() || found->second.first < td.amount(), error::wallet_internal_error, "Transfer index out of sync");
+    found->second.first -= td.amount();
+    found->second.second.first = std::max(found->second.second.first, blocks_to_unlock);
+    found->second.second.second = std::max(found->second.second.second, time_to_unlock);
   }
   return amount_per_subaddr;
 }
@@ -10278,8 +10791,13 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
 
   LOG_PRINT_L2("pick_preferred_rct_inputs: needed_money " << print_money(needed_money));
 
-  // try to find a rct input of enough size
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  // try to find a rct input of enough size, only outputs of at least that amount need looking at
+  const auto &available_by_amount = m_transfer_index.available_by_amount(subaddr_account);
+  std::vector<size_t> large_enough;
+  for (auto it = available_by_amount.lower_bound(std::make_pair(needed_money, (size_t)0)); it != available_by_amount.end(); ++it)
+    large_enough.push_back(it->second);
+  std::sort(large_enough.begin(), large_enough.end());
+  for (size_t i: large_enough)
   {
     const transfer_details& td = m_transfers[i];
     if (!is_spent(td, false) && !td.m_frozen && td.is_rct() && td.amount() >= needed_money && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
@@ -10299,7 +10817,8 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
   // this could be made better by picking one of the outputs to be a small one, since those
   // are less useful since often below the needed money, so if one can be used in a pair,
   // it gets rid of it for the future
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  const std::set<size_t> &available = m_transfer_index.available(subaddr_account);
+  for (size_t i: available)
   {
     const transfer_details& td = m_transfers[i];
     if (!is_spent(td, false) && !td.m_frozen && !td.m_key_image_partial && td.is_rct() && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
@@ -10310,8 +10829,9 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
         continue;
       }
       LOG_PRINT_L2("Considering input " << i << ", " << print_money(td.amount()));
-      for (size_t j = i + 1; j < m_transfers.size(); ++j)
+      for (auto jt = available.upper_bound(i); jt != available.end(); ++jt)
       {
+        const size_t j = *jt;
         const transfer_details& td2 = m_transfers[j];
         if (td2.amount() > m_ignore_outputs_above || td2.amount() < m_ignore_outputs_below)
         {
@@ -10616,7 +11136,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   // gather all dust and non-dust outputs belonging to specified subaddresses
   size_t num_nondust_outputs = 0;
   size_t num_dust_outputs = 0;
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t i: m_transfer_index.available(subaddr_account))
   {
     const transfer_details& td = m_transfers[i];
     if (m_ignore_fractional_outputs && td.amount() < fractional_threshold)
@@ -11209,7 +11729,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_all(uint64_t below
 
   // gather all dust and non-dust outputs of specified subaddress (if any) and below specified threshold (if any)
   bool fund_found = false;
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t i: m_transfer_index.available(subaddr_account))
   {
     const transfer_details& td = m_transfers[i];
     if (m_ignore_fractional_outputs && td.amount() < fractional_threshold)
@@ -11628,18 +12148,18 @@ uint64_t wallet2::get_upper_transaction_weight_limit()
 std::vector<size_t> wallet2::select_available_outputs(const std::function<bool(const transfer_details &td)> &f)
 {
   std::vector<size_t> outputs;
-  size_t n = 0;
-  for (transfer_container::const_iterator i = m_transfers.begin(); i != m_transfers.end(); ++i, ++n)
+  for (size_t n: m_transfer_index.available())
   {
-    if (is_spent(*i, false))
+    const transfer_details &td = m_transfers[n];
+    if (is_spent(td, false))
       continue;
-    if (i->m_frozen)
+    if (td.m_frozen)
       continue;
-    if (i->m_key_image_partial)
+    if (td.m_key_image_partial)
       continue;
-    if (!is_transfer_unlocked(*i))
+    if (!is_transfer_unlocked(td))
       continue;
-    if (f(*i))
+    if (f(td))
       outputs.push_back(n);
   }
   return outputs;
@@ -13473,6 +13993,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
     {
       transfer_details &td = m_transfers[n + offset];
       td.m_spent = daemon_resp.spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
+      update_transfer_index(n + offset);
     }
   }
   spent = 0;
@@ -13879,6 +14400,7 @@ void wallet2::store_background_cache(const crypto::chacha_key &custom_background
   background_w2->clear();
   r = ::serialization::parse_binary(this_wallet2, *background_w2);
   THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to deserialize wallet cache");
+  background_w2->rebuild_transfer_index();
 
   // Clear sensitive data from background cache not needed to sync
   background_w2->clear_user_data();
@@ -14273,6 +14795,7 @@ size_t wallet2::import_outputs(const std::tuple<uint64_t, uint64_t, std::vector<
     m_transfers.resize(offset + output_array.size());
   else if (num_outputs < m_transfers.size())
     m_transfers.resize(num_outputs);
+  auto rebuild_index = epee::misc_utils::create_scope_leave_handler([this](){ rebuild_transfer_index(); });
 
   for (size_t i = 0; i < output_array.size(); ++i)
   {
@@ -14353,6 +14876,7 @@ size_t wallet2::import_outputs(const std::tuple<uint64_t, uint64_t, std::vector<
     m_transfers.resize(offset + output_array.size());
   else if (num_outputs < m_transfers.size())
     m_transfers.resize(num_outputs);
+  auto rebuild_index = epee::misc_utils::create_scope_leave_handler([this](){ rebuild_transfer_index(); });
 
   for (size_t i = 0; i < output_array.size(); ++i)
   {
@@ -41,6 +41,7 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/deque.hpp>
 #include <boost/thread/lock_guard.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <atomic>
 #include <random>
 
@@ -71,6 +72,8 @@
 #include "common/password.h"
 #include "node_rpc_proxy.h"
 #include "message_store.h"
+#include "cache_records.h"
+#include "transfer_index.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "wallet.wallet2"
@@ -864,6 +867,19 @@ private:
       bool error;
     };
 
+    struct refresh_stats
+    {
+      uint64_t batches;
+      uint64_t blocks;
+      uint64_t fetch_ms;       // pulling and parsing blocks from the daemon
+      uint64_t fetch_stall_ms; // fetch stage waiting for room in the queue
+      uint64_t scan_ms;        // deriving and view tag checking outputs
+      uint64_t apply_ms;       // adding scanned blocks to the wallet
+      uint64_t apply_stall_ms; // apply stage waiting for the next batch
+      uint64_t rescans;        // batches scanned again after the subaddress table grew
+      size_t max_queue_depth;
+    };
+
     struct is_out_data
     {
       crypto::public_key pkey;
@@ -1148,6 +1164,17 @@ private:
     void refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blocks_fetched, bool& received_money, bool check_pool = true, bool try_incremental = true, uint64_t max_blocks = std::numeric_limits<uint64_t>::max());
     bool refresh(bool trusted_daemon, uint64_t & blocks_fetched, bool& received_money, bool& ok);
 
+    /*!
+     * \brief  Entry points for a wallet_scanner, which pulls and parses blocks once for several wallets
+     *
+     * pull_scanned_blocks pulls the next blocks after this wallet's chain, cache_parsed_blocks computes
+     * the per tx data which only depends on the refresh type, and process_scanned_blocks derives,
+     * checks and adds the blocks to this wallet, as process_parsed_blocks does.
+     */
+    void pull_scanned_blocks(uint64_t &blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &last);
+    void cache_parsed_blocks(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const;
+    void process_scanned_blocks(const uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> tx_cache_data, uint64_t& blocks_added);
+
     void set_refresh_type(RefreshType refresh_type) { m_refresh_type = refresh_type; }
     RefreshType get_refresh_type() const { return m_refresh_type; }
 
@@ -1371,17 +1398,39 @@ private:
       a & m_background_sync_data;
     }
 
+    // While storing with cache records, these containers are written empty and live in the records file
+#define CACHE_RECORDS_FIELD(f) \
+    if (m_cache_records_state.empty()) \
+      FIELD(f) \
+    else \
+    { \
+      decltype(f) empty; \
+      FIELD_N(#f, empty) \
+    }
+
     BEGIN_SERIALIZE_OBJECT()
-      MAGIC_FIELD("monero wallet cache")
-      VERSION_FIELD(2)
+      // caches without records keep version 2, so they can still be opened by older wallets.
+      // Those do not check the version, and would find no transfers in a cache with records,
+      // so those get another magic, which older wallets fail to open instead
+      std::string magic = m_cache_records_state.empty() ? "monero wallet cache" : "monero record cache";
+      ar.tag("magic");
+      ar.serialize_blob((void*)magic.data(), magic.size());
+      if (!ar.good())
+        return false;
+      const bool records = magic == "monero record cache";
+      if (!records && magic != "monero wallet cache")
+        return false;
+      VERSION_FIELD(records ? 3 : 2)
+      if (version > 3 || records != (version >= 3))
+        return false;
       FIELD(m_blockchain)
-      FIELD(m_transfers)
+      CACHE_RECORDS_FIELD(m_transfers)
       FIELD(m_account_public_address)
       FIELD(m_key_images)
-      FIELD(m_unconfirmed_txs)
-      FIELD(m_payments)
-      FIELD(m_tx_keys)
-      FIELD(m_confirmed_txs)
+      CACHE_RECORDS_FIELD(m_unconfirmed_txs)
+      CACHE_RECORDS_FIELD(m_payments)
+      CACHE_RECORDS_FIELD(m_tx_keys)
+      CACHE_RECORDS_FIELD(m_confirmed_txs)
       FIELD(m_tx_notes)
       FIELD(m_unconfirmed_payments)
       FIELD(m_pub_keys)
@@ -1412,7 +1461,14 @@ private:
         return true;
       }
       FIELD(m_background_sync_data)
+      if (version < 3)
+      {
+        m_cache_records_state = tools::cache_records::state();
+        return true;
+      }
+      FIELD(m_cache_records_state)
     END_SERIALIZE()
+#undef CACHE_RECORDS_FIELD
 
     /*!
      * \brief  Check if wallet keys and bin files exist
@@ -1470,11 +1526,14 @@ private:
     bool ignore_fractional_outputs() const { return m_ignore_fractional_outputs; }
     void ignore_fractional_outputs(bool value) { m_ignore_fractional_outputs = value; }
     uint64_t ignore_outputs_above() const { return m_ignore_outputs_above; }
-    void ignore_outputs_above(uint64_t value) { m_ignore_outputs_above = value; }
+    void ignore_outputs_above(uint64_t value) { m_ignore_outputs_above = value; rebuild_transfer_index(); }
     uint64_t ignore_outputs_below() const { return m_ignore_outputs_below; }
-    void ignore_outputs_below(uint64_t value) { m_ignore_outputs_below = value; }
+    void ignore_outputs_below(uint64_t value) { m_ignore_outputs_below = value; rebuild_transfer_index(); }
     bool track_uses() const { return m_track_uses; }
     void track_uses(bool value) { m_track_uses = value; }
+    size_t refresh_pipeline_depth() const { return m_refresh_pipeline_depth; }
+    void refresh_pipeline_depth(size_t depth) { m_refresh_pipeline_depth = std::max<size_t>(depth, 1); }
+    const refresh_stats &get_last_refresh_stats() const { return m_last_refresh_stats; }
     BackgroundSyncType background_sync_type() const { return m_background_sync_type; }
     void setup_background_sync(BackgroundSyncType background_sync_type, const epee::wipeable_string &wallet_password, const boost::optional<epee::wipeable_string> &background_cache_password);
     bool is_background_syncing() const { return m_background_syncing; }
@@ -1492,6 +1551,8 @@ private:
     inline void set_export_format(const ExportFormat& export_format) { m_export_format = export_format; }
     bool load_deprecated_formats() const { return m_load_deprecated_formats; }
     void load_deprecated_formats(bool load) { m_load_deprecated_formats = load; }
+    bool columnar_cache() const { return m_columnar_cache; }
+    void columnar_cache(bool value) { m_columnar_cache = value; }
     bool is_multisig_enabled() const { return m_enable_multisig; }
     void enable_multisig(bool enable) { m_enable_multisig = enable; }
     bool is_mismatched_daemon_version_allowed() const { return m_allow_mismatched_daemon_version; }
@@ -1804,6 +1865,8 @@ private:
     bool load_keys_buf(const std::string& keys_buf, const epee::wipeable_string& password);
     bool load_keys_buf(const std::string& keys_buf, const epee::wipeable_string& password, boost::optional<crypto::chacha_key>& keys_to_encrypt);
     void load_wallet_cache(const bool use_fs, const std::string& cache_buf = "");
+    void load_cache_records();
+    void store_cache_records(tools::cache_records &records, bool rewrite);
     void process_new_transaction(const crypto::hash &txid, const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, uint64_t height, uint8_t block_version, uint64_t ts, bool miner_tx, bool pool, bool double_spend_seen, const tx_cache_data &tx_cache_data, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL, bool ignore_callbacks = false);
     bool should_skip_block(const cryptonote::block &b, uint64_t height) const;
     void process_new_blockchain_entry(const cryptonote::block& b, const cryptonote::block_complete_entry& bche, const parsed_block &parsed_block, const crypto::hash& bl_id, uint64_t height, const std::vector<tx_cache_data> &tx_cache_data, size_t tx_cache_data_offset, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
@@ -1826,6 +1889,9 @@ private:
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, bool force = false);
     void pull_and_parse_next_blocks(bool first, bool try_incremental, uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>>& process_pool_txs, bool &last, bool &error, std::exception_ptr &exception);
     void process_parsed_blocks(const uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
+    uint64_t scan_parsed_blocks(const uint64_t start_height, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const;
+    void scan_cached_blocks(const uint64_t start_height, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const;
+    void apply_parsed_blocks(const uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, const std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
     bool accept_pool_tx_for_processing(const crypto::hash &txid);
     void process_unconfirmed_transfer(bool incremental, const crypto::hash &txid, wallet2::unconfirmed_transfer_details &tx_details, bool seen_in_pool, std::chrono::system_clock::time_point now, bool refreshed);
     void process_pool_info_extent(const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response &res, std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>> &process_txs, bool refreshed);
@@ -1852,6 +1918,9 @@ private:
     std::vector<size_t> pick_preferred_rct_inputs(uint64_t needed_money, uint32_t subaddr_account, const std::set<uint32_t> &subaddr_indices);
     void set_spent(size_t idx, uint64_t height);
     void set_unspent(size_t idx);
+    void update_transfer_index(size_t idx);
+    void rebuild_transfer_index();
+    std::map<uint32_t, uint64_t> unconfirmed_balance_per_subaddress(uint32_t index_major) const;
     bool is_spent(const transfer_details &td, bool strict = true) const;
     bool is_spent(size_t idx, bool strict = true) const;
     void get_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count, bool rct, std::unordered_set<crypto::public_key> &valid_public_keys_cache);
@@ -1938,6 +2007,10 @@ private:
     std::unordered_map<crypto::public_key, size_t> m_pub_keys;
     cryptonote::account_public_address m_account_public_address;
     std::unordered_map<crypto::public_key, cryptonote::subaddress_index> m_subaddresses;
+    // guards m_subaddresses against output scanning running ahead of refresh,
+    // and counts its changes so stale scan results can be detected
+    mutable boost::shared_mutex m_subaddresses_mutex;
+    std::atomic<uint64_t> m_subaddresses_generation;
     std::vector<std::vector<std::string>> m_subaddress_labels;
     std::unordered_map<crypto::hash, std::string> m_tx_notes;
     std::unordered_map<std::string, std::string> m_attributes;
@@ -1999,6 +2072,8 @@ private:
     uint64_t m_ignore_outputs_above;
     uint64_t m_ignore_outputs_below;
     bool m_track_uses;
+    size_t m_refresh_pipeline_depth;
+    refresh_stats m_last_refresh_stats;
     bool m_is_background_wallet;
     BackgroundSyncType m_background_sync_type;
     bool m_show_wallet_name_when_locked;
@@ -2048,6 +2123,11 @@ private:
     ExportFormat m_export_format;
     bool m_load_deprecated_formats;
 
+    bool m_columnar_cache;
+    std::unique_ptr<tools::cache_records> m_cache_records;
+    tools::transfer_index m_transfer_index;
+    tools::cache_records::state m_cache_records_state; // only set while the cache is being stored or loaded
+
     bool m_has_ever_refreshed_from_node;
 
     static boost::mutex default_daemon_address_lock;
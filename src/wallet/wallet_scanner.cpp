@@ -0,0 +1,196 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include "misc_language.h"
+#include "misc_log_ex.h"
+#include "wallet_scanner.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.scanner"
+
+namespace tools
+{
+  namespace
+  {
+    uint64_t ms_since(const std::chrono::steady_clock::time_point &t)
+    {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t).count();
+    }
+  }
+  //----------------------------------------------------------------------------------------------------
+  wallet_scanner::wallet_scanner():
+    m_run(true),
+    m_stats{0, 0, 0, 0, 0, 0}
+  {
+  }
+  //----------------------------------------------------------------------------------------------------
+  void wallet_scanner::add_wallet(wallet2 *wallet)
+  {
+    CHECK_AND_ASSERT_THROW_MES(wallet, "Null wallet");
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    if (std::find(m_wallets.begin(), m_wallets.end(), wallet) == m_wallets.end())
+      m_wallets.push_back(wallet);
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool wallet_scanner::remove_wallet(wallet2 *wallet)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    auto it = std::find(m_wallets.begin(), m_wallets.end(), wallet);
+    if (it == m_wallets.end())
+      return false;
+    m_wallets.erase(it);
+    // the caller may destroy the wallet once this returns
+    while (std::find(m_batch_wallets.begin(), m_batch_wallets.end(), wallet) != m_batch_wallets.end())
+      m_batch_done.wait(lock);
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  size_t wallet_scanner::num_wallets() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_wallets.size();
+  }
+  //----------------------------------------------------------------------------------------------------
+  wallet_scanner::stats wallet_scanner::get_stats() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_stats;
+  }
+  //----------------------------------------------------------------------------------------------------
+  wallet2 *wallet_scanner::get_lagging_wallet(const std::vector<wallet2*> &wallets)
+  {
+    wallet2 *lagging = NULL;
+    for (wallet2 *wallet: wallets)
+    {
+      if (wallet->is_offline())
+        continue;
+      if (!lagging || wallet->get_blockchain_current_height() < lagging->get_blockchain_current_height())
+        lagging = wallet;
+    }
+    return lagging;
+  }
+  //----------------------------------------------------------------------------------------------------
+  std::vector<wallet2*> wallet_scanner::begin_batch()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_batch_wallets = m_wallets;
+    return m_batch_wallets;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void wallet_scanner::end_batch(const stats &batch_stats)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_batch_wallets.clear();
+    m_stats.batches += batch_stats.batches;
+    m_stats.blocks += batch_stats.blocks;
+    m_stats.fetch_ms += batch_stats.fetch_ms;
+    m_stats.cache_ms += batch_stats.cache_ms;
+    m_stats.scan_ms += batch_stats.scan_ms;
+    m_stats.fallbacks += batch_stats.fallbacks;
+    m_batch_done.notify_all();
+  }
+  //----------------------------------------------------------------------------------------------------
+  uint64_t wallet_scanner::scan(bool trusted_daemon)
+  {
+    // the wallets are used without m_mutex, so adding and removing them does not wait for the whole scan
+    boost::unique_lock<boost::mutex> scan_lock(m_scan_mutex);
+    uint64_t blocks_fetched = 0;
+
+    while (m_run)
+    {
+      const std::vector<wallet2*> wallets = begin_batch();
+      stats batch_stats{0, 0, 0, 0, 0, 0};
+      auto batch_ender = epee::misc_utils::create_scope_leave_handler([&, this]() { end_batch(batch_stats); });
+      wallet2 *lagging = get_lagging_wallet(wallets);
+      if (!lagging)
+        break;
+
+      const uint64_t lagging_height = lagging->get_blockchain_current_height();
+      uint64_t start_height = 0;
+      std::vector<cryptonote::block_complete_entry> blocks;
+      std::vector<wallet2::parsed_block> parsed_blocks;
+      bool last = false;
+      auto start = std::chrono::steady_clock::now();
+      lagging->pull_scanned_blocks(start_height, blocks, parsed_blocks, last);
+      batch_stats.fetch_ms += ms_since(start);
+      if (blocks.empty() || start_height + blocks.size() <= lagging->get_blockchain_current_height())
+        break;
+      blocks_fetched += blocks.size();
+      ++batch_stats.batches;
+      batch_stats.blocks += blocks.size();
+
+      // wallets with the same refresh type share their per tx data
+      start = std::chrono::steady_clock::now();
+      std::map<wallet2::RefreshType, std::vector<wallet2::tx_cache_data>> tx_cache_data;
+      for (wallet2 *wallet: wallets)
+      {
+        if (!wallet->is_offline() && tx_cache_data.find(wallet->get_refresh_type()) == tx_cache_data.end())
+          wallet->cache_parsed_blocks(parsed_blocks, tx_cache_data[wallet->get_refresh_type()]);
+      }
+      batch_stats.cache_ms += ms_since(start);
+
+      start = std::chrono::steady_clock::now();
+      for (wallet2 *wallet: wallets)
+      {
+        if (wallet->is_offline())
+          continue;
+        // wallets which are further along than the whole batch have nothing to do with it
+        if (start_height + blocks.size() <= wallet->get_blockchain_current_height())
+          continue;
+        try
+        {
+          uint64_t blocks_added = 0;
+          wallet->process_scanned_blocks(start_height, blocks, parsed_blocks, tx_cache_data[wallet->get_refresh_type()], blocks_added);
+        }
+        catch (const std::exception &e)
+        {
+          MWARNING("Wallet " << wallet->get_account().get_public_address_str(wallet->nettype()) << " failed to add blocks from "
+              << start_height << ", refreshing it on its own: " << e.what());
+          ++batch_stats.fallbacks;
+          uint64_t wallet_blocks_fetched = 0;
+          bool received_money = false;
+          try { wallet->refresh(trusted_daemon, 0, wallet_blocks_fetched, received_money, false); }
+          catch (const std::exception &e) { MERROR("Failed to refresh wallet: " << e.what()); }
+        }
+      }
+      batch_stats.scan_ms += ms_since(start);
+
+      if (last)
+        break;
+      if (lagging->get_blockchain_current_height() <= lagging_height)
+      {
+        MWARNING("No progress scanning from height " << lagging_height << ", stopping");
+        break;
+      }
+    }
+    return blocks_fetched;
+  }
+}
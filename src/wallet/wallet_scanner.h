@@ -0,0 +1,104 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "wallet2.h"
+
+namespace tools
+{
+  // Refreshes many wallets against a single stream of blocks.
+  //
+  // Each batch of blocks is pulled and parsed once, by the wallet which is
+  // furthest behind, so its chain history is what reorgs get detected
+  // against. The per tx data which does not depend on any key (tx extra and
+  // tx public keys) is computed once per refresh type, and each wallet then
+  // only derives and view tag checks the outputs with its own view key.
+  //
+  // Wallets are not owned, and must not be refreshed or otherwise modified
+  // by anything else while scan() runs. Each batch works on a copy of the
+  // wallet list, so wallets added during a scan join it from the next batch,
+  // and removing a wallet only waits for the batch it is part of. Pool txes
+  // are not looked at, a host wanting those calls update_pool_state on each
+  // wallet.
+  class wallet_scanner
+  {
+  public:
+    struct stats
+    {
+      uint64_t batches;
+      uint64_t blocks;
+      uint64_t fetch_ms;   // pulling and parsing blocks
+      uint64_t cache_ms;   // per tx data shared between wallets
+      uint64_t scan_ms;    // deriving, checking and adding blocks, all wallets
+      uint64_t fallbacks;  // wallets which had to refresh on their own
+    };
+
+    wallet_scanner();
+
+    void add_wallet(wallet2 *wallet);
+    //! waits for a running batch using this wallet, so must not be called from within scan()
+    bool remove_wallet(wallet2 *wallet);
+    size_t num_wallets() const;
+
+    /*!
+     * \brief  Brings all wallets up to the daemon's height
+     * \param  trusted_daemon  passed to the wallets which need to refresh on their own
+     * \return the number of blocks pulled
+     *
+     * A wallet which fails to add a batch (eg, because its chain diverged from
+     * the daemon's below that batch) refreshes on its own and carries on with
+     * the next batch.
+     */
+    uint64_t scan(bool trusted_daemon);
+    //! makes scan() return after the current batch, and any later one return at once until start()
+    void stop() { m_run = false; }
+    //! call when queueing a scan, so a stop() coming before it runs is not lost
+    void start() { m_run = true; }
+
+    stats get_stats() const;
+
+  private:
+    static wallet2 *get_lagging_wallet(const std::vector<wallet2*> &wallets);
+    std::vector<wallet2*> begin_batch();
+    void end_batch(const stats &batch_stats);
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_batch_done;
+    std::vector<wallet2*> m_wallets;
+    std::vector<wallet2*> m_batch_wallets; // used by the running batch, without m_mutex
+    boost::mutex m_scan_mutex;             // one scan at a time
+    std::atomic<bool> m_run;
+    stats m_stats;
+  };
+}
@@ -288,6 +288,80 @@ bool gen_bpp_txs_valid_2_and_2::generate(std::vector<test_event_entry>& events)
   return generate_with(events, mixin, 2, amounts_paid, true, rct_config, HF_VERSION_BULLETPROOF_PLUS, NULL, [&](const cryptonote::transaction &tx, size_t tx_idx){ return check_bpp(tx, tx_idx, bp_sizes, "gen_bpp_txs_valid_2_and_2"); });
 }
 
+bool gen_bpp_txs_valid_precomputed_span::generate(std::vector<test_event_entry>& events) const
+{
+  const size_t mixin = 10;
+  const uint64_t amounts_paid[] = {1000, 1000, (size_t)-1, 1000, 1000, (uint64_t)-1};
+  const rct::RCTConfig rct_config[] = { { rct::RangeProofPaddedBulletproof, 4 }, {rct::RangeProofPaddedBulletproof, 4 } };
+  if (!generate_with(events, mixin, 2, amounts_paid, true, rct_config, HF_VERSION_BULLETPROOF_PLUS, NULL, NULL))
+    return false;
+  DO_CALLBACK(events, "check_precomputed_span");
+  return true;
+}
+
+bool gen_bpp_txs_valid_precomputed_span::check_precomputed_span(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_bpp_txs_valid_precomputed_span::check_precomputed_span");
+
+  // the last blocks, the last one with the rct txes, are added again as one span
+  const size_t n_blocks = 3;
+  const uint64_t height = c.get_current_blockchain_height() - n_blocks;
+  const crypto::hash top_hash = c.get_tail_id();
+  std::vector<std::pair<cryptonote::blobdata, cryptonote::block>> blocks;
+  CHECK_TEST_CONDITION(c.get_blocks(height, n_blocks, blocks));
+  CHECK_EQ(blocks.size(), n_blocks);
+  std::vector<cryptonote::block_complete_entry> span;
+  for (const auto &b: blocks)
+  {
+    cryptonote::block_complete_entry bce;
+    bce.pruned = false;
+    bce.block = b.first;
+    std::vector<cryptonote::blobdata> txs;
+    std::vector<crypto::hash> missed_txs;
+    CHECK_TEST_CONDITION(c.get_transactions(b.second.tx_hashes, txs, missed_txs));
+    CHECK_TEST_CONDITION(missed_txs.empty());
+    for (const auto &tx: txs)
+      bce.txs.push_back({tx, crypto::null_hash});
+    span.push_back(std::move(bce));
+  }
+  CHECK_TEST_CONDITION(!span.back().txs.empty());
+
+  cryptonote::Blockchain &bc = c.get_blockchain_storage();
+  const bool pipeline_block_import = bc.get_pipeline_block_import();
+  bc.set_pipeline_block_import(true);
+
+  // without precomputation, with a span precomputed for that height, and with one for another height, which must be ignored
+  std::vector<std::vector<bool>> added;
+  for (int pass = 0; pass < 3; ++pass)
+  {
+    bc.pop_blocks(c.get_current_blockchain_height() - height);
+    CHECK_EQ(c.get_current_blockchain_height(), height);
+    if (pass == 1)
+      c.precompute_incoming_blocks(height, span);
+    else if (pass == 2)
+      c.precompute_incoming_blocks(height + 1, span);
+
+    std::vector<cryptonote::block> pblocks;
+    added.push_back(std::vector<bool>());
+    if (c.prepare_handle_incoming_blocks(span, pblocks))
+    {
+      for (size_t i = 0; i < span.size(); ++i)
+      {
+        cryptonote::block_verification_context bvc = AUTO_VAL_INIT(bvc);
+        c.handle_incoming_block(span[i].block, pblocks.empty() ? NULL : &pblocks[i], bvc);
+        added.back().push_back(bvc.m_added_to_main_chain && !bvc.m_verifivation_failed);
+      }
+      c.cleanup_handle_incoming_blocks();
+    }
+    CHECK_TEST_CONDITION(added.back() == added.front());
+    CHECK_TEST_CONDITION(c.get_tail_id() == top_hash);
+  }
+  CHECK_TEST_CONDITION(added.front() == std::vector<bool>(n_blocks, true));
+
+  bc.set_pipeline_block_import(pipeline_block_import);
+  return true;
+}
+
 bool gen_bpp_txs_invalid_2_and_8_2_and_16_16_1::generate(std::vector<test_event_entry>& events) const
 {
   const size_t mixin = 10;
@@ -163,6 +163,18 @@ struct gen_bpp_txs_valid_2_and_2 : public gen_bpp_tx_validation_base
 };
 template<> struct get_test_options<gen_bpp_txs_valid_2_and_2>: public get_bpp_versioned_test_options<HF_VERSION_BULLETPROOF_PLUS> {};
 
+struct gen_bpp_txs_valid_precomputed_span : public gen_bpp_tx_validation_base
+{
+  gen_bpp_txs_valid_precomputed_span()
+  {
+    REGISTER_CALLBACK_METHOD(gen_bpp_txs_valid_precomputed_span, check_precomputed_span);
+  }
+
+  bool generate(std::vector<test_event_entry>& events) const;
+  bool check_precomputed_span(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+};
+template<> struct get_test_options<gen_bpp_txs_valid_precomputed_span>: public get_bpp_versioned_test_options<HF_VERSION_BULLETPROOF_PLUS> {};
+
 struct gen_bpp_txs_invalid_2_and_8_2_and_16_16_1 : public gen_bpp_tx_validation_base
 {
   bool generate(std::vector<test_event_entry>& events) const;
@@ -107,6 +107,7 @@ int main(int argc, char* argv[])
     GENERATE_AND_PLAY(gen_simple_chain_split_1);
     GENERATE_AND_PLAY(one_block);
     GENERATE_AND_PLAY(gen_chain_switch_1);
+    GENERATE_AND_PLAY(gen_read_snapshot_during_import);
     GENERATE_AND_PLAY(gen_ring_signature_1);
     GENERATE_AND_PLAY(gen_ring_signature_2);
     //GENERATE_AND_PLAY(gen_ring_signature_big); // Takes up to XXX hours (if CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW == 10)
@@ -291,6 +292,7 @@ int main(int argc, char* argv[])
     GENERATE_AND_PLAY(gen_bpp_tx_invalid_4_2_1);
     GENERATE_AND_PLAY(gen_bpp_tx_invalid_16_16);
     GENERATE_AND_PLAY(gen_bpp_txs_valid_2_and_2);
+    GENERATE_AND_PLAY(gen_bpp_txs_valid_precomputed_span);
     GENERATE_AND_PLAY(gen_bpp_txs_invalid_2_and_8_2_and_16_16_1);
     GENERATE_AND_PLAY(gen_bpp_txs_valid_2_and_3_and_2_and_4);
     GENERATE_AND_PLAY(gen_bpp_tx_invalid_not_enough_proofs);
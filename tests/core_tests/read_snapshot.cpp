@@ -0,0 +1,145 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include "chaingen.h"
+#include "read_snapshot.h"
+
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  // reads what get_info reads from a snapshot, and checks it is consistent
+  bool check_snapshot(cryptonote::core& c)
+  {
+    Blockchain &bc = c.get_blockchain_storage();
+    const Blockchain::read_snapshot snapshot(bc);
+    const uint64_t height = snapshot.height();
+    if (height == 0 || bc.get_current_blockchain_height() != height)
+      return false;
+    if (bc.get_block_id_by_height(height - 1) != snapshot.top_hash())
+      return false;
+    if (snapshot.tip() && (snapshot.tip()->top_hash != snapshot.top_hash() || snapshot.tip()->height != height))
+      return false;
+    std::vector<std::pair<cryptonote::blobdata, cryptonote::block>> blocks;
+    if (!bc.get_blocks(height - 1, 1, blocks) || blocks.size() != 1 || get_block_hash(blocks.front().second) != snapshot.top_hash())
+      return false;
+    c.get_pool_transactions_count(true);
+    bc.get_alternative_blocks_count();
+    bc.get_db().get_block_cumulative_difficulty(height - 1);
+    bc.get_adjusted_time(height);
+    return true;
+  }
+}
+
+gen_read_snapshot_during_import::gen_read_snapshot_during_import()
+{
+  REGISTER_CALLBACK_METHOD(gen_read_snapshot_during_import, check_snapshot_reads);
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_read_snapshot_during_import::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+
+  GENERATE_ACCOUNT(miner_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);
+  REWIND_BLOCKS(events, blk_0r, blk_0, miner_account);
+  DO_CALLBACK(events, "check_snapshot_reads");
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_read_snapshot_during_import::check_snapshot_reads(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_read_snapshot_during_import::check_snapshot_reads");
+
+  // the last blocks are added again, one at a time, while another thread reads from snapshots
+  const size_t n_blocks = 20;
+  const uint64_t height = c.get_current_blockchain_height() - n_blocks;
+  const crypto::hash top_hash = c.get_tail_id();
+  std::vector<std::pair<cryptonote::blobdata, cryptonote::block>> blocks;
+  CHECK_TEST_CONDITION(c.get_blocks(height, n_blocks, blocks));
+  CHECK_EQ(blocks.size(), n_blocks);
+  c.get_blockchain_storage().pop_blocks(n_blocks);
+  CHECK_EQ(c.get_current_blockchain_height(), height);
+
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> reads(0), bad_reads(0);
+  boost::thread reader([&]() {
+    while (!stop)
+    {
+      try
+      {
+        if (!check_snapshot(c))
+          ++bad_reads;
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Exception reading from snapshot: " << e.what());
+        ++bad_reads;
+      }
+      ++reads;
+    }
+  });
+
+  bool added = true;
+  for (const auto &b: blocks)
+  {
+    cryptonote::block_complete_entry bce;
+    bce.pruned = false;
+    bce.block = b.first;
+    std::vector<cryptonote::block> pblocks;
+    if (!c.prepare_handle_incoming_blocks(std::vector<cryptonote::block_complete_entry>(1, bce), pblocks))
+    {
+      added = false;
+      break;
+    }
+    cryptonote::block_verification_context bvc = AUTO_VAL_INIT(bvc);
+    c.handle_incoming_block(b.first, &b.second, bvc);
+    c.cleanup_handle_incoming_blocks();
+    added = added && bvc.m_added_to_main_chain && !bvc.m_verifivation_failed;
+    // give the reader a chance at each intermediate chain
+    const uint64_t reads_before = reads;
+    const auto deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(10);
+    while (reads == reads_before && boost::chrono::steady_clock::now() < deadline)
+      boost::this_thread::yield();
+  }
+
+  // the reader must not have been held up by, nor held up, block import
+  stop = true;
+  CHECK_TEST_CONDITION(reader.try_join_for(boost::chrono::seconds(60)));
+  CHECK_TEST_CONDITION(added);
+  CHECK_TEST_CONDITION(c.get_tail_id() == top_hash);
+  CHECK_TEST_CONDITION(reads > 0);
+  CHECK_EQ(bad_reads, 0);
+  return true;
+}
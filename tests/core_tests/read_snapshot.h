@@ -1,21 +1,21 @@
-// Copyright (c) 2014-2024, The Monero Project
-// 
+// Copyright (c) 2024, The Monero Project
+//
 // All rights reserved.
-// 
+//
 // Redistribution and use in source and binary forms, with or without modification, are
 // permitted provided that the following conditions are met:
-// 
+//
 // 1. Redistributions of source code must retain the above copyright notice, this list of
 //    conditions and the following disclaimer.
-// 
+//
 // 2. Redistributions in binary form must reproduce the above copyright notice, this list
 //    of conditions and the following disclaimer in the documentation and/or other
 //    materials provided with the distribution.
-// 
+//
 // 3. Neither the name of the copyright holder nor the names of its contributors may be
 //    used to endorse or promote products derived from this software without specific
 //    prior written permission.
-// 
+//
 // THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
 // EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
 // MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
@@ -25,41 +25,19 @@
 // INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-// 
-// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
-#pragma once 
+#pragma once
+#include "chaingen.h"
 
-#include <unordered_set>
-#include <mutex>
-
-namespace tools
+/************************************************************************/
+/*                                                                      */
+/************************************************************************/
+class gen_read_snapshot_during_import : public test_chain_unit_base
 {
-  template<typename T, size_t MAX_SIZE>
-  class data_cache
-  {
-  public:
-    void add(const T& value)
-    {
-      std::lock_guard<std::mutex> lock(m);
-      if (data.insert(value).second)
-      {
-        T& old_value = buf[counter++ % MAX_SIZE];
-        data.erase(old_value);
-        old_value = value;
-      }
-    }
+public:
+  gen_read_snapshot_during_import();
 
-    bool has(const T& value) const
-    {
-      std::lock_guard<std::mutex> lock(m);
-      return (data.find(value) != data.end());
-    }
+  bool generate(std::vector<test_event_entry>& events) const;
 
-  private:
-    mutable std::mutex m;
-    std::unordered_set<T> data;
-    T buf[MAX_SIZE] = {};
-    size_t counter = 0;
-  };
-}
+  bool check_snapshot_reads(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+};
@@ -0,0 +1,192 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_protocol/compact_block.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// Relays a block along a line of nodes, serializing and parsing every
+// message a hop takes, fluffy or compact. Each node's pool holds the
+// block's txes but the first `missing` ones, which cost a round trip
+// (NOTIFY_REQUEST_FLUFFY_MISSING_TX and a fluffy block carrying them) unless
+// the sender prefilled them. A node which lacked them prefills them for the
+// next one, as relay_block does.
+template<bool compact, size_t hops, size_t missing>
+class test_compact_block
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t tx_count = 100;
+  static const size_t tx_size = 2000;
+
+  bool init()
+  {
+    m_block.major_version = 16;
+    m_block.minor_version = 16;
+    m_block.prev_id = crypto::rand<crypto::hash>();
+    m_block.miner_tx.version = 2;
+    m_block.miner_tx.vin.push_back(cryptonote::txin_gen{1});
+    for (size_t i = 0; i < tx_count; ++i)
+    {
+      m_block.tx_hashes.push_back(crypto::rand<crypto::hash>());
+      m_txs.push_back({std::string(tx_size, (char)i), crypto::null_hash});
+    }
+    m_block_hash = cryptonote::get_block_hash(m_block);
+
+    m_nodes.resize(hops + 1);
+    for (auto &node: m_nodes)
+    {
+      node.salt = crypto::rand<uint64_t>() | 1;
+      // other pool txes, so lookups are not all hits
+      for (size_t i = 0; i < 5 * tx_count; ++i)
+        node.add(crypto::rand<crypto::hash>());
+      for (size_t i = missing; i < tx_count; ++i)
+        node.add(m_block.tx_hashes[i]);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    std::unordered_set<crypto::hash> lacked; // the origin has them all
+    for (size_t hop = 1; hop <= hops; ++hop)
+    {
+      if (!(compact ? relay_compact(m_nodes[hop], lacked) : relay_fluffy(m_nodes[hop], lacked)))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  struct node
+  {
+    uint64_t salt;
+    std::unordered_set<crypto::hash> pool;
+    std::unordered_multimap<uint64_t, crypto::hash> short_ids;
+
+    void add(const crypto::hash &txid)
+    {
+      pool.insert(txid);
+      short_ids.emplace(cryptonote::get_transaction_short_id(txid, salt), txid);
+    }
+  };
+
+  template<typename T>
+  static bool send(const T &in, T &out)
+  {
+    epee::byte_slice buffer;
+    return epee::serialization::store_t_to_binary(in, buffer) && epee::serialization::load_t_from_binary(out, epee::to_span(buffer));
+  }
+
+  // the round trip for txes the receiver did not find, which then go to the next hop prefilled
+  bool request_missing(const std::vector<uint64_t> &indices, std::unordered_set<crypto::hash> &lacked)
+  {
+    cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::request req, req_in;
+    req.block_hash = m_block_hash;
+    req.missing_tx_indices = indices;
+    if (!send(req, req_in))
+      return false;
+    cryptonote::NOTIFY_NEW_FLUFFY_BLOCK::request res, res_in;
+    res.b.block = cryptonote::block_to_blob(m_block);
+    for (uint64_t idx: req_in.missing_tx_indices)
+      res.b.txs.push_back(m_txs[idx]);
+    if (!send(res, res_in))
+      return false;
+    cryptonote::block b;
+    if (!cryptonote::parse_and_validate_block_from_blob(res_in.b.block, b) || res_in.b.txs.size() != indices.size())
+      return false;
+    lacked.clear();
+    for (uint64_t idx: indices)
+      lacked.insert(b.tx_hashes[idx]);
+    return true;
+  }
+
+  bool relay_fluffy(const node &receiver, std::unordered_set<crypto::hash> &lacked)
+  {
+    cryptonote::NOTIFY_NEW_FLUFFY_BLOCK::request req, req_in;
+    req.b.block = cryptonote::block_to_blob(m_block);
+    if (!send(req, req_in))
+      return false;
+    cryptonote::block b;
+    crypto::hash hash;
+    if (!cryptonote::parse_and_validate_block_from_blob(req_in.b.block, b, hash) || hash != m_block_hash)
+      return false;
+    std::vector<uint64_t> need;
+    for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+      if (!receiver.pool.count(b.tx_hashes[i]))
+        need.push_back(i);
+    return need.empty() || request_missing(need, lacked);
+  }
+
+  bool relay_compact(const node &receiver, std::unordered_set<crypto::hash> &lacked)
+  {
+    cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request req, req_in;
+    if (!cryptonote::make_compact_block(m_block, m_txs, lacked, receiver.salt, 0, req) || !send(req, req_in))
+      return false;
+    cryptonote::block b;
+    std::vector<uint64_t> short_ids;
+    if (!cryptonote::parse_and_validate_block_from_blob(req_in.block, b) || !cryptonote::get_compact_block_short_ids(req_in, short_ids))
+      return false;
+    b.tx_hashes.resize(short_ids.size(), crypto::null_hash);
+    for (size_t i = 0; i < req_in.prefilled_tx_indices.size(); ++i)
+      b.tx_hashes[req_in.prefilled_tx_indices[i]] = m_block.tx_hashes[req_in.prefilled_tx_indices[i]]; // stands for hashing the tx
+    std::vector<uint64_t> need;
+    for (size_t i = 0; i < short_ids.size(); ++i)
+    {
+      if (b.tx_hashes[i] != crypto::null_hash)
+        continue;
+      const auto range = receiver.short_ids.equal_range(short_ids[i]);
+      if (range.first == range.second || std::next(range.first) != range.second)
+        need.push_back(i);
+      else
+        b.tx_hashes[i] = range.first->second;
+    }
+    if (!need.empty())
+      return request_missing(need, lacked);
+    b.invalidate_hashes();
+    if (cryptonote::get_block_hash(b) != m_block_hash)
+      return false;
+    lacked.clear();
+    for (uint64_t idx: req_in.prefilled_tx_indices)
+      lacked.insert(m_block.tx_hashes[idx]);
+    return true;
+  }
+
+  cryptonote::block m_block;
+  crypto::hash m_block_hash;
+  std::vector<cryptonote::tx_blob_entry> m_txs;
+  std::vector<node> m_nodes;
+};
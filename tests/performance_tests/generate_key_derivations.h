@@ -0,0 +1,83 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+
+// Wallet scan kernel: derivation and view tag for batch_size (tx pub key, output index)
+// pairs, either one derivation at a time or through generate_key_derivations. Time
+// per call is for the whole batch; divide by batch_size for the per output cost.
+template<size_t batch_size, bool batched>
+class test_generate_key_derivations
+{
+public:
+  static const size_t loop_count = batch_size >= 1000 ? 10 : 10000 / batch_size;
+
+  bool init()
+  {
+    crypto::public_key view_public_key;
+    crypto::secret_key tx_secret_key;
+    crypto::generate_keys(view_public_key, m_view_secret_key);
+    m_tx_pub_keys.resize(batch_size);
+    for (auto &pkey: m_tx_pub_keys)
+      crypto::generate_keys(pkey, tx_secret_key);
+    m_derivations.resize(batch_size);
+    m_valid.reset(new bool[batch_size]);
+    return true;
+  }
+
+  bool test()
+  {
+    if (batched)
+    {
+      if (!crypto::generate_key_derivations(m_tx_pub_keys.data(), batch_size, m_view_secret_key, m_derivations.data(), m_valid.get()))
+        return false;
+    }
+    else
+    {
+      for (size_t i = 0; i < batch_size; ++i)
+        if (!crypto::generate_key_derivation(m_tx_pub_keys[i], m_view_secret_key, m_derivations[i]))
+          return false;
+    }
+    crypto::view_tag view_tag;
+    for (size_t i = 0; i < batch_size; ++i)
+      crypto::derive_view_tag(m_derivations[i], i % 16, view_tag);
+    return true;
+  }
+
+private:
+  crypto::secret_key m_view_secret_key;
+  std::vector<crypto::public_key> m_tx_pub_keys;
+  std::vector<crypto::key_derivation> m_derivations;
+  std::unique_ptr<bool[]> m_valid;
+};
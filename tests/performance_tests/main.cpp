@@ -46,6 +46,7 @@
 #include "ge_frombytes_vartime.h"
 #include "ge_tobytes.h"
 #include "generate_key_derivation.h"
+#include "generate_key_derivations.h"
 #include "generate_key_image.h"
 #include "generate_key_image_helper.h"
 #include "generate_keypair.h"
@@ -65,6 +66,8 @@
 #include "multiexp.h"
 #include "sig_mlsag.h"
 #include "sig_clsag.h"
+#include "threadpool.h"
+#include "compact_block.h"
 
 namespace po = boost::program_options;
 
@@ -214,9 +217,23 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(filter, p, test_signature, false);
   TEST_PERFORMANCE1(filter, p, test_signature, true);
   TEST_PERFORMANCE0(filter, p, test_derive_view_tag);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivations, 16, false);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivations, 16, true);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivations, 256, false);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivations, 256, true);
 
   TEST_PERFORMANCE2(filter, p, test_wallet2_expand_subaddresses, 50, 200);
 
+  TEST_PERFORMANCE2(filter, p, test_threadpool, false, 16); // nested submits, global queue
+  TEST_PERFORMANCE2(filter, p, test_threadpool, true, 16); // nested submits, work stealing
+  TEST_PERFORMANCE2(filter, p, test_threadpool, false, 64);
+  TEST_PERFORMANCE2(filter, p, test_threadpool, true, 64);
+
+  TEST_PERFORMANCE3(filter, p, test_compact_block, false, 8, 0); // fluffy, all txes in the pools
+  TEST_PERFORMANCE3(filter, p, test_compact_block, true, 8, 0); // compact, all txes in the pools
+  TEST_PERFORMANCE3(filter, p, test_compact_block, false, 8, 5); // fluffy, 5 txes missing at every hop
+  TEST_PERFORMANCE3(filter, p, test_compact_block, true, 8, 5); // compact, 5 txes missing, prefilled after the first hop
+
   TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, 0);
   TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, 1);
   TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, 2);
@@ -0,0 +1,194 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include "common/threadpool.h"
+#include "common/util.h"
+#include "crypto/hash.h"
+
+// The previous tools::threadpool design, kept here as a baseline: one global
+// queue behind one mutex, and nested submits run inline in the submitter.
+class global_queue_threadpool
+{
+public:
+  class waiter
+  {
+  public:
+    waiter(global_queue_threadpool &pool): pool(pool), num(0) {}
+    void inc() { const boost::unique_lock<boost::mutex> lock(mt); ++num; }
+    void dec() { const boost::unique_lock<boost::mutex> lock(mt); if (!--num) cv.notify_all(); }
+    void wait() { pool.run(true); boost::unique_lock<boost::mutex> lock(mt); while (num) cv.wait(lock); }
+  private:
+    boost::mutex mt;
+    boost::condition_variable cv;
+    global_queue_threadpool &pool;
+    int num;
+  };
+
+  global_queue_threadpool(unsigned int max_threads): active(0), max(max_threads), running(true)
+  {
+    for (unsigned int i = 1; i < max; ++i)
+      threads.push_back(boost::thread([this](){ run(false); }));
+  }
+
+  ~global_queue_threadpool()
+  {
+    {
+      const boost::unique_lock<boost::mutex> lock(mutex);
+      running = false;
+      has_work.notify_all();
+    }
+    for (auto &t: threads)
+      t.join();
+  }
+
+  void submit(waiter *obj, std::function<void()> f, bool leaf = false)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!leaf && ((active == max && !queue.empty()) || depth() > 0))
+    {
+      lock.unlock();
+      ++depth();
+      f();
+      --depth();
+      return;
+    }
+    obj->inc();
+    if (leaf)
+      queue.push_front({obj, std::move(f)});
+    else
+      queue.push_back({obj, std::move(f)});
+    has_work.notify_one();
+  }
+
+private:
+  struct entry { waiter *wo; std::function<void()> f; };
+
+  static int &depth() { static thread_local int d = 0; return d; }
+
+  void run(bool flush)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (running)
+    {
+      while (queue.empty() && running)
+      {
+        if (flush)
+          return;
+        has_work.wait(lock);
+      }
+      if (!running)
+        break;
+      ++active;
+      entry e = std::move(queue.front());
+      queue.pop_front();
+      lock.unlock();
+      ++depth();
+      e.f();
+      --depth();
+      e.wo->dec();
+      lock.lock();
+      --active;
+    }
+  }
+
+  std::deque<entry> queue;
+  boost::condition_variable has_work;
+  boost::mutex mutex;
+  std::vector<boost::thread> threads;
+  unsigned int active;
+  unsigned int max;
+  bool running;
+};
+
+// Nested submit load: fanout tasks each fanning out to fanout leaf tasks,
+// roughly what Blockchain::prepare_handle_incoming_blocks and RCT verification
+// do when they run at the same time
+template<bool work_stealing, size_t fanout>
+class test_threadpool
+{
+public:
+  static const size_t loop_count = 100;
+
+  bool init()
+  {
+    const unsigned int threads = tools::get_max_concurrency();
+    if (work_stealing)
+      m_pool.reset(tools::threadpool::getNewForUnitTests(threads));
+    else
+      m_legacy_pool.reset(new global_queue_threadpool(threads));
+    return true;
+  }
+
+  bool test()
+  {
+    std::atomic<size_t> done(0);
+    if (work_stealing)
+      run(*m_pool, done);
+    else
+      run(*m_legacy_pool, done);
+    return done == fanout * fanout;
+  }
+
+private:
+  static void work(std::atomic<size_t> &done)
+  {
+    crypto::hash h = crypto::null_hash;
+    for (int i = 0; i < 16; ++i)
+      crypto::cn_fast_hash(h.data, sizeof(h), h);
+    ++done;
+  }
+
+  template<typename pool_t>
+  static void run(pool_t &pool, std::atomic<size_t> &done)
+  {
+    typename pool_t::waiter waiter(pool);
+    for (size_t i = 0; i < fanout; ++i)
+    {
+      pool.submit(&waiter, [&pool, &done](){
+        typename pool_t::waiter inner(pool);
+        for (size_t j = 0; j < fanout; ++j)
+          pool.submit(&inner, [&done](){ work(done); }, true);
+        inner.wait();
+      });
+    }
+    waiter.wait();
+  }
+
+  std::unique_ptr<tools::threadpool> m_pool;
+  std::unique_ptr<global_queue_threadpool> m_legacy_pool;
+};
@@ -0,0 +1,123 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "blockchain_db/batch_tuner.h"
+
+using cryptonote::batch_tuner;
+
+// a batch where the commit takes as long as the writes
+static void fast_batches(batch_tuner &tuner, uint64_t n, uint64_t blocks)
+{
+  for (uint64_t i = 0; i < n; ++i)
+    tuner.on_batch(blocks, 100000, 300000, 100000, 100000);
+}
+
+// a batch running for over a minute, mostly writing
+static void slow_batches(batch_tuner &tuner, uint64_t n, uint64_t blocks)
+{
+  for (uint64_t i = 0; i < n; ++i)
+    tuner.on_batch(blocks, 100000, 300000, 60000000, 100000);
+}
+
+TEST(batch_tuner, no_opinion_until_measured)
+{
+  batch_tuner tuner(20, 100);
+  ASSERT_EQ(tuner.get_suggested_blocks(), 0);
+  ASSERT_EQ(tuner.estimate_growth(1000), 0);
+  tuner.on_batch(0, 0, 0, 0, 0);
+  fast_batches(tuner, batch_tuner::MIN_SAMPLES - 1, 20);
+  ASSERT_EQ(tuner.get_suggested_blocks(), 0);
+  ASSERT_EQ(tuner.estimate_growth(1000), 0);
+  fast_batches(tuner, 1, 20);
+  ASSERT_GE(tuner.get_suggested_blocks(), 20);
+  ASSERT_NE(tuner.estimate_growth(1000), 0);
+}
+
+TEST(batch_tuner, growth_estimate)
+{
+  batch_tuner tuner(20, 100);
+  for (uint64_t i = 0; i < batch_tuner::MIN_SAMPLES; ++i)
+    tuner.on_batch(20, 1000, 3000, 1000, 100);
+  ASSERT_EQ(tuner.estimate_growth(1000), 3000 * batch_tuner::GROWTH_SAFETY_FACTOR);
+
+  // a batch reusing freed pages does not make the next one look free
+  tuner.on_batch(20, 1000, 0, 1000, 100);
+  ASSERT_EQ(tuner.estimate_growth(1000), 3000 * (1 - 0.25) * batch_tuner::GROWTH_SAFETY_FACTOR);
+  for (int i = 0; i < 100; ++i)
+    tuner.on_batch(20, 1000, 0, 1000, 100);
+  ASSERT_GE(tuner.estimate_growth(1000), 1000 * batch_tuner::GROWTH_SAFETY_FACTOR);
+
+  // a larger batch after small ones is accounted for
+  tuner.on_batch(20, 1000, 50000, 1000, 100);
+  ASSERT_GE(tuner.estimate_growth(1000), 50000 * batch_tuner::GROWTH_SAFETY_FACTOR);
+}
+
+TEST(batch_tuner, grows_when_commits_dominate)
+{
+  batch_tuner tuner(20, 100);
+  uint64_t prev = 0;
+  for (int i = 0; i < 100; ++i)
+  {
+    const uint64_t blocks = std::max<uint64_t>(tuner.get_suggested_blocks(), 20);
+    fast_batches(tuner, 1, blocks);
+    ASSERT_GE(tuner.get_suggested_blocks(), prev);
+    prev = tuner.get_suggested_blocks();
+  }
+  ASSERT_EQ(tuner.get_suggested_blocks(), 100);
+
+  cryptonote::db_batch_stats stats = cryptonote::db_batch_stats();
+  tuner.get_stats(stats);
+  ASSERT_EQ(stats.batches, 100);
+  ASSERT_EQ(stats.write_time, 100000);
+  ASSERT_EQ(stats.commit_time, 100000);
+  ASSERT_EQ(stats.write_amplification, 3.0);
+  ASSERT_EQ(stats.suggested_batch_blocks, 100);
+}
+
+TEST(batch_tuner, shrinks_when_batches_run_long)
+{
+  batch_tuner tuner(20, 100);
+  fast_batches(tuner, 100, 100);
+  ASSERT_EQ(tuner.get_suggested_blocks(), 100);
+  for (int i = 0; i < 100; ++i)
+    slow_batches(tuner, 1, tuner.get_suggested_blocks());
+  ASSERT_EQ(tuner.get_suggested_blocks(), 20);
+}
+
+TEST(batch_tuner, ignores_small_batches)
+{
+  batch_tuner tuner(20, 100);
+  fast_batches(tuner, 100, 100);
+  ASSERT_EQ(tuner.get_suggested_blocks(), 100);
+
+  // single block batches once synced do not shrink the sync size
+  slow_batches(tuner, 100, 1);
+  ASSERT_EQ(tuner.get_suggested_blocks(), 100);
+}
@@ -0,0 +1,271 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/tx_pool.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "blockchain_db/testdb.h"
+
+namespace
+{
+
+class TestDB: public cryptonote::BaseTestDB
+{
+public:
+  TestDB() { m_open = true; }
+
+  virtual void add_block( const cryptonote::block& blk
+                        , size_t block_weight
+                        , uint64_t long_term_block_weight
+                        , const cryptonote::difficulty_type& cumulative_difficulty
+                        , const uint64_t& coins_generated
+                        , uint64_t num_rct_outs
+                        , const crypto::hash& blk_hash
+                        ) override {
+    blocks.push_back({blk, blk_hash, cumulative_difficulty});
+  }
+  virtual uint64_t height() const override { return blocks.size(); }
+  virtual bool block_exists(const crypto::hash& h, uint64_t *height) const override {
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      if (blocks[i].hash == h)
+      {
+        if (height)
+          *height = i;
+        return true;
+      }
+    }
+    return false;
+  }
+  virtual cryptonote::block get_block_from_height(const uint64_t &h) const override { return blocks[h].bl; }
+  virtual uint64_t get_block_timestamp(const uint64_t &h) const override { return blocks[h].bl.timestamp; }
+  virtual cryptonote::difficulty_type get_block_cumulative_difficulty(const uint64_t &h) const override { return blocks[h].cumulative_difficulty; }
+  virtual crypto::hash get_block_hash_from_height(const uint64_t &h) const override { return blocks[h].hash; }
+  virtual crypto::hash top_block_hash(uint64_t *block_height = NULL) const override {
+    if (block_height)
+      *block_height = blocks.size() - 1;
+    return blocks.back().hash;
+  }
+  virtual void pop_block(cryptonote::block &blk, std::vector<cryptonote::transaction> &txs) override { blocks.pop_back(); }
+
+private:
+  struct block_t
+  {
+    cryptonote::block bl;
+    crypto::hash hash;
+    cryptonote::difficulty_type cumulative_difficulty;
+  };
+  std::vector<block_t> blocks;
+};
+
+cryptonote::block make_header(uint64_t height, const crypto::hash &prev_id)
+{
+  cryptonote::block b;
+  b.major_version = 1;
+  b.minor_version = 0;
+  b.timestamp = 1000000000 + height * DIFFICULTY_TARGET_V1;
+  b.prev_id = prev_id;
+  b.nonce = height;
+  b.miner_tx.version = 1;
+  b.miner_tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+  b.miner_tx.vin.push_back(cryptonote::txin_gen{height});
+  cryptonote::txout_to_key out;
+  out.key = crypto::rand<crypto::public_key>();
+  b.miner_tx.vout.push_back({1000, out});
+  return b;
+}
+
+void make_headers(uint64_t height, crypto::hash prev_id, size_t count, std::vector<cryptonote::blobdata> &headers, std::vector<crypto::hash> &hashes)
+{
+  headers.clear();
+  hashes.clear();
+  for (size_t i = 0; i < count; ++i)
+  {
+    const cryptonote::block b = make_header(height + i, prev_id);
+    headers.push_back(cryptonote::block_to_blob(b));
+    hashes.push_back(cryptonote::get_block_hash(b));
+    prev_id = hashes.back();
+  }
+}
+
+}
+
+#define PREFIX_DIFFICULTY(difficulty) \
+  cryptonote::BlockchainAndPool bap; \
+  cryptonote::Blockchain *bc = &bap.blockchain; \
+  struct get_test_options { \
+    const std::pair<uint8_t, uint64_t> hard_forks[2]; \
+    const cryptonote::test_options test_options = { \
+      hard_forks, \
+      0, \
+    }; \
+    get_test_options(): hard_forks{std::make_pair(1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0)} {} \
+  } opts; \
+  bool r = bc->init(new TestDB(), cryptonote::FAKECHAIN, true, &opts.test_options, difficulty, NULL); \
+  ASSERT_TRUE(r); \
+  ASSERT_EQ(bc->get_current_blockchain_height(), 1)
+
+#define PREFIX PREFIX_DIFFICULTY(0)
+
+TEST(block_headers, validate)
+{
+  PREFIX;
+  std::vector<cryptonote::blobdata> headers;
+  std::vector<crypto::hash> hashes;
+  uint64_t nvalidated;
+
+  ASSERT_EQ(bc->get_validated_headers_height(), 1);
+  make_headers(1, bc->get_tail_id(), 8, headers, hashes);
+  ASSERT_TRUE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+  ASSERT_EQ(nvalidated, 8);
+  ASSERT_EQ(bc->get_validated_headers_height(), 9);
+
+  // the next ones build on those
+  make_headers(9, hashes.back(), 4, headers, hashes);
+  ASSERT_TRUE(bc->prevalidate_block_headers(9, headers, hashes, nvalidated));
+  ASSERT_EQ(nvalidated, 4);
+  ASSERT_EQ(bc->get_validated_headers_height(), 13);
+}
+
+TEST(block_headers, checked)
+{
+  PREFIX;
+  std::vector<cryptonote::blobdata> headers;
+  std::vector<crypto::hash> hashes;
+  uint64_t nvalidated;
+
+  // with no validated headers, nothing past the chain is checked
+  std::vector<std::pair<crypto::hash, uint64_t>> ids;
+  make_headers(1, bc->get_tail_id(), 8, headers, hashes);
+  for (const crypto::hash &hash: hashes)
+    ids.push_back(std::make_pair(hash, 0));
+  ASSERT_EQ(bc->get_checked_headers_height(1, ids), 1);
+
+  // blocks agreeing with the validated headers are checked up to them
+  headers.resize(4);
+  hashes.resize(4);
+  ASSERT_TRUE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+  ASSERT_EQ(nvalidated, 4);
+  ASSERT_EQ(bc->get_checked_headers_height(1, ids), 5);
+  ASSERT_EQ(bc->get_checked_headers_height(3, std::vector<std::pair<crypto::hash, uint64_t>>(ids.begin() + 2, ids.end())), 5);
+  ASSERT_EQ(bc->get_checked_headers_height(7, std::vector<std::pair<crypto::hash, uint64_t>>(ids.begin() + 6, ids.end())), 5);
+
+  // others are not checked at all
+  ids[2].first = crypto::rand<crypto::hash>();
+  ASSERT_EQ(bc->get_checked_headers_height(1, ids), 1);
+}
+
+TEST(block_headers, other_chain)
+{
+  PREFIX;
+  std::vector<cryptonote::blobdata> headers;
+  std::vector<crypto::hash> hashes;
+  uint64_t nvalidated;
+
+  // headers which are fine, but do not build on what we have, are left alone
+  make_headers(1, crypto::rand<crypto::hash>(), 4, headers, hashes);
+  ASSERT_TRUE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+  ASSERT_EQ(nvalidated, 0);
+  make_headers(2, bc->get_tail_id(), 4, headers, hashes);
+  ASSERT_TRUE(bc->prevalidate_block_headers(2, headers, hashes, nvalidated));
+  ASSERT_EQ(nvalidated, 0);
+  ASSERT_EQ(bc->get_validated_headers_height(), 1);
+}
+
+TEST(block_headers, invalid)
+{
+  PREFIX;
+  std::vector<cryptonote::blobdata> headers;
+  std::vector<crypto::hash> hashes;
+  uint64_t nvalidated;
+
+  // not the hash it should have
+  make_headers(1, bc->get_tail_id(), 4, headers, hashes);
+  hashes[2] = crypto::rand<crypto::hash>();
+  ASSERT_FALSE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+
+  // not chained
+  make_headers(1, bc->get_tail_id(), 4, headers, hashes);
+  const cryptonote::block b = make_header(3, crypto::rand<crypto::hash>());
+  headers[2] = cryptonote::block_to_blob(b);
+  hashes[2] = cryptonote::get_block_hash(b);
+  ASSERT_FALSE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+
+  // bad miner tx
+  make_headers(1, bc->get_tail_id(), 4, headers, hashes);
+  cryptonote::block bad = make_header(1, bc->get_tail_id());
+  bad.miner_tx.unlock_time = 0;
+  headers[0] = cryptonote::block_to_blob(bad);
+  hashes[0] = cryptonote::get_block_hash(bad);
+  headers.resize(1);
+  hashes.resize(1);
+  ASSERT_FALSE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+
+  // garbage
+  headers[0] = "foo";
+  ASSERT_FALSE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+  ASSERT_EQ(bc->get_validated_headers_height(), 1);
+}
+
+TEST(block_headers, proof_of_work)
+{
+  PREFIX_DIFFICULTY(std::numeric_limits<uint64_t>::max());
+  std::vector<cryptonote::blobdata> headers;
+  std::vector<crypto::hash> hashes;
+  uint64_t nvalidated;
+
+  make_headers(1, bc->get_tail_id(), 4, headers, hashes);
+  ASSERT_FALSE(bc->prevalidate_block_headers(1, headers, hashes, nvalidated));
+  ASSERT_EQ(bc->get_validated_headers_height(), 1);
+}
+
+TEST(block_headers, serve)
+{
+  PREFIX;
+  cryptonote::NOTIFY_REQUEST_BLOCK_HEADERS::request req;
+  cryptonote::NOTIFY_RESPONSE_BLOCK_HEADERS::request rsp;
+
+  // up to the first block we do not have
+  req.blocks.push_back(bc->get_tail_id());
+  req.blocks.push_back(crypto::rand<crypto::hash>());
+  req.blocks.push_back(bc->get_tail_id());
+  bc->handle_get_block_headers(req, rsp, 1024 * 1024);
+  ASSERT_EQ(rsp.headers.size(), 1);
+  cryptonote::block b;
+  ASSERT_TRUE(cryptonote::parse_and_validate_block_from_blob(rsp.headers[0], b));
+  ASSERT_EQ(cryptonote::get_block_hash(b), bc->get_tail_id());
+
+  // and at least one, whatever its size
+  req.blocks.resize(1);
+  req.blocks.push_back(bc->get_tail_id());
+  rsp.headers.clear();
+  bc->handle_get_block_headers(req, rsp, 1);
+  ASSERT_EQ(rsp.headers.size(), 1);
+}
@@ -26,6 +26,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <map>
 #include <boost/uuid/uuid.hpp>
 #include "gtest/gtest.h"
 #include "crypto/crypto.h"
@@ -87,3 +88,196 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1(), na);
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+namespace
+{
+  struct sim_peer
+  {
+    boost::uuids::uuid id;
+    double rate; // bytes/s
+    double latency; // s
+    bool busy;
+    double requested, done;
+    uint64_t start, nblocks;
+  };
+
+  boost::uuids::uuid make_uuid(uint8_t n)
+  {
+    boost::uuids::uuid uuid{};
+    uuid.data[0] = n + 1;
+    return uuid;
+  }
+
+  // syncs `nblocks` blocks of `block_size` bytes past the genesis block from
+  // the peers, which serve spans at their rate after their latency, adding spans
+  // to the chain as soon as they are contiguous; returns the time it took, or
+  // -1 if it got stuck, and the most times any one span was requested
+  double simulate_sync(std::vector<sim_peer> &peers, cryptonote::block_queue &bq, uint64_t nblocks, size_t block_size, uint64_t span_size, unsigned &max_requests)
+  {
+    std::map<uint64_t, unsigned> requests;
+    max_requests = 0;
+    std::vector<std::pair<crypto::hash, uint64_t>> hashes(nblocks, std::make_pair(crypto::null_hash, 0));
+    for (uint64_t h = 0; h < nblocks; ++h)
+      memcpy(&hashes[h].first, &h, sizeof(h));
+    const boost::posix_time::ptime epoch = boost::posix_time::from_time_t(1700000000);
+    const auto at = [&epoch](double t) { return epoch + boost::posix_time::microseconds((int64_t)(t * 1e6)); };
+    const epee::net_utils::network_address na;
+
+    uint64_t height = 1;
+    double now = 0;
+    while (true)
+    {
+      uint64_t start;
+      std::vector<cryptonote::block_complete_entry> bcel;
+      boost::uuids::uuid connection_id;
+      epee::net_utils::network_address addr;
+      while (bq.get_next_span(start, bcel, connection_id, addr, false) && start <= height && !bcel.empty())
+      {
+        bq.remove_span(start);
+        if (start == height)
+          height += bcel.size();
+      }
+      if (height > nblocks)
+        return now;
+
+      for (sim_peer &peer: peers)
+      {
+        if (peer.busy)
+          continue;
+        std::pair<uint64_t, uint64_t> span(0, 0);
+        if (bq.should_rerequest_next_span(peer.id, height, at(now)))
+        {
+          std::vector<crypto::hash> span_hashes;
+          boost::posix_time::ptime time;
+          span = bq.get_next_span_if_scheduled(span_hashes, connection_id, time);
+          if (span.second > 0)
+            bq.reset_next_span_time(peer.id, at(now));
+        }
+        else if (bq.get_max_block_height() < height + 10 * span_size)
+        {
+          const std::vector<std::pair<crypto::hash, uint64_t>> needed(hashes.begin() + height - 1, hashes.end());
+          span = bq.reserve_span(height, nblocks, span_size, peer.id, na, false, 0, 0, nblocks + 1, needed, at(now));
+        }
+        if (span.second > 0)
+        {
+          peer.busy = true;
+          peer.start = span.first;
+          peer.nblocks = span.second;
+          peer.requested = now;
+          peer.done = now + peer.latency + span.second * block_size / peer.rate;
+          max_requests = std::max(max_requests, ++requests[span.first]);
+        }
+      }
+
+      // idle peers look again at least every quarter second
+      double next = std::numeric_limits<double>::max();
+      for (const sim_peer &peer: peers)
+        if (peer.busy)
+          next = std::min(next, peer.done);
+      if (next == std::numeric_limits<double>::max())
+        return -1;
+      now = std::min(next, now + 0.25);
+
+      for (sim_peer &peer: peers)
+      {
+        if (!peer.busy || peer.done > now)
+          continue;
+        peer.busy = false;
+        const size_t size = peer.nblocks * block_size;
+        bq.add_blocks(peer.start, std::vector<cryptonote::block_complete_entry>(peer.nblocks), peer.id, na, size / (peer.done - peer.requested), size);
+      }
+    }
+  }
+}
+
+TEST(block_queue, span_size)
+{
+  cryptonote::block_queue bq;
+  epee::net_utils::network_address na;
+  const std::vector<cryptonote::block_complete_entry> bcel(100);
+
+  ASSERT_EQ(bq.get_span_size(make_uuid(0), 100), 100);
+  ASSERT_LT(bq.get_expected_span_time(make_uuid(0), 100), 0.0f);
+  for (uint64_t n = 0; n < 2; ++n)
+  {
+    bq.add_blocks(n * 200, bcel, make_uuid(0), na, 1000000.0f, 1000000);
+    bq.add_blocks(n * 200 + 100, bcel, make_uuid(1), na, 500000.0f, 1000000);
+    bq.add_blocks(n * 200 + 100, bcel, make_uuid(2), na, 10000.0f, 1000000);
+  }
+  ASSERT_EQ(bq.get_span_size(make_uuid(0), 100), 100);
+  ASSERT_EQ(bq.get_span_size(make_uuid(1), 100), 50);
+  ASSERT_EQ(bq.get_span_size(make_uuid(2), 100), 25);
+  ASSERT_FLOAT_EQ(bq.get_expected_span_time(make_uuid(0), 100), 1.0f);
+  ASSERT_FLOAT_EQ(bq.get_expected_span_time(make_uuid(1), 100), 2.0f);
+
+  const auto scores = bq.get_peer_scores();
+  ASSERT_EQ(scores.size(), 3);
+  ASSERT_EQ(scores.at(make_uuid(0)).spans, 2);
+  ASSERT_FLOAT_EQ(scores.at(make_uuid(2)).span_time, 100.0f);
+
+  std::set<boost::uuids::uuid> live_connections{make_uuid(0)};
+  bq.flush_stale_spans(live_connections);
+  ASSERT_EQ(bq.get_peer_scores().size(), 1);
+}
+
+TEST(block_queue, rerequest_next_span)
+{
+  cryptonote::block_queue bq;
+  epee::net_utils::network_address na;
+  const boost::posix_time::ptime t0 = boost::posix_time::from_time_t(1700000000);
+  for (uint64_t n = 0; n < 2; ++n)
+  {
+    bq.add_blocks(1000 + n * 200, std::vector<cryptonote::block_complete_entry>(100), make_uuid(0), na, 1000000.0f, 1000000);
+    bq.add_blocks(1100 + n * 200, std::vector<cryptonote::block_complete_entry>(100), make_uuid(1), na, 100000.0f, 1000000);
+  }
+
+  // the fast peer holding the next span is not worth racing
+  bq.add_blocks(0, 100, make_uuid(0), na, t0);
+  ASSERT_FALSE(bq.should_rerequest_next_span(make_uuid(1), 0, t0 + boost::posix_time::seconds(1)));
+  ASSERT_FALSE(bq.should_rerequest_next_span(make_uuid(0), 0, t0 + boost::posix_time::seconds(100)));
+  bq.remove_span(0);
+
+  // the slow one is, unless it is nearly done
+  bq.add_blocks(0, 100, make_uuid(1), na, t0);
+  ASSERT_TRUE(bq.should_rerequest_next_span(make_uuid(0), 0, t0));
+  ASSERT_FALSE(bq.should_rerequest_next_span(make_uuid(0), 0, t0 + boost::posix_time::seconds(9)));
+  ASSERT_FALSE(bq.should_rerequest_next_span(make_uuid(2), 0, t0));
+
+  // an unknown peer is given as long again as it took so far
+  bq.remove_span(0);
+  bq.add_blocks(0, 100, make_uuid(2), na, t0);
+  ASSERT_FALSE(bq.should_rerequest_next_span(make_uuid(0), 0, t0 + boost::posix_time::seconds(1)));
+  ASSERT_TRUE(bq.should_rerequest_next_span(make_uuid(0), 0, t0 + boost::posix_time::seconds(2)));
+}
+
+TEST(block_queue, sync_simulation)
+{
+  // three fast peers, and a slow one which would stall the chain for twenty
+  // seconds each time the next span is a full one of its
+  std::vector<sim_peer> peers{
+    {make_uuid(0), 1000000, 0.1},
+    {make_uuid(1), 2000000, 0.1},
+    {make_uuid(2), 50000, 0.5},
+    {make_uuid(3), 1000000, 0.1},
+  };
+  cryptonote::block_queue bq;
+  const uint64_t nblocks = 20000;
+  const size_t block_size = 10000;
+  unsigned max_requests;
+  const double t = simulate_sync(peers, bq, nblocks, block_size, 100, max_requests);
+  ASSERT_GT(t, 0.0);
+  // a span the slow peer holds up is fetched again once, not by every fast peer
+  ASSERT_LE(max_requests, 2);
+
+  // the fast peers alone would take 50 seconds without latency
+  const double fast_only = nblocks * block_size / 4000000.0;
+  ASSERT_LT(t, fast_only * 1.3);
+
+  const auto scores = bq.get_peer_scores();
+  ASSERT_EQ(scores.size(), 4);
+  ASSERT_LT(scores.at(make_uuid(2)).rate, scores.at(make_uuid(0)).rate / 10);
+  ASSERT_GT(scores.at(make_uuid(1)).rate, scores.at(make_uuid(0)).rate);
+  ASSERT_GT(scores.at(make_uuid(2)).rerequested, 0);
+  ASSERT_EQ(bq.get_span_size(make_uuid(1), 100), 100);
+  ASSERT_EQ(bq.get_span_size(make_uuid(2), 100), 25);
+}
@@ -149,6 +149,27 @@ std::string h2b(const std::string& s)
   return result;
 }
 
+// a block whose v2 miner tx has n_outs rct outputs, rct era past the genesis block
+std::pair<block, blobdata> make_rct_block(uint64_t height, const crypto::hash &prev_id, size_t n_outs)
+{
+  block bl;
+  bl.major_version = height > 0 ? 4 : 1;
+  bl.minor_version = 0;
+  bl.timestamp = 1000000000 + height * 120;
+  bl.prev_id = prev_id;
+  bl.miner_tx.version = 2;
+  bl.miner_tx.unlock_time = height + 60;
+  bl.miner_tx.vin.push_back(txin_gen{height});
+  for (size_t i = 0; i < n_outs; ++i)
+  {
+    txout_to_key out;
+    out.key = crypto::rand<crypto::public_key>();
+    bl.miner_tx.vout.push_back({1000, out});
+  }
+  bl.miner_tx.rct_signatures.type = rct::RCTTypeNull;
+  return std::make_pair(bl, block_to_blob(bl));
+}
+
 template <typename T>
 class BlockchainDBTest : public testing::Test
 {
@@ -341,4 +362,240 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1].first), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, KeyImages)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_wtxn_guard guard(this->m_db);
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<crypto::key_image> key_images;
+  for (const auto &txs: this->m_txs)
+    for (const auto &tx: txs)
+      for (const auto &in: tx.first.vin)
+        if (in.type() == typeid(txin_to_key))
+          key_images.push_back(boost::get<txin_to_key>(in).k_image);
+  const size_t n_spent = key_images.size();
+  for (size_t i = 0; i < 16; ++i)
+    key_images.push_back(crypto::rand<crypto::key_image>());
+
+  std::vector<bool> spent;
+  ASSERT_NO_THROW(this->m_db->has_key_images(epee::to_span(key_images), spent));
+  ASSERT_EQ(key_images.size(), spent.size());
+  for (size_t i = 0; i < key_images.size(); ++i)
+  {
+    ASSERT_EQ(i < n_spent, spent[i]);
+    ASSERT_EQ(i < n_spent, this->m_db->has_key_image(key_images[i]));
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, GetOutputKeys)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_wtxn_guard guard(this->m_db);
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // outputs are enumerated in db order, so the nth output of an amount has index n
+  std::vector<uint64_t> amounts, offsets;
+  std::map<uint64_t, uint64_t> counts;
+  ASSERT_TRUE(this->m_db->for_all_outputs([&](uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx) {
+    amounts.push_back(amount);
+    offsets.push_back(counts[amount]++);
+    return true;
+  }));
+  ASSERT_FALSE(amounts.empty());
+
+  // ask in reverse order, with a duplicate
+  std::reverse(amounts.begin(), amounts.end());
+  std::reverse(offsets.begin(), offsets.end());
+  amounts.push_back(amounts.front());
+  offsets.push_back(offsets.front());
+
+  std::vector<output_data_t> outputs;
+  ASSERT_NO_THROW(this->m_db->get_output_key(epee::to_span(amounts), offsets, outputs));
+  ASSERT_EQ(offsets.size(), outputs.size());
+  for (size_t i = 0; i < offsets.size(); ++i)
+  {
+    const output_data_t od = this->m_db->get_output_key(amounts[i], offsets[i]);
+    ASSERT_EQ(od.pubkey, outputs[i].pubkey);
+    ASSERT_EQ(od.height, outputs[i].height);
+    ASSERT_EQ(od.unlock_time, outputs[i].unlock_time);
+  }
+
+  // a missing output throws, or ends a partial result
+  amounts.insert(amounts.begin() + 1, amounts.front());
+  offsets.insert(offsets.begin() + 1, counts[amounts.front()]);
+  ASSERT_THROW(this->m_db->get_output_key(epee::to_span(amounts), offsets, outputs), OUTPUT_DNE);
+  ASSERT_NO_THROW(this->m_db->get_output_key(epee::to_span(amounts), offsets, outputs, true));
+  ASSERT_EQ(1, outputs.size());
+}
+
+TYPED_TEST(BlockchainDBTest, GetBlocksFrom)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_wtxn_guard guard(this->m_db);
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  for (bool pruned: {false, true})
+  {
+    std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>> blocks;
+    std::vector<block_blob_refs_t> refs;
+    ASSERT_TRUE(this->m_db->get_blocks_from(0, 3, 10, 100, 1000000, blocks, pruned, true, true));
+    ASSERT_TRUE(this->m_db->get_blocks_from(0, 3, 10, 100, 1000000, refs, pruned, true, true));
+    ASSERT_EQ(2, blocks.size());
+    ASSERT_EQ(blocks.size(), refs.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      ASSERT_EQ(blocks[i].first.first, std::string(reinterpret_cast<const char*>(refs[i].block.data()), refs[i].block.size()));
+      ASSERT_EQ(blocks[i].first.second, refs[i].miner_tx_hash);
+      ASSERT_EQ(blocks[i].second.size(), refs[i].txs.size());
+      for (size_t j = 0; j < refs[i].txs.size(); ++j)
+      {
+        const auto &tx = refs[i].txs[j];
+        ASSERT_EQ(blocks[i].second[j].first, tx.hash);
+        ASSERT_EQ(pruned, tx.prunable.empty());
+        std::string blob(reinterpret_cast<const char*>(tx.pruned.data()), tx.pruned.size());
+        blob.append(reinterpret_cast<const char*>(tx.prunable.data()), tx.prunable.size());
+        ASSERT_EQ(blocks[i].second[j].second, blob);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, RctDistribution)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  // make sure open does not throw
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // enough blocks to fill a few 512 height records
+  std::vector<uint64_t> expected;
+  crypto::hash prev_id = crypto::null_hash;
+  {
+    db_wtxn_guard guard(this->m_db);
+    for (uint64_t height = 0; height < 1100; ++height)
+    {
+      const auto bl = make_rct_block(height, prev_id, height % 3);
+      ASSERT_NO_THROW(this->m_db->add_block(bl, 100, 100, height + 1, 0, {}));
+      expected.push_back((expected.empty() ? 0 : expected.back()) + height % 3);
+      prev_id = get_block_hash(bl.first);
+    }
+  }
+  ASSERT_EQ(expected, this->m_db->get_rct_output_distribution(0, expected.size()));
+  ASSERT_EQ(std::vector<uint64_t>(expected.begin() + 500, expected.begin() + 530), this->m_db->get_rct_output_distribution(500, 30));
+  ASSERT_THROW(this->m_db->get_rct_output_distribution(1000, 101), BLOCK_DNE);
+
+  // pop back past a record boundary, as a reorg would
+  for (size_t i = 0; i < 600; ++i)
+  {
+    block bl;
+    std::vector<transaction> txs;
+    ASSERT_NO_THROW(this->m_db->pop_block(bl, txs));
+    expected.pop_back();
+  }
+  ASSERT_EQ(500, this->m_db->height());
+  ASSERT_EQ(expected, this->m_db->get_rct_output_distribution(0, expected.size()));
+  ASSERT_THROW(this->m_db->get_rct_output_distribution(0, 501), BLOCK_DNE);
+
+  // and add the other side of the reorg, with different output counts
+  prev_id = this->m_db->top_block_hash();
+  {
+    db_wtxn_guard guard(this->m_db);
+    for (uint64_t height = 500; height < 1030; ++height)
+    {
+      const auto bl = make_rct_block(height, prev_id, height % 2 + 1);
+      ASSERT_NO_THROW(this->m_db->add_block(bl, 100, 100, height + 1, 0, {}));
+      expected.push_back(expected.back() + height % 2 + 1);
+      prev_id = get_block_hash(bl.first);
+    }
+  }
+  ASSERT_EQ(expected, this->m_db->get_rct_output_distribution(0, expected.size()));
+  ASSERT_EQ(std::vector<uint64_t>(expected.begin() + 1020, expected.end()), this->m_db->get_rct_output_distribution(1020, 10));
+}
+
+TYPED_TEST(BlockchainDBTest, RctDistributionMigration)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  std::vector<uint64_t> expected;
+  {
+    db_wtxn_guard guard(this->m_db);
+    crypto::hash prev_id = crypto::null_hash;
+    for (uint64_t height = 0; height < 700; ++height)
+    {
+      const auto bl = make_rct_block(height, prev_id, height % 3);
+      ASSERT_NO_THROW(this->m_db->add_block(bl, 100, 100, height + 1, 0, {}));
+      expected.push_back((expected.empty() ? 0 : expected.back()) + height % 3);
+      prev_id = get_block_hash(bl.first);
+    }
+  }
+  ASSERT_NO_THROW(this->m_db->close());
+
+  // take the db back to version 5, which did not have the distribution table
+  MDB_env *env;
+  MDB_txn *txn;
+  MDB_dbi properties, distribution;
+  ASSERT_EQ(0, mdb_env_create(&env));
+  ASSERT_EQ(0, mdb_env_set_maxdbs(env, 32));
+  ASSERT_EQ(0, mdb_env_open(env, dirPath.c_str(), 0, 0644));
+  ASSERT_EQ(0, mdb_txn_begin(env, NULL, 0, &txn));
+  ASSERT_EQ(0, mdb_dbi_open(txn, "properties", 0, &properties));
+  ASSERT_EQ(0, mdb_dbi_open(txn, "rct_distribution", 0, &distribution));
+  ASSERT_EQ(0, mdb_drop(txn, distribution, 0));
+  uint32_t version = 5;
+  MDB_val k = {sizeof("version"), (void*)"version"};
+  MDB_val v = {sizeof(version), &version};
+  ASSERT_EQ(0, mdb_put(txn, properties, &k, &v, 0));
+  ASSERT_EQ(0, mdb_txn_commit(txn));
+  mdb_env_close(env);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  ASSERT_EQ(expected, this->m_db->get_rct_output_distribution(0, expected.size()));
+}
+
 }  // anonymous namespace
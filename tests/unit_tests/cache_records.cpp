@@ -0,0 +1,267 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+#include <map>
+#include <thread>
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "crypto/chacha.h"
+#include "wallet/cache_records.h"
+
+namespace
+{
+  crypto::chacha_key generate_chacha_key()
+  {
+    crypto::chacha_key chacha_key;
+    uint64_t password = crypto::rand<uint64_t>();
+    crypto::generate_chacha_key(std::string((const char*)&password, sizeof(password)), chacha_key, 1);
+    return chacha_key;
+  }
+
+  crypto::hash make_key(uint64_t n)
+  {
+    crypto::hash key = crypto::null_hash;
+    memcpy(key.data, &n, sizeof(n));
+    return key;
+  }
+
+  std::pair<uint8_t, uint64_t> record_id(uint8_t column, uint64_t n)
+  {
+    return std::make_pair(column, n);
+  }
+
+  class CacheRecords: public ::testing::Test
+  {
+  protected:
+    CacheRecords():
+      filename((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string()),
+      key(generate_chacha_key())
+    {}
+    ~CacheRecords()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove(filename, ec);
+      boost::filesystem::remove(filename + ".new", ec);
+    }
+
+    uint64_t file_size() const { return boost::filesystem::file_size(filename); }
+
+    // records by column and the number their key was made from
+    std::map<std::pair<uint8_t, uint64_t>, std::string> load(const tools::cache_records::state &st)
+    {
+      tools::cache_records records(filename);
+      std::vector<tools::cache_records::record> loaded;
+      EXPECT_TRUE(records.load(key, st, loaded));
+      std::map<std::pair<uint8_t, uint64_t>, std::string> res;
+      for (const auto &r: loaded)
+      {
+        uint64_t n;
+        memcpy(&n, r.key.data, sizeof(n));
+        res[std::make_pair(r.column, n)] = r.data;
+      }
+      return res;
+    }
+
+    const std::string filename;
+    const crypto::chacha_key key;
+  };
+}
+
+TEST_F(CacheRecords, empty)
+{
+  tools::cache_records records(filename);
+  std::vector<tools::cache_records::record> loaded;
+  ASSERT_TRUE(records.load(key, tools::cache_records::state(), loaded));
+  ASSERT_TRUE(loaded.empty());
+}
+
+TEST_F(CacheRecords, round_trip)
+{
+  tools::cache_records records(filename);
+  records.begin_store(key, false);
+  records.put(0, make_key(0), "foo");
+  records.put(0, make_key(1), "bar");
+  records.put(1, make_key(0), "");
+  const tools::cache_records::state st = records.finish_store();
+  records.commit_store();
+
+  const auto loaded = load(st);
+  ASSERT_EQ(loaded.size(), 3);
+  ASSERT_EQ(loaded.at(record_id(0, 0)), "foo");
+  ASSERT_EQ(loaded.at(record_id(0, 1)), "bar");
+  ASSERT_EQ(loaded.at(record_id(1, 0)), "");
+}
+
+TEST_F(CacheRecords, only_changes_are_appended)
+{
+  tools::cache_records records(filename);
+  records.begin_store(key, false);
+  for (uint64_t i = 0; i < 100; ++i)
+    records.put(0, make_key(i), std::string(100, 'a'));
+  tools::cache_records::state st = records.finish_store();
+  records.commit_store();
+  const uint64_t size = file_size();
+  ASSERT_EQ(st.length, size);
+
+  // nothing changed
+  records.begin_store(key, false);
+  for (uint64_t i = 0; i < 100; ++i)
+    records.put(0, make_key(i), std::string(100, 'a'));
+  ASSERT_EQ(records.finish_store().length, size);
+  records.commit_store();
+
+  // one changed, one erased
+  records.begin_store(key, false);
+  for (uint64_t i = 0; i < 99; ++i)
+    records.put(0, make_key(i), std::string(100, i == 5 ? 'b' : 'a'));
+  st = records.finish_store();
+  records.commit_store();
+  ASSERT_GT(st.length, size);
+  ASSERT_LT(st.length, size + 300);
+
+  const auto loaded = load(st);
+  ASSERT_EQ(loaded.size(), 99);
+  ASSERT_EQ(loaded.at(record_id(0, 5)), std::string(100, 'b'));
+  ASSERT_EQ(loaded.at(record_id(0, 6)), std::string(100, 'a'));
+  ASSERT_EQ(loaded.count(record_id(0, 99)), 0);
+}
+
+TEST_F(CacheRecords, uncommitted_store_is_ignored)
+{
+  tools::cache_records records(filename);
+  records.begin_store(key, false);
+  records.put(0, make_key(0), "foo");
+  const tools::cache_records::state st = records.finish_store();
+  records.commit_store();
+
+  // the wallet cache never got written for this one
+  records.begin_store(key, false);
+  records.put(0, make_key(0), "bar");
+  records.finish_store();
+  records.abort_store();
+  ASSERT_GT(file_size(), st.length);
+
+  auto loaded = load(st);
+  ASSERT_EQ(loaded.size(), 1);
+  ASSERT_EQ(loaded.at(record_id(0, 0)), "foo");
+
+  // and the next store starts from the committed state
+  records.begin_store(key, false);
+  records.put(0, make_key(0), "baz");
+  const tools::cache_records::state st2 = records.finish_store();
+  records.commit_store();
+  ASSERT_EQ(file_size(), st2.length);
+  loaded = load(st2);
+  ASSERT_EQ(loaded.at(record_id(0, 0)), "baz");
+}
+
+TEST_F(CacheRecords, interrupted_rewrite)
+{
+  tools::cache_records records(filename);
+  records.begin_store(key, false);
+  records.put(0, make_key(0), "foo");
+  const tools::cache_records::state st = records.finish_store();
+  records.commit_store();
+
+  // the wallet cache was written, but the rewritten file was not renamed yet
+  records.begin_store(key, true);
+  records.put(0, make_key(0), "bar");
+  const tools::cache_records::state st2 = records.finish_store();
+  ASSERT_NE(st.file_id, st2.file_id);
+
+  auto loaded = load(st2);
+  ASSERT_EQ(loaded.size(), 1);
+  ASSERT_EQ(loaded.at(record_id(0, 0)), "bar");
+  ASSERT_FALSE(boost::filesystem::exists(filename + ".new"));
+}
+
+TEST_F(CacheRecords, mismatched_state)
+{
+  tools::cache_records records(filename);
+  records.begin_store(key, false);
+  records.put(0, make_key(0), "foo");
+  const tools::cache_records::state st = records.finish_store();
+  records.commit_store();
+
+  tools::cache_records other(filename);
+  std::vector<tools::cache_records::record> loaded;
+  tools::cache_records::state bad = st;
+  ++bad.file_id;
+  ASSERT_FALSE(other.load(key, bad, loaded));
+  bad = st;
+  bad.length += 1;
+  ASSERT_FALSE(other.load(key, bad, loaded));
+}
+
+TEST_F(CacheRecords, background_compaction)
+{
+  tools::cache_records records(filename);
+  tools::cache_records::state st;
+  // superseding every record twice leaves a third of the file live, which starts a compaction
+  for (char c = 'a'; c <= 'c'; ++c)
+  {
+    records.begin_store(key, false);
+    for (uint64_t i = 0; i < 100; ++i)
+      records.put(0, make_key(i), std::string(100000, c));
+    st = records.finish_store();
+    records.commit_store();
+  }
+  const uint64_t full_size = file_size();
+  ASSERT_GT(full_size, 30000000);
+
+  // stores carry on in the old file until the compaction is done, then move to the new one
+  for (int n = 0; n < 100 && file_size() > full_size / 2; ++n)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    records.begin_store(key, false);
+    for (uint64_t i = 0; i < 100; ++i)
+      records.put(0, make_key(i), std::string(100000, i == 0 ? 'd' + n % 2 : 'c'));
+    st = records.finish_store();
+    records.commit_store();
+  }
+  ASSERT_LT(file_size(), full_size / 2);
+  ASSERT_EQ(file_size(), st.length);
+  ASSERT_FALSE(boost::filesystem::exists(filename + ".new"));
+
+  const auto loaded = load(st);
+  ASSERT_EQ(loaded.size(), 100);
+  ASSERT_EQ(loaded.at(record_id(0, 1)), std::string(100000, 'c'));
+  ASSERT_TRUE(loaded.at(record_id(0, 0)) == std::string(100000, 'd') || loaded.at(record_id(0, 0)) == std::string(100000, 'e'));
+
+  // and the compacted file is still only appended to
+  records.begin_store(key, false);
+  for (uint64_t i = 0; i < 100; ++i)
+    records.put(0, make_key(i), std::string(100000, i == 0 ? 'f' : 'c'));
+  st = records.finish_store();
+  records.commit_store();
+  ASSERT_EQ(load(st).at(record_id(0, 0)), std::string(100000, 'f'));
+}
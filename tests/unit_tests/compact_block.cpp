@@ -0,0 +1,156 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <unordered_set>
+#include "crypto/crypto.h"
+#include "storages/portable_storage_template_helper.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_protocol/compact_block.h"
+
+static cryptonote::block make_block(size_t n_txes)
+{
+  cryptonote::block b;
+  b.major_version = 16;
+  b.minor_version = 16;
+  b.timestamp = 1700000000;
+  b.prev_id = crypto::rand<crypto::hash>();
+  b.nonce = 42;
+  b.miner_tx.version = 2;
+  b.miner_tx.unlock_time = 70;
+  b.miner_tx.vin.push_back(cryptonote::txin_gen{10});
+  for (size_t i = 0; i < n_txes; ++i)
+    b.tx_hashes.push_back(crypto::rand<crypto::hash>());
+  return b;
+}
+
+TEST(compact_block, short_ids)
+{
+  const crypto::hash h = crypto::rand<crypto::hash>();
+  ASSERT_EQ(cryptonote::get_transaction_short_id(h, 1), cryptonote::get_transaction_short_id(h, 1));
+  ASSERT_NE(cryptonote::get_transaction_short_id(h, 1), cryptonote::get_transaction_short_id(h, 2));
+  ASSERT_NE(cryptonote::get_transaction_short_id(h, 1), cryptonote::get_transaction_short_id(crypto::rand<crypto::hash>(), 1));
+  ASSERT_EQ(cryptonote::get_transaction_short_id(h, 1) >> (8 * cryptonote::COMPACT_BLOCK_SHORT_ID_SIZE), 0);
+}
+
+TEST(compact_block, round_trip)
+{
+  const cryptonote::block b = make_block(50);
+  const uint64_t salt = 0x0123456789abcdef;
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request req;
+  ASSERT_TRUE(cryptonote::make_compact_block(b, {}, {}, salt, 1234, req));
+  ASSERT_EQ(req.block_hash, cryptonote::get_block_hash(b));
+  ASSERT_EQ(req.current_blockchain_height, 1234);
+  ASSERT_EQ(req.short_ids.size(), 50 * cryptonote::COMPACT_BLOCK_SHORT_ID_SIZE);
+  ASSERT_TRUE(req.prefilled_txs.empty());
+  ASSERT_LT(req.block.size() + req.short_ids.size(), cryptonote::block_to_blob(b).size());
+
+  epee::byte_slice stored;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(req, stored));
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request loaded;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(loaded, epee::to_span(stored)));
+
+  std::vector<uint64_t> short_ids;
+  ASSERT_TRUE(cryptonote::get_compact_block_short_ids(loaded, short_ids));
+  ASSERT_EQ(short_ids.size(), b.tx_hashes.size());
+  for (size_t i = 0; i < short_ids.size(); ++i)
+    ASSERT_EQ(short_ids[i], cryptonote::get_transaction_short_id(b.tx_hashes[i], salt));
+
+  cryptonote::block rebuilt;
+  ASSERT_TRUE(cryptonote::parse_and_validate_block_from_blob(loaded.block, rebuilt));
+  ASSERT_TRUE(rebuilt.tx_hashes.empty());
+  rebuilt.tx_hashes = b.tx_hashes;
+  rebuilt.invalidate_hashes();
+  ASSERT_EQ(cryptonote::get_block_hash(rebuilt), loaded.block_hash);
+  ASSERT_EQ(cryptonote::block_to_blob(rebuilt), cryptonote::block_to_blob(b));
+
+  // a wrong tx does not rebuild the block
+  std::swap(rebuilt.tx_hashes[3], rebuilt.tx_hashes[4]);
+  rebuilt.invalidate_hashes();
+  ASSERT_NE(cryptonote::get_block_hash(rebuilt), loaded.block_hash);
+}
+
+TEST(compact_block, prefill)
+{
+  const cryptonote::block b = make_block(10);
+  std::vector<cryptonote::tx_blob_entry> txs;
+  for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+    txs.push_back({std::string(1000, 'a' + i), crypto::null_hash});
+  const std::unordered_set<crypto::hash> lacked{b.tx_hashes[2], b.tx_hashes[7]};
+
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request req;
+  ASSERT_TRUE(cryptonote::make_compact_block(b, txs, lacked, 1, 0, req));
+  ASSERT_EQ(req.prefilled_tx_indices, std::vector<uint64_t>({2, 7}));
+  ASSERT_EQ(req.prefilled_txs.size(), 2);
+  ASSERT_EQ(req.prefilled_txs[0], txs[2].blob);
+  ASSERT_EQ(req.prefilled_txs[1], txs[7].blob);
+  std::vector<uint64_t> short_ids;
+  ASSERT_TRUE(cryptonote::get_compact_block_short_ids(req, short_ids));
+  ASSERT_EQ(short_ids.size(), 10);
+
+  // no prefill without the matching tx blobs
+  txs.pop_back();
+  ASSERT_TRUE(cryptonote::make_compact_block(b, txs, lacked, 1, 0, req));
+  ASSERT_TRUE(req.prefilled_txs.empty());
+
+  // prefill stops at the size limit
+  txs.clear();
+  for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+    txs.push_back({std::string(cryptonote::COMPACT_BLOCK_MAX_PREFILL_BYTES / 2, 'a'), crypto::null_hash});
+  const std::unordered_set<crypto::hash> all(b.tx_hashes.begin(), b.tx_hashes.end());
+  ASSERT_TRUE(cryptonote::make_compact_block(b, txs, all, 1, 0, req));
+  ASSERT_EQ(req.prefilled_tx_indices, std::vector<uint64_t>({0, 1}));
+}
+
+TEST(compact_block, malformed)
+{
+  const cryptonote::block b = make_block(10);
+  std::vector<cryptonote::tx_blob_entry> txs(b.tx_hashes.size());
+  const std::unordered_set<crypto::hash> lacked{b.tx_hashes[2], b.tx_hashes[7]};
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request req;
+  ASSERT_TRUE(cryptonote::make_compact_block(b, txs, lacked, 1, 0, req));
+  std::vector<uint64_t> short_ids;
+  ASSERT_TRUE(cryptonote::get_compact_block_short_ids(req, short_ids));
+
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request bad = req;
+  bad.short_ids.pop_back();
+  ASSERT_FALSE(cryptonote::get_compact_block_short_ids(bad, short_ids));
+
+  bad = req;
+  bad.prefilled_txs.pop_back();
+  ASSERT_FALSE(cryptonote::get_compact_block_short_ids(bad, short_ids));
+
+  bad = req;
+  bad.prefilled_tx_indices[1] = 10;
+  ASSERT_FALSE(cryptonote::get_compact_block_short_ids(bad, short_ids));
+
+  bad = req;
+  bad.prefilled_tx_indices[1] = 2;
+  ASSERT_FALSE(cryptonote::get_compact_block_short_ids(bad, short_ids));
+}
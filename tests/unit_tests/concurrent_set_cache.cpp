@@ -0,0 +1,123 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "common/concurrent_set_cache.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+typedef tools::concurrent_set_cache<crypto::hash, 1024> test_cache_t;
+
+static crypto::hash make_hash(uint64_t n)
+{
+  crypto::hash h;
+  crypto::cn_fast_hash(&n, sizeof(n), h);
+  return h;
+}
+
+TEST(concurrent_set_cache, empty)
+{
+  test_cache_t cache;
+  ASSERT_EQ(cache.capacity(), 1024);
+  ASSERT_FALSE(cache.has(crypto::null_hash));
+  ASSERT_FALSE(cache.has(make_hash(0)));
+}
+
+TEST(concurrent_set_cache, add_has)
+{
+  test_cache_t cache;
+  for (uint64_t n = 0; n < 100; ++n)
+    cache.add(make_hash(n));
+  for (uint64_t n = 0; n < 100; ++n)
+    ASSERT_TRUE(cache.has(make_hash(n)));
+  for (uint64_t n = 100; n < 200; ++n)
+    ASSERT_FALSE(cache.has(make_hash(n)));
+}
+
+TEST(concurrent_set_cache, bounded)
+{
+  test_cache_t cache;
+  for (uint64_t n = 0; n < 100000; ++n)
+    cache.add(make_hash(n));
+  size_t found = 0;
+  for (uint64_t n = 0; n < 100000; ++n)
+    found += cache.has(make_hash(n));
+  ASSERT_LE(found, cache.capacity());
+  ASSERT_GT(found, cache.capacity() / 2);
+  // the most recent one is always there
+  ASSERT_TRUE(cache.has(make_hash(99999)));
+}
+
+TEST(concurrent_set_cache, second_chance)
+{
+  tools::concurrent_set_cache<crypto::hash, 1> cache;
+  ASSERT_EQ(cache.capacity(), test_cache_t::BUCKET_SLOTS * test_cache_t::SHARDS);
+  const crypto::hash hot = make_hash(0);
+  cache.add(hot);
+  for (uint64_t n = 1; n < 10000; ++n)
+  {
+    ASSERT_TRUE(cache.has(hot));
+    cache.add(make_hash(n));
+  }
+  ASSERT_TRUE(cache.has(hot));
+}
+
+TEST(concurrent_set_cache, resize)
+{
+  test_cache_t cache;
+  cache.add(make_hash(0));
+  cache.resize(100000);
+  ASSERT_GE(cache.capacity(), 100000);
+  ASSERT_FALSE(cache.has(make_hash(0)));
+}
+
+TEST(concurrent_set_cache, concurrent)
+{
+  test_cache_t cache;
+  std::atomic<bool> false_positive(false);
+  std::vector<std::thread> threads;
+  for (uint64_t t = 0; t < 4; ++t)
+  {
+    threads.emplace_back([&cache, &false_positive, t](){
+      // each thread only adds even numbers, and checks odd ones are never there
+      for (uint64_t n = 0; n < 20000; ++n)
+      {
+        cache.add(make_hash(2 * (t * 20000 + n)));
+        if (cache.has(make_hash(2 * (t * 20000 + n) + 1)))
+          false_positive = true;
+        cache.has(make_hash(2 * n));
+      }
+    });
+  }
+  for (auto &t: threads)
+    t.join();
+  ASSERT_FALSE(false_positive);
+}
@@ -31,6 +31,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 extern "C"
 {
@@ -345,3 +346,35 @@ TEST(Crypto, generator_consistency)
   // ringct/rctTypes.h
   ASSERT_TRUE(memcmp(H.data, rct::H.bytes, 32) == 0);
 }
+
+TEST(Crypto, generate_key_derivations)
+{
+  crypto::public_key pub;
+  crypto::secret_key view_secret_key;
+  crypto::generate_keys(pub, view_secret_key);
+
+  // spans more than one normalization batch, with an invalid point in the middle
+  std::vector<crypto::public_key> keys(150);
+  crypto::secret_key sec;
+  for (auto &key: keys)
+    crypto::generate_keys(key, sec);
+  crypto::public_key invalid = crypto::null_pkey;
+  while (crypto::check_key(invalid))
+    ++invalid.data[0];
+  keys[70] = invalid;
+
+  std::vector<crypto::key_derivation> derivations(keys.size());
+  std::unique_ptr<bool[]> valid(new bool[keys.size()]);
+  ASSERT_FALSE(crypto::generate_key_derivations(keys.data(), keys.size(), view_secret_key, derivations.data(), valid.get()));
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    crypto::key_derivation derivation;
+    ASSERT_EQ(crypto::generate_key_derivation(keys[i], view_secret_key, derivation), valid[i]);
+    if (valid[i])
+      ASSERT_TRUE(memcmp(&derivation, &derivations[i], sizeof(derivation)) == 0);
+  }
+  ASSERT_FALSE(valid[70]);
+
+  ASSERT_TRUE(crypto::generate_key_derivations(keys.data(), 70, view_secret_key, derivations.data(), valid.get()));
+  ASSERT_TRUE(crypto::generate_key_derivations(keys.data(), 0, view_secret_key, derivations.data(), valid.get()));
+}
@@ -34,6 +34,8 @@
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage.h"
 #include "storages/portable_storage_template_helper.h"
+#include "storages/portable_storage_to_bin.h"
+#include "byte_stream.h"
 #include "span.h"
 
 TEST(epee_binary, two_keys)
@@ -77,6 +79,17 @@ struct ObjOfInts
     KV_SERIALIZE(x)
   END_KV_SERIALIZE_MAP()
 };
+
+struct ObjOfStrings
+{
+  uint64_t a;
+  std::vector<std::string> x;
+
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(a)
+    KV_SERIALIZE(x)
+  END_KV_SERIALIZE_MAP()
+};
 }
 
 TEST(epee_binary, any_empty_seq)
@@ -141,3 +154,33 @@ TEST(epee_binary, any_empty_seq)
   EXPECT_TRUE(epee::serialization::load_t_from_binary(i, epee::span<const std::uint8_t>(data_empty_object)));
   EXPECT_EQ(0, i.x.size());
 }
+
+TEST(epee_binary, extra_root_entries)
+{
+  ObjOfStrings o{};
+  o.a = 42;
+
+  epee::byte_stream out;
+  epee::serialization::portable_storage ps;
+  o.store(ps);
+  ASSERT_TRUE(ps.store_to_binary(out, 1));
+
+  const std::string x0 = "abc", x1(300, 'x');
+  epee::serialization::pack_entry_name(out, "x");
+  epee::serialization::pack_array_header(out, SERIALIZE_TYPE_STRING, 2);
+  epee::serialization::put_string(out, epee::strspan<std::uint8_t>(x0));
+  epee::serialization::put_string(out, epee::strspan<std::uint8_t>(x1));
+
+  ObjOfStrings loaded{};
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(loaded, epee::span<const std::uint8_t>(out.data(), out.size())));
+  EXPECT_EQ(42, loaded.a);
+  ASSERT_EQ(2, loaded.x.size());
+  EXPECT_EQ(x0, loaded.x[0]);
+  EXPECT_EQ(x1, loaded.x[1]);
+
+  // the same bytes as storing it in one go, but for the order of the root entries
+  o.x = loaded.x;
+  epee::byte_stream expected;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(o, expected));
+  EXPECT_EQ(expected.size(), out.size());
+}
@@ -28,6 +28,7 @@
 
 #include "gtest/gtest.h"
 #include "net/http_auth.h"
+#include "net/http_protocol_handler.h"
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -743,3 +744,121 @@ TEST(HTTP, Add_Field)
 
   EXPECT_STREQ("leading textfoo: bar\r\nbar: foo\r\nmoarbars: moarfoo\r\n", str.c_str());
 }
+
+namespace
+{
+  struct test_http_endpoint final : public epee::net_utils::i_service_endpoint
+  {
+    boost::asio::io_service io_service;
+    std::string sent;
+    std::size_t waits = 0;
+    std::vector<std::chrono::milliseconds> timeouts;
+
+    virtual bool do_send(epee::byte_slice message) override
+    {
+      sent.append(reinterpret_cast<const char*>(message.data()), message.size());
+      return true;
+    }
+    virtual bool close() override { return true; }
+    virtual bool send_done() override { return true; }
+    virtual bool call_run_once_service_io() override { return false; }
+    virtual bool request_callback() override { return false; }
+    virtual boost::asio::io_service& get_io_service() override { return io_service; }
+    virtual bool add_ref() override { return true; }
+    virtual bool release() override { return true; }
+    virtual bool wait_send_queue(std::size_t, std::chrono::milliseconds timeout) override
+    {
+      ++waits;
+      timeouts.push_back(timeout);
+      return true;
+    }
+  };
+
+  struct test_http_handler final : public http::i_http_server_handler<epee::net_utils::connection_context_base>
+  {
+    std::string body;
+
+    virtual bool handle_http_request(const http::http_request_info&, http::http_response_info& response, epee::net_utils::connection_context_base&) override
+    {
+      std::string copy = body;
+      auto slice = std::make_shared<epee::byte_slice>(std::move(copy));
+      response.m_body_writer = [slice](http::i_http_body_writer& writer) { return writer.write(std::move(*slice)); };
+      return true;
+    }
+  };
+
+  std::string get_response(const std::string& body, const std::string& request)
+  {
+    test_http_endpoint endpoint;
+    test_http_handler handler;
+    handler.body = body;
+    http::custum_handler_config<epee::net_utils::connection_context_base> config;
+    config.m_phandler = &handler;
+    epee::net_utils::connection_context_base context;
+    http::http_custom_handler<epee::net_utils::connection_context_base> connection{&endpoint, config, context};
+    EXPECT_TRUE(connection.handle_recv(request.data(), request.size()));
+    return endpoint.sent;
+  }
+}
+
+TEST(HTTP_Server, ChunkedWriter)
+{
+  test_http_endpoint endpoint;
+  const std::string body(HTTP_STREAM_CHUNK_SIZE * 2 + 100, 'x');
+  http::http_chunked_writer writer{endpoint};
+  ASSERT_TRUE(writer.write(epee::byte_slice{std::string{body}}));
+  ASSERT_TRUE(writer.finish());
+  EXPECT_EQ(3u, endpoint.waits);
+
+  const std::string chunk(HTTP_STREAM_CHUNK_SIZE, 'x');
+  EXPECT_EQ("10000\r\n" + chunk + "\r\n10000\r\n" + chunk + "\r\n64\r\n" + std::string(100, 'x') + "\r\n0\r\n\r\n", endpoint.sent);
+
+  test_http_endpoint empty;
+  http::http_chunked_writer empty_writer{empty};
+  ASSERT_TRUE(empty_writer.finish());
+  EXPECT_EQ("0\r\n\r\n", empty.sent);
+}
+
+TEST(HTTP_Server, ChunkedWriterMinimumRate)
+{
+  // the peer gets a grace period, then must read at the minimum rate
+  test_http_endpoint endpoint;
+  const std::size_t size = HTTP_STREAM_MAX_QUEUED_BYTES + 64 * HTTP_STREAM_CHUNK_SIZE;
+  http::http_chunked_writer writer{endpoint};
+  ASSERT_TRUE(writer.write(epee::byte_slice{std::string(size, 'x')}));
+  ASSERT_EQ(size / HTTP_STREAM_CHUNK_SIZE, endpoint.timeouts.size());
+
+  const std::chrono::milliseconds grace{HTTP_STREAM_GRACE_PERIOD_MS};
+  EXPECT_LE(endpoint.timeouts.front(), grace);
+  EXPECT_GT(endpoint.timeouts.front(), grace - std::chrono::seconds(10));
+  const std::chrono::milliseconds at_min_rate{(size - HTTP_STREAM_MAX_QUEUED_BYTES) * 1000 / HTTP_STREAM_MIN_BYTES_PER_SECOND};
+  EXPECT_GT(endpoint.timeouts.back(), grace + at_min_rate - std::chrono::seconds(15));
+  EXPECT_LE(endpoint.timeouts.back(), grace + at_min_rate);
+  for (std::size_t i = 1; i < endpoint.timeouts.size(); ++i)
+    EXPECT_LE(endpoint.timeouts[i - 1], endpoint.timeouts[i] + std::chrono::seconds(1));
+}
+
+TEST(HTTP_Server, ChunkedResponse)
+{
+  const std::string response = get_response("hello world", "GET /foo HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  const std::size_t end_of_header = response.find("\r\n\r\n");
+  ASSERT_NE(std::string::npos, end_of_header);
+  const std::string header = response.substr(0, end_of_header + 2);
+  EXPECT_NE(std::string::npos, header.find("Transfer-Encoding: chunked\r\n"));
+  EXPECT_EQ(std::string::npos, header.find("Content-Length"));
+  EXPECT_EQ("b\r\nhello world\r\n0\r\n\r\n", response.substr(end_of_header + 4));
+}
+
+TEST(HTTP_Server, ChunkedResponseFallback)
+{
+  // HTTP/1.0 clients get the whole body with a length instead
+  std::string response = get_response("hello world", "GET /foo HTTP/1.0\r\nHost: localhost\r\n\r\n");
+  EXPECT_EQ(std::string::npos, response.find("Transfer-Encoding"));
+  EXPECT_NE(std::string::npos, response.find("Content-Length: 11\r\n"));
+  EXPECT_TRUE(boost::algorithm::ends_with(response, "\r\n\r\nhello world"));
+
+  response = get_response("hello world", "HEAD /foo HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_EQ(std::string::npos, response.find("Transfer-Encoding"));
+  EXPECT_NE(std::string::npos, response.find("Content-Length: 11\r\n"));
+  EXPECT_TRUE(boost::algorithm::ends_with(response, "\r\n\r\n"));
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <vector>
+#include "crypto/crypto.h"
+#include "blockchain_db/key_image_filter.h"
+
+static std::vector<crypto::key_image> make_key_images(size_t n)
+{
+  std::vector<crypto::key_image> key_images(n);
+  for (auto &ki: key_images)
+    ki = crypto::rand<crypto::key_image>();
+  return key_images;
+}
+
+TEST(key_image_filter, empty)
+{
+  cryptonote::key_image_filter filter;
+  const crypto::key_image ki = crypto::rand<crypto::key_image>();
+  ASSERT_TRUE(filter.may_contain(ki));
+  filter.insert(ki);
+  ASSERT_EQ(filter.size(), 0);
+  ASSERT_FALSE(filter.needs_rebuild());
+}
+
+TEST(key_image_filter, no_false_negatives)
+{
+  cryptonote::key_image_filter filter;
+  filter.reset(20000);
+  const std::vector<crypto::key_image> key_images = make_key_images(20000);
+  for (const auto &ki: key_images)
+    filter.insert(ki);
+  ASSERT_EQ(filter.size(), key_images.size());
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(filter.may_contain(ki));
+
+  size_t false_positives = 0;
+  for (const auto &ki: make_key_images(20000))
+    false_positives += filter.may_contain(ki);
+  ASSERT_LT(false_positives, 20000 / 50);
+}
+
+TEST(key_image_filter, rebuild)
+{
+  cryptonote::key_image_filter filter;
+  filter.reset(0);
+  std::vector<crypto::key_image> key_images = make_key_images(65536);
+  for (const auto &ki: key_images)
+    filter.insert(ki);
+  ASSERT_FALSE(filter.needs_rebuild());
+  const crypto::key_image extra = crypto::rand<crypto::key_image>();
+  filter.insert(extra);
+  key_images.push_back(extra);
+  ASSERT_TRUE(filter.needs_rebuild());
+
+  cryptonote::key_image_filter bigger;
+  bigger.reset(key_images.size());
+  for (const auto &ki: key_images)
+    bigger.insert(ki);
+  filter.swap(bigger);
+  ASSERT_FALSE(filter.needs_rebuild());
+  ASSERT_EQ(filter.size(), key_images.size());
+  ASSERT_EQ(bigger.size(), key_images.size());
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(filter.may_contain(ki));
+
+  filter.clear();
+  ASSERT_EQ(filter.size(), 0);
+  ASSERT_TRUE(filter.may_contain(crypto::rand<crypto::key_image>()));
+}
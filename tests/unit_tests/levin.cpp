@@ -46,6 +46,7 @@
 #include "cryptonote_protocol/levin_notify.h"
 #include "int-util.h"
 #include "p2p/net_node.h"
+#include "net/abstract_tcp_server2.h"
 #include "net/dandelionpp.h"
 #include "net/levin_base.h"
 #include "span.h"
@@ -193,6 +194,12 @@ namespace
             return count;
         }
 
+        //\return Messages waiting in `process_send_queue`, oldest first
+        const std::deque<epee::byte_slice>& get_send_queue() const noexcept
+        {
+            return endpoint_.send_queue_;
+        }
+
         const boost::uuids::uuid& get_id() const noexcept
         {
             return context_.m_connection_id;
@@ -584,6 +591,104 @@ TEST(make_fragment, multiple)
     EXPECT_EQ(18, std::count(fragment.cbegin(), fragment.cend(), 0));
 }
 
+TEST(gather_write_buffers, limits)
+{
+    std::deque<epee::byte_slice> queue;
+    std::vector<boost::asio::const_buffer> buffers;
+    EXPECT_EQ(0u, epee::net_utils::gather_write_buffers(queue, buffers));
+    EXPECT_TRUE(buffers.empty());
+
+    // newest messages are pushed at the front, the oldest is written first
+    for (unsigned count = 0; count < ABSTRACT_SERVER_GATHER_MAX_COUNT + 10; ++count)
+        queue.emplace_front(std::string(10, char(count)));
+
+    EXPECT_EQ(ABSTRACT_SERVER_GATHER_MAX_COUNT * 10u, epee::net_utils::gather_write_buffers(queue, buffers));
+    ASSERT_EQ(ABSTRACT_SERVER_GATHER_MAX_COUNT, buffers.size());
+    for (std::size_t i = 0; i < buffers.size(); ++i)
+        EXPECT_EQ(queue[queue.size() - 1 - i].data(), buffers[i].data());
+
+    queue.clear();
+    const std::size_t third = ABSTRACT_SERVER_GATHER_MAX_BYTES / 3 + 1;
+    for (unsigned count = 0; count < 3; ++count)
+        queue.emplace_front(std::string(third, char(count)));
+    EXPECT_EQ(2 * third, epee::net_utils::gather_write_buffers(queue, buffers));
+    EXPECT_EQ(2u, buffers.size());
+
+    // a message over the byte limit is still written, on its own
+    queue.clear();
+    queue.emplace_front(std::string(ABSTRACT_SERVER_GATHER_MAX_BYTES + 1, 'a'));
+    queue.emplace_front(std::string(10, 'b'));
+    EXPECT_EQ(ABSTRACT_SERVER_GATHER_MAX_BYTES + 1, epee::net_utils::gather_write_buffers(queue, buffers));
+    ASSERT_EQ(1u, buffers.size());
+    EXPECT_EQ(queue.back().data(), buffers[0].data());
+}
+
+TEST(gather_write_buffers, drains_in_order)
+{
+    std::deque<epee::byte_slice> queue;
+    std::string expected;
+    for (unsigned count = 0; count < 1000; ++count)
+    {
+        std::string message(1 + count * 37 % 4096, char(count));
+        expected.append(message);
+        queue.emplace_front(std::move(message));
+    }
+
+    // what on_write does: pop exactly the gathered messages, then gather again
+    std::string written;
+    std::vector<boost::asio::const_buffer> buffers;
+    while (!queue.empty())
+    {
+        const std::size_t bytes = epee::net_utils::gather_write_buffers(queue, buffers);
+        ASSERT_FALSE(buffers.empty());
+        ASSERT_LE(buffers.size(), ABSTRACT_SERVER_GATHER_MAX_COUNT);
+        ASSERT_TRUE(buffers.size() == 1 || bytes <= ABSTRACT_SERVER_GATHER_MAX_BYTES);
+        const std::size_t before = written.size();
+        for (const auto& buffer : buffers)
+            written.append(static_cast<const char*>(buffer.data()), buffer.size());
+        EXPECT_EQ(bytes, written.size() - before);
+        for (std::size_t i = 0; i < buffers.size(); ++i)
+            queue.pop_back();
+    }
+    EXPECT_EQ(expected, written);
+}
+
+TEST(fluff_coalesce, window)
+{
+    using cryptonote::levin::detail::get_fluff_coalesce_window;
+    EXPECT_EQ(0, get_fluff_coalesce_window(0).count());
+    EXPECT_EQ(0, get_fluff_coalesce_window(99).count());
+    EXPECT_EQ(std::chrono::milliseconds{250}, get_fluff_coalesce_window(100));
+    EXPECT_EQ(std::chrono::milliseconds{750}, get_fluff_coalesce_window(399));
+    EXPECT_EQ(std::chrono::seconds{1}, get_fluff_coalesce_window(400));
+    EXPECT_EQ(std::chrono::seconds{1}, get_fluff_coalesce_window(1000000));
+}
+
+TEST(fluff_coalesce, flush_time)
+{
+    using cryptonote::levin::detail::get_fluff_flush_time;
+    using time_point = std::chrono::steady_clock::time_point;
+    const time_point grid{std::chrono::seconds{1000}};
+    const std::chrono::steady_clock::duration window{std::chrono::milliseconds{500}};
+
+    EXPECT_EQ(grid + std::chrono::milliseconds{1}, get_fluff_flush_time(grid + std::chrono::milliseconds{1}, {}));
+    EXPECT_EQ(grid, get_fluff_flush_time(grid, window));
+    EXPECT_EQ(grid + window, get_fluff_flush_time(grid + std::chrono::nanoseconds{1}, window));
+    EXPECT_EQ(grid + window, get_fluff_flush_time(grid + std::chrono::milliseconds{250}, window));
+    EXPECT_EQ(grid + window, get_fluff_flush_time(grid + window, window));
+    EXPECT_EQ(grid + 2 * window, get_fluff_flush_time(grid + window + std::chrono::milliseconds{1}, window));
+
+    // any time is pushed back by less than one window, onto the grid
+    for (unsigned count = 0; count < 100; ++count)
+    {
+        const time_point random{std::chrono::nanoseconds{crypto::rand<std::uint32_t>()}};
+        const time_point rounded = get_fluff_flush_time(random, window);
+        EXPECT_LE(random, rounded);
+        EXPECT_LT(rounded - random, window);
+        EXPECT_EQ(0, (rounded.time_since_epoch() % window).count());
+    }
+}
+
 TEST_F(levin_notify, defaulted)
 {
     cryptonote::levin::notify notifier{};
@@ -2276,6 +2381,104 @@ TEST_F(levin_notify, fluff_with_duplicate)
 
 }
 
+TEST_F(levin_notify, fluff_shared_message)
+{
+    std::shared_ptr<cryptonote::levin::notify> notifier_ptr = make_notifier(0, true, false);
+    auto &notifier = *notifier_ptr;
+
+    for (unsigned count = 0; count < 10; ++count)
+        add_connection(count % 2 == 0);
+
+    notifier.new_out_connection();
+    io_service_.poll();
+
+    std::vector<cryptonote::blobdata> txs(3);
+    txs[0].resize(100, 'f');
+    txs[1].resize(200, 'e');
+    txs[2].resize(300, 'd');
+
+    ASSERT_EQ(10u, contexts_.size());
+    {
+        auto context = contexts_.begin();
+        EXPECT_TRUE(notifier.send_txs(txs, context->get_id(), cryptonote::relay_method::fluff));
+
+        io_service_.reset();
+        ASSERT_LT(0u, io_service_.poll());
+        notifier.run_fluff();
+        ASSERT_LT(0u, io_service_.poll());
+
+        // every connection got the same txs, so they share one serialized message
+        EXPECT_TRUE(context->get_send_queue().empty());
+        ++context;
+        ASSERT_EQ(1u, context->get_send_queue().size());
+        const epee::byte_slice& first = context->get_send_queue().front();
+        for (auto other = context; other != contexts_.end(); ++other)
+        {
+            ASSERT_EQ(1u, other->get_send_queue().size());
+            EXPECT_EQ(first.data(), other->get_send_queue().front().data());
+            EXPECT_EQ(first.size(), other->get_send_queue().front().size());
+        }
+        for (; context != contexts_.end(); ++context)
+            EXPECT_EQ(1u, context->process_send_queue());
+
+        EXPECT_EQ(txs, events_.take_relayed(cryptonote::relay_method::fluff));
+        ASSERT_EQ(9u, receiver_.notified_size());
+        const received_message message = receiver_.get_raw_notification();
+        EXPECT_EQ(int(cryptonote::NOTIFY_NEW_TRANSACTIONS::ID), message.command);
+        for (unsigned count = 1; count < 9; ++count)
+        {
+            const received_message other = receiver_.get_raw_notification();
+            EXPECT_EQ(message.command, other.command);
+            EXPECT_EQ(message.payload, other.payload);
+        }
+    }
+}
+
+TEST_F(levin_notify, fluff_burst_shared_message)
+{
+    std::shared_ptr<cryptonote::levin::notify> notifier_ptr = make_notifier(0, true, false);
+    auto &notifier = *notifier_ptr;
+
+    for (unsigned count = 0; count < 10; ++count)
+        add_connection(count % 2 == 0);
+
+    notifier.new_out_connection();
+    io_service_.poll();
+
+    // enough txs for flush times to be put on the burst grid
+    std::vector<cryptonote::blobdata> txs(150);
+    for (std::size_t i = 0; i < txs.size(); ++i)
+        txs[i] = std::string(10, char(i)) + std::to_string(i);
+
+    ASSERT_EQ(10u, contexts_.size());
+    {
+        auto context = contexts_.begin();
+        EXPECT_TRUE(notifier.send_txs(txs, context->get_id(), cryptonote::relay_method::fluff));
+
+        io_service_.reset();
+        ASSERT_LT(0u, io_service_.poll());
+        notifier.run_fluff();
+        ASSERT_LT(0u, io_service_.poll());
+
+        EXPECT_EQ(0u, context->process_send_queue());
+        for (++context; context != contexts_.end(); ++context)
+            EXPECT_EQ(1u, context->process_send_queue());
+
+        EXPECT_EQ(txs, events_.take_relayed(cryptonote::relay_method::fluff));
+        std::sort(txs.begin(), txs.end());
+        ASSERT_EQ(9u, receiver_.notified_size());
+        const received_message message = receiver_.get_raw_notification();
+        for (unsigned count = 1; count < 9; ++count)
+            EXPECT_EQ(message.payload, receiver_.get_raw_notification().payload);
+
+        epee::serialization::portable_storage storage{};
+        ASSERT_TRUE(storage.load_from_binary(epee::strspan<std::uint8_t>(message.payload)));
+        cryptonote::NOTIFY_NEW_TRANSACTIONS::request request{};
+        ASSERT_TRUE(request.load(storage));
+        EXPECT_EQ(txs, request.txs);
+    }
+}
+
 TEST_F(levin_notify, noise)
 {
     for (unsigned count = 0; count < 10; ++count)
@@ -60,6 +60,7 @@ public:
   bool have_block_unlocked(const crypto::hash& id, int *where = NULL) const {return false;}
   void get_blockchain_top(uint64_t& height, crypto::hash& top_id)const{height=0;top_id=crypto::null_hash;}
   bool handle_incoming_tx(const cryptonote::tx_blob_entry& tx_blob, cryptonote::tx_verification_context& tvc, cryptonote::relay_method tx_relay, bool relayed) { return true; }
+  std::shared_ptr<const cryptonote::transaction> parse_tx_from_blob(crypto::hash& tx_hash, const cryptonote::blobdata& blob) const { auto tx = std::make_shared<cryptonote::transaction>(); if (!cryptonote::parse_and_validate_tx_from_blob(blob, *tx, tx_hash)) return nullptr; return tx; }
   bool handle_incoming_txs(const std::vector<cryptonote::tx_blob_entry>& tx_blob, std::vector<cryptonote::tx_verification_context>& tvc, cryptonote::relay_method tx_relay, bool relayed) { return true; }
   bool handle_incoming_block(const cryptonote::blobdata& block_blob, const cryptonote::block *block, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { return true; }
   void pause_mine(){}
@@ -72,6 +73,8 @@ public:
   bool get_test_drop_download_height() const {return true;}
   bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks_entry, std::vector<cryptonote::block> &blocks) { return true; }
   bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+  void precompute_incoming_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> blocks_entry) {}
+  bool get_pipeline_block_import() const { return false; }
   bool update_checkpoints(const bool skip_dns = false) { return true; }
   uint64_t get_target_blockchain_height() const { return 1; }
   size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
@@ -89,13 +92,21 @@ public:
   cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
   bool fluffy_blocks_enabled() const { return false; }
   uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights) { return 0; }
+  bool prevalidate_block_headers(uint64_t height, const std::vector<cryptonote::blobdata> &headers, const std::vector<crypto::hash> &hashes, uint64_t &nvalidated) { nvalidated = 0; return true; }
+  uint64_t get_validated_headers_height() const { return 0; }
+  uint64_t get_checked_headers_height(uint64_t height, const std::vector<std::pair<crypto::hash, uint64_t>> &ids) const { return 0; }
+  bool get_headers_first_sync() const { return false; }
+  void handle_get_block_headers(const cryptonote::NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote::NOTIFY_RESPONSE_BLOCK_HEADERS::request& rsp, size_t max_size) const {}
   bool pad_transactions() { return false; }
   uint32_t get_blockchain_pruning_seed() const { return 0; }
   bool prune_blockchain(uint32_t pruning_seed = 0) { return true; }
   bool is_within_compiled_block_hash_area(uint64_t height) const { return false; }
   bool has_block_weights(uint64_t height, uint64_t nblocks) const { return false; }
   bool get_txpool_complement(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &txes) { return false; }
+  uint64_t get_pool_short_id_salt() const { return 0; }
+  void find_pool_transactions_by_short_ids(const std::vector<uint64_t> &short_ids, std::vector<crypto::hash> &hashes) const { hashes.assign(short_ids.size(), crypto::null_hash); }
   bool get_pool_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const { return false; }
+  size_t get_pool_transactions_count(bool include_sensitive_txes = false) const { return 0; }
   crypto::hash get_block_id_by_height(uint64_t height) const { return crypto::null_hash; }
   void stop() {}
 };
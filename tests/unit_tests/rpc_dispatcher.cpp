@@ -0,0 +1,207 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include "storages/portable_storage_template_helper.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "rpc/rpc_dispatcher.h"
+
+using cryptonote::rpc_dispatcher;
+
+TEST(rpc_dispatcher, classify)
+{
+  ASSERT_EQ(rpc_dispatcher::classify("/get_info", ""), rpc_dispatcher::cost_class_cheap);
+  ASSERT_EQ(rpc_dispatcher::classify("/get_blocks.bin", ""), rpc_dispatcher::cost_class_cheap);
+  ASSERT_EQ(rpc_dispatcher::classify("/get_output_distribution.bin", ""), rpc_dispatcher::cost_class_expensive);
+  ASSERT_EQ(rpc_dispatcher::classify("/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":\"0\",\"method\":\"get_block_count\"}"), rpc_dispatcher::cost_class_cheap);
+  ASSERT_EQ(rpc_dispatcher::classify("/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":\"0\",\"method\" : \"get_output_histogram\"}"), rpc_dispatcher::cost_class_expensive);
+  ASSERT_EQ(rpc_dispatcher::classify("/json_rpc", "{\"method\":\n\"generateblocks\",\"params\":{}}"), rpc_dispatcher::cost_class_expensive);
+  ASSERT_EQ(rpc_dispatcher::classify("/json_rpc", "{\"method\":"), rpc_dispatcher::cost_class_cheap);
+  ASSERT_EQ(rpc_dispatcher::classify("/json_rpc", "garbage"), rpc_dispatcher::cost_class_cheap);
+}
+
+TEST(rpc_dispatcher, classify_output_distribution)
+{
+  // classified by the amounts asked for, like it is charged
+  ASSERT_EQ(rpc_dispatcher::classify("/json_rpc", "{\"method\":\"get_output_distribution\",\"params\":{\"amounts\":[0]}}"), rpc_dispatcher::cost_class_cheap);
+  ASSERT_EQ(rpc_dispatcher::classify("/json_rpc", "{\"method\":\"get_output_distribution\",\"params\":{\"amounts\":[0,1000000]}}"), rpc_dispatcher::cost_class_expensive);
+
+  cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req;
+  req.amounts = {0};
+  epee::byte_slice body = epee::serialization::store_t_to_binary(req);
+  ASSERT_EQ(rpc_dispatcher::classify("/get_output_distribution.bin", std::string(body.begin(), body.end())), rpc_dispatcher::cost_class_cheap);
+  req.amounts = {1000000};
+  body = epee::serialization::store_t_to_binary(req);
+  ASSERT_EQ(rpc_dispatcher::classify("/get_output_distribution.bin", std::string(body.begin(), body.end())), rpc_dispatcher::cost_class_expensive);
+}
+
+TEST(rpc_dispatcher, json_rpc_method)
+{
+  std::string method;
+  ASSERT_TRUE(rpc_dispatcher::get_json_rpc_method("{\"method\":\"get_txids_loose\"}", method));
+  ASSERT_EQ(method, "get_txids_loose");
+  ASSERT_TRUE(rpc_dispatcher::get_json_rpc_method("{ \"method\"\t:  \"\" }", method));
+  ASSERT_EQ(method, "");
+  ASSERT_FALSE(rpc_dispatcher::get_json_rpc_method("{\"method\":42}", method));
+  ASSERT_FALSE(rpc_dispatcher::get_json_rpc_method("{\"method\":\"unterminated", method));
+  ASSERT_FALSE(rpc_dispatcher::get_json_rpc_method("{\"params\":{}}", method));
+}
+
+TEST(rpc_dispatcher, shed_when_saturated)
+{
+  rpc_dispatcher dispatcher;
+  dispatcher.configure(rpc_dispatcher::cost_class_expensive, 1, 0);
+  dispatcher.configure(rpc_dispatcher::cost_class_cheap, 1, 0);
+  ASSERT_EQ(dispatcher.get_threads_needed(), 2 + rpc_dispatcher::SPARE_THREADS);
+
+  {
+    rpc_dispatcher::ticket t0, t1, t2;
+    ASSERT_TRUE(dispatcher.admit(rpc_dispatcher::cost_class_expensive, t0));
+    ASSERT_FALSE(dispatcher.admit(rpc_dispatcher::cost_class_expensive, t1));
+    // a saturated expensive class does not hold up cheap calls
+    ASSERT_TRUE(dispatcher.admit(rpc_dispatcher::cost_class_cheap, t2));
+  }
+
+  rpc_dispatcher::ticket t;
+  ASSERT_TRUE(dispatcher.admit(rpc_dispatcher::cost_class_expensive, t));
+  t.release();
+
+  const auto stats = dispatcher.get_stats();
+  ASSERT_EQ(stats.size(), rpc_dispatcher::cost_class_count);
+  const auto &expensive = stats[rpc_dispatcher::cost_class_expensive];
+  ASSERT_EQ(expensive.name, "expensive");
+  ASSERT_EQ(expensive.active, 0);
+  ASSERT_EQ(expensive.admitted, 2);
+  ASSERT_EQ(expensive.shed, 1);
+  ASSERT_EQ(expensive.queue_depth_histogram.size(), rpc_dispatcher::QUEUE_DEPTH_BUCKETS);
+  ASSERT_EQ(expensive.queue_depth_histogram[0], 3);
+  ASSERT_EQ(expensive.latency_histogram.size(), rpc_dispatcher::LATENCY_BUCKETS);
+  uint64_t completed = 0;
+  for (uint64_t n: expensive.latency_histogram)
+    completed += n;
+  ASSERT_EQ(completed, 2);
+  ASSERT_EQ(stats[rpc_dispatcher::cost_class_cheap].admitted, 1);
+}
+
+TEST(rpc_dispatcher, queue)
+{
+  rpc_dispatcher dispatcher;
+  dispatcher.configure(rpc_dispatcher::cost_class_expensive, 1, 1);
+
+  std::unique_ptr<rpc_dispatcher::ticket> running(new rpc_dispatcher::ticket());
+  ASSERT_TRUE(dispatcher.admit(rpc_dispatcher::cost_class_expensive, *running));
+
+  bool admitted = false;
+  boost::thread waiter([&]() {
+    rpc_dispatcher::ticket t;
+    admitted = dispatcher.admit(rpc_dispatcher::cost_class_expensive, t);
+  });
+  while (dispatcher.get_stats()[rpc_dispatcher::cost_class_expensive].queued == 0)
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+
+  // the queue is full now
+  rpc_dispatcher::ticket t;
+  ASSERT_FALSE(dispatcher.admit(rpc_dispatcher::cost_class_expensive, t));
+
+  running.reset();
+  waiter.join();
+  ASSERT_TRUE(admitted);
+
+  const auto stats = dispatcher.get_stats()[rpc_dispatcher::cost_class_expensive];
+  ASSERT_EQ(stats.admitted, 2);
+  ASSERT_EQ(stats.shed, 1);
+  ASSERT_EQ(stats.queue_depth_histogram[0], 2);
+  ASSERT_EQ(stats.queue_depth_histogram[1], 1);
+}
+
+TEST(rpc_dispatcher, queue_timeout)
+{
+  rpc_dispatcher dispatcher;
+  dispatcher.configure(rpc_dispatcher::cost_class_expensive, 1, 1);
+  dispatcher.set_max_queue_wait(std::chrono::milliseconds(10));
+
+  rpc_dispatcher::ticket t0, t1;
+  ASSERT_TRUE(dispatcher.admit(rpc_dispatcher::cost_class_expensive, t0));
+  ASSERT_FALSE(dispatcher.admit(rpc_dispatcher::cost_class_expensive, t1));
+  ASSERT_EQ(dispatcher.get_stats()[rpc_dispatcher::cost_class_expensive].shed, 1);
+  ASSERT_EQ(dispatcher.get_stats()[rpc_dispatcher::cost_class_expensive].queued, 0);
+}
+
+TEST(rpc_dispatcher, saturated)
+{
+  rpc_dispatcher dispatcher;
+  dispatcher.configure(rpc_dispatcher::cost_class_cheap, 1, 1);
+  dispatcher.configure(rpc_dispatcher::cost_class_expensive, 1, 1);
+  ASSERT_EQ(dispatcher.get_threads_needed(), 4 + rpc_dispatcher::SPARE_THREADS);
+
+  // take every worker slot and queue entry, each holding a connection thread
+  rpc_dispatcher::ticket running[rpc_dispatcher::cost_class_count];
+  std::vector<boost::thread> queued;
+  for (size_t c = 0; c < rpc_dispatcher::cost_class_count; ++c)
+  {
+    const rpc_dispatcher::cost_class cost_class = rpc_dispatcher::cost_class(c);
+    ASSERT_TRUE(dispatcher.admit(cost_class, running[c]));
+    queued.emplace_back([&dispatcher, cost_class]() {
+      rpc_dispatcher::ticket t;
+      dispatcher.admit(cost_class, t);
+    });
+    while (dispatcher.get_stats()[c].queued == 0)
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+  }
+
+  // the spare threads are left to shed further calls, which must not wait
+  const auto start = std::chrono::steady_clock::now();
+  std::atomic<unsigned> shed(0);
+  std::vector<boost::thread> spare;
+  for (unsigned i = 0; i < rpc_dispatcher::SPARE_THREADS; ++i)
+  {
+    spare.emplace_back([&dispatcher, &shed, i]() {
+      rpc_dispatcher::ticket t;
+      if (!dispatcher.admit(rpc_dispatcher::cost_class(i % rpc_dispatcher::cost_class_count), t))
+        ++shed;
+    });
+  }
+  for (boost::thread &t: spare)
+    t.join();
+  ASSERT_EQ(shed, rpc_dispatcher::SPARE_THREADS);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+
+  for (rpc_dispatcher::ticket &t: running)
+    t.release();
+  for (boost::thread &t: queued)
+    t.join();
+  for (const auto &stats: dispatcher.get_stats())
+  {
+    ASSERT_EQ(stats.admitted, 2);
+    ASSERT_EQ(stats.active, 0);
+  }
+}
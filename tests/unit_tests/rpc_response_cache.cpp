@@ -0,0 +1,174 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "net/http_server_handlers_map2.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "rpc/rpc_response_cache.h"
+
+using cryptonote::rpc_response_cache;
+
+namespace
+{
+  crypto::hash make_hash(char c)
+  {
+    crypto::hash h;
+    memset(h.data, c, sizeof(h.data));
+    return h;
+  }
+
+  std::string make_body(const std::vector<uint64_t> &depths)
+  {
+    cryptonote::COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response res{};
+    for (uint64_t depth: depths)
+    {
+      res.headers.push_back({});
+      res.headers.back().height = 7;
+      res.headers.back().depth = depth;
+      res.headers.back().hash = "00";
+    }
+    res.status = "OK";
+    return epee::serialization::store_t_to_json(res, 1);
+  }
+}
+
+TEST(rpc_response_cache, depths)
+{
+  rpc_response_cache cache(1024 * 1024);
+  const crypto::hash top = make_hash(1);
+  const uint64_t p = rpc_response_cache::DEPTH_PLACEHOLDER;
+
+  // rendered with the depths at the current height, then again as the chain grows
+  ASSERT_EQ(cache.put("k", top, false, cache.get_generation(), make_body({p, p}), {5, 7}, 7, 100), make_body({94, 92}));
+  std::string body;
+  ASSERT_TRUE(cache.get("k", top, 100, body));
+  ASSERT_EQ(body, make_body({94, 92}));
+  ASSERT_TRUE(cache.get("k", make_hash(2), 110, body));
+  ASSERT_EQ(body, make_body({104, 102}));
+
+  const auto stats = cache.get_stats();
+  ASSERT_EQ(stats.hits, 2);
+  ASSERT_EQ(stats.misses, 0);
+  ASSERT_EQ(stats.entries, 1);
+  ASSERT_GT(stats.bytes, make_body({p, p}).size());
+}
+
+TEST(rpc_response_cache, shallow)
+{
+  rpc_response_cache cache(1024 * 1024);
+  const crypto::hash top = make_hash(1);
+  cache.put("k", top, true, cache.get_generation(), "body", {}, 98, 100);
+
+  std::string body;
+  ASSERT_TRUE(cache.get("k", top, 100, body));
+  ASSERT_EQ(body, "body");
+  ASSERT_FALSE(cache.get("k", make_hash(2), 100, body));
+
+  // any new block drops shallow entries
+  cache.invalidate(100);
+  ASSERT_FALSE(cache.get("k", top, 100, body));
+  ASSERT_EQ(cache.get_stats().entries, 0);
+}
+
+TEST(rpc_response_cache, invalidate)
+{
+  rpc_response_cache cache(1024 * 1024);
+  const crypto::hash top = make_hash(1);
+  cache.put("a", top, false, cache.get_generation(), "a", {}, 50, 100);
+  cache.put("b", top, false, cache.get_generation(), "b", {}, 60, 100);
+
+  std::string body;
+  cache.invalidate(100);
+  ASSERT_TRUE(cache.get("a", top, 101, body));
+  ASSERT_TRUE(cache.get("b", top, 101, body));
+
+  // reorg from 55
+  cache.invalidate(55);
+  ASSERT_TRUE(cache.get("a", top, 101, body));
+  ASSERT_FALSE(cache.get("b", top, 101, body));
+
+  // popped, not replaced yet
+  ASSERT_FALSE(cache.get("a", top, 50, body));
+  ASSERT_EQ(cache.get_stats().entries, 0);
+}
+
+TEST(rpc_response_cache, generation)
+{
+  rpc_response_cache cache(1024 * 1024);
+  const crypto::hash top = make_hash(1);
+  const uint64_t generation = cache.get_generation();
+  cache.invalidate(100);
+  ASSERT_EQ(cache.put("k", top, false, generation, "body", {}, 50, 100), "body");
+  std::string body;
+  ASSERT_FALSE(cache.get("k", top, 100, body));
+
+  cache.put("k", top, false, cache.get_generation(), "body", {}, 50, 100);
+  cache.clear();
+  ASSERT_FALSE(cache.get("k", top, 100, body));
+}
+
+TEST(rpc_response_cache, budget)
+{
+  const std::string big(1000, 'x');
+  rpc_response_cache cache(2500);
+  const crypto::hash top = make_hash(1);
+  cache.put("a", top, false, cache.get_generation(), big, {}, 1, 100);
+  cache.put("b", top, false, cache.get_generation(), big, {}, 1, 100);
+  std::string body;
+  ASSERT_TRUE(cache.get("a", top, 100, body));
+  cache.put("c", top, false, cache.get_generation(), big, {}, 1, 100);
+
+  // b was the least recently used
+  ASSERT_TRUE(cache.get("a", top, 100, body));
+  ASSERT_FALSE(cache.get("b", top, 100, body));
+  ASSERT_TRUE(cache.get("c", top, 100, body));
+  ASSERT_LE(cache.get_stats().bytes, 2500);
+
+  cache.set_max_bytes(0);
+  ASSERT_EQ(cache.get_stats().entries, 0);
+  cache.put("a", top, false, cache.get_generation(), big, {}, 1, 100);
+  ASSERT_EQ(cache.get_stats().entries, 0);
+}
+
+TEST(rpc_response_cache, raw_json_rpc_response)
+{
+  epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response, epee::json_rpc::dummy_error> resp{};
+  resp.jsonrpc = "2.0";
+  resp.id = epee::serialization::storage_entry(std::string("some id"));
+  resp.result.block_header.hash = "abcd";
+  resp.result.block_header.depth = 12;
+  resp.result.status = "OK";
+
+  epee::json_rpc::raw_response raw;
+  raw.jsonrpc = "2.0";
+  raw.id = resp.id;
+  std::string json;
+  epee::json_rpc::store_raw_result_to_json(raw, epee::serialization::store_t_to_json(resp.result, 1), json);
+  ASSERT_EQ(json, epee::serialization::store_t_to_json(resp));
+}
@@ -28,6 +28,7 @@
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <atomic>
+#include <set>
 #include "gtest/gtest.h"
 #include "misc_language.h"
 #include "common/threadpool.h"
@@ -145,3 +146,56 @@ TEST(threadpool, leaf_reentrancy)
   waiter.wait();
   ASSERT_EQ(counter, 500000);
 }
+
+TEST(threadpool, priority)
+{
+  // no worker threads, so everything runs in wait, in scheduling order
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(1));
+  tools::threadpool::waiter waiter(*tpool);
+
+  std::vector<int> order;
+  tpool->submit(&waiter, [&](){ order.push_back(0); });
+  tpool->submit(&waiter, [&](){ order.push_back(1); });
+  tpool->submit(&waiter, [&](){ order.push_back(2); }, false, tools::threadpool::priority::high);
+  waiter.wait();
+  ASSERT_EQ(order.size(), 3);
+  ASSERT_EQ(order[0], 2);
+  ASSERT_EQ(order[1], 0);
+  ASSERT_EQ(order[2], 1);
+}
+
+TEST(threadpool, nested_tasks_are_stolen)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(4));
+  tools::threadpool::waiter waiter(*tpool);
+
+  boost::mutex mutex;
+  std::set<boost::thread::id> ids;
+  tpool->submit(&waiter, [&](){
+    tools::threadpool::waiter inner(*tpool);
+    for (int i = 0; i < 64; ++i)
+    {
+      tpool->submit(&inner, [&](){
+        epee::misc_utils::sleep_no_w(10);
+        const boost::unique_lock<boost::mutex> lock(mutex);
+        ids.insert(boost::this_thread::get_id());
+      }, true);
+    }
+    inner.wait();
+  });
+  waiter.wait();
+  ASSERT_GT(ids.size(), 1);
+}
+
+TEST(threadpool, recycle_keeps_pending)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(4));
+  tools::threadpool::waiter waiter(*tpool);
+
+  std::atomic<unsigned int> counter(0);
+  for (size_t n = 0; n < 1024; ++n)
+    tpool->submit(&waiter, [&counter](){++counter;});
+  tpool->recycle();
+  waiter.wait();
+  ASSERT_EQ(counter, 1024);
+}
@@ -0,0 +1,171 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "wallet/transfer_index.h"
+
+namespace
+{
+  tools::transfer_index::entry make_entry(std::mt19937_64 &rng)
+  {
+    tools::transfer_index::entry e;
+    e.subaddr = {(uint32_t)(rng() % 3), (uint32_t)(rng() % 4)};
+    e.amount = 1 + rng() % 1000;
+    e.unlock_height = 100 + rng() % 100;
+    e.time_locked = rng() % 10 == 0;
+    e.available = rng() % 2;
+    e.unspent = e.available || rng() % 2;
+    e.counted = rng() % 5 != 0;
+    return e;
+  }
+
+  void check(const tools::transfer_index &index, const std::vector<tools::transfer_index::entry> &entries)
+  {
+    ASSERT_EQ(index.size(), entries.size());
+    std::set<size_t> available;
+    for (uint32_t major = 0; major < 4; ++major)
+    {
+      for (bool strict: {false, true})
+      {
+        std::map<uint32_t, uint64_t> balances;
+        uint64_t total = 0;
+        for (const auto &e: entries)
+        {
+          if (e.subaddr.major == major && e.counted && (strict ? e.unspent : e.available))
+          {
+            balances[e.subaddr.minor] += e.amount;
+            total += e.amount;
+          }
+        }
+        ASSERT_EQ(index.balance_per_subaddress(major, strict), balances);
+        ASSERT_EQ(index.balance(major, strict), total);
+      }
+
+      std::set<size_t> available_in_account;
+      std::set<std::pair<uint64_t, size_t>> by_amount;
+      std::set<size_t> locked;
+      for (size_t i = 0; i < entries.size(); ++i)
+      {
+        const auto &e = entries[i];
+        if (e.subaddr.major != major)
+          continue;
+        if (e.available)
+        {
+          available_in_account.insert(i);
+          by_amount.insert(std::make_pair(e.amount, i));
+        }
+        if (e.unspent && e.counted && (e.time_locked || e.unlock_height > 150))
+          locked.insert(i);
+      }
+      ASSERT_EQ(index.available(major), available_in_account);
+      ASSERT_EQ(index.available_by_amount(major), by_amount);
+      std::vector<size_t> indices;
+      index.get_locked(major, 150, indices);
+      ASSERT_EQ(std::set<size_t>(indices.begin(), indices.end()), locked);
+      ASSERT_EQ(indices.size(), locked.size());
+      available.insert(available_in_account.begin(), available_in_account.end());
+    }
+    ASSERT_EQ(index.available(), available);
+  }
+}
+
+TEST(transfer_index, empty)
+{
+  tools::transfer_index index;
+  ASSERT_EQ(index.balance(0, false), 0);
+  ASSERT_TRUE(index.balance_per_subaddress(0, true).empty());
+  ASSERT_TRUE(index.available().empty());
+  ASSERT_TRUE(index.available(1).empty());
+  std::vector<size_t> indices;
+  index.get_locked(0, 0, indices);
+  ASSERT_TRUE(indices.empty());
+}
+
+TEST(transfer_index, strict_and_loose_balances)
+{
+  tools::transfer_index index;
+  tools::transfer_index::entry e;
+  e.subaddr = {0, 1};
+  e.amount = 5;
+  e.counted = true;
+  e.unspent = true;
+  e.available = true;
+  index.update(0, e);
+  e.amount = 7;
+  e.available = false; // spent in the pool
+  index.update(1, e);
+  ASSERT_EQ(index.balance(0, false), 5);
+  ASSERT_EQ(index.balance(0, true), 12);
+  ASSERT_EQ(index.available(0), std::set<size_t>{0});
+
+  e.unspent = false; // and now mined
+  index.update(1, e);
+  ASSERT_EQ(index.balance(0, true), 5);
+  ASSERT_EQ(index.balance_per_subaddress(0, true), (std::map<uint32_t, uint64_t>{{1, 5}}));
+
+  index.resize(0);
+  ASSERT_EQ(index.balance(0, true), 0);
+  ASSERT_TRUE(index.balance_per_subaddress(0, true).empty());
+  ASSERT_TRUE(index.available(0).empty());
+}
+
+TEST(transfer_index, random_updates)
+{
+  std::mt19937_64 rng(0);
+  tools::transfer_index index;
+  std::vector<tools::transfer_index::entry> entries;
+  for (int n = 0; n < 2000; ++n)
+  {
+    const int op = rng() % 10;
+    if (op < 4 || entries.empty())
+    {
+      entries.push_back(make_entry(rng));
+      index.update(entries.size() - 1, entries.back());
+    }
+    else if (op < 9)
+    {
+      const size_t idx = rng() % entries.size();
+      entries[idx] = make_entry(rng);
+      index.update(idx, entries[idx]);
+    }
+    else
+    {
+      entries.resize(rng() % entries.size());
+      index.resize(entries.size());
+    }
+    if (n % 100 == 0)
+      check(index, entries);
+  }
+  check(index, entries);
+}
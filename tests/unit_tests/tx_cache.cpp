@@ -0,0 +1,112 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/tx_cache.h"
+
+static cryptonote::blobdata make_tx_blob(uint64_t height)
+{
+  cryptonote::transaction tx;
+  tx.version = 1;
+  tx.unlock_time = height + 60;
+  cryptonote::txin_gen in;
+  in.height = height;
+  tx.vin.push_back(in);
+  cryptonote::tx_out out;
+  out.amount = 1;
+  out.target = cryptonote::txout_to_key(crypto::rand<crypto::public_key>());
+  tx.vout.push_back(out);
+  return cryptonote::tx_to_blob(tx);
+}
+
+TEST(tx_cache, parse)
+{
+  cryptonote::tx_cache cache;
+  const cryptonote::blobdata blob = make_tx_blob(1);
+  crypto::hash txid;
+  cryptonote::transaction tx;
+  ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(blob, tx, txid));
+
+  const std::shared_ptr<const cryptonote::cached_tx> parsed = cache.parse(blob);
+  ASSERT_TRUE(parsed != nullptr);
+  ASSERT_EQ(parsed->txid, txid);
+  ASSERT_EQ(parsed->prefix_hash, cryptonote::get_transaction_prefix_hash(tx));
+  ASSERT_EQ(parsed->blob_size, blob.size());
+  ASSERT_EQ(parsed->weight, blob.size());
+  ASSERT_EQ(cache.parse(blob), parsed);
+  ASSERT_EQ(cache.find(txid), parsed);
+
+  const cryptonote::tx_cache::stats stats = cache.get_stats();
+  ASSERT_EQ(stats.hits, 2);
+  ASSERT_EQ(stats.misses, 1);
+  ASSERT_EQ(stats.entries, 1);
+
+  ASSERT_TRUE(cache.parse("invalid") == nullptr);
+  ASSERT_EQ(cache.get_stats().entries, 1);
+}
+
+TEST(tx_cache, insert)
+{
+  cryptonote::tx_cache cache;
+  const cryptonote::blobdata blob = make_tx_blob(1);
+  crypto::hash txid;
+  cryptonote::transaction tx;
+  ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(blob, tx, txid));
+
+  ASSERT_TRUE(cache.find(txid) == nullptr);
+  cache.insert(tx, txid, blob);
+  const std::shared_ptr<const cryptonote::cached_tx> cached = cache.find(txid);
+  ASSERT_TRUE(cached != nullptr);
+  ASSERT_EQ(cryptonote::get_transaction_hash(cached->tx), txid);
+  ASSERT_EQ(cache.parse(blob), cached);
+}
+
+TEST(tx_cache, evict)
+{
+  cryptonote::tx_cache cache;
+  const cryptonote::blobdata blob0 = make_tx_blob(1), blob1 = make_tx_blob(2);
+  const std::shared_ptr<const cryptonote::cached_tx> tx0 = cache.parse(blob0);
+  ASSERT_TRUE(tx0 != nullptr);
+  cache.set_max_bytes(cache.get_stats().bytes);
+
+  ASSERT_TRUE(cache.parse(blob1) != nullptr);
+  ASSERT_TRUE(cache.find(tx0->txid) == nullptr);
+  cryptonote::tx_cache::stats stats = cache.get_stats();
+  ASSERT_EQ(stats.entries, 1);
+  ASSERT_EQ(stats.evictions, 1);
+
+  cache.set_max_bytes(0);
+  stats = cache.get_stats();
+  ASSERT_EQ(stats.entries, 0);
+  ASSERT_EQ(stats.bytes, 0);
+  ASSERT_TRUE(cache.parse(blob0) != nullptr);
+  ASSERT_EQ(cache.get_stats().entries, 0);
+}
@@ -0,0 +1,155 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <vector>
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/txpool_sketch.h"
+
+static std::vector<uint64_t> make_ids(size_t n)
+{
+  std::vector<uint64_t> ids;
+  for (size_t i = 0; i < n; ++i)
+    ids.push_back(crypto::rand<uint64_t>() & 0xffffffffffff);
+  return ids;
+}
+
+static cryptonote::txpool_sketch make_sketch(size_t cells, const std::vector<uint64_t> &ids)
+{
+  cryptonote::txpool_sketch sketch(cells);
+  for (uint64_t id: ids)
+    sketch.add(id);
+  return sketch;
+}
+
+TEST(txpool_sketch, cells)
+{
+  ASSERT_EQ(cryptonote::txpool_sketch(0).size(), cryptonote::TXPOOL_SKETCH_MIN_CELLS);
+  ASSERT_EQ(cryptonote::txpool_sketch(100).size() % 3, 0);
+  ASSERT_GE(cryptonote::txpool_sketch(100).size(), 100);
+  ASSERT_GE(cryptonote::txpool_sketch::get_cells_for_difference(1000), 1230);
+}
+
+TEST(txpool_sketch, same_sets)
+{
+  const std::vector<uint64_t> ids = make_ids(5000);
+  cryptonote::txpool_sketch ours = make_sketch(30, ids);
+  ASSERT_TRUE(ours.subtract(make_sketch(30, ids)));
+  std::vector<uint64_t> ours_only, theirs_only;
+  ASSERT_TRUE(ours.decode(ours_only, theirs_only));
+  ASSERT_TRUE(ours_only.empty());
+  ASSERT_TRUE(theirs_only.empty());
+}
+
+TEST(txpool_sketch, difference)
+{
+  const std::vector<uint64_t> common = make_ids(5000), extra = make_ids(200);
+  std::vector<uint64_t> ours_ids = common, theirs_ids = common;
+  ours_ids.insert(ours_ids.end(), extra.begin(), extra.begin() + 150);
+  theirs_ids.insert(theirs_ids.end(), extra.begin() + 150, extra.end());
+  std::shuffle(theirs_ids.begin(), theirs_ids.end(), crypto::random_device{});
+
+  const size_t cells = cryptonote::txpool_sketch::get_cells_for_difference(extra.size());
+  cryptonote::txpool_sketch ours = make_sketch(cells, ours_ids);
+  ASSERT_TRUE(ours.subtract(make_sketch(cells, theirs_ids)));
+  std::vector<uint64_t> ours_only, theirs_only;
+  ASSERT_TRUE(ours.decode(ours_only, theirs_only));
+  std::sort(ours_only.begin(), ours_only.end());
+  std::sort(theirs_only.begin(), theirs_only.end());
+  std::vector<uint64_t> expected_ours(extra.begin(), extra.begin() + 150), expected_theirs(extra.begin() + 150, extra.end());
+  std::sort(expected_ours.begin(), expected_ours.end());
+  std::sort(expected_theirs.begin(), expected_theirs.end());
+  ASSERT_EQ(ours_only, expected_ours);
+  ASSERT_EQ(theirs_only, expected_theirs);
+}
+
+TEST(txpool_sketch, too_large_difference)
+{
+  const std::vector<uint64_t> common = make_ids(1000), extra = make_ids(500);
+  std::vector<uint64_t> ours_ids = common;
+  ours_ids.insert(ours_ids.end(), extra.begin(), extra.end());
+  cryptonote::txpool_sketch ours = make_sketch(60, ours_ids);
+  ASSERT_TRUE(ours.subtract(make_sketch(60, common)));
+  std::vector<uint64_t> ours_only, theirs_only;
+  ASSERT_FALSE(ours.decode(ours_only, theirs_only));
+  ASSERT_FALSE(ours.subtract(make_sketch(90, common)));
+}
+
+TEST(txpool_sketch, serialization)
+{
+  const std::vector<uint64_t> common = make_ids(1000), extra = make_ids(10);
+  std::vector<uint64_t> theirs_ids = common;
+  theirs_ids.insert(theirs_ids.end(), extra.begin(), extra.end());
+  const std::string blob = make_sketch(60, theirs_ids).serialize();
+  ASSERT_EQ(blob.size(), 60 * cryptonote::TXPOOL_SKETCH_CELL_SIZE);
+
+  cryptonote::txpool_sketch theirs;
+  ASSERT_TRUE(theirs.parse(blob));
+  ASSERT_EQ(theirs.serialize(), blob);
+  cryptonote::txpool_sketch ours = make_sketch(60, common);
+  ASSERT_TRUE(ours.subtract(theirs));
+  std::vector<uint64_t> ours_only, theirs_only;
+  ASSERT_TRUE(ours.decode(ours_only, theirs_only));
+  ASSERT_TRUE(ours_only.empty());
+  std::sort(theirs_only.begin(), theirs_only.end());
+  std::vector<uint64_t> expected = extra;
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(theirs_only, expected);
+}
+
+TEST(txpool_sketch, malformed)
+{
+  cryptonote::txpool_sketch sketch;
+  ASSERT_FALSE(sketch.parse(std::string(60 * cryptonote::TXPOOL_SKETCH_CELL_SIZE + 1, 0)));
+  ASSERT_FALSE(sketch.parse(std::string(61 * cryptonote::TXPOOL_SKETCH_CELL_SIZE, 0)));
+  ASSERT_FALSE(sketch.parse(std::string(3 * cryptonote::TXPOOL_SKETCH_CELL_SIZE, 0)));
+  ASSERT_FALSE(sketch.parse(std::string((cryptonote::TXPOOL_SKETCH_MAX_CELLS + 3) * cryptonote::TXPOOL_SKETCH_CELL_SIZE, 0)));
+  ASSERT_TRUE(sketch.parse(std::string(60 * cryptonote::TXPOOL_SKETCH_CELL_SIZE, 0)));
+}
+
+TEST(txpool_sketch, extreme_counts)
+{
+  // counts from a peer may be anything, subtracting them must not overflow
+  std::string blob(60 * cryptonote::TXPOOL_SKETCH_CELL_SIZE, 0);
+  for (size_t cell = 0; cell < 60; ++cell)
+  {
+    const uint32_t count = cell % 2 ? 0x80000000 : 0x7fffffff;
+    for (size_t byte = 0; byte < 4; ++byte)
+      blob[cell * cryptonote::TXPOOL_SKETCH_CELL_SIZE + byte] = (char)(count >> (8 * byte));
+  }
+  cryptonote::txpool_sketch theirs;
+  ASSERT_TRUE(theirs.parse(blob));
+  ASSERT_EQ(theirs.serialize(), blob);
+
+  cryptonote::txpool_sketch ours = make_sketch(60, make_ids(100));
+  ASSERT_TRUE(ours.subtract(theirs));
+  std::vector<uint64_t> ours_only, theirs_only;
+  ASSERT_FALSE(ours.decode(ours_only, theirs_only));
+}
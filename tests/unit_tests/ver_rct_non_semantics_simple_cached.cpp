@@ -35,6 +35,7 @@
 
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/blockchain_and_pool.h"
 #include "file_io_utils.h"
 #include "misc_log_ex.h"
 #include "ringct/rctSigs.h"
@@ -424,3 +425,37 @@ TEST(verRctNonSemanticsSimple, expand_transaction_2_failures)
     EXPAND_TRANSACTION_2_FAILURES_SUBTEST(rct_signatures.mixRing[0][15].dest[31]++)
     EXPAND_TRANSACTION_2_FAILURES_SUBTEST(rct_signatures.mixRing[0][15].mask[31]++)
 }
+
+TEST(verRctNonSemanticsSimple, span_preverification_seeds_cache)
+{
+    std::string tx_blob;
+    ASSERT_TRUE(epee::file_io_utils::load_file_to_string((unit_test::data_dir / tx1_file_name).string(), tx_blob));
+    cryptonote::transaction tx;
+    ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(tx_blob, tx));
+
+    // the ring members, as prepare_handle_incoming_blocks would have found them
+    std::vector<cryptonote::output_data_t> ring;
+    for (const rct::ctkey &key: tx1_input_pubkeys[0])
+        ring.push_back({rct::rct2pk(key.dest), 0, 0, key.mask});
+
+    cryptonote::BlockchainAndPool bap;
+    cryptonote::Blockchain &bc = bap.blockchain;
+    bc.m_scan_table[cryptonote::get_transaction_prefix_hash(tx)][boost::get<cryptonote::txin_to_key>(tx.vin[0]).k_image] = ring;
+
+    const cryptonote::blobdata *blobs[] = {&tx_blob};
+    std::vector<crypto::hash> verified;
+    bc.rct_span_verify_worker(epee::span<const cryptonote::blobdata* const>(blobs, 1), verified);
+    ASSERT_EQ(1, verified.size());
+    EXPECT_EQ(cryptonote::get_transaction_hash(tx), verified[0]);
+
+    // a hit returns before the tx gets expanded, so the mix ring stays empty
+    cryptonote::transaction hit_tx = tx;
+    EXPECT_TRUE(cryptonote::ver_rct_non_semantics_simple_cached(hit_tx, tx1_input_pubkeys, bc.m_rct_ver_cache, rct::RCTTypeBulletproofPlus));
+    EXPECT_TRUE(hit_tx.rct_signatures.mixRing.empty());
+
+    // while without the span check, check_tx_inputs has to verify it
+    cryptonote::rct_ver_cache_t cold_cache;
+    cryptonote::transaction miss_tx = tx;
+    EXPECT_TRUE(cryptonote::ver_rct_non_semantics_simple_cached(miss_tx, tx1_input_pubkeys, cold_cache, rct::RCTTypeBulletproofPlus));
+    EXPECT_EQ(tx1_input_pubkeys, miss_tx.rct_signatures.mixRing);
+}
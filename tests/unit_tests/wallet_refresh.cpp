@@ -0,0 +1,332 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "misc_language.h"
+#include "ringct/rctOps.h"
+#include "storages/portable_storage_template_helper.h"
+#include "wallet/wallet2.h"
+#include "wallet_refresh.h"
+
+namespace
+{
+  class fake_daemon_client: public epee::net_utils::http::abstract_http_client
+  {
+  public:
+    explicit fake_daemon_client(test::fake_daemon &daemon): m_daemon(daemon) {}
+
+    void set_server(std::string host, std::string port, boost::optional<epee::net_utils::http::login> user, epee::net_utils::ssl_options_t ssl_options) override {}
+    void set_auto_connect(bool auto_connect) override {}
+    bool connect(std::chrono::milliseconds timeout) override { return true; }
+    bool disconnect() override { return true; }
+    bool is_connected(bool *ssl) override { if (ssl) *ssl = false; return true; }
+    bool invoke(const boost::string_ref uri, const boost::string_ref method, const boost::string_ref body, std::chrono::milliseconds timeout, const epee::net_utils::http::http_response_info** ppresponse_info, const epee::net_utils::http::fields_list& additional_params) override
+    {
+      m_response.clear();
+      m_response.m_response_code = 404;
+      if (uri == "/getblocks.bin")
+      {
+        cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req;
+        cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res;
+        if (!epee::serialization::load_t_from_binary(req, epee::span<const uint8_t>(reinterpret_cast<const uint8_t*>(body.data()), body.size())))
+          return false;
+        m_daemon.get_blocks(req, res);
+        epee::byte_slice blob;
+        if (!epee::serialization::store_t_to_binary(res, blob))
+          return false;
+        m_response.m_body.assign(reinterpret_cast<const char*>(blob.data()), blob.size());
+        m_response.m_response_code = 200;
+      }
+      if (ppresponse_info)
+        *ppresponse_info = &m_response;
+      return true;
+    }
+    bool invoke_get(const boost::string_ref uri, std::chrono::milliseconds timeout, const std::string& body, const epee::net_utils::http::http_response_info** ppresponse_info, const epee::net_utils::http::fields_list& additional_params) override
+    {
+      return invoke(uri, "GET", body, timeout, ppresponse_info, additional_params);
+    }
+    uint64_t get_bytes_sent() const override { return 0; }
+    uint64_t get_bytes_received() const override { return 0; }
+
+  private:
+    test::fake_daemon &m_daemon;
+    epee::net_utils::http::http_response_info m_response;
+  };
+
+  class fake_daemon_client_factory: public epee::net_utils::http::http_client_factory
+  {
+  public:
+    explicit fake_daemon_client_factory(test::fake_daemon &daemon): m_daemon(daemon) {}
+    std::unique_ptr<epee::net_utils::http::abstract_http_client> create() override
+    {
+      return std::unique_ptr<epee::net_utils::http::abstract_http_client>(new fake_daemon_client(m_daemon));
+    }
+
+  private:
+    test::fake_daemon &m_daemon;
+  };
+
+  // one output, found by the wallet as a subaddress one when is_subaddress is set
+  cryptonote::transaction make_miner_tx(uint64_t height, const cryptonote::account_public_address &address, bool is_subaddress, uint64_t amount)
+  {
+    crypto::public_key tx_pub;
+    crypto::secret_key tx_sec;
+    crypto::generate_keys(tx_pub, tx_sec);
+    if (is_subaddress)
+      tx_pub = rct::rct2pk(rct::scalarmultKey(rct::pk2rct(address.m_spend_public_key), rct::sk2rct(tx_sec)));
+
+    cryptonote::transaction tx;
+    tx.version = 1;
+    tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+    tx.vin.push_back(cryptonote::txin_gen{height});
+    cryptonote::add_tx_pub_key_to_extra(tx, tx_pub);
+    crypto::key_derivation derivation;
+    CHECK_AND_ASSERT_THROW_MES(crypto::generate_key_derivation(address.m_view_public_key, tx_sec, derivation), "Failed to generate key derivation");
+    cryptonote::txout_to_key out;
+    CHECK_AND_ASSERT_THROW_MES(crypto::derive_public_key(derivation, 0, address.m_spend_public_key, out.key), "Failed to derive public key");
+    tx.vout.push_back({amount, out});
+    return tx;
+  }
+}
+
+namespace test
+{
+  std::unique_ptr<tools::wallet2> make_wallet(fake_daemon &daemon, const crypto::secret_key &recovery_key, size_t pipeline_depth)
+  {
+    std::unique_ptr<tools::wallet2> wallet(new tools::wallet2(cryptonote::MAINNET, 1, true, daemon.client_factory()));
+    wallet->set_subaddress_lookahead(1, 10);
+    wallet->generate("", "", recovery_key, true);
+    wallet->allow_mismatched_daemon_version(true);
+    wallet->refresh_pipeline_depth(pipeline_depth);
+    return wallet;
+  }
+
+  void expect_same_transfers(const tools::wallet2 &a, const tools::wallet2 &b)
+  {
+    tools::wallet2::transfer_container ta, tb;
+    a.get_transfers(ta);
+    b.get_transfers(tb);
+    ASSERT_EQ(ta.size(), tb.size());
+    for (size_t i = 0; i < ta.size(); ++i)
+    {
+      EXPECT_EQ(ta[i].m_txid, tb[i].m_txid);
+      EXPECT_EQ(ta[i].m_block_height, tb[i].m_block_height);
+      EXPECT_EQ(ta[i].m_global_output_index, tb[i].m_global_output_index);
+      EXPECT_EQ(ta[i].amount(), tb[i].amount());
+      EXPECT_EQ(ta[i].m_subaddr_index, tb[i].m_subaddr_index);
+    }
+  }
+
+  fake_daemon::fake_daemon(size_t batch_size): m_batch_size(batch_size), m_requests(0)
+  {
+    entry genesis;
+    CHECK_AND_ASSERT_THROW_MES(cryptonote::generate_genesis_block(genesis.block, config::GENESIS_TX, config::GENESIS_NONCE), "Failed to generate genesis block");
+    genesis.hash = cryptonote::get_block_hash(genesis.block);
+    genesis.amount = 0;
+    m_chain.push_back(genesis);
+  }
+
+  void fake_daemon::add_block(const cryptonote::account_public_address &address, bool is_subaddress)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    const uint64_t height = m_chain.size();
+    entry e;
+    e.block.major_version = 1;
+    e.block.minor_version = 0;
+    e.block.timestamp = m_chain.back().block.timestamp + DIFFICULTY_TARGET_V2;
+    e.block.prev_id = m_chain.back().hash;
+    e.block.nonce = 0;
+    e.address = address;
+    e.amount = 1000000 + height;
+    e.block.miner_tx = make_miner_tx(height, address, is_subaddress, e.amount);
+    e.hash = cryptonote::get_block_hash(e.block);
+    m_chain.push_back(e);
+  }
+
+  uint64_t fake_daemon::height() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_chain.size();
+  }
+
+  uint64_t fake_daemon::mined_to(const cryptonote::account_public_address &address) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    uint64_t amount = 0;
+    for (size_t i = 1; i < m_chain.size(); ++i)
+      if (m_chain[i].address == address)
+        amount += m_chain[i].amount;
+    return amount;
+  }
+
+  size_t fake_daemon::requests() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_requests;
+  }
+
+  std::unique_ptr<epee::net_utils::http::http_client_factory> fake_daemon::client_factory()
+  {
+    return std::unique_ptr<epee::net_utils::http::http_client_factory>(new fake_daemon_client_factory(*this));
+  }
+
+  void fake_daemon::get_blocks(const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request &req, cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response &res)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    ++m_requests;
+
+    // the short chain history is newest first, and ends with the genesis block
+    uint64_t start = 0;
+    for (const crypto::hash &id: req.block_ids)
+    {
+      const auto it = std::find_if(m_chain.begin(), m_chain.end(), [&id](const entry &e) { return e.hash == id; });
+      if (it != m_chain.end())
+      {
+        start = it - m_chain.begin();
+        break;
+      }
+    }
+    start = std::max<uint64_t>(start, req.start_height);
+
+    res.start_height = start;
+    res.current_height = m_chain.size();
+    for (uint64_t height = start; height < m_chain.size() && height < start + m_batch_size; ++height)
+    {
+      cryptonote::block_complete_entry bce;
+      bce.pruned = req.prune;
+      bce.block = cryptonote::block_to_blob(m_chain[height].block);
+      res.blocks.push_back(std::move(bce));
+      cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices indices;
+      indices.indices.push_back({{height}});
+      res.output_indices.push_back(std::move(indices));
+    }
+    res.pool_info_extent = cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::FULL;
+    res.daemon_time = 0;
+    res.status = CORE_RPC_STATUS_OK;
+  }
+}
+
+TEST(wallet_refresh, pipelined_matches_sequential)
+{
+  test::fake_daemon daemon(7);
+  cryptonote::account_base account;
+  account.generate();
+  const crypto::secret_key &recovery_key = account.get_keys().m_spend_secret_key;
+  // depth 1 fetches, scans and adds one batch at a time
+  std::unique_ptr<tools::wallet2> sequential = test::make_wallet(daemon, recovery_key, 1);
+  std::unique_ptr<tools::wallet2> pipelined = test::make_wallet(daemon, recovery_key, 8);
+
+  cryptonote::account_base other;
+  other.generate();
+  const cryptonote::account_public_address address = sequential->get_address();
+  for (size_t i = 0; i < 100; ++i)
+    daemon.add_block(i % 3 ? other.get_keys().m_account_address : address);
+
+  sequential->refresh(true);
+  pipelined->refresh(true);
+
+  EXPECT_EQ(daemon.height(), sequential->get_blockchain_current_height());
+  EXPECT_EQ(daemon.height(), pipelined->get_blockchain_current_height());
+  EXPECT_EQ(daemon.mined_to(address), sequential->balance_all(false));
+  EXPECT_EQ(daemon.mined_to(address), pipelined->balance_all(false));
+  test::expect_same_transfers(*sequential, *pipelined);
+  EXPECT_EQ(daemon.height() - 1, pipelined->get_last_refresh_stats().blocks);
+  EXPECT_LE(pipelined->get_last_refresh_stats().max_queue_depth, 8);
+
+  // and incrementally, on top of what they already have
+  for (size_t i = 0; i < 30; ++i)
+    daemon.add_block(address);
+  sequential->refresh(true);
+  pipelined->refresh(true);
+  EXPECT_EQ(daemon.height(), pipelined->get_blockchain_current_height());
+  EXPECT_EQ(daemon.mined_to(address), sequential->balance_all(false));
+  EXPECT_EQ(daemon.mined_to(address), pipelined->balance_all(false));
+  test::expect_same_transfers(*sequential, *pipelined);
+}
+
+TEST(wallet_refresh, subaddresses_added_while_scanning_ahead)
+{
+  test::fake_daemon daemon(5);
+  cryptonote::account_base account;
+  account.generate();
+  const crypto::secret_key &recovery_key = account.get_keys().m_spend_secret_key;
+  std::unique_ptr<tools::wallet2> sequential = test::make_wallet(daemon, recovery_key, 1);
+  std::unique_ptr<tools::wallet2> pipelined = test::make_wallet(daemon, recovery_key, 8);
+
+  cryptonote::account_base other;
+  other.generate();
+  // the lookahead is 10, so (0, 15) is only known once the output to (0, 8) was added,
+  // and the batch with it is likely to have been scanned before that
+  const cryptonote::account_public_address first = sequential->get_subaddress({0, 8});
+  const cryptonote::account_public_address second = sequential->get_subaddress({0, 15});
+  for (size_t i = 0; i < 40; ++i)
+  {
+    if (i == 19)
+      daemon.add_block(first, true);
+    else if (i == 20)
+      daemon.add_block(second, true);
+    else
+      daemon.add_block(other.get_keys().m_account_address);
+  }
+
+  sequential->refresh(true);
+  pipelined->refresh(true);
+
+  const uint64_t expected = daemon.mined_to(first) + daemon.mined_to(second);
+  EXPECT_EQ(expected, sequential->balance_all(false));
+  EXPECT_EQ(expected, pipelined->balance_all(false));
+  test::expect_same_transfers(*sequential, *pipelined);
+}
+
+TEST(wallet_refresh, no_compute_threads)
+{
+  // with a concurrency of 1 the compute threadpool has no threads, and tasks only
+  // run when waited for, so batches can not be scanned ahead of the wallet
+  tools::threadpool &tpool = tools::threadpool::getInstanceForCompute();
+  const unsigned max_concurrency = tpool.get_max_concurrency();
+  tpool.recycle(1);
+  auto restore = epee::misc_utils::create_scope_leave_handler([&](){ tpool.recycle(max_concurrency); });
+
+  test::fake_daemon daemon(5);
+  cryptonote::account_base account;
+  account.generate();
+  std::unique_ptr<tools::wallet2> pipelined = test::make_wallet(daemon, account.get_keys().m_spend_secret_key, 4);
+
+  const cryptonote::account_public_address address = pipelined->get_address();
+  for (size_t i = 0; i < 40; ++i)
+    daemon.add_block(address);
+
+  pipelined->refresh(true);
+  EXPECT_EQ(daemon.height(), pipelined->get_blockchain_current_height());
+  EXPECT_EQ(daemon.mined_to(address), pipelined->balance_all(false));
+  EXPECT_EQ(daemon.height() - 1, pipelined->get_last_refresh_stats().blocks);
+}
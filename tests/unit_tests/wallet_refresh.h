@@ -0,0 +1,81 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "net/abstract_http_client.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+namespace tools
+{
+  class wallet2;
+}
+
+namespace test
+{
+  // A chain of blocks mined to given addresses, served to wallets through
+  // getblocks.bin, at most batch_size blocks per call
+  class fake_daemon
+  {
+  public:
+    explicit fake_daemon(size_t batch_size);
+
+    void add_block(const cryptonote::account_public_address &address, bool is_subaddress = false);
+    uint64_t height() const;
+    //! the sum of the miner tx outputs paid to this address
+    uint64_t mined_to(const cryptonote::account_public_address &address) const;
+    size_t requests() const;
+
+    //! for wallet2's constructor, the clients it creates talk to this daemon
+    std::unique_ptr<epee::net_utils::http::http_client_factory> client_factory();
+
+    void get_blocks(const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request &req, cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response &res);
+
+  private:
+    struct entry
+    {
+      cryptonote::block block;
+      crypto::hash hash;
+      cryptonote::account_public_address address;
+      uint64_t amount;
+    };
+
+    mutable boost::mutex m_mutex;
+    const size_t m_batch_size;
+    std::vector<entry> m_chain;
+    size_t m_requests;
+  };
+
+  //! an in memory wallet restored from recovery_key, which refreshes from daemon
+  std::unique_ptr<tools::wallet2> make_wallet(fake_daemon &daemon, const crypto::secret_key &recovery_key, size_t pipeline_depth = 1);
+  void expect_same_transfers(const tools::wallet2 &a, const tools::wallet2 &b);
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "wallet/wallet2.h"
+#include "wallet/wallet_scanner.h"
+#include "wallet_refresh.h"
+
+namespace
+{
+  cryptonote::account_base make_account()
+  {
+    cryptonote::account_base account;
+    account.generate();
+    return account;
+  }
+}
+
+TEST(wallet_scanner, matches_own_refresh)
+{
+  test::fake_daemon daemon(9);
+  std::vector<cryptonote::account_base> accounts{make_account(), make_account(), make_account()};
+  std::vector<std::unique_ptr<tools::wallet2>> scanned, refreshed;
+  tools::wallet_scanner scanner;
+  for (const cryptonote::account_base &account: accounts)
+  {
+    scanned.push_back(test::make_wallet(daemon, account.get_keys().m_spend_secret_key));
+    refreshed.push_back(test::make_wallet(daemon, account.get_keys().m_spend_secret_key));
+    scanner.add_wallet(scanned.back().get());
+  }
+  scanner.add_wallet(scanned.front().get());
+  EXPECT_EQ(accounts.size(), scanner.num_wallets());
+
+  for (size_t i = 0; i < 60; ++i)
+    daemon.add_block(scanned[i % accounts.size()]->get_address());
+  // one wallet starts ahead of the others
+  refreshed[1]->refresh(true);
+  scanned[1]->refresh(true);
+  for (size_t i = 0; i < 40; ++i)
+    daemon.add_block(scanned[(i / 2) % accounts.size()]->get_address());
+
+  const uint64_t blocks_fetched = scanner.scan(true);
+  const tools::wallet_scanner::stats stats = scanner.get_stats();
+  EXPECT_EQ(blocks_fetched, stats.blocks);
+  EXPECT_LE(daemon.height() - 1, stats.blocks);
+  EXPECT_LT(0, stats.batches);
+  EXPECT_EQ(0, stats.fallbacks);
+
+  for (size_t i = 0; i < accounts.size(); ++i)
+  {
+    refreshed[i]->refresh(true);
+    EXPECT_EQ(daemon.height(), scanned[i]->get_blockchain_current_height());
+    EXPECT_EQ(daemon.mined_to(scanned[i]->get_address()), scanned[i]->balance_all(false));
+    test::expect_same_transfers(*scanned[i], *refreshed[i]);
+  }
+
+  // nothing new, and the stats add up across scans
+  EXPECT_EQ(0, scanner.scan(true));
+  EXPECT_EQ(stats.batches, scanner.get_stats().batches);
+  EXPECT_EQ(stats.blocks, scanner.get_stats().blocks);
+}
+
+TEST(wallet_scanner, add_remove)
+{
+  test::fake_daemon daemon(5);
+  const cryptonote::account_base account = make_account();
+  std::unique_ptr<tools::wallet2> first = test::make_wallet(daemon, account.get_keys().m_spend_secret_key);
+  std::unique_ptr<tools::wallet2> second = test::make_wallet(daemon, make_account().get_keys().m_spend_secret_key);
+  tools::wallet_scanner scanner;
+  scanner.add_wallet(first.get());
+  for (size_t i = 0; i < 20; ++i)
+    daemon.add_block(first->get_address());
+  scanner.scan(true);
+  EXPECT_EQ(daemon.height(), first->get_blockchain_current_height());
+  EXPECT_EQ(daemon.mined_to(first->get_address()), first->balance_all(false));
+
+  // a wallet added later gets brought up from its own height, a removed one is left alone
+  EXPECT_TRUE(scanner.remove_wallet(first.get()));
+  EXPECT_FALSE(scanner.remove_wallet(first.get()));
+  scanner.add_wallet(second.get());
+  const uint64_t first_height = first->get_blockchain_current_height();
+  for (size_t i = 0; i < 20; ++i)
+    daemon.add_block(second->get_address());
+  scanner.scan(true);
+  EXPECT_EQ(first_height, first->get_blockchain_current_height());
+  EXPECT_EQ(daemon.height(), second->get_blockchain_current_height());
+  EXPECT_EQ(daemon.mined_to(second->get_address()), second->balance_all(false));
+  EXPECT_EQ(1, scanner.num_wallets());
+}
+
+TEST(wallet_scanner, stop_before_scan)
+{
+  test::fake_daemon daemon(5);
+  std::unique_ptr<tools::wallet2> wallet = test::make_wallet(daemon, make_account().get_keys().m_spend_secret_key);
+  tools::wallet_scanner scanner;
+  scanner.add_wallet(wallet.get());
+  for (size_t i = 0; i < 20; ++i)
+    daemon.add_block(wallet->get_address());
+
+  // a stop coming between queueing a scan and running it still stops it
+  scanner.start();
+  scanner.stop();
+  EXPECT_EQ(0, scanner.scan(true));
+  EXPECT_EQ(1, wallet->get_blockchain_current_height());
+
+  scanner.start();
+  EXPECT_LE(daemon.height() - 1, scanner.scan(true));
+  EXPECT_EQ(daemon.height(), wallet->get_blockchain_current_height());
+}
@@ -33,6 +33,7 @@
 
 #include "file_io_utils.h"
 #include "wallet/wallet2.h"
+#include "serialization/binary_utils.h"
 #include "common/util.h"
 
 using namespace boost::filesystem;
@@ -382,3 +383,73 @@ TEST(wallet_storage, change_export_format)
 
     EXPECT_EQ(primary_address_1, primary_address_2);
 }
+
+TEST(wallet_storage, columnar_cache)
+{
+    const path source_wallet_file = unit_test::data_dir / "wallet_00fd416a";
+    const path interm_wallet_file = unit_test::data_dir / "wallet_00fd416a_copy_columnar_cache";
+    const std::string records_file = interm_wallet_file.string() + ".records";
+
+    ASSERT_TRUE(is_file_exist(source_wallet_file.string()));
+    ASSERT_TRUE(is_file_exist(source_wallet_file.string() + ".keys"));
+
+    tools::copy_file(source_wallet_file.string(), interm_wallet_file.string());
+    tools::copy_file(source_wallet_file.string() + ".keys", interm_wallet_file.string() + ".keys");
+    if (is_file_exist(records_file))
+        remove(records_file);
+
+    epee::wipeable_string password("beepbeep");
+    size_t num_transfers = 0;
+    uint64_t balance = 0;
+
+    // migrate from the single blob cache
+    {
+        tools::wallet2 w;
+        w.load(interm_wallet_file.string(), password);
+        num_transfers = w.get_num_transfer_details();
+        balance = w.balance_all(false);
+        w.columnar_cache(true);
+        w.rewrite(interm_wallet_file.string(), password);
+        w.store();
+        EXPECT_TRUE(is_file_exist(records_file));
+    }
+
+    // reload, and store again with nothing changed
+    {
+        tools::wallet2 w;
+        w.load(interm_wallet_file.string(), password);
+        EXPECT_TRUE(w.columnar_cache());
+        EXPECT_EQ(num_transfers, w.get_num_transfer_details());
+        EXPECT_EQ(balance, w.balance_all(false));
+        const uint64_t records_size = file_size(records_file);
+        w.store();
+        EXPECT_EQ(records_size, file_size(records_file));
+    }
+
+    // and back to the single blob cache
+    {
+        tools::wallet2 w;
+        w.load(interm_wallet_file.string(), password);
+        EXPECT_EQ(num_transfers, w.get_num_transfer_details());
+        w.columnar_cache(false);
+        w.rewrite(interm_wallet_file.string(), password);
+        w.store();
+        EXPECT_FALSE(is_file_exist(records_file));
+    }
+
+    {
+        tools::wallet2 w;
+        w.load(interm_wallet_file.string(), password);
+        EXPECT_FALSE(w.columnar_cache());
+        EXPECT_EQ(num_transfers, w.get_num_transfer_details());
+        EXPECT_EQ(balance, w.balance_all(false));
+
+        // without records, the cache keeps the version older wallets can read
+        std::string blob;
+        ASSERT_TRUE(::serialization::dump_binary(w, blob));
+        const std::string magic = "monero wallet cache";
+        ASSERT_LT(magic.size(), blob.size());
+        EXPECT_EQ(magic, blob.substr(0, magic.size()));
+        EXPECT_EQ(2, blob[magic.size()]);
+    }
+}